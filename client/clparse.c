@@ -622,6 +622,8 @@ void parse_client_statement (cfile, ip, config)
 						option->name, 0, MDL);
 			option_code_hash_delete(option->universe->code_hash,
 						&option->code, 0, MDL);
+			option_code_index_clear(option->universe,
+						option->code);
 		}
 
 		parse_option_code_definition(cfile, option);
@@ -184,6 +184,7 @@ int group_allocate
 	if (g) 
 	{
 		memset(g, 0, sizeof(*g));
+		config_generation++;
 		return group_reference(ptr, g, file, line);
 	}
 	return 0;
@@ -266,6 +267,9 @@ int group_dereference (ptr, file, line)
 						  file, line);
 	if (group -> next)
 		group_dereference (&group -> next, file, line);
+	if (group -> flat)
+		group_flat_free (group);
+	config_generation++;
 	dfree (group, file, line);
 	return 1;
 }
@@ -391,27 +395,14 @@ void free_client_lease (lease, file, line)
 	dfree (lease, file, line);
 }
 
-pair free_pairs;
+static omapi_pool_t pair_pool =
+	OMAPI_POOL_INITIALIZER ("pair", struct _pair, 256, 4096);
 
 pair new_pair (file, line)
 	const char *file;
 	int line;
 {
-	pair foo;
-
-	if (free_pairs) {
-		foo = free_pairs;
-		free_pairs = foo -> cdr;
-		memset (foo, 0, sizeof *foo);
-		dmalloc_reuse (foo, file, line, 0);
-		return foo;
-	}
-
-	foo = dmalloc (sizeof *foo, file, line);
-	if (!foo)
-		return foo;
-	memset (foo, 0, sizeof *foo);
-	return foo;
+	return omapi_pool_get (&pair_pool, file, line);
 }
 
 void free_pair (foo, file, line)
@@ -419,22 +410,14 @@ void free_pair (foo, file, line)
 	const char *file;
 	int line;
 {
-	foo -> cdr = free_pairs;
-	free_pairs = foo;
-	dmalloc_reuse (free_pairs, __FILE__, __LINE__, 0);
+	omapi_pool_put (&pair_pool, foo, file, line);
 }
 
 #if defined (DEBUG_MEMORY_LEAKAGE) || \
 		defined (DEBUG_MEMORY_LEAKAGE_ON_EXIT)
 void relinquish_free_pairs ()
 {
-	pair pf, pc;
-
-	for (pf = free_pairs; pf; pf = pc) {
-		pc = pf -> cdr;
-		dfree (pf, MDL);
-	}
-	free_pairs = (pair)0;
+	omapi_pool_relinquish (&pair_pool);
 }
 #endif
 
@@ -900,6 +883,160 @@ int dns_host_entry_dereference (ptr, file, line)
 	return 1;
 }
 
+/* Per-packet arena.
+
+   Processing one packet creates and destroys a number of option_state
+   structures together with their per-universe hash tables.  While a
+   packet is being processed (between packet_arena_begin() and
+   packet_arena_end()), these are carved out of a block with a bump
+   pointer instead of being obtained from dmalloc() one by one.
+
+   Every allocation is preceded by a header naming the block it came
+   from, or NULL if it had to come from dmalloc() because no packet was
+   being processed or it did not fit in a block.  Each block counts the
+   allocations still live in it; the current block is rewound when that
+   count drops to zero, which normally happens when the packet is
+   released after the reply has gone out.  An object that outlives its
+   packet (a packet held for a ping check, for example) simply keeps its
+   block from being reused until it is freed. */
+
+#define PACKET_ARENA_BLOCK_SIZE		8192
+#define PACKET_ARENA_SPARE_BLOCKS	4
+
+struct packet_arena_block {
+	struct packet_arena_block *next;
+	unsigned used;
+	int live;
+};
+
+union packet_arena_header {
+	struct packet_arena_block *block;
+	double align;
+};
+
+#define PACKET_ARENA_ROUND(x) \
+	(((x) + sizeof (union packet_arena_header) - 1) & \
+	 ~(sizeof (union packet_arena_header) - 1))
+#define PACKET_ARENA_DATA(b) \
+	((unsigned char *)(b) + \
+	 PACKET_ARENA_ROUND (sizeof (struct packet_arena_block)))
+#define PACKET_ARENA_CAPACITY \
+	(PACKET_ARENA_BLOCK_SIZE - \
+	 PACKET_ARENA_ROUND (sizeof (struct packet_arena_block)))
+
+int packet_arena_enabled = 0;
+static int packet_arena_depth;
+static struct packet_arena_block *packet_arena;
+static struct packet_arena_block *packet_arena_spares;
+static int packet_arena_spare_count;
+
+/* Mark the start of processing of one packet.  Calls may nest. */
+void packet_arena_begin ()
+{
+	packet_arena_depth++;
+}
+
+/* Mark the end of processing of one packet.  Allocations made after
+   the outermost packet_arena_end() go back to dmalloc(). */
+void packet_arena_end ()
+{
+	if (packet_arena_depth > 0)
+		packet_arena_depth--;
+}
+
+void *packet_arena_alloc (size, file, line)
+	unsigned size;
+	const char *file;
+	int line;
+{
+	union packet_arena_header *hp;
+	struct packet_arena_block *block;
+	unsigned len;
+
+	len = PACKET_ARENA_ROUND (size) + sizeof *hp;
+	if (packet_arena_enabled && packet_arena_depth > 0 &&
+	    len <= PACKET_ARENA_CAPACITY) {
+		block = packet_arena;
+		if (!block || block -> used + len > PACKET_ARENA_CAPACITY) {
+			/* The current block is full; if anything in it is
+			   still live, it will be released by the last
+			   packet_arena_free() into it. */
+			if (packet_arena_spares) {
+				block = packet_arena_spares;
+				packet_arena_spares = block -> next;
+				packet_arena_spare_count--;
+			} else
+				block = dmalloc (PACKET_ARENA_BLOCK_SIZE, MDL);
+			if (block) {
+				block -> next = (struct packet_arena_block *)0;
+				block -> used = 0;
+				block -> live = 0;
+				packet_arena = block;
+			}
+		}
+		if (block) {
+			hp = (union packet_arena_header *)
+				(PACKET_ARENA_DATA (block) + block -> used);
+			block -> used += len;
+			block -> live++;
+			hp -> block = block;
+			return hp + 1;
+		}
+	}
+
+	hp = dmalloc (len, file, line);
+	if (!hp)
+		return (void *)0;
+	hp -> block = (struct packet_arena_block *)0;
+	return hp + 1;
+}
+
+void packet_arena_free (ptr, file, line)
+	void *ptr;
+	const char *file;
+	int line;
+{
+	union packet_arena_header *hp;
+	struct packet_arena_block *block;
+
+	hp = (union packet_arena_header *)ptr - 1;
+	block = hp -> block;
+	if (!block) {
+		dfree (hp, file, line);
+		return;
+	}
+
+	if (--block -> live > 0)
+		return;
+	if (block == packet_arena) {
+		block -> used = 0;
+	} else if (packet_arena_spare_count < PACKET_ARENA_SPARE_BLOCKS) {
+		block -> next = packet_arena_spares;
+		packet_arena_spares = block;
+		packet_arena_spare_count++;
+	} else
+		dfree (block, MDL);
+}
+
+#if defined (DEBUG_MEMORY_LEAKAGE) || \
+		defined (DEBUG_MEMORY_LEAKAGE_ON_EXIT)
+void relinquish_packet_arena ()
+{
+	struct packet_arena_block *block, *next;
+
+	for (block = packet_arena_spares; block; block = next) {
+		next = block -> next;
+		dfree (block, MDL);
+	}
+	packet_arena_spares = (struct packet_arena_block *)0;
+	packet_arena_spare_count = 0;
+	if (packet_arena && !packet_arena -> live) {
+		dfree (packet_arena, MDL);
+		packet_arena = (struct packet_arena_block *)0;
+	}
+}
+#endif
+
 int option_state_allocate
 (
 	struct option_state **ptr,
@@ -928,7 +1065,7 @@ int option_state_allocate
 
 	/* һuniverse_countvoid *ָ룬ҽȫuniversedhcp_universe */
 	size = sizeof(**ptr) + (universe_count - 1) * sizeof(void *);
-	*ptr = dmalloc(size, file, line);
+	*ptr = packet_arena_alloc(size, file, line);
 	if (*ptr) 
 	{
 		memset (*ptr, 0, size);
@@ -1004,6 +1141,9 @@ int option_state_dereference (ptr, file, line)
 #endif
 	}
 
+	/* Drop any options that were never decoded. */
+	option_index_detach (options);
+
 	/* Loop through the per-universe state. */
 	for (i = 0; i < options -> universe_count; i++)
 		if (options -> universes [i] &&
@@ -1011,7 +1151,7 @@ int option_state_dereference (ptr, file, line)
 			((*(universes [i] -> option_state_dereference))
 			 (universes [i], options, file, line));
 
-	dfree (options, file, line);
+	packet_arena_free (options, file, line);
 	return 1;
 }
 
@@ -1176,6 +1316,8 @@ int packet_dereference (ptr, file, line)
 #endif
 	}
 
+	if (packet -> expr_memo)
+		expr_memo_forget (packet);
 	if (packet -> options)
 		option_state_dereference (&packet -> options, file, line);
 	if (packet -> interface)
@@ -1314,6 +1456,20 @@ int binding_scope_reference (ptr, bp, file, line)
 	return 1;
 }
 
+/* What LEASE_COLD_RO() gives for a lease without a cold part. */
+const struct lease_cold lease_cold_none;
+
+/* Give a lease its cold part, see LEASE_COLD().  The server frees it
+   along with the lease in dhcp_lease_destroy(). */
+struct lease_cold *lease_cold_allocate (struct lease *lease)
+{
+	lease->cold = dmalloc (sizeof *lease->cold, MDL);
+	if (!lease->cold)
+		log_fatal ("No memory for lease %s.",
+			   piaddr (lease->ip_addr));
+	return lease->cold;
+}
+
 /*!
  * \brief  Constructs a null-terminated data_string from a char* and length.
  *
@@ -174,6 +174,7 @@ isc_result_t dhcp_group_set_value  (omapi_object_t *h,
 					    "network client", 0);
 			if (status != ISC_R_SUCCESS || parse == NULL)
 				return status;
+			config_generation++;
 			if (!(parse_executable_statements
 			      (&group -> group -> statements, parse, &lose,
 			       context_any))) {
@@ -98,7 +98,7 @@ int execute_statements
 			 * This handles the previous v4 calls.
 			 */
 			if ((on_star == NULL) && (lease != NULL))
-			    on_star = &lease->on_star;
+			    on_star = &LEASE_COLD(lease)->on_star;
 
 			if (on_star != NULL) {
 			    if (r->data.on.evtypes & ON_EXPIRY) {
@@ -171,7 +171,7 @@ int execute_statements
 			break;
 
 		      case if_statement:
-			status = (evaluate_boolean_expression
+			status = (evaluate_boolean_expression_compiled
 				  (&rc, packet,
 				   lease, client_state, in_options,
 				   out_options, scope, r->data.ie.expr));
@@ -565,6 +565,183 @@ int execute_statements
 	return 1;
 }
 
+/* Flattened option scopes.
+
+   Most groups contain nothing but option statements, and running
+   them for every reply walks the same group chains and stores the same
+   option caches over and over, only for inner scopes to supersede most
+   of what outer scopes stored.   For such chains we record, once per
+   configuration generation, the net effect of the statements: for each
+   option, the cache that ends up installed and whether it was set
+   unconditionally or only as a default.   Options are kept in the order
+   in which they were first mentioned, so they land in the option state
+   exactly as executing the statements one by one would put them there.
+   Chains containing anything other than supersede, send and default
+   option statements are simply executed. */
+
+unsigned config_generation;
+
+struct group_flat_option {
+	struct universe *universe;
+	struct option_cache *oc;
+	enum statement_op op;
+};
+
+struct group_flat {
+	struct group_flat *next;
+	struct group *limit;
+	unsigned generation;
+	int count;			/* -1 if the chain can't be flattened */
+	int max;
+	struct group_flat_option *options;
+};
+
+static void group_flat_clear (struct group_flat *flat)
+{
+	int i;
+
+	for (i = 0; i < flat -> count; i++)
+		option_cache_dereference (&flat -> options [i].oc, MDL);
+	if (flat -> options)
+		dfree (flat -> options, MDL);
+	flat -> options = NULL;
+	flat -> count = flat -> max = 0;
+}
+
+void group_flat_free (struct group *group)
+{
+	struct group_flat *flat, *next;
+
+	for (flat = group -> flat; flat; flat = next) {
+		next = flat -> next;
+		group_flat_clear (flat);
+		dfree (flat, MDL);
+	}
+	group -> flat = NULL;
+}
+
+/* Fold one statement list into the flattened chain.   Returns zero if
+   it contains a statement that has to be executed. */
+static int group_flat_add (struct group_flat *flat,
+			   struct executable_statement *statements)
+{
+	struct executable_statement *r;
+	struct group_flat_option *fo;
+	struct option_cache *oc;
+	int i;
+
+	for (r = statements; r; r = r -> next) {
+		switch (r -> op) {
+		      case statements_statement:
+			if (!group_flat_add (flat, r -> data.statements))
+				return 0;
+			continue;
+
+		      case supersede_option_statement:
+		      case send_option_statement:
+		      case default_option_statement:
+			break;
+
+		      default:
+			return 0;
+		}
+
+		oc = r -> data.option;
+		if (!oc || !oc -> option)
+			return 0;
+
+		for (i = 0; i < flat -> count; i++) {
+			fo = &flat -> options [i];
+			if (fo -> universe == oc -> option -> universe &&
+			    fo -> oc -> option -> code == oc -> option -> code)
+				break;
+		}
+
+		if (i < flat -> count) {
+			/* A default for an option that is already set is a
+			   no-op; anything else replaces the value in place. */
+			if (r -> op != default_option_statement) {
+				option_cache_dereference (&fo -> oc, MDL);
+				option_cache_reference (&fo -> oc, oc, MDL);
+				fo -> op = supersede_option_statement;
+			}
+			continue;
+		}
+
+		if (flat -> count == flat -> max) {
+			int max = flat -> max ? flat -> max * 2 : 8;
+
+			fo = dmalloc (max * sizeof *fo, MDL);
+			if (!fo)
+				return 0;
+			if (flat -> options) {
+				memcpy (fo, flat -> options,
+					flat -> count * sizeof *fo);
+				dfree (flat -> options, MDL);
+			}
+			flat -> options = fo;
+			flat -> max = max;
+		}
+		fo = &flat -> options [flat -> count++];
+		memset (fo, 0, sizeof *fo);
+		fo -> universe = oc -> option -> universe;
+		option_cache_reference (&fo -> oc, oc, MDL);
+		fo -> op = (r -> op == default_option_statement
+			    ? default_option_statement
+			    : supersede_option_statement);
+	}
+	return 1;
+}
+
+/* Build the flattened form of the chain from group outwards, stopping
+   at the first group in the limiting chain. */
+static int group_flat_build (struct group_flat *flat, struct group *group,
+			     struct group *limiting_group)
+{
+	struct group *limit;
+
+	if (!group)
+		return 1;
+	for (limit = limiting_group; limit; limit = limit -> next)
+		if (group == limit)
+			return 1;
+
+	if (!group_flat_build (flat, group -> next, limiting_group))
+		return 0;
+	return group_flat_add (flat, group -> statements);
+}
+
+static struct group_flat *group_flat_lookup (struct group *group,
+					     struct group *limiting_group)
+{
+	struct group_flat *flat;
+
+	for (flat = group -> flat; flat; flat = flat -> next)
+		if (flat -> limit == limiting_group)
+			break;
+
+	if (!flat) {
+		flat = dmalloc (sizeof *flat, MDL);
+		if (!flat)
+			return NULL;
+		memset (flat, 0, sizeof *flat);
+		flat -> limit = limiting_group;
+		flat -> generation = config_generation - 1;
+		flat -> next = group -> flat;
+		group -> flat = flat;
+	}
+
+	if (flat -> generation != config_generation) {
+		group_flat_clear (flat);
+		if (!group_flat_build (flat, group, limiting_group)) {
+			group_flat_clear (flat);
+			flat -> count = -1;
+		}
+		flat -> generation = config_generation;
+	}
+	return flat;
+}
+
 /* Execute all the statements in a particular scope, and all statements in
    scopes outer from that scope, but if a particular limiting scope is
    reached, do not execute statements in that scope or in scopes outer
@@ -587,11 +764,26 @@ void execute_statements_in_scope
 )
 {
 	struct group *limit;
+	struct group_flat *flat;
+	int i;
 
 	/* If we've recursed as far as we can, return. */
 	if (!group)
 		return;
 
+	/* If the whole chain is option statements, install its net effect. */
+	if (!result || !*result) {
+		flat = group_flat_lookup (group, limiting_group);
+		if (flat && flat -> count >= 0) {
+			for (i = 0; i < flat -> count; i++)
+				set_option (flat -> options [i].universe,
+					    out_options,
+					    flat -> options [i].oc,
+					    flat -> options [i].op);
+			return;
+		}
+	}
+
 	/* As soon as we get to a scope that is outer than the limiting
 	   scope, we are done.   This is so that if somebody does something
 	   like this, it does the expected thing:
@@ -41,6 +41,194 @@ static int prepare_option_buffer(struct universe *universe, struct buffer *bp,
 				 unsigned char *buffer, unsigned length,
 				 unsigned code, int terminatep,
 				 struct option_cache **opp);
+static struct option_cache *option_index_decode(struct universe *universe,
+						struct option_state *options,
+						unsigned code);
+static void option_index_forget(struct universe *universe,
+				struct option_state *options, unsigned code);
+
+/*
+ * If set, parse_options() only records where each top level DHCPv4 option
+ * lives in the received buffer, and the option caches are built the first
+ * time lookup_option() asks for them.  Most packets are only ever asked
+ * about a handful of options, so this saves an option cache, a hash
+ * bucket and a handful of reference count operations per option that is
+ * never looked at, both when parsing and in packet_dereference().
+ */
+int lazy_option_decode = 0;
+
+static struct option_index *free_option_indexes;
+
+/*
+ * Option code sets used while building replies.  Every DHCPv4 code and
+ * nearly every DHCPv6 code is below 256, so a 256 bit map on the stack
+ * answers membership in constant time without allocating; callers
+ * check larger codes by hand.
+ */
+#define OPTION_CODE_SET_WORDS	(256 / 32)
+#define OPTION_CODE_SET_HAS(set, code) \
+	((set)[(code) >> 5] & (1U << ((code) & 31)))
+#define OPTION_CODE_SET_ADD(set, code) \
+	((set)[(code) >> 5] |= (1U << ((code) & 31)))
+
+/*
+ * parse_option_buffer() first walks the tag/length chain of a buffer
+ * into an array of option_tlv entries, validating the bounds of every
+ * option as it goes, and then stores the options in a second pass that
+ * no longer has to worry about the buffer layout.  The walk is done in
+ * batches so that the array can live on the stack.
+ */
+#define OPTION_TLV_BATCH	64
+
+struct option_tlv {
+	unsigned code;
+	unsigned offset;	/* offset of the option data in the buffer */
+	unsigned len;
+};
+
+enum option_scan_status {
+	OPTION_SCAN_MORE,	/* the batch is full, call again */
+	OPTION_SCAN_DONE,	/* reached the end option or buffer */
+	OPTION_SCAN_NO_LENGTH,	/* tag at end of buffer, no length field */
+	OPTION_SCAN_OVERRUN	/* option length exceeds buffer length */
+};
+
+static int option_buffer_scan(struct universe *universe,
+			      const unsigned char *buffer, unsigned length,
+			      unsigned *offsetp, struct option_tlv *tlv,
+			      int max, enum option_scan_status *status);
+static int store_option_data(struct universe *universe,
+			     struct option_state *options, struct buffer *bp,
+			     unsigned char *data, unsigned len, unsigned code);
+
+/*!
+ * \brief Attach an empty lazy decode index to an option state
+ *
+ * Options of the given universe subsequently parsed into the state by
+ * parse_option_buffer() are recorded in the index rather than decoded.
+ * Only the first buffer parsed is indexed; options from later buffers
+ * (the overloaded file and sname fields) are decoded immediately.
+ *
+ * \param options the option state, normally packet->options
+ * \param universe the universe to index, must have 8 bit codes
+ *
+ * \return 1 on success, 0 if no memory was available
+ */
+int
+option_index_attach(struct option_state *options, struct universe *universe)
+{
+	struct option_index *index;
+
+	if (options->index != NULL || universe->tag_size != 1)
+		return 0;
+
+	if (free_option_indexes != NULL) {
+		index = free_option_indexes;
+		free_option_indexes = index->next;
+		dmalloc_reuse(index, __FILE__, __LINE__, 1);
+	} else {
+		index = dmalloc(sizeof(*index), MDL);
+		if (index == NULL)
+			return 0;
+	}
+
+	memset(index, 0, sizeof(*index));
+	index->universe = universe;
+	options->index = index;
+	return 1;
+}
+
+/*!
+ * \brief Release an option state's lazy decode index
+ *
+ * Any options still pending are discarded along with the reference
+ * to the buffer they point into.  Called when the option state is freed.
+ */
+void
+option_index_detach(struct option_state *options)
+{
+	struct option_index *index = options->index;
+
+	if (index == NULL)
+		return;
+
+	options->index = NULL;
+	if (index->buffer != NULL)
+		buffer_dereference(&index->buffer, MDL);
+	index->next = free_option_indexes;
+	free_option_indexes = index;
+	dmalloc_reuse(free_option_indexes, NULL, 0, 0);
+}
+
+/*!
+ * \brief Decode every option still pending in an option state
+ *
+ * Used before code that walks the option hash tables directly rather
+ * than going through lookup_option(), so that it sees the same set of
+ * options as it would have had the packet been decoded eagerly.
+ *
+ * \param options the option state
+ * \param universe the universe about to be walked
+ */
+void
+option_state_materialize(struct option_state *options,
+			 struct universe *universe)
+{
+	struct option_index *index = options->index;
+	unsigned code;
+
+	if (index == NULL || index->universe != universe)
+		return;
+
+	for (code = 0; index->pending > 0 && code < 256; code++) {
+		if (index->offset[code] != 0)
+			(void) option_index_decode(universe, options, code);
+	}
+}
+
+/* Build the option cache for a pending option, and return it.  The
+ * option is saved into the option state exactly as parse_option_buffer()
+ * would have saved it had it not been deferred. */
+static struct option_cache *
+option_index_decode(struct universe *universe, struct option_state *options,
+		    unsigned code)
+{
+	struct option_index *index = options->index;
+	unsigned offset;
+
+	if (index == NULL || index->universe != universe ||
+	    code > 255 || index->offset[code] == 0)
+		return NULL;
+
+	offset = index->offset[code] - 1;
+	index->offset[code] = 0;
+	index->pending--;
+
+	if (!save_option_buffer(universe, options, index->buffer,
+				index->buffer->data + offset,
+				index->length[code], code, 1)) {
+		log_error("option_index_decode: save_option_buffer failed");
+		return NULL;
+	}
+
+	return lookup_hashed_option(universe, options, code);
+}
+
+/* Drop a pending option without decoding it, because it is being
+ * deleted or replaced. */
+static void
+option_index_forget(struct universe *universe, struct option_state *options,
+		    unsigned code)
+{
+	struct option_index *index = options->index;
+
+	if (index == NULL || index->universe != universe ||
+	    code > 255 || index->offset[code] == 0)
+		return;
+
+	index->offset[code] = 0;
+	index->pending--;
+}
 
 /*********************************************************************
 Func Name :   parse_options
@@ -69,6 +257,11 @@ int parse_options
 		return 1;
 	}
 
+	/* Defer decoding of the main options field if configured to;
+	   if the index can't be had we just decode everything now. */
+	if (lazy_option_decode)
+		(void) option_index_attach(packet->options, &dhcp_universe);
+
 	/* Go through the options field, up to the end of the packet or the End field. */
 	if (!parse_option_buffer(packet->options, &packet->raw->options[4],
 				  (packet->packet_length - DHCP_FIXED_NON_UDP - 4), &dhcp_universe)) 
@@ -148,10 +341,14 @@ int parse_option_buffer
 {
 	unsigned len, offset;
 	unsigned code;
-	struct option_cache *op = NULL, *nop = NULL;
 	struct buffer *bp = (struct buffer *)0;
 	struct option *option = NULL;
-	char *reason = "general failure";
+	struct option_index *index = NULL;
+	struct option_tlv tlv[OPTION_TLV_BATCH + 1];
+	enum option_scan_status status;
+	unsigned char *data;
+	int i, count;
+	const char *reason;
 
 	/* lengthǴoptionsֶεĳȣһdiscover13֮һֽ */
 	if (!buffer_allocate(&bp, length, MDL)) 
@@ -163,21 +360,225 @@ int parse_option_buffer
 	/* bufferֵbp->data */
 	memcpy(bp->data, buffer, length);
 
-	/* dhcp_universeget_tagȡַĵһֽڣtag_size1 */
-	for (offset = 0; (offset + universe->tag_size) <= length &&
-	     (code = universe->get_tag(buffer + offset)) != universe->end;) 
-	{
-		offset += universe->tag_size;
+	/* If the option state has an index for this universe that hasn't
+	   been given a buffer yet, this buffer is the one to index. */
+	if (options->index != NULL && options->index->universe == universe &&
+	    options->index->buffer == NULL) {
+		index = options->index;
+		buffer_reference(&index->buffer, bp, MDL);
+	}
+
+	offset = 0;
+	do {
+		count = option_buffer_scan(universe, buffer, length, &offset,
+					   tlv, OPTION_TLV_BATCH, &status);
+
+		for (i = 0; i < count; i++) {
+			code = tlv[i].code;
+			len = tlv[i].len;
+			data = bp->data + tlv[i].offset;
+
+			/* hash_lookupҵĻücode_hashdhcp_universecodehash */
+			/* ҵģҵoptionָdhcp_options[i]ȫֱ */
+			option_code_lookup(&option, universe, code, MDL);
+
+			/* If the option contains an encapsulation, parse it.
+			   In any case keep the raw data as well.  (Previous to
+			   4.4.0 we only kept the raw data if the parse failed,
+			   the option wasn't an encapsulation (by far the most
+			   common case), or the option wasn't entirely an
+			   encapsulation
+			*/
+			if (option && (option->format[0] == 'e' ||
+				       option->format[0] == 'E')) {
+				(void)parse_encapsulated_suboptions(options,
+						option, data, len, universe,
+						NULL);
+			}
+
+			if (universe == &dhcp_universe &&
+			    code == DHO_HOST_NAME && len == 0) {
+				/* non-compliant clients can send it
+				 * we'll just drop it and go on */
+				log_debug ("Ignoring empty DHO_HOST_NAME option");
+				option_dereference(&option, MDL);
+				continue;
+			}
+
+			/* Defer anything that isn't an encapsulation and
+			   isn't already present; lookup_option() below
+			   decodes a pending duplicate first, so that
+			   concatenation is unaffected. */
+			if (index != NULL && index->offset[code] == 0 &&
+			    !(option && (option->format[0] == 'e' ||
+					 option->format[0] == 'E')) &&
+			    lookup_hashed_option(universe, options,
+						 code) == NULL) {
+				index->offset[code] = tlv[i].offset + 1;
+				index->length[code] = len;
+				index->pending++;
+				option_dereference(&option, MDL);
+				continue;
+			}
+
+			option_dereference(&option, MDL);
+
+			if (!store_option_data(universe, options, bp, data,
+					       len, code)) {
+				buffer_dereference(&bp, MDL);
+				return (0);
+			}
+		}
+	} while (status == OPTION_SCAN_MORE);
+
+	/* Options ahead of a malformed one have been stored above, which
+	   parse_options() relies on to find the message type. */
+	if (status != OPTION_SCAN_DONE) {
+		code = tlv[count].code;
+		if (status == OPTION_SCAN_OVERRUN) {
+			option_code_lookup(&option, universe, code, MDL);
+			reason = "option length exceeds option buffer length";
+		} else {
+			reason = "code tag at end of buffer - missing length field";
+		}
+		log_error("parse_option_buffer: malformed option "
+			  "%s.%s (code %u): %s.", universe->name,
+			  option ? option->name : "<unknown>",
+			  code, reason);
+		option_dereference(&option, MDL);
+		buffer_dereference (&bp, MDL);
+		return 0;
+	}
+
+	buffer_dereference(&bp, MDL);
+	return 1;
+}
+
+/*
+ * Store one option parsed out of bp: save it if it isn't present yet,
+ * otherwise concatenate or chain it to the existing option as the
+ * universe prescribes.  Returns 0 if no memory was available.
+ */
+static int
+store_option_data(struct universe *universe, struct option_state *options,
+		  struct buffer *bp, unsigned char *data, unsigned len,
+		  unsigned code)
+{
+	struct option_cache *op, *nop = NULL;
+
+	op = lookup_option(universe, options, code);
+	if (op == NULL) {
+		/* If we don't have an option create one */
+		if (save_option_buffer(universe, options, bp, data, len,
+				       code, 1) == 0) {
+			log_error("parse_option_buffer: save_option_buffer failed");
+			return (0);
+		}
+	} else if (universe->concat_duplicates) {
+		/* If we do have an option either concat with
+		   what is there ...*/
+		struct data_string new;
+		memset(&new, 0, sizeof new);
+		if (!buffer_allocate(&new.buffer, op->data.len + len, MDL)) {
+			log_error("parse_option_buffer: No memory.");
+			return (0);
+		}
+		/* Copy old option to new data object. */
+		memcpy(new.buffer->data, op->data.data, op->data.len);
+		/* Concat new option behind old. */
+		memcpy(new.buffer->data + op->data.len, data, len);
+		new.len = op->data.len + len;
+		new.data = new.buffer->data;
+		/* Save new concat'd object. */
+		data_string_forget(&op->data, MDL);
+		data_string_copy(&op->data, &new, MDL);
+		data_string_forget(&new, MDL);
+	} else {
+		/* ... or we must append this statement onto the
+		 * end of the list.
+		 */
+		while (op->next != NULL)
+			op = op->next;
+
+		if (!option_cache_allocate(&nop, MDL)) {
+			log_error("parse_option_buffer: No memory.");
+			return (0);
+		}
+
+		/* ͬoptionֱʹopбoptionͿ */
+		option_reference(&nop->option, op->option, MDL);
+
+		nop->data.buffer = NULL;
+		buffer_reference(&nop->data.buffer, bp, MDL);
+		nop->data.data = data;
+		nop->data.len = len;
+
+		option_cache_reference(&op->next, nop, MDL);
+		option_cache_dereference(&nop, MDL);
+	}
+
+	return (1);
+}
+
+/*!
+ * \brief Walk the tag/length chain of an option buffer
+ *
+ * Fills tlv with up to max options starting at *offsetp, skipping pad
+ * options, and advances *offsetp past them.  Every returned option lies
+ * entirely within the buffer.  If the chain is malformed the entry
+ * following the last returned one holds the code of the bad option.
+ *
+ * \param universe the option space the buffer belongs to
+ * \param buffer the raw options
+ * \param length the length of the buffer
+ * \param offsetp where to start, updated on return
+ * \param tlv array of at least max + 1 entries to fill
+ * \param max the number of options to return at most
+ * \param status set to the reason the walk stopped
+ *
+ * \return the number of options stored in tlv
+ */
+static int
+option_buffer_scan(struct universe *universe, const unsigned char *buffer,
+		   unsigned length, unsigned *offsetp, struct option_tlv *tlv,
+		   int max, enum option_scan_status *status)
+{
+	unsigned offset = *offsetp;
+	unsigned code, len;
+	unsigned tag_size = universe->tag_size;
+	unsigned length_size = universe->length_size;
+	int narrow, count = 0;
+
+	/* DHCPv4 and most of its encapsulations use single octet tags
+	   and lengths; read those directly rather than through the
+	   universe's accessors. */
+	narrow = (universe->get_tag == getUChar &&
+		  universe->get_length == getUChar);
+
+	*status = OPTION_SCAN_DONE;
+	while (offset + tag_size <= length) {
+		code = narrow ? buffer[offset]
+			      : universe->get_tag(buffer + offset);
+		if (code == universe->end)
+			break;
+
+		if (count == max) {
+			*status = OPTION_SCAN_MORE;
+			break;
+		}
+
+		offset += tag_size;
 
 		/* Pad options don't have a length - just skip them. */
 		if (code == DHO_PAD)
 			continue;
 
+		tlv[count].code = code;
+
 		/* Don't look for length if the buffer isn't that big. */
-		if ((offset + universe->length_size) > length) 
-		{
-			reason = "code tag at end of buffer - missing length field";
-			goto bogus;
+		if (offset + length_size > length) {
+			*status = OPTION_SCAN_NO_LENGTH;
+			break;
 		}
 
 		/* All other fields (except PAD and END handled above)
@@ -187,17 +588,13 @@ int parse_option_buffer
 		 * Zero-length-size option spaces basically consume the
 		 * entire options buffer, so have at it.
 		 */
-		/* dhcp_universeget_lengthȡһֽڵunsignedֵ */
-		if (universe->get_length != NULL)
-		{
+		if (narrow) {
+			len = buffer[offset];
+		} else if (universe->get_length != NULL) {
 			len = universe->get_length(buffer + offset);
-		}
-		else if (universe->length_size == 0)
-		{
-			len = length - universe->tag_size;
-		}
-		else 
-		{
+		} else if (length_size == 0) {
+			len = length - tag_size;
+		} else {
 			log_fatal("Improperly configured option space(%s): "
 				  "may not have a nonzero length size "
 				  "AND a NULL get_length function.",
@@ -207,118 +604,22 @@ int parse_option_buffer
 			return 0;
 		}
 
-		offset += universe->length_size;
-
-		/* hash_lookupҵĻücode_hashdhcp_universecodehash */
-		/* ҵģҵoptionָdhcp_options[i]ȫֱ */
-		option_code_hash_lookup(&option, universe->code_hash, &code, 0, MDL);
+		offset += length_size;
 
 		/* If the length is outrageous, the options are bad. */
-		if (offset + len > length) 
-		{
-			/* Avoid reference count overflow */
-			option_dereference(&option, MDL);
-			reason = "option length exceeds option buffer length";
-		      bogus:
-			log_error("parse_option_buffer: malformed option "
-				  "%s.%s (code %u): %s.", universe->name,
-				  option ? option->name : "<unknown>",
-				  code, reason);
-			buffer_dereference (&bp, MDL);
-			return 0;
-		}
-
-		/* If the option contains an encapsulation, parse it.  In
-		   any case keep the raw data as well.  (Previous to 4.4.0
-		   we only kept the raw data if the parse failed, the option
-		   wasn't an encapsulation (by far the most common case), or
-		   the option wasn't entirely an encapsulation
-		*/
-
-		if (option && (option->format[0] == 'e' || option->format[0] == 'E')) 
-		{
-			(void)parse_encapsulated_suboptions(options, option,
-							     bp->data + offset, len, universe, NULL);
-		}
-
-		if (universe == &dhcp_universe && code == DHO_HOST_NAME && len == 0) 
-		{
-			/* non-compliant clients can send it
-			 * we'll just drop it and go on */
-			log_debug ("Ignoring empty DHO_HOST_NAME option");
-			option_dereference(&option, MDL);
-			offset += len;
-			continue;
-		}
-
-		op = lookup_option(universe, options, code);
-		if (op == NULL) 
-		{
-			/* If we don't have an option create one */
-			if (save_option_buffer(universe, options, bp, bp->data + offset, len,
-					       code, 1) == 0) 
-			{
-				log_error("parse_option_buffer: save_option_buffer failed");
-				buffer_dereference(&bp, MDL);
-				return (0);
-			}
-		} 
-		else if (universe->concat_duplicates) 
-		{
-			/* If we do have an option either concat with
-			   what is there ...*/
-			struct data_string new;
-			memset(&new, 0, sizeof new);
-			if (!buffer_allocate(&new.buffer, op->data.len + len, MDL)) 
-			{
-				log_error("parse_option_buffer: No memory.");
-				buffer_dereference(&bp, MDL);
-				return (0);
-			}
-			/* Copy old option to new data object. */
-			memcpy(new.buffer->data, op->data.data, op->data.len);
-			/* Concat new option behind old. */
-			memcpy(new.buffer->data + op->data.len, bp->data + offset, len);
-			new.len = op->data.len + len;
-			new.data = new.buffer->data;
-			/* Save new concat'd object. */
-			data_string_forget(&op->data, MDL);
-			data_string_copy(&op->data, &new, MDL);
-			data_string_forget(&new, MDL);
-		} 
-		else  
-		{
-			/* ... or we must append this statement onto the
-			 * end of the list.
-			 */
-			while (op->next != NULL)
-				op = op->next;
-
-			if (!option_cache_allocate(&nop, MDL)) 
-			{
-				log_error("parse_option_buffer: No memory.");
-				buffer_dereference(&bp, MDL);
-				return (0);
-			}
-
-			/* ͬoptionֱʹopбoptionͿ */
-			option_reference(&nop->option, op->option, MDL);
-
-			nop->data.buffer = NULL;
-			buffer_reference(&nop->data.buffer, bp, MDL);
-			nop->data.data = bp->data + offset;
-			nop->data.len = len;
-
-			option_cache_reference(&op->next, nop, MDL);
-			option_cache_dereference(&nop, MDL);
+		if (offset + len > length) {
+			*status = OPTION_SCAN_OVERRUN;
+			break;
 		}
 
-		option_dereference(&option, MDL);
+		tlv[count].offset = offset;
+		tlv[count].len = len;
+		count++;
 		offset += len;
 	}
-	
-	buffer_dereference(&bp, MDL);
-	return 1;
+
+	*offsetp = offset;
+	return count;
 }
 
 /* If an option in an option buffer turns out to be an encapsulation,
@@ -1111,9 +1412,11 @@ store_options6(char *buf, int buflen,
 	int vsio_wanted;
 	struct vsio_state vs;
 	unsigned char *tmp;
+	u_int32_t required[OPTION_CODE_SET_WORDS];
 
 	bufpos = 0;
 	vsio_wanted = 0;
+	memset(required, 0, sizeof(required));
 
 	/*
 	 * Find the option code for the VSIO universe.
@@ -1136,6 +1439,10 @@ store_options6(char *buf, int buflen,
 			if (required_opts[i] == vsio_option_code) {
 				vsio_wanted = 1;
 			}
+			if (required_opts[i] < 256) {
+				OPTION_CODE_SET_ADD(required,
+						    required_opts[i]);
+			}
 
 			oc = lookup_option(&dhcpv6_universe,
 					   opt_state, required_opts[i]);
@@ -1173,7 +1480,10 @@ store_options6(char *buf, int buflen,
 		 * it is required.
 		 */
 		in_required_opts = 0;
-		if (required_opts != NULL) {
+		if (code < 256) {
+			in_required_opts = OPTION_CODE_SET_HAS(required, code)
+					   != 0;
+		} else if (required_opts != NULL) {
 			for (j=0; required_opts[j] != 0; j++) {
 				if (required_opts[j] == code) {
 					in_required_opts = 1;
@@ -1223,9 +1533,8 @@ store_options6(char *buf, int buflen,
 			struct option *encap_opt = NULL;
 			unsigned int code_int = code;
 
-			option_code_hash_lookup(&encap_opt,
-						dhcpv6_universe.code_hash,
-						&code_int, 0, MDL);
+			option_code_lookup(&encap_opt,
+						&dhcpv6_universe, code_int, MDL);
 			if (encap_opt != NULL) {
 				store_encap6(buf, buflen, &bufpos, opt_state,
 					     packet, encap_opt, code);
@@ -1302,6 +1611,8 @@ store_options(int *ocount,
 	struct option_cache *oc;
 	struct option *option = NULL;
 	unsigned code;
+	u_int32_t seen[OPTION_CODE_SET_WORDS];
+	int mask_ix, routers_ix;
 
 	/*
 	 * These arguments are relative to the start of the buffer, so
@@ -1336,43 +1647,47 @@ store_options(int *ocount,
 
 	memset (&od, 0, sizeof od);
 
-	/* Eliminate duplicate options from the parameter request list.
-	 * Enforce RFC-mandated ordering of options that are present.
+	/* Eliminate duplicate options from the parameter request list,
+	 * keeping the first occurrence of each code, in a single pass.
 	 */
-	for (i = 0; i < priority_len; i++) {
-		/* Eliminate duplicates. */
-		tto = 0;
-		for (ix = i + 1; ix < priority_len + tto; ix++) {
-			if (tto)
-				priority_list [ix - tto] =
-					priority_list [ix];
-			if (priority_list [i] == priority_list [ix]) {
-				tto++;
-				priority_len--;
-			}
-		}
-
-		/* Enforce ordering of SUBNET_MASK options, according to
-		 * RFC2132 Section 3.3:
-		 *
-		 *   If both the subnet mask and the router option are
-		 *   specified in a DHCP reply, the subnet mask option MUST
-		 *   be first.
-		 *
-		 * This guidance does not specify what to do if the client
-		 * PRL explicitly requests the options out of order, it is
-		 * a general statement.
-		 */
-		if (priority_list[i] == DHO_SUBNET_MASK) {
-			for (ix = i - 1 ; ix >= 0 ; ix--) {
-				if (priority_list[ix] == DHO_ROUTERS) {
-                                        /* swap */
-					priority_list[ix] = DHO_SUBNET_MASK;
-					priority_list[i] = DHO_ROUTERS;
+	memset(seen, 0, sizeof(seen));
+	mask_ix = routers_ix = -1;
+	for (i = ix = 0; i < priority_len; i++) {
+		code = priority_list[i];
+		if (code < 256) {
+			if (OPTION_CODE_SET_HAS(seen, code))
+				continue;
+			OPTION_CODE_SET_ADD(seen, code);
+		} else {
+			for (tto = 0; tto < ix; tto++)
+				if (priority_list[tto] == code)
 					break;
-				}
-			}
+			if (tto < ix)
+				continue;
 		}
+
+		if (code == DHO_SUBNET_MASK)
+			mask_ix = ix;
+		else if (code == DHO_ROUTERS)
+			routers_ix = ix;
+		priority_list[ix++] = code;
+	}
+	priority_len = ix;
+
+	/* Enforce ordering of SUBNET_MASK options, according to
+	 * RFC2132 Section 3.3:
+	 *
+	 *   If both the subnet mask and the router option are
+	 *   specified in a DHCP reply, the subnet mask option MUST
+	 *   be first.
+	 *
+	 * This guidance does not specify what to do if the client
+	 * PRL explicitly requests the options out of order, it is
+	 * a general statement.
+	 */
+	if (routers_ix >= 0 && mask_ix > routers_ix) {
+		priority_list[routers_ix] = DHO_SUBNET_MASK;
+		priority_list[mask_ix] = DHO_ROUTERS;
 	}
 
 	/* Copy out the options in the order that they appear in the
@@ -1408,7 +1723,7 @@ store_options(int *ocount,
 	    if (oc && oc->option)
 		option_reference(&option, oc->option, MDL);
 	    else
-		option_code_hash_lookup(&option, u->code_hash, &code, 0, MDL);
+		option_code_lookup(&option, u, code, MDL);
 
 	    /* If it's a straight encapsulation, and the user supplied a
 	     * value for the entire option, use that.  Otherwise, search
@@ -2543,6 +2858,11 @@ struct option_cache *lookup_hashed_option
 	pair bptr;
 	pair *hash;
 
+	/* Options not yet decoded from the packet get decoded now. */
+	if (options->index != NULL && options->index->universe == universe &&
+	    code < 256 && options->index->offset[code] != 0)
+		return option_index_decode(universe, options, code);
+
 	/* Make sure there's a hash table. */
 	/* Щڴڸoptionڴʱһ */
 	if (universe->index >= options->universe_count || !(options->universes[universe->index]))
@@ -2676,7 +2996,7 @@ static int prepare_option_buffer
 	}
 
 	/* hash_lookupdhcp_universecode_hashвңһҵ */
-	option_code_hash_lookup(&option, universe->code_hash, &code, 0, MDL);
+	option_code_lookup(&option, universe, code, MDL);
 
 	/* If we created an option structure for each option a client
 	 * supplied, it's possible we may create > 2^32 option structures.
@@ -2890,6 +3210,7 @@ void save_option
 	struct option_cache *oc
 )
 {
+	options->generation++;
 	if (universe->save_func)
 		(*universe->save_func)(universe, options, oc, ISC_FALSE);
 	else
@@ -2901,6 +3222,7 @@ void
 also_save_option(struct universe *universe, struct option_state *options,
 		 struct option_cache *oc)
 {
+	options->generation++;
 	if (universe->save_func)
 		(*universe->save_func)(universe, options, oc, ISC_TRUE);
 	else
@@ -2936,6 +3258,15 @@ void save_hashed_option
 	if (oc->refcnt == 0)
 		abort();
 
+	/* An option still pending in the packet comes before anything
+	   appended to it, and is simply superseded by a replacement. */
+	if (appendp)
+		(void) option_index_decode(universe, options,
+					   oc->option->code);
+	else
+		option_index_forget(universe, options, oc->option->code);
+	hash = options->universes[universe->index];
+
 	/* Compute the hash. */
 	hashix = compute_option_hash(oc->option->code);
 
@@ -2943,7 +3274,8 @@ void save_hashed_option
 	if (!hash) 
 	{
 		/* һOPTION_HASH_SIZEͰ */
-		hash = (pair *)dmalloc(OPTION_HASH_SIZE * sizeof(*hash), MDL);
+		hash = (pair *)packet_arena_alloc(OPTION_HASH_SIZE *
+						  sizeof(*hash), MDL);
 		if (!hash) 
 		{
 			log_error ("no memory to store %s.%s",
@@ -3010,6 +3342,7 @@ void delete_option (universe, options, code)
 	struct option_state *options;
 	int code;
 {
+	options->generation++;
 	if (universe -> delete_func)
 		(*universe -> delete_func) (universe, options, code);
 	else
@@ -3028,6 +3361,8 @@ void delete_hashed_option
 	pair bptr, prev = (pair)0;
 	pair *hash = options->universes[universe->index];
 
+	option_index_forget(universe, options, code);
+
 	/* There may not be any options in this space. */
 	if (!hash)
 		return;
@@ -3132,7 +3467,7 @@ int hashed_option_state_dereference (universe, state, file, line)
 		}
 	}
 
-	dfree (heads, file, line);
+	packet_arena_free (heads, file, line);
 	state -> universes [universe -> index] = (void *)0;
 	return 1;
 }
@@ -3369,6 +3704,7 @@ int hashed_option_space_encapsulate (result, packet, lease, client_state,
 	if (universe -> index >= cfg_options -> universe_count)
 		return 0;
 
+	option_state_materialize(cfg_options, universe);
 	hash = cfg_options -> universes [universe -> index];
 	if (!hash)
 		return 0;
@@ -3439,9 +3775,8 @@ int nwip_option_space_encapsulate (result, packet, lease, client_state,
 			ds.len = 2;
 			if (option_cache_allocate (&no_nwip, MDL))
 				data_string_copy (&no_nwip -> data, &ds, MDL);
-			if (!option_code_hash_lookup(&no_nwip->option,
-						     nwip_universe.code_hash,
-						     &one, 0, MDL))
+			if (!option_code_lookup(&no_nwip->option,
+						     &nwip_universe, one, MDL))
 				log_fatal("Nwip option hash does not contain "
 					  "1 (%s:%d).", MDL);
 		}
@@ -3958,6 +4293,7 @@ void hashed_option_space_foreach (struct packet *packet, struct lease *lease,
 	if (cfg_options -> universe_count <= u -> index)
 		return;
 
+	option_state_materialize(cfg_options, u);
 	hash = cfg_options -> universes [u -> index];
 	if (!hash)
 		return;
@@ -4209,6 +4545,7 @@ void do_packet
 		log_error("do_packet: no memory for incoming packet!");
 		return;
 	}
+	packet_arena_begin();
 	
 	decoded_packet->raw 		  = packet;
 	decoded_packet->packet_length = len;
@@ -4222,6 +4559,7 @@ void do_packet
 	if (packet->hlen > sizeof(packet->chaddr)) 
 	{
 		packet_dereference(&decoded_packet, MDL);
+		packet_arena_end();
 		log_info("Discarding packet with bogus hlen.");
 		return;
 	}
@@ -4231,6 +4569,7 @@ void do_packet
 	if (!option_state_allocate(&decoded_packet->options, MDL)) 
 	{
 		packet_dereference(&decoded_packet, MDL);
+		packet_arena_end();
 		return;
 	}
 
@@ -4242,6 +4581,7 @@ void do_packet
 		if (!parse_options(decoded_packet)) 
 		{
 			packet_dereference(&decoded_packet, MDL);
+			packet_arena_end();
 			return;
 		}
 
@@ -4280,6 +4620,7 @@ void do_packet
 
 	/* If the caller kept the packet, they'll have upped the refcnt. */
 	packet_dereference(&decoded_packet, MDL);
+	packet_arena_end();
 
 #if defined (DEBUG_MEMORY_LEAKAGE)
 	log_info("generation %ld: %ld new, %ld outstanding, %ld long-term",
@@ -4342,10 +4683,12 @@ do_packet6(struct interface_info *interface, const char *packet,
 		log_error("do_packet6: no memory for incoming packet.");
 		return;
 	}
+	packet_arena_begin();
 
 	if (!option_state_allocate(&decoded_packet->options, MDL)) {
 		log_error("do_packet6: no memory for options.");
 		packet_dereference(&decoded_packet, MDL);
+		packet_arena_end();
 		return;
 	}
 
@@ -4384,6 +4727,7 @@ do_packet6(struct interface_info *interface, const char *packet,
 			/* no logging here, as parse_option_buffer() logs all
 			   cases where it fails */
 			packet_dereference(&decoded_packet, MDL);
+			packet_arena_end();
 			return;
 		}
 #ifdef DHCP4o6
@@ -4405,6 +4749,7 @@ do_packet6(struct interface_info *interface, const char *packet,
 			/* no logging here, as parse_option_buffer() logs all
 			   cases where it fails */
 			packet_dereference(&decoded_packet, MDL);
+			packet_arena_end();
 			return;
 		}
 #endif
@@ -4424,6 +4769,7 @@ do_packet6(struct interface_info *interface, const char *packet,
 			/* no logging here, as parse_option_buffer() logs all
 			   cases where it fails */
 			packet_dereference(&decoded_packet, MDL);
+			packet_arena_end();
 			return;
 		}
 	}
@@ -4431,6 +4777,7 @@ do_packet6(struct interface_info *interface, const char *packet,
 	dhcpv6(decoded_packet);
 
 	packet_dereference(&decoded_packet, MDL);
+	packet_arena_end();
 
 #if defined (DEBUG_MEMORY_LEAKAGE)
 	log_info("generation %ld: %ld new, %ld outstanding, %ld long-term",
@@ -4601,8 +4948,7 @@ add_option(struct option_state *options,
 	/* INSIST(data != NULL); */
 
 	option = NULL;
-	if (!option_code_hash_lookup(&option, dhcp_universe.code_hash,
-				     &option_num, 0, MDL)) {
+	if (!option_code_lookup(&option, &dhcp_universe, option_num, MDL)) {
 		log_error("Attempting to add unknown option %d.", option_num);
 		return 0;
 	}
@@ -4773,8 +5119,7 @@ void parse_vendor_option(packet, lease, client_state, in_options,
 	}
 
 	/* Get the proper option to pass to the parse routine */
-	option_code_hash_lookup(&option, dhcp_universe.code_hash,
-				&code, 0, MDL);
+	option_code_lookup(&option, &dhcp_universe, code, MDL);
 
 	/* Now that we have the data from the vendor option and a vendor
 	 * option space try to parse things.  On success the parsed options
@@ -809,6 +809,26 @@ unsigned char *parse_numeric_aggregate
 	return bufp;
 }
 
+/* Value of each hex digit character, -1 for anything else. */
+static const signed char hex_value[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
 void convert_num (cfile, buf, str, base, size)
 	struct parse *cfile;
 	unsigned char *buf;
@@ -822,6 +842,19 @@ void convert_num (cfile, buf, str, base, size)
 	int tval;
 	int max;
 
+	/* Hardware addresses, DUIDs and hex lease ids arrive here one or
+	 * two digits at a time; decode those straight from the table. */
+	if ((base == 16) && (size == 8) && (hex_value[ptr[0]] >= 0)) {
+		if (ptr[1] == 0) {
+			*buf = hex_value[ptr[0]];
+			return;
+		}
+		if ((hex_value[ptr[1]] >= 0) && (ptr[2] == 0)) {
+			*buf = (hex_value[ptr[0]] << 4) | hex_value[ptr[1]];
+			return;
+		}
+	}
+
 	if (*ptr == '-') {
 		negative = 1;
 		++ptr;
@@ -1882,6 +1915,7 @@ int parse_option_code_definition
 	}
 	option_code_hash_add(option->universe->code_hash, &option->code, 0,
 			     option, MDL);
+	option_code_index_set(option->universe, option);
 	option_name_hash_add(option->universe->name_hash, option->name, 0,
 			     option, MDL);
 	if (has_encapsulation) {
@@ -5081,6 +5115,8 @@ int parse_option_statement
     (*result)->op = op;
 	if (expr && !option_cache(&(*result)->data.option, NULL, expr, option, MDL))
 		log_fatal("no memory for option cache");
+	if (expr)
+		option_cache_fold_constant((*result)->data.option);
 
 	if (expr)
 		expression_dereference(&expr, MDL);
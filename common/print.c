@@ -30,6 +30,30 @@
 
 int db_time_format = DEFAULT_TIME_FORMAT;
 
+static const char hex_digits[] = "0123456789abcdef";
+
+/*
+ * Write len bytes of data as pairs of lower case hex digits, separated by
+ * sep unless it is 0, and NUL terminate the result.  buf must have room
+ * for 3 * len bytes (2 * len + 1 without a separator); returns a pointer
+ * to the terminating NUL.  This is the common back end for the hardware
+ * address, DUID and lease id formatters below, which run for every packet
+ * logged and every lease written, so it avoids sprintf().
+ */
+char *hex_encode(char *buf, const unsigned char *data, unsigned len, int sep)
+{
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		if (sep && (i > 0))
+			*buf++ = sep;
+		*buf++ = hex_digits[data[i] >> 4];
+		*buf++ = hex_digits[data[i] & 0xf];
+	}
+	*buf = 0;
+	return buf;
+}
+
 char *quotify_string (const char *s, const char *file, int line)
 {
 	unsigned len = 0;
@@ -101,8 +125,10 @@ char *quotify_buf (const unsigned char *s, unsigned len, char enclose_char,
 			if (s [i] == ' ')
 				*nsp++ = ' ';
 			else if (!isascii (s [i]) || !isprint (s [i])) {
-				sprintf (nsp, "\\%03o", s [i]);
-				nsp += 4;
+				*nsp++ = '\\';
+				*nsp++ = hex_digits[s [i] >> 6];
+				*nsp++ = hex_digits[(s [i] >> 3) & 7];
+				*nsp++ = hex_digits[s [i] & 7];
 			} else if (s [i] == '"' || s [i] == '\\') {
 				*nsp++ = '\\';
 				*nsp++ = s [i];
@@ -174,20 +200,11 @@ char *print_hw_addr (htype, hlen, data)
 	const unsigned char *data;
 {
 	static char habuf [49];
-	char *s;
-	int i;
 
 	if (hlen <= 0)
 		habuf [0] = 0;
-	else {
-		s = habuf;
-		for (i = 0; i < hlen; i++) {
-			sprintf (s, "%02x", data [i]);
-			s += strlen (s);
-			*s++ = ':';
-		}
-		*--s = 0;
-	}
+	else
+		hex_encode (habuf, data, hlen, ':');
 	return habuf;
 }
 
@@ -214,7 +231,7 @@ void print_lease (lease)
 					  lease -> hardware_addr.hlen - 1,
 					  &lease -> hardware_addr.hbuf [1]));
 	log_debug ("  host %s  ",
-	       lease -> host ? lease -> host -> name : "<none>");
+	       LEASE_COLD_RO(lease)->host ? LEASE_COLD_RO(lease)->host -> name : "<none>");
 }
 
 #if defined (DEBUG_PACKET)
@@ -274,6 +291,7 @@ void dump_packet (tp)
 	if (tp -> options_valid) {
 		int i;
 
+		option_state_materialize (tp -> options, &dhcp_universe);
 		for (i = 0; i < tp -> options -> universe_count; i++) {
 			if (tp -> options -> universes [i]) {
 				option_space_foreach (tp, (struct lease *)0,
@@ -383,28 +401,16 @@ void print_hex_only (len, data, limit, buf)
 	unsigned limit;
 	char *buf;
 {
-	char *bufptr = buf;
-	int byte = 0;
-
-	if (data == NULL || bufptr == NULL || limit == 0) {
+	if (data == NULL || buf == NULL || limit == 0) {
 		return;
 	}
 
 	if (((len == 0) || ((len * 3) > limit))) {
-		*bufptr = 0x0;
+		*buf = 0x0;
 		return;
 	}
 
-	for ( ; byte < len; ++byte) {
-		if (byte > 0) {
-			*bufptr++ = ':';
-		}
-
-		sprintf(bufptr, "%02x", data[byte]);
-		bufptr += 2;
-	}
-
-	return;
+	hex_encode(buf, data, len, ':');
 }
 
 /*
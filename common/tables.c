@@ -1124,6 +1124,7 @@ void initialize_common_option_spaces()
 				     dhcp_options[i].name, 0,
 				     &dhcp_options[i], MDL);
 	}
+	option_code_index_init(&dhcp_universe, dhcp_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("DHCP name hash: %s",
 		 option_name_hash_report(dhcp_universe.name_hash));
@@ -1170,6 +1171,7 @@ void initialize_common_option_spaces()
 				     nwip_options[i].name, 0,
 				     &nwip_options[i], MDL);
 	}
+	option_code_index_init(&nwip_universe, nwip_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("NWIP name hash: %s",
 		 option_name_hash_report(nwip_universe.name_hash));
@@ -1216,6 +1218,7 @@ void initialize_common_option_spaces()
 				     fqdn_options[i].name, 0,
 				     &fqdn_options[i], MDL);
 	}
+	option_code_index_init(&fqdn_universe, fqdn_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("FQDN name hash: %s",
 		 option_name_hash_report(fqdn_universe.name_hash));
@@ -1265,6 +1268,7 @@ void initialize_common_option_spaces()
                                      vendor_class_options[i].name, 0,
                                      &vendor_class_options[i], MDL);
         }
+	option_code_index_init(&vendor_class_universe, vendor_class_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("VIVCO name hash: %s",
 		 option_name_hash_report(vendor_class_universe.name_hash));
@@ -1312,6 +1316,7 @@ void initialize_common_option_spaces()
 				     vendor_options[i].name, 0,
 				     &vendor_options[i], MDL);
         }
+	option_code_index_init(&vendor_universe, vendor_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("VIVSO name hash: %s",
 		 option_name_hash_report(vendor_universe.name_hash));
@@ -1358,6 +1363,7 @@ void initialize_common_option_spaces()
                                      isc_options[i].name, 0,
                                      &isc_options[i], MDL);
         }
+	option_code_index_init(&isc_universe, isc_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("ISC name hash: %s",
 		 option_name_hash_report(isc_universe.name_hash));
@@ -1400,6 +1406,7 @@ void initialize_common_option_spaces()
 				     dhcpv6_options[i].name, 0,
 				     &dhcpv6_options[i], MDL);
 	}
+	option_code_index_init(&dhcpv6_universe, dhcpv6_options);
 
 	/* Add DHCPv6 protocol enumeration sets. */
 	add_enumeration(&dhcpv6_duid_types);
@@ -1446,6 +1453,7 @@ void initialize_common_option_spaces()
 				     vsio_options[i].name, 0,
 				     &vsio_options[i], MDL);
 	}
+	option_code_index_init(&vsio_universe, vsio_options);
 
 	/* Add ISC VSIO sub-sub-option space. */
 	isc6_universe.name = "isc6";
@@ -1487,6 +1495,7 @@ void initialize_common_option_spaces()
 				     isc6_options[i].name, 0,
 				     &isc6_options[i], MDL);
 	}
+	option_code_index_init(&isc6_universe, isc6_options);
 
 	/* The fqdn6 option space is a protocol-wrapper shill for the
 	 * old DHCPv4 space.
@@ -1554,3 +1563,96 @@ void initialize_common_option_spaces()
 			  &fqdn6_universe, MDL);
 
 }
+
+/*!
+ * \brief Build the direct code index of a built-in option space
+ *
+ * Every option in the table whose code is below OPTION_CODE_INDEX_SIZE
+ * is entered into the universe's code index, after which
+ * option_code_lookup() answers those codes with a single array access
+ * instead of a trip through the code hash.  Options defined later in
+ * the configuration are added by option_code_index_set().
+ *
+ * \param universe the option space, its code hash already filled in
+ * \param options the space's option table, terminated by a NULL name
+ */
+void
+option_code_index_init(struct universe *universe, struct option *options)
+{
+	unsigned code;
+	int i;
+
+	if (universe->code_index == NULL) {
+		universe->code_index =
+			dmalloc(OPTION_CODE_INDEX_SIZE *
+				sizeof(*universe->code_index), MDL);
+		if (universe->code_index == NULL)
+			log_fatal("No memory for %s option code index.",
+				  universe->name);
+		universe->code_index_size = OPTION_CODE_INDEX_SIZE;
+	} else {
+		for (code = 0; code < universe->code_index_size; code++)
+			option_code_index_clear(universe, code);
+	}
+
+	/* Later entries win, just as they do in the code hash. */
+	for (i = 0; options[i].name != NULL; i++)
+		option_code_index_set(universe, &options[i]);
+}
+
+/* Record option in its universe's code index, replacing any option
+   previously defined with the same code. */
+void
+option_code_index_set(struct universe *universe, struct option *option)
+{
+	struct option **slot;
+
+	if (option->code >= universe->code_index_size)
+		return;
+
+	slot = &universe->code_index[option->code];
+	if (*slot != NULL)
+		option_dereference(slot, MDL);
+	option_reference(slot, option, MDL);
+}
+
+/* Forget the option with the given code; called wherever an option is
+   deleted from the universe's code hash. */
+void
+option_code_index_clear(struct universe *universe, unsigned code)
+{
+	if (code < universe->code_index_size &&
+	    universe->code_index[code] != NULL)
+		option_dereference(&universe->code_index[code], MDL);
+}
+
+/*!
+ * \brief Find an option by code
+ *
+ * Equivalent to option_code_hash_lookup() on the universe's code hash.
+ * Codes covered by the universe's code index are answered from the
+ * index; others, and universes without an index, go to the hash.
+ *
+ * \param result where to store a reference to the option, must be NULL
+ * \param universe the option space to look in
+ * \param code the option code
+ *
+ * \return 1 if the option was found, 0 otherwise
+ */
+int
+option_code_lookup(struct option **result, struct universe *universe,
+		   unsigned code, const char *file, int line)
+{
+	if (code < universe->code_index_size) {
+		if (universe->code_index[code] == NULL)
+			return 0;
+		option_reference(result, universe->code_index[code],
+				 file, line);
+		return 1;
+	}
+
+	if (universe->code_hash == NULL)
+		return 0;
+	return option_code_hash_lookup(result, universe->code_hash, &code, 0,
+				       file, line);
+}
@@ -217,6 +217,80 @@ ATF_TC_BODY(print_hex_only, tc)
     }
 }
     	
+ATF_TC(hex_codec);
+
+ATF_TC_HEAD(hex_codec, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Verify hex and octal id encoding "
+		      "and hex byte decoding.");
+}
+
+/* This test exercises hex_encode and the callers that use it for
+ * hardware addresses and lease ids, and the hex byte decoding in
+ * convert_num.
+ */
+ATF_TC_BODY(hex_codec, tc)
+{
+    unsigned char data[] = {0x00, 0x01, 0x7f, 0x80, 0xab, 0xff, 'a', '"'};
+    unsigned char byte;
+    char buf[32];
+    char *s, *end;
+    int i;
+
+    end = hex_encode(buf, data, sizeof(data), ':');
+    if (strcmp(buf, "00:01:7f:80:ab:ff:61:22") || (end != buf + 23)) {
+	    atf_tc_fail("hex_encode with separator: %s", buf);
+    }
+
+    end = hex_encode(buf, data, 3, 0);
+    if (strcmp(buf, "00017f") || (*end != 0)) {
+	    atf_tc_fail("hex_encode without separator: %s", buf);
+    }
+
+    hex_encode(buf, data, 0, ':');
+    if (buf[0] != 0) {
+	    atf_tc_fail("hex_encode of nothing should be empty");
+    }
+
+    if (strcmp(print_hw_addr(HTYPE_ETHER, 6, data), "00:01:7f:80:ab:ff")) {
+	    atf_tc_fail("print_hw_addr mismatch");
+    }
+
+    s = format_lease_id(data, sizeof(data), TOKEN_OCTAL, MDL);
+    if ((s == NULL) ||
+	strcmp(s, "\"\\000\\001\\177\\200\\253\\377a\\\"\"")) {
+	    atf_tc_fail("octal lease id mismatch: %s", s ? s : "(null)");
+    }
+    dfree(s, MDL);
+
+    s = format_lease_id(data, 2, TOKEN_HEX, MDL);
+    if ((s == NULL) || strcmp(s, "00:01")) {
+	    atf_tc_fail("hex lease id mismatch: %s", s ? s : "(null)");
+    }
+    dfree(s, MDL);
+
+    /* Every byte survives a trip through hex_encode and convert_num,
+     * in either case. */
+    for (i = 0; i < 256; i++) {
+	    data[0] = i;
+	    hex_encode(buf, data, 1, 0);
+	    convert_num(NULL, &byte, buf, 16, 8);
+	    if (byte != i) {
+		    atf_tc_fail("convert_num(%s) gave %d", buf, byte);
+	    }
+	    buf[0] = toupper((unsigned char)buf[0]);
+	    buf[1] = toupper((unsigned char)buf[1]);
+	    convert_num(NULL, &byte, buf, 16, 8);
+	    if (byte != i) {
+		    atf_tc_fail("convert_num(%s) gave %d", buf, byte);
+	    }
+    }
+    convert_num(NULL, &byte, "c", 16, 8);
+    if (byte != 12) {
+	    atf_tc_fail("convert_num of a single digit gave %d", byte);
+    }
+}
+
 /* This macro defines main() method that will call specified
    test cases. tp and simple_test_case names can be whatever you want
    as long as it is a valid variable identifier. */
@@ -225,6 +299,7 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, find_percent_basic);
     ATF_TP_ADD_TC(tp, find_percent_adv);
     ATF_TP_ADD_TC(tp, print_hex_only);
+    ATF_TP_ADD_TC(tp, hex_codec);
 
     return (atf_no_error());
 }
@@ -130,13 +130,750 @@ ATF_TC_BODY(pretty_print_option, tc)
 }
 
 
+ATF_TC(parse_option_buffer_lazy);
+
+ATF_TC_HEAD(parse_option_buffer_lazy, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify options deferred by the lazy decode index "
+		      "behave like eagerly decoded ones.");
+}
+
+/* Walker used to count the options visible in an option space. */
+static void
+count_option(struct option_cache *oc, struct packet *packet,
+	     struct lease *lease, struct client_state *client_state,
+	     struct option_state *in_options, struct option_state *cfg_options,
+	     struct binding_scope **scope, struct universe *u, void *stuff)
+{
+    (*(int *)stuff)++;
+}
+
+/* This test parses a buffer with a lazy decode index attached and checks
+ * that lookups decode on demand, that duplicates are still concatenated,
+ * that deleted options stay deleted and that walking the space sees
+ * every option.
+ */
+ATF_TC_BODY(parse_option_buffer_lazy, tc)
+{
+    struct option_state *options;
+    struct option_cache *oc;
+    int count;
+    unsigned char buffer[] = {
+	53, 1, 3,			/* dhcp-message-type */
+	12, 3, 'f', 'o', 'o',		/* host-name */
+	61, 3, 1, 2, 3,			/* dhcp-client-identifier */
+	12, 3, 'b', 'a', 'r',		/* host-name, concatenated */
+	55, 2, 1, 3,			/* dhcp-parameter-request-list */
+	255
+    };
+
+    initialize_common_option_spaces();
+
+    options = NULL;
+    if (!option_state_allocate(&options, MDL)) {
+	atf_tc_fail("can't allocate option state");
+    }
+
+    if (!option_index_attach(options, &dhcp_universe)) {
+	atf_tc_fail("can't attach option index");
+    }
+
+    if (!parse_option_buffer(options, buffer, sizeof(buffer),
+			     &dhcp_universe)) {
+	atf_tc_fail("parse_option_buffer failed");
+    }
+
+    /* Only the duplicate host-name had to be decoded while parsing. */
+    if (options->index->pending != 3) {
+	atf_tc_fail("expected 3 pending options, got %d",
+		    options->index->pending);
+    }
+
+    oc = lookup_option(&dhcp_universe, options, DHO_DHCP_MESSAGE_TYPE);
+    if (oc == NULL || oc->data.len != 1 || oc->data.data[0] != 3) {
+	atf_tc_fail("dhcp-message-type not decoded correctly");
+    }
+
+    oc = lookup_option(&dhcp_universe, options, DHO_HOST_NAME);
+    if (oc == NULL || oc->data.len != 6 ||
+	memcmp(oc->data.data, "foobar", 6) != 0) {
+	atf_tc_fail("host-name not concatenated");
+    }
+
+    delete_option(&dhcp_universe, options, DHO_DHCP_CLIENT_IDENTIFIER);
+    if (lookup_option(&dhcp_universe, options,
+		      DHO_DHCP_CLIENT_IDENTIFIER) != NULL) {
+	atf_tc_fail("deleted dhcp-client-identifier is still present");
+    }
+
+    count = 0;
+    option_space_foreach(NULL, NULL, NULL, NULL, options, NULL,
+			 &dhcp_universe, &count, count_option);
+    if (count != 3 || options->index->pending != 0) {
+	atf_tc_fail("expected 3 options and none pending, got %d and %d",
+		    count, options->index->pending);
+    }
+
+    option_state_dereference(&options, MDL);
+}
+
+ATF_TC(parse_option_buffer_batches);
+
+ATF_TC_HEAD(parse_option_buffer_batches, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify option buffers longer than one scan batch and "
+		      "malformed buffers are parsed correctly.");
+}
+
+/* This test builds a buffer with more options than parse_option_buffer()
+ * scans in one go, with a host-name split across the batch boundary, and
+ * checks every option is stored.  It then truncates the last option and
+ * checks the parse fails but keeps the options in front of it.
+ */
+ATF_TC_BODY(parse_option_buffer_batches, tc)
+{
+    struct option_state *options;
+    struct option_cache *oc;
+    unsigned char buffer[512];
+    unsigned length, code;
+    int count, pass;
+
+    initialize_common_option_spaces();
+
+    for (pass = 0; pass < 2; pass++) {
+	length = 0;
+	buffer[length++] = DHO_HOST_NAME;
+	buffer[length++] = 3;
+	memcpy(buffer + length, "foo", 3);
+	length += 3;
+	buffer[length++] = DHO_PAD;
+	for (code = 128; code < 198; code++) {
+	    buffer[length++] = code;
+	    buffer[length++] = 1;
+	    buffer[length++] = code;
+	}
+	buffer[length++] = DHO_HOST_NAME;
+	buffer[length++] = 3;
+	memcpy(buffer + length, "bar", 3);
+	length += 3;
+	if (pass == 0) {
+	    buffer[length++] = DHO_END;
+	} else {
+	    /* A final option claiming more data than there is. */
+	    buffer[length++] = DHO_DOMAIN_NAME;
+	    buffer[length++] = 10;
+	    buffer[length++] = 'x';
+	}
+
+	options = NULL;
+	if (!option_state_allocate(&options, MDL)) {
+	    atf_tc_fail("can't allocate option state");
+	}
+
+	if (parse_option_buffer(options, buffer, length,
+				&dhcp_universe) != (pass == 0)) {
+	    atf_tc_fail("parse_option_buffer returned the wrong status "
+			"in pass %d", pass);
+	}
+
+	oc = lookup_option(&dhcp_universe, options, DHO_HOST_NAME);
+	if (oc == NULL || oc->data.len != 6 ||
+	    memcmp(oc->data.data, "foobar", 6) != 0) {
+	    atf_tc_fail("host-name not concatenated in pass %d", pass);
+	}
+
+	oc = lookup_option(&dhcp_universe, options, 197);
+	if (oc == NULL || oc->data.len != 1 || oc->data.data[0] != 197) {
+	    atf_tc_fail("option 197 not stored in pass %d", pass);
+	}
+
+	if (lookup_option(&dhcp_universe, options, DHO_DOMAIN_NAME) != NULL) {
+	    atf_tc_fail("malformed option stored");
+	}
+
+	count = 0;
+	option_space_foreach(NULL, NULL, NULL, NULL, options, NULL,
+			     &dhcp_universe, &count, count_option);
+	if (count != 71) {
+	    atf_tc_fail("expected 71 options in pass %d, got %d",
+			pass, count);
+	}
+
+	option_state_dereference(&options, MDL);
+    }
+}
+
+ATF_TC(compiled_boolean_expression);
+
+ATF_TC_HEAD(compiled_boolean_expression, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify compiled boolean expressions agree with the "
+		      "tree walker.");
+}
+
+/* This test parses a set of boolean expressions over a small option
+ * state and checks that the compiled program and the tree walker return
+ * the same status and result for each of them, including the cases
+ * where operands fail to evaluate.
+ */
+ATF_TC_BODY(compiled_boolean_expression, tc)
+{
+    struct option_state *options;
+    struct expression *expr;
+    struct parse *cfile;
+    int lose, i, s0, s1, r0, r1;
+    unsigned char buffer[] = {
+	60, 8, 'M', 'S', 'F', 'T', ' ', '5', '.', '0', /* vendor-class */
+	12, 3, 'F', 'o', 'o',			/* host-name */
+	61, 4, 1, 2, 3, 4,			/* dhcp-client-identifier */
+	255
+    };
+    const char *tests[] = {
+	"substring (option vendor-class-identifier, 0, 4) = \"MSFT\"",
+	"substring (option vendor-class-identifier, 20, 4) = \"\"",
+	"suffix (option vendor-class-identifier, 3) = \"5.0\"",
+	"lcase (option host-name) = \"foo\" and "
+	    "ucase (option host-name) = \"FOO\"",
+	"option host-name = concat (\"F\", \"oo\")",
+	"option domain-name = option nis-domain",
+	"option domain-name != \"x\"",
+	"option domain-name = \"x\" or exists host-name",
+	"not exists domain-name and exists dhcp-client-identifier",
+	"exists domain-name and exists host-name",
+	"not (exists domain-name and exists host-name)",
+	"extract-int (option dhcp-client-identifier, 16) = 258",
+	"extract-int (option dhcp-client-identifier, 32) = 16909060",
+	"extract-int (option host-name, 32) = 0",
+	"(extract-int (option host-name, 8) = 70) or (1 = 2)",
+	"substring (\"abcdef\", 1, 2) = \"bc\"",
+	"option host-name = 70",
+	"known",
+    };
+
+    initialize_common_option_spaces();
+
+    options = NULL;
+    if (!option_state_allocate(&options, MDL)) {
+	atf_tc_fail("can't allocate option state");
+    }
+    if (!parse_option_buffer(options, buffer, sizeof(buffer),
+			     &dhcp_universe)) {
+	atf_tc_fail("parse_option_buffer failed");
+    }
+
+    expression_compile_enabled = 1;
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+	cfile = NULL;
+	if (new_parse(&cfile, -1, (char *)tests[i], strlen(tests[i]),
+		      "test", 0) != ISC_R_SUCCESS) {
+	    atf_tc_fail("can't set up parse for %s", tests[i]);
+	}
+	expr = NULL;
+	lose = 0;
+	if (!parse_boolean_expression(&expr, cfile, &lose)) {
+	    atf_tc_fail("can't parse %s", tests[i]);
+	}
+	end_parse(&cfile);
+
+	r0 = r1 = -1;
+	s0 = evaluate_boolean_expression(&r0, NULL, NULL, NULL, options,
+					 NULL, NULL, expr);
+	s1 = evaluate_boolean_expression_compiled(&r1, NULL, NULL, NULL,
+						  options, NULL, NULL, expr);
+	if (expr->program == NULL) {
+	    atf_tc_fail("%s was not compiled", tests[i]);
+	}
+	if (s0 != s1 || (s0 && r0 != r1)) {
+	    atf_tc_fail("%s: tree gives %d/%d, program gives %d/%d",
+			tests[i], s0, r0, s1, r1);
+	}
+	expression_dereference(&expr, MDL);
+    }
+    expression_compile_enabled = 0;
+
+    option_state_dereference(&options, MDL);
+}
+
+ATF_TC(expression_memo);
+
+ATF_TC_HEAD(expression_memo, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify data expression results are remembered per "
+		      "packet and dropped when its options change.");
+}
+
+static struct expression *
+parse_data_text(const char *text)
+{
+    struct expression *expr;
+    struct parse *cfile;
+    int lose;
+
+    cfile = NULL;
+    if (new_parse(&cfile, -1, (char *)text, strlen(text),
+		  "test", 0) != ISC_R_SUCCESS) {
+	atf_tc_fail("can't set up parse for %s", text);
+    }
+    expr = NULL;
+    lose = 0;
+    if (!parse_data_expression(&expr, cfile, &lose)) {
+	atf_tc_fail("can't parse %s", text);
+    }
+    end_parse(&cfile);
+    return expr;
+}
+
+/* This test evaluates a packet-only data expression twice and checks
+ * the second evaluation is answered from the packet's memo, then
+ * deletes the option it reads and checks the memo doesn't outlive
+ * the change.  Expressions reading the configuration are not
+ * remembered.
+ */
+ATF_TC_BODY(expression_memo, tc)
+{
+    struct packet *packet;
+    struct expression *expr, *cfg_expr;
+    struct data_string data;
+    unsigned char buffer[] = {
+	60, 8, 'M', 'S', 'F', 'T', ' ', '5', '.', '0', /* vendor-class */
+	255
+    };
+
+    initialize_common_option_spaces();
+
+    packet = NULL;
+    if (!packet_allocate(&packet, MDL) ||
+	!option_state_allocate(&packet->options, MDL)) {
+	atf_tc_fail("can't allocate packet");
+    }
+    if (!parse_option_buffer(packet->options, buffer, sizeof(buffer),
+			     &dhcp_universe)) {
+	atf_tc_fail("parse_option_buffer failed");
+    }
+
+    expression_memo_enabled = 1;
+    expr = parse_data_text("substring (option vendor-class-identifier, 0, 4)");
+    cfg_expr = parse_data_text("config-option domain-name");
+
+    memset(&data, 0, sizeof(data));
+    if (evaluate_data_expression(&data, packet, NULL, NULL, packet->options,
+				 NULL, NULL, cfg_expr, MDL) ||
+	packet->expr_memo != NULL) {
+	atf_tc_fail("config-option was remembered");
+    }
+
+    if (!evaluate_data_expression(&data, packet, NULL, NULL, packet->options,
+				  NULL, NULL, expr, MDL) ||
+	data.len != 4 || memcmp(data.data, "MSFT", 4) != 0) {
+	atf_tc_fail("first evaluation failed");
+    }
+    data_string_forget(&data, MDL);
+    if (packet->expr_memo == NULL) {
+	atf_tc_fail("result was not remembered");
+    }
+
+    if (!evaluate_data_expression(&data, packet, NULL, NULL, packet->options,
+				  NULL, NULL, expr, MDL) ||
+	data.len != 4 || memcmp(data.data, "MSFT", 4) != 0) {
+	atf_tc_fail("remembered evaluation failed");
+    }
+    data_string_forget(&data, MDL);
+
+    delete_option(&dhcp_universe, packet->options,
+		  DHO_VENDOR_CLASS_IDENTIFIER);
+    if (evaluate_data_expression(&data, packet, NULL, NULL, packet->options,
+				 NULL, NULL, expr, MDL)) {
+	atf_tc_fail("stale result returned after the option was deleted");
+    }
+
+    expression_memo_enabled = 0;
+    expression_dereference(&expr, MDL);
+    expression_dereference(&cfg_expr, MDL);
+    packet_dereference(&packet, MDL);
+}
+
+ATF_TC(option_cache_fold_constant);
+
+ATF_TC_HEAD(option_cache_fold_constant, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify constant option statements are evaluated "
+		      "once when they are parsed.");
+}
+
+/* Parse an option statement for the given option from text, returning
+ * the resulting executable statement. */
+static struct executable_statement *
+parse_option_text(const char *text, unsigned code)
+{
+    struct executable_statement *stmt;
+    struct option *option;
+    struct parse *cfile;
+
+    option = NULL;
+    if (!option_code_hash_lookup(&option, dhcp_universe.code_hash,
+				 &code, 0, MDL)) {
+	atf_tc_fail("can't find option %u", code);
+    }
+
+    cfile = NULL;
+    if (new_parse(&cfile, -1, (char *)text, strlen(text),
+		  "test", 0) != ISC_R_SUCCESS) {
+	atf_tc_fail("can't set up parse for %s", text);
+    }
+    stmt = NULL;
+    if (!parse_option_statement(&stmt, cfile, 1, option,
+				supersede_option_statement)) {
+	atf_tc_fail("can't parse %s", text);
+    }
+    end_parse(&cfile);
+    option_dereference(&option, MDL);
+    return stmt;
+}
+
+/* This test checks that a constant option statement carries its
+ * evaluated value alongside the expression, and that one depending on
+ * the packet is left to be evaluated per reply.
+ */
+ATF_TC_BODY(option_cache_fold_constant, tc)
+{
+    struct executable_statement *stmt;
+    struct option_cache *oc;
+    struct data_string data;
+    const unsigned char servers[] = { 10, 0, 0, 1, 10, 0, 0, 2 };
+
+    initialize_common_option_spaces();
+
+    stmt = parse_option_text("10.0.0.1, 10.0.0.2;", DHO_DOMAIN_NAME_SERVERS);
+    oc = stmt->data.option;
+    if (oc->expression == NULL || oc->data.len != sizeof(servers) ||
+	memcmp(oc->data.data, servers, sizeof(servers)) != 0) {
+	atf_tc_fail("domain-name-servers was not folded");
+    }
+
+    memset(&data, 0, sizeof(data));
+    if (!evaluate_option_cache(&data, NULL, NULL, NULL, NULL, NULL, NULL,
+			       oc, MDL) ||
+	data.data != oc->data.data) {
+	atf_tc_fail("evaluate_option_cache did not use the folded value");
+    }
+    data_string_forget(&data, MDL);
+    executable_statement_dereference(&stmt, MDL);
+
+    stmt = parse_option_text("= concat (option host-name, \".example\");",
+			     DHO_DOMAIN_NAME);
+    if (stmt->data.option->data.data != NULL) {
+	atf_tc_fail("option reference was folded");
+    }
+    executable_statement_dereference(&stmt, MDL);
+}
+
+ATF_TC(flattened_option_scope);
+
+ATF_TC_HEAD(flattened_option_scope, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify flattened option scopes install the same "
+		      "options as executing the statements.");
+}
+
+/* Parse a statement list from text into a new group whose next
+ * pointer is outer. */
+static struct group *
+parse_group_text(const char *text, struct group *outer)
+{
+    struct group *group;
+    struct parse *cfile;
+    int lose = 0;
+
+    group = NULL;
+    if (!group_allocate(&group, MDL)) {
+	atf_tc_fail("can't allocate group");
+    }
+    if (outer != NULL) {
+	group_reference(&group->next, outer, MDL);
+    }
+
+    cfile = NULL;
+    if (new_parse(&cfile, -1, (char *)text, strlen(text),
+		  "test", 0) != ISC_R_SUCCESS) {
+	atf_tc_fail("can't set up parse for %s", text);
+    }
+    if (!parse_executable_statements(&group->statements, cfile, &lose,
+				     context_any)) {
+	atf_tc_fail("can't parse %s", text);
+    }
+    end_parse(&cfile);
+    return group;
+}
+
+/* Walker used to record the order of the options in an option space. */
+static void
+list_option(struct option_cache *oc, struct packet *packet,
+	    struct lease *lease, struct client_state *client_state,
+	    struct option_state *in_options, struct option_state *cfg_options,
+	    struct binding_scope **scope, struct universe *u, void *stuff)
+{
+    char *list = stuff;
+
+    sprintf(list + strlen(list), "%u=%p ", oc->option->code, oc);
+}
+
+/* This test runs an inner scope (a flattened chain) against an option
+ * state that already holds an option, and compares the options and
+ * their order with those left by executing each group's statements
+ * by hand.
+ */
+ATF_TC_BODY(flattened_option_scope, tc)
+{
+    struct group *outer, *inner;
+    struct option_state *flat, *exec;
+    struct executable_statement *pre;
+    char flat_list[512], exec_list[512];
+    struct parse *cfile;
+    const char *pre_text = "option time-offset 1;";
+    int lose = 0;
+
+    initialize_common_option_spaces();
+
+    outer = parse_group_text("option domain-name \"outer\"; "
+			     "default host-name \"outer-host\"; "
+			     "option routers 10.0.0.1; "
+			     "default time-offset 5;", NULL);
+    inner = parse_group_text("default domain-name \"inner\"; "
+			     "option host-name \"inner-host\"; "
+			     "default routers 10.0.0.2; "
+			     "option domain-name-servers 10.0.0.3;", outer);
+
+    pre = NULL;
+    cfile = NULL;
+    if (new_parse(&cfile, -1, (char *)pre_text, strlen(pre_text),
+		  "test", 0) != ISC_R_SUCCESS ||
+	!parse_executable_statements(&pre, cfile, &lose, context_any)) {
+	atf_tc_fail("can't parse %s", pre_text);
+    }
+    end_parse(&cfile);
+
+    flat = exec = NULL;
+    if (!option_state_allocate(&flat, MDL) ||
+	!option_state_allocate(&exec, MDL)) {
+	atf_tc_fail("can't allocate option state");
+    }
+
+    execute_statements(NULL, NULL, NULL, NULL, NULL, flat, NULL, pre, NULL);
+    execute_statements_in_scope(NULL, NULL, NULL, NULL, NULL, flat, NULL,
+				inner, NULL, NULL);
+    if (inner->flat == NULL) {
+	atf_tc_fail("inner scope was not flattened");
+    }
+
+    execute_statements(NULL, NULL, NULL, NULL, NULL, exec, NULL, pre, NULL);
+    execute_statements(NULL, NULL, NULL, NULL, NULL, exec, NULL,
+		       outer->statements, NULL);
+    execute_statements(NULL, NULL, NULL, NULL, NULL, exec, NULL,
+		       inner->statements, NULL);
+
+    flat_list[0] = exec_list[0] = 0;
+    option_space_foreach(NULL, NULL, NULL, NULL, flat, NULL,
+			 &dhcp_universe, flat_list, list_option);
+    option_space_foreach(NULL, NULL, NULL, NULL, exec, NULL,
+			 &dhcp_universe, exec_list, list_option);
+    if (strcmp(flat_list, exec_list) != 0) {
+	atf_tc_fail("flattened scope gives %s, statements give %s",
+		    flat_list, exec_list);
+    }
+
+    /* A scope the chain stops at contributes nothing. */
+    option_state_dereference(&flat, MDL);
+    option_state_allocate(&flat, MDL);
+    execute_statements_in_scope(NULL, NULL, NULL, NULL, NULL, flat, NULL,
+				inner, outer, NULL);
+    if (lookup_option(&dhcp_universe, flat, DHO_ROUTERS) == NULL ||
+	lookup_option(&dhcp_universe, flat, DHO_TIME_OFFSET) != NULL) {
+	atf_tc_fail("limiting scope was not honoured");
+    }
+
+    executable_statement_dereference(&pre, MDL);
+    option_state_dereference(&flat, MDL);
+    option_state_dereference(&exec, MDL);
+    group_dereference(&inner, MDL);
+    group_dereference(&outer, MDL);
+}
+
+ATF_TC(store_options_priority);
+
+ATF_TC_HEAD(store_options_priority, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify store_options drops duplicate codes and puts "
+		      "the subnet mask before the routers.");
+}
+
+/* This test stores options from a priority list holding duplicates and
+ * the routers option ahead of the subnet mask, and checks the exact
+ * bytes produced.
+ */
+ATF_TC_BODY(store_options_priority, tc)
+{
+    struct executable_statement *stmts;
+    struct option_state *options;
+    struct parse *cfile;
+    const char *text = "option routers 10.0.0.1; "
+		       "option subnet-mask 255.255.255.0; "
+		       "option domain-name \"x\";";
+    unsigned priority[] = { DHO_ROUTERS, DHO_DOMAIN_NAME, DHO_ROUTERS,
+			    DHO_SUBNET_MASK, DHO_DOMAIN_NAME, DHO_HOST_NAME };
+    unsigned char buffer[64];
+    const unsigned char expected[] = {
+	DHO_SUBNET_MASK, 4, 255, 255, 255, 0,
+	DHO_DOMAIN_NAME, 1, 'x',
+	DHO_ROUTERS, 4, 10, 0, 0, 1
+    };
+    int len, lose = 0;
+
+    initialize_common_option_spaces();
+
+    stmts = NULL;
+    cfile = NULL;
+    if (new_parse(&cfile, -1, (char *)text, strlen(text),
+		  "test", 0) != ISC_R_SUCCESS ||
+	!parse_executable_statements(&stmts, cfile, &lose, context_any)) {
+	atf_tc_fail("can't parse %s", text);
+    }
+    end_parse(&cfile);
+
+    options = NULL;
+    if (!option_state_allocate(&options, MDL)) {
+	atf_tc_fail("can't allocate option state");
+    }
+    options->site_universe = dhcp_universe.index;
+    execute_statements(NULL, NULL, NULL, NULL, NULL, options, NULL,
+		       stmts, NULL);
+
+    len = store_options(NULL, buffer, 0, sizeof(buffer), NULL, NULL, NULL,
+			NULL, options, NULL, priority,
+			sizeof(priority) / sizeof(priority[0]), 0, 0, 0, NULL);
+    if (len != sizeof(expected) || memcmp(buffer, expected, len) != 0) {
+	atf_tc_fail("unexpected options stored (%d bytes)", len);
+    }
+
+    executable_statement_dereference(&stmts, MDL);
+    option_state_dereference(&options, MDL);
+}
+
 /* This macro defines main() method that will call specified
    test cases. tp and simple_test_case names can be whatever you want
    as long as it is a valid variable identifier. */
+ATF_TC(option_code_index);
+
+ATF_TC_HEAD(option_code_index, tc)
+{
+    atf_tc_set_md_var(tc, "descr",
+		      "Verify the option code index agrees with the code "
+		      "hash, including for options defined at run time.");
+}
+
+static struct option *
+define_test_option(const char *name, const char *text)
+{
+    struct option *option;
+    struct parse *cfile;
+
+    option = new_option(name, MDL);
+    if (option == NULL) {
+	atf_tc_fail("can't allocate option %s", name);
+    }
+    option->universe = &dhcp_universe;
+
+    cfile = NULL;
+    if (new_parse(&cfile, -1, (char *)text, strlen(text),
+		  "test", 0) != ISC_R_SUCCESS) {
+	atf_tc_fail("can't set up parse for %s", text);
+    }
+    if (!parse_option_code_definition(cfile, option)) {
+	atf_tc_fail("can't parse %s", text);
+    }
+    end_parse(&cfile);
+    return option;
+}
+
+/* This test looks up every indexed code of every built-in option space
+ * both ways and checks the answers match, then defines options in the
+ * dhcp space, replacing one of them, and checks the index follows.
+ */
+ATF_TC_BODY(option_code_index, tc)
+{
+    struct option *first, *second, *hashed, *indexed;
+    struct universe *universe;
+    unsigned code;
+    int i;
+
+    initialize_common_option_spaces();
+
+    if (dhcp_universe.code_index_size != OPTION_CODE_INDEX_SIZE ||
+	dhcpv6_universe.code_index_size != OPTION_CODE_INDEX_SIZE) {
+	atf_tc_fail("built-in option spaces aren't indexed");
+    }
+
+    for (i = 0; i < universe_count; i++) {
+	universe = universes[i];
+	for (code = 0; code < universe->code_index_size; code++) {
+	    hashed = indexed = NULL;
+	    option_code_hash_lookup(&hashed, universe->code_hash,
+				    &code, 0, MDL);
+	    option_code_lookup(&indexed, universe, code, MDL);
+	    if (hashed != indexed) {
+		atf_tc_fail("%s option %u differs between hash and index",
+			    universe->name, code);
+	    }
+	    if (hashed != NULL) {
+		option_dereference(&hashed, MDL);
+		option_dereference(&indexed, MDL);
+	    }
+	}
+    }
+
+    first = define_test_option("index-test-first", "250 = text;");
+    indexed = NULL;
+    if (!option_code_lookup(&indexed, &dhcp_universe, 250, MDL) ||
+	indexed != first) {
+	atf_tc_fail("defined option not found in the index");
+    }
+    option_dereference(&indexed, MDL);
+
+    second = define_test_option("index-test-second", "250 = ip-address;");
+    if (!option_code_lookup(&indexed, &dhcp_universe, 250, MDL) ||
+	indexed != second) {
+	atf_tc_fail("redefined option not found in the index");
+    }
+    option_dereference(&indexed, MDL);
+
+    option_code_hash_delete(dhcp_universe.code_hash, &second->code, 0, MDL);
+    option_code_index_clear(&dhcp_universe, second->code);
+    if (option_code_lookup(&indexed, &dhcp_universe, 250, MDL)) {
+	atf_tc_fail("deleted option still found in the index");
+    }
+
+    option_dereference(&first, MDL);
+    option_dereference(&second, MDL);
+}
+
 ATF_TP_ADD_TCS(tp)
 {
     ATF_TP_ADD_TC(tp, option_refcnt);
     ATF_TP_ADD_TC(tp, pretty_print_option);
+    ATF_TP_ADD_TC(tp, parse_option_buffer_lazy);
+    ATF_TP_ADD_TC(tp, parse_option_buffer_batches);
+    ATF_TP_ADD_TC(tp, compiled_boolean_expression);
+    ATF_TP_ADD_TC(tp, expression_memo);
+    ATF_TP_ADD_TC(tp, option_cache_fold_constant);
+    ATF_TP_ADD_TC(tp, flattened_option_scope);
+    ATF_TP_ADD_TC(tp, store_options_priority);
+    ATF_TP_ADD_TC(tp, option_code_index);
 
     return (atf_no_error());
 }
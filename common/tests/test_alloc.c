@@ -553,6 +553,135 @@ ATF_TC_BODY(data_string_terminate, tc) {
     data_string_forget(&new_string, MDL);
 }
 
+ATF_TC(packet_arena);
+
+ATF_TC_HEAD(packet_arena, tc) {
+    atf_tc_set_md_var(tc, "descr", "packet_arena_alloc/free test");
+}
+
+ATF_TC_BODY(packet_arena, tc) {
+    unsigned char *a, *b, *c;
+    struct option_state *options = NULL;
+
+    packet_arena_enabled = 1;
+
+    /* Outside of a packet everything comes from dmalloc(). */
+    a = packet_arena_alloc(100, MDL);
+    if (a == NULL) {
+        atf_tc_fail("failed on allocate");
+    }
+    memset(a, 0xff, 100);
+    packet_arena_free(a, MDL);
+
+    /* Inside a packet allocations are carved out of one block, which
+     * is rewound once everything in it has been freed. */
+    packet_arena_begin();
+    a = packet_arena_alloc(100, MDL);
+    b = packet_arena_alloc(100, MDL);
+    if (a == NULL || b == NULL) {
+        atf_tc_fail("failed on allocate");
+    }
+    if (b <= a || b - a > 128) {
+        atf_tc_fail("allocations not adjacent");
+    }
+    memset(a, 0xff, 100);
+    memset(b, 0xff, 100);
+    packet_arena_free(a, MDL);
+    packet_arena_free(b, MDL);
+    c = packet_arena_alloc(100, MDL);
+    if (c != a) {
+        atf_tc_fail("block not rewound");
+    }
+    packet_arena_free(c, MDL);
+
+    /* Something that outlives its packet keeps the block pinned. */
+    a = packet_arena_alloc(100, MDL);
+    packet_arena_end();
+    packet_arena_begin();
+    b = packet_arena_alloc(100, MDL);
+    if (b == a) {
+        atf_tc_fail("live allocation reused");
+    }
+    packet_arena_free(a, MDL);
+    packet_arena_free(b, MDL);
+
+    /* Requests larger than a block still succeed. */
+    a = packet_arena_alloc(65536, MDL);
+    if (a == NULL) {
+        atf_tc_fail("failed on large allocate");
+    }
+    memset(a, 0xff, 65536);
+    packet_arena_free(a, MDL);
+
+    /* option_state_allocate() draws from the arena. */
+    if (!option_state_allocate(&options, MDL)) {
+        atf_tc_fail("option_state_allocate() failed");
+    }
+    option_state_dereference(&options, MDL);
+    packet_arena_end();
+
+    packet_arena_enabled = 0;
+}
+
+ATF_TC(omapi_pool);
+
+ATF_TC_HEAD(omapi_pool, tc) {
+    atf_tc_set_md_var(tc, "descr", "omapi_pool get/put/trim test");
+}
+
+ATF_TC_BODY(omapi_pool, tc) {
+    static omapi_pool_t pool =
+        OMAPI_POOL_INITIALIZER("test", struct data_string, 4, 8);
+    struct data_string *objs[40];
+    int i, j;
+
+    for (i = 0; i < 40; i++) {
+        objs[i] = omapi_pool_get(&pool, MDL);
+        if (objs[i] == NULL) {
+            atf_tc_fail("omapi_pool_get() failed");
+        }
+        if (objs[i]->buffer != NULL || objs[i]->len != 0) {
+            atf_tc_fail("object not zeroed");
+        }
+        for (j = 0; j < i; j++) {
+            if (objs[i] == objs[j]) {
+                atf_tc_fail("object handed out twice");
+            }
+        }
+        memset(objs[i], 0xff, sizeof(*objs[i]));
+    }
+    if (pool.in_use != 40 || pool.peak != 40 || pool.nslabs != 10 ||
+        pool.nfree != 0) {
+        atf_tc_fail("bad statistics after allocation");
+    }
+
+    /* Returning everything should give most slabs back, keeping at
+     * least high_water objects on hand. */
+    for (i = 0; i < 40; i++) {
+        omapi_pool_put(&pool, objs[i], MDL);
+    }
+    if (pool.in_use != 0 || pool.trims == 0) {
+        atf_tc_fail("pool not trimmed");
+    }
+    if (pool.nfree < 8 || pool.nslabs >= 10 ||
+        pool.nfree != pool.nslabs * 4) {
+        atf_tc_fail("bad statistics after trim: %lu free, %lu slabs",
+                    pool.nfree, pool.nslabs);
+    }
+
+    /* The pool still works after a trim. */
+    objs[0] = omapi_pool_get(&pool, MDL);
+    if (objs[0] == NULL) {
+        atf_tc_fail("omapi_pool_get() failed after trim");
+    }
+    omapi_pool_put(&pool, objs[0], MDL);
+
+    omapi_pool_relinquish(&pool);
+    if (pool.nslabs != 0 || pool.nfree != 0) {
+        atf_tc_fail("pool not relinquished");
+    }
+}
+
 void checkBuffer(size_t test_size, const char *file, int line) {
     char *buf;
     size_t max_size;
@@ -648,6 +777,8 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, data_string_copy_nobuf);
     ATF_TP_ADD_TC(tp, data_string_new);
     ATF_TP_ADD_TC(tp, data_string_terminate);
+    ATF_TP_ADD_TC(tp, packet_arena);
+    ATF_TP_ADD_TC(tp, omapi_pool);
 #if 0
     ATF_TP_ADD_TC(tp, dmalloc_max32);
 #endif
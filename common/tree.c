@@ -38,6 +38,15 @@
 struct binding_scope *global_scope;
 
 static int do_host_lookup (struct data_string *, struct dns_host_entry *);
+static int expr_is_constant (struct expression *);
+static int evaluate_data_expression_tree (struct data_string *,
+					  struct packet *, struct lease *,
+					  struct client_state *,
+					  struct option_state *,
+					  struct option_state *,
+					  struct binding_scope **,
+					  struct expression *,
+					  const char *, int);
 
 #define DS_SPRINTF_SIZE 128
 
@@ -409,6 +418,28 @@ int option_cache
 	return 1;
 }
 
+/* If the expression of a configured option cache can't depend on the
+   packet, lease or scope it is evaluated in, evaluate it once now and
+   keep the result in the cache.   evaluate_option_cache then hands out
+   the stored value, so store_options only has to copy it into the
+   reply.   The expression is kept for write_statements and for the
+   append and prepend statements. */
+void option_cache_fold_constant (struct option_cache *oc)
+{
+	struct data_string data;
+
+	if (!oc -> expression || oc -> data.data ||
+	    !expr_is_constant (oc -> expression))
+		return;
+
+	memset (&data, 0, sizeof data);
+	if (evaluate_data_expression (&data, NULL, NULL, NULL, NULL, NULL,
+				      NULL, oc -> expression, MDL)) {
+		data_string_copy (&oc -> data, &data, MDL);
+		data_string_forget (&data, MDL);
+	}
+}
+
 int make_let (result, name)
 	struct executable_statement **result;
 	const char *name;
@@ -1200,6 +1231,208 @@ int evaluate_boolean_expression
 	return 0;
 }
 
+/* Data expression memoization.
+
+   The same data expression is often evaluated several times for one
+   packet: a class match, a spawning class, a pool permit and an if
+   statement may all look at option agent.remote-id or at a substring
+   of the vendor class identifier.  Expressions whose value depends on
+   nothing but the packet and its options are remembered on the packet
+   the first time they are evaluated against the packet's own options,
+   and later evaluations copy the remembered value.  The memo is keyed
+   by expression node, is dropped whenever an option is added to or
+   deleted from the packet's option state, and goes away with the
+   packet. */
+
+int expression_memo_enabled;
+
+#define EXPR_MEMO_SIZE	16
+
+struct expr_memo {
+	unsigned generation;		/* of the packet's options */
+	int count;
+	struct {
+		struct expression *expr;
+		int status;
+		struct data_string value;
+	} entry [EXPR_MEMO_SIZE];
+};
+
+/* Return nonzero if expr evaluates to the same thing for a given packet
+   and option state no matter what lease, scope or configuration it is
+   evaluated in. */
+static int
+expr_packet_only(struct expression *expr)
+{
+	if (expr == NULL)
+		return 0;
+
+	switch (expr->op) {
+	      case expr_const_data:
+	      case expr_const_int:
+	      case expr_option:
+	      case expr_hardware:
+	      case expr_packet:
+		return 1;
+
+	      case expr_substring:
+		return (expr_packet_only(expr->data.substring.expr) &&
+			expr_packet_only(expr->data.substring.offset) &&
+			expr_packet_only(expr->data.substring.len));
+
+	      case expr_suffix:
+		return (expr_packet_only(expr->data.suffix.expr) &&
+			expr_packet_only(expr->data.suffix.len));
+
+	      case expr_lcase:
+		return expr_packet_only(expr->data.lcase);
+
+	      case expr_ucase:
+		return expr_packet_only(expr->data.ucase);
+
+	      case expr_concat:
+		return (expr_packet_only(expr->data.concat[0]) &&
+			expr_packet_only(expr->data.concat[1]));
+
+	      case expr_extract_int8:
+	      case expr_extract_int16:
+	      case expr_extract_int32:
+		return expr_packet_only(expr->data.extract_int);
+
+	      case expr_encode_int8:
+	      case expr_encode_int16:
+	      case expr_encode_int32:
+		return expr_packet_only(expr->data.encode_int);
+
+	      case expr_binary_to_ascii:
+		return (expr_packet_only(expr->data.b2a.base) &&
+			expr_packet_only(expr->data.b2a.width) &&
+			expr_packet_only(expr->data.b2a.separator) &&
+			expr_packet_only(expr->data.b2a.buffer));
+
+	      case expr_pick_first_value:
+		return (expr_packet_only(expr->data.pick_first_value.car) &&
+			(expr->data.pick_first_value.cdr == NULL ||
+			 expr_packet_only(expr->data.pick_first_value.cdr)));
+
+	      default:
+		return 0;
+	}
+}
+
+/* Return nonzero if the value of expr is worth remembering: it depends
+   on the packet alone and takes more than a constant to produce. */
+static int
+expr_memoizable(struct expression *expr)
+{
+	if (!(expr->flags & EXPR_MEMO_CHECKED)) {
+		if (!(expr->flags & EXPR_EPHEMERAL) &&
+		    expr->op != expr_const_data &&
+		    expr_packet_only(expr))
+			expr->flags |= EXPR_MEMOIZABLE;
+		expr->flags |= EXPR_MEMO_CHECKED;
+	}
+
+	return (expr->flags & EXPR_MEMOIZABLE) != 0;
+}
+
+/*!
+ * \brief Drop the data expression results remembered for a packet
+ *
+ * Called when the packet goes away, and by code that changes the raw
+ * packet after expressions may have been evaluated against it.
+ *
+ * \param packet the packet
+ */
+void
+expr_memo_forget(struct packet *packet)
+{
+	struct expr_memo *memo = packet->expr_memo;
+	int i;
+
+	if (memo == NULL)
+		return;
+
+	for (i = 0; i < memo->count; i++) {
+		data_string_forget(&memo->entry[i].value, MDL);
+		expression_dereference(&memo->entry[i].expr, MDL);
+	}
+	packet_arena_free(memo, MDL);
+	packet->expr_memo = NULL;
+}
+
+int evaluate_data_expression
+(
+	struct data_string *result,
+	struct packet *packet,
+	struct lease *lease,
+	struct client_state *client_state,
+	struct option_state *in_options,
+	struct option_state *cfg_options,
+	struct binding_scope **scope,
+	struct expression *expr,
+	const char *file,
+	int line
+)
+{
+	struct expr_memo *memo;
+	int i, status;
+
+	/* Only remember values computed from the packet's own options;
+	   on the client, hardware is the client's and not the packet's. */
+	if (!expression_memo_enabled || expr == NULL || packet == NULL ||
+	    in_options == NULL || in_options != packet->options ||
+	    client_state != NULL || !expr_memoizable(expr))
+		return evaluate_data_expression_tree(result, packet, lease,
+						     client_state, in_options,
+						     cfg_options, scope, expr,
+						     file, line);
+
+	memo = packet->expr_memo;
+	if (memo != NULL) {
+		if (memo->generation != in_options->generation) {
+			expr_memo_forget(packet);
+			memo = NULL;
+		} else {
+			for (i = 0; i < memo->count; i++) {
+				if (memo->entry[i].expr != expr)
+					continue;
+				if (memo->entry[i].status)
+					data_string_copy(result,
+							 &memo->entry[i].value,
+							 file, line);
+				return memo->entry[i].status;
+			}
+		}
+	}
+
+	status = evaluate_data_expression_tree(result, packet, lease,
+					       client_state, in_options,
+					       cfg_options, scope, expr,
+					       file, line);
+
+	/* Remember the result, unless evaluating it changed the options. */
+	if (memo == NULL) {
+		memo = packet_arena_alloc(sizeof(*memo), MDL);
+		if (memo == NULL)
+			return status;
+		memset(memo, 0, sizeof(*memo));
+		memo->generation = in_options->generation;
+		packet->expr_memo = memo;
+	}
+	if (memo->generation != in_options->generation ||
+	    memo->count == EXPR_MEMO_SIZE)
+		return status;
+
+	i = memo->count++;
+	expression_reference(&memo->entry[i].expr, expr, MDL);
+	memo->entry[i].status = status;
+	if (status)
+		data_string_copy(&memo->entry[i].value, result, MDL);
+
+	return status;
+}
+
 /*********************************************************************
 Func Name :   evaluate_data_expression
 Date Created: 2018/07/24
@@ -1210,7 +1443,7 @@ Output:
 Return:       int
 Caution : 	  
 *********************************************************************/
-int evaluate_data_expression 
+static int evaluate_data_expression_tree
 (
 	struct data_string *result,
 	struct packet *packet,
@@ -1966,16 +2199,16 @@ int evaluate_data_expression
 		return 0;
 
 	      case expr_host_decl_name:
-		if (!lease || !lease -> host) {
+		if (!lease || !LEASE_COLD_RO(lease)->host) {
 			log_error ("data: host_decl_name: not available");
 			return 0;
 		}
-		result -> len = strlen (lease -> host -> name);
+		result -> len = strlen (LEASE_COLD_RO(lease)->host -> name);
 		if (buffer_allocate (&result -> buffer,
 				     result -> len + 1, file, line)) {
 			result -> data = &result -> buffer -> data [0];
 			strcpy ((char *)&result -> buffer -> data [0],
-				lease -> host -> name);
+				LEASE_COLD_RO(lease)->host -> name);
 			result -> terminated = 1;
 		} else {
 			log_error ("data: host-decl-name: no memory.");
@@ -2904,9 +3137,9 @@ int evaluate_boolean_expression_result
 	if (!expr)
 		return 0;
 	
-	if (!evaluate_boolean_expression(&result, packet, lease, client_state,
-					  in_options, cfg_options,
-					  scope, expr))
+	if (!evaluate_boolean_expression_compiled(&result, packet, lease,
+						  client_state, in_options,
+						  cfg_options, scope, expr))
 		return 0;
 
 	if (result == 2) 
@@ -2919,6 +3152,864 @@ int evaluate_boolean_expression_result
 	
 	return result;
 }
+
+/* Compiled boolean expressions.
+
+   The predicates the server evaluates for every packet (class match
+   statements and if statements) are flattened on first use into a
+   linear program that runs on a small value stack.  Subtrees made up
+   only of constants are evaluated once when the program is built,
+   substring, suffix and packet operands are folded into the
+   instructions, and data values are handled as views of the option or
+   packet data they came from, so the usual comparison of an option
+   prefix against a string costs no allocation at all.  Any node the
+   program can't express is handed back to the tree walker, so the
+   result is always the one evaluate_boolean_expression would give. */
+
+int expression_compile_enabled;
+
+#define EXPR_VM_STACK	16
+#define EXPR_VM_SCRATCH	512
+
+enum expr_insn_op {
+	EXPR_I_BOOL,		/* push a constant boolean */
+	EXPR_I_FAIL,		/* push a value that failed to evaluate */
+	EXPR_I_DATA,		/* push a constant data string */
+	EXPR_I_INT,		/* push a constant integer */
+	EXPR_I_OPTION,		/* push an option from in_options */
+	EXPR_I_CONFIG_OPTION,	/* push an option from cfg_options */
+	EXPR_I_HARDWARE,
+	EXPR_I_PACKET,
+	EXPR_I_SUBSTRING,
+	EXPR_I_SUFFIX,
+	EXPR_I_LCASE,
+	EXPR_I_UCASE,
+	EXPR_I_CONCAT,
+	EXPR_I_EXTRACT_INT8,
+	EXPR_I_EXTRACT_INT16,
+	EXPR_I_EXTRACT_INT32,
+	EXPR_I_EXISTS,
+	EXPR_I_CHECK,
+	EXPR_I_KNOWN,
+	EXPR_I_STATIC,
+	EXPR_I_EQUAL,
+	EXPR_I_NOT,
+	EXPR_I_AND,		/* jump to target unless the top is true */
+	EXPR_I_AND_MERGE,
+	EXPR_I_OR,		/* jump to target if the top is true */
+	EXPR_I_OR_MERGE,
+	EXPR_I_TREE_BOOL,	/* evaluate the node with the tree walker */
+	EXPR_I_TREE_DATA,
+	EXPR_I_TREE_NUM
+};
+
+enum expr_value_kind {
+	EXPR_V_NONE,
+	EXPR_V_BOOL,
+	EXPR_V_NUM,
+	EXPR_V_DATA
+};
+
+/* EXPR_I_EQUAL flags. */
+#define EXPR_EQ_NOT		1	/* expr_not_equal */
+#define EXPR_EQ_MISMATCH	2	/* operands are of different types */
+
+struct expr_insn {
+	enum expr_insn_op op;
+	int arg;			/* jump target, equal flags or kind */
+	unsigned long offset, len;	/* folded constant operands */
+	struct expression *expr;	/* node this instruction came from */
+	struct data_string data;	/* constant data, if any */
+};
+
+struct expr_program {
+	int count;
+	struct expr_insn insns[1];
+};
+
+struct expr_compiler {
+	struct expr_insn *insns;
+	int count, max;
+	int depth, max_depth;
+	int failed;
+};
+
+/* A value that failed to evaluate has a false boolean unless it came
+   from the tree walker, which matches what the and, or and not cases of
+   evaluate_boolean_expression see from their operands. */
+struct expr_vm_value {
+	struct data_string data;	/* owned if data.buffer is set */
+	unsigned long intval;
+	int boolean;
+	int ok;
+};
+
+static int expr_compile_bool (struct expr_compiler *, struct expression *);
+static int expr_compile_data (struct expr_compiler *, struct expression *);
+static int expr_compile_num (struct expr_compiler *, struct expression *);
+
+/* Classify an operand the way evaluate_expression would bind it, or
+   return EXPR_V_NONE if its type is only known at run time. */
+static enum expr_value_kind expr_value_kind (struct expression *expr)
+{
+	if (expr -> op == expr_variable_reference ||
+	    expr -> op == expr_funcall)
+		return EXPR_V_NONE;
+	if (is_boolean_expression (expr))
+		return EXPR_V_BOOL;
+	if (is_numeric_expression (expr))
+		return EXPR_V_NUM;
+	if (is_data_expression (expr))
+		return EXPR_V_DATA;
+	return EXPR_V_NONE;
+}
+
+/* Return nonzero if the value of expr can't depend on the packet, the
+   lease or the scope it is evaluated in. */
+static int expr_is_constant (struct expression *expr)
+{
+	switch (expr -> op) {
+	      case expr_const_data:
+	      case expr_const_int:
+		return 1;
+
+	      case expr_substring:
+		return (expr_is_constant (expr -> data.substring.expr) &&
+			expr_is_constant (expr -> data.substring.offset) &&
+			expr_is_constant (expr -> data.substring.len));
+
+	      case expr_suffix:
+		return (expr_is_constant (expr -> data.suffix.expr) &&
+			expr_is_constant (expr -> data.suffix.len));
+
+	      case expr_equal:
+	      case expr_not_equal:
+	      case expr_concat:
+	      case expr_and:
+	      case expr_or:
+		return (expr_is_constant (expr -> data.equal [0]) &&
+			expr_is_constant (expr -> data.equal [1]));
+
+	      case expr_not:
+	      case expr_lcase:
+	      case expr_ucase:
+	      case expr_extract_int8:
+	      case expr_extract_int16:
+	      case expr_extract_int32:
+	      case expr_encode_int8:
+	      case expr_encode_int16:
+	      case expr_encode_int32:
+		return expr_is_constant (expr -> data.not);
+
+	      default:
+		return 0;
+	}
+}
+
+static struct expr_insn *expr_emit (struct expr_compiler *c,
+				    enum expr_insn_op op,
+				    struct expression *expr, int push)
+{
+	struct expr_insn *insn;
+
+	if (c -> count == c -> max) {
+		int max = c -> max ? c -> max * 2 : 16;
+		struct expr_insn *n;
+
+		n = dmalloc (max * sizeof *n, MDL);
+		if (!n) {
+			c -> failed = 1;
+			return NULL;
+		}
+		if (c -> insns) {
+			memcpy (n, c -> insns, c -> count * sizeof *n);
+			dfree (c -> insns, MDL);
+		}
+		c -> insns = n;
+		c -> max = max;
+	}
+
+	c -> depth += push;
+	if (c -> depth > c -> max_depth)
+		c -> max_depth = c -> depth;
+
+	insn = &c -> insns [c -> count++];
+	memset (insn, 0, sizeof *insn);
+	insn -> op = op;
+	insn -> expr = expr;
+	return insn;
+}
+
+/* Emit code that leaves the value of expr, of the given kind, on top
+   of the stack. */
+static int expr_compile_value (struct expr_compiler *c,
+			       struct expression *expr,
+			       enum expr_value_kind kind)
+{
+	switch (kind) {
+	      case EXPR_V_BOOL:
+		return expr_compile_bool (c, expr);
+	      case EXPR_V_NUM:
+		return expr_compile_num (c, expr);
+	      case EXPR_V_DATA:
+		return expr_compile_data (c, expr);
+	      default:
+		c -> failed = 1;
+		return 0;
+	}
+}
+
+static int expr_compile_bool (struct expr_compiler *c, struct expression *expr)
+{
+	struct expr_insn *insn;
+	enum expr_value_kind k0, k1;
+	int result, at;
+
+	if (expr_is_constant (expr)) {
+		result = 0;
+		if (evaluate_boolean_expression (&result, NULL, NULL, NULL,
+						 NULL, NULL, NULL, expr)) {
+			insn = expr_emit (c, EXPR_I_BOOL, expr, 1);
+			if (insn)
+				insn -> arg = result;
+		} else
+			insn = expr_emit (c, EXPR_I_FAIL, expr, 1);
+		return insn != NULL;
+	}
+
+	switch (expr -> op) {
+	      case expr_equal:
+	      case expr_not_equal:
+		k0 = expr_value_kind (expr -> data.equal [0]);
+		k1 = expr_value_kind (expr -> data.equal [1]);
+		if (k0 == EXPR_V_NONE || k1 == EXPR_V_NONE)
+			break;
+		if (!expr_compile_value (c, expr -> data.equal [0], k0) ||
+		    !expr_compile_value (c, expr -> data.equal [1], k1))
+			return 0;
+		insn = expr_emit (c, EXPR_I_EQUAL, expr, -1);
+		if (!insn)
+			return 0;
+		if (expr -> op == expr_not_equal)
+			insn -> arg |= EXPR_EQ_NOT;
+		if (k0 != k1)
+			insn -> arg |= EXPR_EQ_MISMATCH;
+		insn -> len = k0;
+		return 1;
+
+	      case expr_and:
+		if (!expr_compile_bool (c, expr -> data.and [0]))
+			return 0;
+		at = c -> count;
+		if (!expr_emit (c, EXPR_I_AND, expr, -1) ||
+		    !expr_compile_bool (c, expr -> data.and [1]) ||
+		    !expr_emit (c, EXPR_I_AND_MERGE, expr, 0))
+			return 0;
+		c -> insns [at].arg = c -> count;
+		return 1;
+
+	      case expr_or:
+		if (!expr_compile_bool (c, expr -> data.or [0]))
+			return 0;
+		at = c -> count;
+		if (!expr_emit (c, EXPR_I_OR, expr, 0) ||
+		    !expr_compile_bool (c, expr -> data.or [1]) ||
+		    !expr_emit (c, EXPR_I_OR_MERGE, expr, -1))
+			return 0;
+		c -> insns [at].arg = c -> count;
+		return 1;
+
+	      case expr_not:
+		if (!expr_compile_bool (c, expr -> data.not))
+			return 0;
+		return expr_emit (c, EXPR_I_NOT, expr, 0) != NULL;
+
+	      case expr_exists:
+		insn = expr_emit (c, EXPR_I_EXISTS, expr, 1);
+		return insn != NULL;
+
+	      case expr_check:
+		return expr_emit (c, EXPR_I_CHECK, expr, 1) != NULL;
+
+	      case expr_known:
+		return expr_emit (c, EXPR_I_KNOWN, expr, 1) != NULL;
+
+	      case expr_static:
+		return expr_emit (c, EXPR_I_STATIC, expr, 1) != NULL;
+
+	      default:
+		break;
+	}
+
+	return expr_emit (c, EXPR_I_TREE_BOOL, expr, 1) != NULL;
+}
+
+/* Fold a constant numeric operand, returning zero if it isn't one. */
+static int expr_constant_int (unsigned long *result, struct expression *expr)
+{
+	if (!expr_is_constant (expr))
+		return 0;
+	return evaluate_numeric_expression (result, NULL, NULL, NULL,
+					    NULL, NULL, NULL, expr);
+}
+
+static int expr_compile_data (struct expr_compiler *c, struct expression *expr)
+{
+	struct expr_insn *insn;
+	unsigned long offset, len;
+	struct data_string data;
+
+	if (expr_is_constant (expr)) {
+		memset (&data, 0, sizeof data);
+		if (evaluate_data_expression (&data, NULL, NULL, NULL,
+					      NULL, NULL, NULL, expr, MDL)) {
+			insn = expr_emit (c, EXPR_I_DATA, expr, 1);
+			if (insn)
+				insn -> data = data;
+			else
+				data_string_forget (&data, MDL);
+		} else
+			insn = expr_emit (c, EXPR_I_FAIL, expr, 1);
+		return insn != NULL;
+	}
+
+	switch (expr -> op) {
+	      case expr_option:
+		return expr_emit (c, EXPR_I_OPTION, expr, 1) != NULL;
+
+	      case expr_config_option:
+		return expr_emit (c, EXPR_I_CONFIG_OPTION, expr, 1) != NULL;
+
+	      case expr_hardware:
+		return expr_emit (c, EXPR_I_HARDWARE, expr, 1) != NULL;
+
+	      case expr_packet:
+		if (!expr_constant_int (&offset, expr -> data.packet.offset) ||
+		    !expr_constant_int (&len, expr -> data.packet.len))
+			break;
+		insn = expr_emit (c, EXPR_I_PACKET, expr, 1);
+		if (!insn)
+			return 0;
+		insn -> offset = offset;
+		insn -> len = len;
+		return 1;
+
+	      case expr_substring:
+		if (!expr_constant_int (&offset,
+					expr -> data.substring.offset) ||
+		    !expr_constant_int (&len, expr -> data.substring.len))
+			break;
+		if (!expr_compile_data (c, expr -> data.substring.expr))
+			return 0;
+		insn = expr_emit (c, EXPR_I_SUBSTRING, expr, 0);
+		if (!insn)
+			return 0;
+		insn -> offset = offset;
+		insn -> len = len;
+		return 1;
+
+	      case expr_suffix:
+		if (!expr_constant_int (&len, expr -> data.suffix.len))
+			break;
+		if (!expr_compile_data (c, expr -> data.suffix.expr))
+			return 0;
+		insn = expr_emit (c, EXPR_I_SUFFIX, expr, 0);
+		if (!insn)
+			return 0;
+		insn -> len = len;
+		return 1;
+
+	      case expr_lcase:
+	      case expr_ucase:
+		if (!expr_compile_data (c, expr -> data.lcase))
+			return 0;
+		return expr_emit (c, (expr -> op == expr_lcase
+				      ? EXPR_I_LCASE : EXPR_I_UCASE),
+				  expr, 0) != NULL;
+
+	      case expr_concat:
+		if (!expr_compile_data (c, expr -> data.concat [0]) ||
+		    !expr_compile_data (c, expr -> data.concat [1]))
+			return 0;
+		return expr_emit (c, EXPR_I_CONCAT, expr, -1) != NULL;
+
+	      default:
+		break;
+	}
+
+	return expr_emit (c, EXPR_I_TREE_DATA, expr, 1) != NULL;
+}
+
+static int expr_compile_num (struct expr_compiler *c, struct expression *expr)
+{
+	struct expr_insn *insn;
+	unsigned long value;
+
+	if (expr_is_constant (expr)) {
+		if (evaluate_numeric_expression (&value, NULL, NULL, NULL,
+						 NULL, NULL, NULL, expr)) {
+			insn = expr_emit (c, EXPR_I_INT, expr, 1);
+			if (insn)
+				insn -> offset = value;
+		} else
+			insn = expr_emit (c, EXPR_I_FAIL, expr, 1);
+		return insn != NULL;
+	}
+
+	switch (expr -> op) {
+	      case expr_extract_int8:
+	      case expr_extract_int16:
+	      case expr_extract_int32:
+		if (!expr_compile_data (c, expr -> data.extract_int))
+			return 0;
+		return expr_emit (c, (expr -> op == expr_extract_int8
+				      ? EXPR_I_EXTRACT_INT8
+				      : expr -> op == expr_extract_int16
+				      ? EXPR_I_EXTRACT_INT16
+				      : EXPR_I_EXTRACT_INT32),
+				  expr, 0) != NULL;
+
+	      default:
+		break;
+	}
+
+	return expr_emit (c, EXPR_I_TREE_NUM, expr, 1) != NULL;
+}
+
+static void expr_program_free (struct expr_program **pp)
+{
+	struct expr_program *prog = *pp;
+	int i;
+
+	*pp = NULL;
+	for (i = 0; i < prog -> count; i++)
+		if (prog -> insns [i].data.buffer)
+			data_string_forget (&prog -> insns [i].data, MDL);
+	dfree (prog, MDL);
+}
+
+/* Build the program for a boolean expression.   Returns NULL if the
+   expression is better left to the tree walker, either because nothing
+   in it can be compiled or because it is too deep for the value
+   stack. */
+static struct expr_program *expr_program_build (struct expression *expr)
+{
+	struct expr_compiler c;
+	struct expr_program *prog = NULL;
+	int i;
+
+	memset (&c, 0, sizeof c);
+	if (!expr_compile_bool (&c, expr))
+		c.failed = 1;
+
+	if (!c.failed && c.max_depth <= EXPR_VM_STACK &&
+	    !(c.count == 1 && c.insns [0].op == EXPR_I_TREE_BOOL)) {
+		prog = dmalloc (sizeof *prog +
+				(c.count - 1) * sizeof c.insns [0], MDL);
+		if (prog) {
+			prog -> count = c.count;
+			memcpy (prog -> insns, c.insns,
+				c.count * sizeof c.insns [0]);
+			c.count = 0;
+		}
+	}
+
+	/* Drop any constants that didn't make it into a program. */
+	for (i = 0; i < c.count; i++)
+		if (c.insns [i].data.buffer)
+			data_string_forget (&c.insns [i].data, MDL);
+	if (c.insns)
+		dfree (c.insns, MDL);
+	return prog;
+}
+
+static void expr_vm_release (struct expr_vm_value *v)
+{
+	if (v -> data.buffer)
+		data_string_forget (&v -> data, MDL);
+	v -> data.data = NULL;
+	v -> data.len = 0;
+}
+
+/* Find room for a len byte result, in the per-run scratch area if it
+   fits and in a buffer owned by the value otherwise. */
+static unsigned char *expr_vm_space (struct expr_vm_value *v, unsigned len,
+				     unsigned char *scratch, unsigned *used)
+{
+	memset (&v -> data, 0, sizeof v -> data);
+	if (*used + len <= EXPR_VM_SCRATCH) {
+		v -> data.data = scratch + *used;
+		v -> data.len = len;
+		*used += len;
+		return scratch + (*used - len);
+	}
+	if (!buffer_allocate (&v -> data.buffer, len, MDL))
+		return NULL;
+	v -> data.data = v -> data.buffer -> data;
+	v -> data.len = len;
+	return v -> data.buffer -> data;
+}
+
+static int expr_program_run (int *result, struct expr_program *prog,
+			     struct packet *packet, struct lease *lease,
+			     struct client_state *client_state,
+			     struct option_state *in_options,
+			     struct option_state *cfg_options,
+			     struct binding_scope **scope)
+{
+	struct expr_vm_value stack [EXPR_VM_STACK];
+	unsigned char scratch [EXPR_VM_SCRATCH];
+	struct expr_vm_value *top = stack - 1, *v, t;
+	struct expr_insn *insn;
+	struct expression *expr;
+	unsigned used = 0, i;
+	unsigned char *s;
+	int pc, eq, status;
+
+	for (pc = 0; pc < prog -> count; pc++) {
+		insn = &prog -> insns [pc];
+		expr = insn -> expr;
+
+		switch (insn -> op) {
+		      case EXPR_I_BOOL:
+		      case EXPR_I_FAIL:
+		      case EXPR_I_DATA:
+		      case EXPR_I_INT:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> ok = insn -> op != EXPR_I_FAIL;
+			v -> boolean = insn -> arg;
+			v -> intval = insn -> offset;
+			v -> data.data = insn -> data.data;
+			v -> data.len = insn -> data.len;
+			break;
+
+		      case EXPR_I_OPTION:
+		      case EXPR_I_CONFIG_OPTION:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			if (insn -> op == EXPR_I_OPTION)
+				v -> ok = (in_options &&
+					   get_option (&v -> data,
+						       expr -> data.option ->
+						       universe,
+						       packet, lease,
+						       client_state,
+						       in_options, cfg_options,
+						       in_options, scope,
+						       expr -> data.option ->
+						       code, MDL));
+			else
+				v -> ok = (cfg_options &&
+					   get_option (&v -> data,
+						       expr -> data.option ->
+						       universe,
+						       packet, lease,
+						       client_state,
+						       in_options, cfg_options,
+						       cfg_options, scope,
+						       expr -> data.option ->
+						       code, MDL));
+			break;
+
+		      case EXPR_I_HARDWARE:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			if (client_state) {
+				v -> data.data =
+				    client_state -> interface ->
+				    hw_address.hbuf;
+				v -> data.len =
+				    client_state -> interface ->
+				    hw_address.hlen;
+				v -> ok = 1;
+			} else if (packet && packet -> raw &&
+				   (packet -> raw -> hlen <=
+				    sizeof packet -> raw -> chaddr)) {
+				s = expr_vm_space (v, packet -> raw -> hlen + 1,
+						   scratch, &used);
+				if (s) {
+					s [0] = packet -> raw -> htype;
+					memcpy (s + 1, packet -> raw -> chaddr,
+						packet -> raw -> hlen);
+					v -> ok = 1;
+				}
+			} else if (!(packet && packet -> raw) && lease) {
+				v -> data.data = lease -> hardware_addr.hbuf;
+				v -> data.len = lease -> hardware_addr.hlen;
+				v -> ok = 1;
+			} else
+				/* Let the tree walker log the failure. */
+				v -> ok = evaluate_data_expression
+					(&v -> data, packet, lease,
+					 client_state, in_options,
+					 cfg_options, scope, expr, MDL);
+			break;
+
+		      case EXPR_I_PACKET:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			if (!packet || !packet -> raw) {
+				log_error ("data: packet: "
+					   "raw packet not available");
+				break;
+			}
+			if (insn -> offset < packet -> packet_length) {
+				v -> data.data = (((unsigned char *)
+						   (packet -> raw)) +
+						  insn -> offset);
+				v -> data.len = packet -> packet_length -
+						insn -> offset;
+				if (v -> data.len > insn -> len)
+					v -> data.len = insn -> len;
+				v -> ok = 1;
+			}
+			break;
+
+		      case EXPR_I_SUBSTRING:
+			if (!top -> ok)
+				break;
+			if (top -> data.len > insn -> offset) {
+				top -> data.data += insn -> offset;
+				top -> data.len -= insn -> offset;
+				if (top -> data.len > insn -> len)
+					top -> data.len = insn -> len;
+			} else
+				expr_vm_release (top);
+			break;
+
+		      case EXPR_I_SUFFIX:
+			if (top -> ok && top -> data.len > insn -> len) {
+				top -> data.data += (top -> data.len -
+						     insn -> len);
+				top -> data.len = insn -> len;
+			}
+			break;
+
+		      case EXPR_I_LCASE:
+		      case EXPR_I_UCASE:
+			if (!top -> ok)
+				break;
+			s = expr_vm_space (&t, top -> data.len,
+					   scratch, &used);
+			if (s) {
+				for (i = 0; i < top -> data.len; i++)
+					s [i] = (insn -> op == EXPR_I_LCASE
+						 ? tolower (top -> data.data [i])
+						 : toupper (top -> data.data [i]));
+			} else
+				log_error ("data: lcase: no buffer memory.");
+			expr_vm_release (top);
+			top -> data = t.data;
+			top -> ok = s != NULL;
+			break;
+
+		      case EXPR_I_CONCAT:
+			v = top--;
+			s = NULL;
+			if (top -> ok && v -> ok) {
+				s = expr_vm_space (&t,
+						   top -> data.len +
+						   v -> data.len,
+						   scratch, &used);
+				if (s) {
+					if (top -> data.len)
+						memcpy (s, top -> data.data,
+							top -> data.len);
+					if (v -> data.len)
+						memcpy (s + top -> data.len,
+							v -> data.data,
+							v -> data.len);
+				} else
+					log_error ("data: concat: no memory");
+			}
+			expr_vm_release (v);
+			expr_vm_release (top);
+			if (s)
+				top -> data = t.data;
+			top -> ok = s != NULL;
+			break;
+
+		      case EXPR_I_EXTRACT_INT8:
+		      case EXPR_I_EXTRACT_INT16:
+		      case EXPR_I_EXTRACT_INT32:
+			status = 0;
+			if (top -> ok) {
+				if (insn -> op == EXPR_I_EXTRACT_INT8 &&
+				    top -> data.len >= 1) {
+					top -> intval = top -> data.data [0];
+					status = 1;
+				} else if (insn -> op == EXPR_I_EXTRACT_INT16 &&
+					   top -> data.len >= 2) {
+					top -> intval =
+						getUShort (top -> data.data);
+					status = 1;
+				} else if (insn -> op == EXPR_I_EXTRACT_INT32 &&
+					   top -> data.len >= 4) {
+					top -> intval =
+						getULong (top -> data.data);
+					status = 1;
+				}
+			}
+			expr_vm_release (top);
+			top -> ok = status;
+			break;
+
+		      case EXPR_I_EXISTS:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> ok = 1;
+			if (in_options &&
+			    get_option (&v -> data,
+					expr -> data.exists -> universe,
+					packet, lease, client_state,
+					in_options, cfg_options, in_options,
+					scope, expr -> data.exists -> code,
+					MDL)) {
+				v -> boolean = 1;
+				expr_vm_release (v);
+			}
+			break;
+
+		      case EXPR_I_CHECK:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> boolean = check_collection (packet, lease,
+							 expr -> data.check);
+			v -> ok = 1;
+			break;
+
+		      case EXPR_I_KNOWN:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			if (packet) {
+				v -> boolean = packet -> known;
+				v -> ok = 1;
+			}
+			break;
+
+		      case EXPR_I_STATIC:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> boolean = (lease &&
+					(lease -> flags & STATIC_LEASE)) ? 1 : 0;
+			v -> ok = 1;
+			break;
+
+		      case EXPR_I_EQUAL:
+			v = top--;
+			if (top -> ok && v -> ok) {
+				if (insn -> arg & EXPR_EQ_MISMATCH)
+					eq = 0;
+				else if (insn -> len == EXPR_V_DATA)
+					eq = (top -> data.len == v -> data.len &&
+					      (!v -> data.len ||
+					       !memcmp (top -> data.data,
+							v -> data.data,
+							v -> data.len)));
+				else if (insn -> len == EXPR_V_NUM)
+					eq = top -> intval == v -> intval;
+				else
+					eq = top -> boolean == v -> boolean;
+			} else
+				eq = !top -> ok && !v -> ok;
+			expr_vm_release (v);
+			expr_vm_release (top);
+			top -> boolean = (insn -> arg & EXPR_EQ_NOT) ? !eq : eq;
+			top -> ok = 1;
+			break;
+
+		      case EXPR_I_NOT:
+			top -> boolean = top -> ok && !top -> boolean;
+			break;
+
+		      case EXPR_I_AND:
+			if (top -> ok && top -> boolean) {
+				top--;
+				break;
+			}
+			top -> ok = top -> boolean = 0;
+			pc = insn -> arg - 1;
+			break;
+
+		      case EXPR_I_AND_MERGE:
+			top -> boolean = top -> ok && top -> boolean;
+			break;
+
+		      case EXPR_I_OR:
+			if (top -> ok && top -> boolean) {
+				top -> boolean = 1;
+				pc = insn -> arg - 1;
+			}
+			break;
+
+		      case EXPR_I_OR_MERGE:
+			v = top--;
+			top -> ok = top -> ok || v -> ok;
+			top -> boolean = (top -> ok &&
+					  (top -> boolean || v -> boolean));
+			break;
+
+		      case EXPR_I_TREE_BOOL:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> ok = evaluate_boolean_expression
+				(&v -> boolean, packet, lease, client_state,
+				 in_options, cfg_options, scope, expr);
+			break;
+
+		      case EXPR_I_TREE_DATA:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> ok = evaluate_data_expression
+				(&v -> data, packet, lease, client_state,
+				 in_options, cfg_options, scope, expr, MDL);
+			break;
+
+		      case EXPR_I_TREE_NUM:
+			v = ++top;
+			memset (v, 0, sizeof *v);
+			v -> ok = evaluate_numeric_expression
+				(&v -> intval, packet, lease, client_state,
+				 in_options, cfg_options, scope, expr);
+			break;
+		}
+	}
+
+	if (!top -> ok)
+		return 0;
+	*result = top -> boolean;
+	return 1;
+}
+
+/* Evaluate a boolean expression through its compiled program, building
+   the program the first time the expression is seen.   Behaves exactly
+   like evaluate_boolean_expression. */
+int evaluate_boolean_expression_compiled
+(
+	int *result,
+	struct packet *packet,
+	struct lease *lease,
+	struct client_state *client_state,
+	struct option_state *in_options,
+	struct option_state *cfg_options,
+	struct binding_scope **scope,
+	struct expression *expr
+)
+{
+	if (expression_compile_enabled &&
+	    !(expr -> flags & (EXPR_COMPILED | EXPR_EPHEMERAL))) {
+		expr -> flags |= EXPR_COMPILED;
+		expr -> program = expr_program_build (expr);
+	}
+	if (expr -> program)
+		return expr_program_run (result, expr -> program, packet,
+					 lease, client_state, in_options,
+					 cfg_options, scope);
+	return evaluate_boolean_expression (result, packet, lease,
+					    client_state, in_options,
+					    cfg_options, scope, expr);
+}
 		
 
 /* Dereference an expression node, and if the reference count goes to zero,
@@ -3138,6 +4229,8 @@ void expression_dereference (eptr, file, line)
 	      default:
 		break;
 	}
+	if (expr -> program)
+		expr_program_free (&expr -> program);
 	free_expression (expr, MDL);
 }
 
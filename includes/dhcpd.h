@@ -112,6 +112,14 @@ typedef time_t TIME;
 # define BYTE_CODE_HASH_SIZE	254	/* Default would be ridiculous. */
 #endif
 
+/* Codes below this are looked up in a direct index in the built-in
+ * option spaces, which covers all but a couple of the options those
+ * spaces define; larger codes still go through the code hash.
+ */
+#if !defined (OPTION_CODE_INDEX_SIZE)
+# define OPTION_CODE_INDEX_SIZE	256
+#endif
+
 /* Although it is highly improbable that a 16-bit option space might
  * actually use 2^16 actual defined options, it is the worst case
  * scenario we must prepare for.  Having 4 options per bucket in this
@@ -394,11 +402,26 @@ struct option_cache {
 	u_int32_t flags;
 };
 
+/* DHCPv4 options that have been located in a received packet but not yet
+   decoded into option caches.  Lookups decode them on demand; see
+   parse_options(). */
+struct option_index {
+	struct option_index *next;	/* free list */
+	struct universe *universe;
+	struct buffer *buffer;
+	int pending;
+	u_int16_t offset [256];		/* offset + 1 into buffer, 0 if none */
+	u_int8_t length [256];
+};
+
 struct option_state {
 	int refcnt;
 	int universe_count;
 	int site_universe;
 	int site_code_min;
+	struct option_index *index;
+	unsigned generation;		/* bumped when options are added
+					   or deleted */
 	void *universes [1];
 };
 
@@ -437,7 +460,9 @@ struct packet {
 					   of local sender (maybe gateway). */
 
 	/* Information for relay agent options (see
-	   draft-ietf-dhc-agent-options-xx.txt). */
+	   draft-ietf-dhc-agent-options-xx.txt).  In the server these
+	   are filled in by packet_index_relay_ids(); a DHCPv6 relay
+	   message records its interface-id and remote-id here. */
 	u_int8_t *circuit_id;		/* Circuit ID of client connection. */
 	int circuit_id_len;
 	u_int8_t *remote_id;		/* Remote ID of client. */
@@ -476,6 +501,9 @@ struct packet {
 
 	/* Relay port check */
 	isc_boolean_t relay_source_port;
+
+	/* Data expression results already computed for this packet. */
+	struct expr_memo *expr_memo;
 };
 
 /*
@@ -553,37 +581,49 @@ struct on_star {
 	struct executable_statement *on_release;
 };
 
-/* A dhcp lease declaration structure. */
+/* A dhcp lease declaration structure.
+
+   Leases are kept in large arrays, one struct lease per address, and
+   walked by the pool timer and by allocate_lease(), which only look at
+   the queue links, the times, the binding states and the client
+   identity.  Everything that is only needed once a particular lease
+   has been picked (the host name, scopes, statements, failover and
+   DDNS bookkeeping) lives in a struct lease_cold of its own, which is
+   only allocated once one of its fields is set.  That keeps the array
+   dense for the scans, and an address that has never been leased
+   costs no more than its struct lease. */
 struct lease {
 	OMAPI_OBJECT_PREAMBLE;
 	struct lease *next;
 #if defined (BINARY_LEASES)
 	struct lease *prev;
 	struct leasechain *lc;
-#endif
-	struct lease *n_uid, *n_hw;
-
-	struct iaddr ip_addr;
-	TIME starts, ends, sort_time;
-#if defined (BINARY_LEASES)
 	long int sort_tiebreaker;
 #endif
-	char *client_hostname;
-	struct binding_scope *scope;
-	struct host_decl *host;
-	struct subnet *subnet;
-	struct pool *pool;
-	struct class *billing_class;
-	struct option_chain_head *agent_options;
+	TIME starts, ends, sort_time;
+	TIME tsfp;	/* Time sent from partner, see struct lease_cold. */
+	struct iaddr ip_addr;
 
-	/* insert the structure directly */
-	struct on_star on_star;
+	/*
+	 * The lease's binding state is its current state.  The next binding
+	 * state is the next state this lease will move into by expiration,
+	 * or timers in general.  The desired binding state is used on lease
+	 * updates; the caller is attempting to move the lease to the desired
+	 * binding state (and this may either succeed or fail, so the binding
+	 * state must be preserved).
+	 *
+	 * The 'rewind' binding state is used in failover processing.  It
+	 * is used for an optimization when out of communications; it allows
+	 * the server to "rewind" a lease to the previous state acknowledged
+	 * by the peer, and progress forward from that point.
+	 */
+	binding_state_t binding_state;
+	binding_state_t next_binding_state;
+	binding_state_t desired_binding_state;
+	binding_state_t rewind_binding_state;
 
-	unsigned char *uid;
-	unsigned short uid_len;
-	unsigned short uid_max;
-	unsigned char uid_buf [7];
-	struct hardware hardware_addr;
+	struct pool *pool;
+	struct subnet *subnet;
 
 	u_int8_t flags;
 #       define STATIC_LEASE		1
@@ -604,23 +644,30 @@ struct lease {
 					 RESERVED_LEASE | \
 					 BOOTP_LEASE)
 
-	/*
-	 * The lease's binding state is its current state.  The next binding
-	 * state is the next state this lease will move into by expiration,
-	 * or timers in general.  The desired binding state is used on lease
-	 * updates; the caller is attempting to move the lease to the desired
-	 * binding state (and this may either succeed or fail, so the binding
-	 * state must be preserved).
-	 *
-	 * The 'rewind' binding state is used in failover processing.  It
-	 * is used for an optimization when out of communications; it allows
-	 * the server to "rewind" a lease to the previous state acknowledged
-	 * by the peer, and progress forward from that point.
-	 */
-	binding_state_t binding_state;
-	binding_state_t next_binding_state;
-	binding_state_t desired_binding_state;
-	binding_state_t rewind_binding_state;
+	/* Set when a lease has been disqualified for cache-threshold reuse */
+	unsigned short cannot_reuse;
+
+	unsigned short uid_len;
+	unsigned short uid_max;
+	struct hardware hardware_addr;
+	unsigned char uid_buf [7];
+	unsigned char *uid;
+	struct lease *n_uid, *n_hw;
+
+	/* Use LEASE_COLD() or LEASE_COLD_RO() to get at this. */
+	struct lease_cold *cold;
+};
+
+/* The part of a lease that is only looked at once it has been picked. */
+struct lease_cold {
+	char *client_hostname;		/* interned, see intern_string() */
+	struct binding_scope *scope;
+	struct host_decl *host;
+	struct class *billing_class;
+	struct option_chain_head *agent_options;
+
+	/* insert the structure directly */
+	struct on_star on_star;
 
 	struct lease_state *state;
 
@@ -629,10 +676,11 @@ struct lease {
 	 * stos+mclt for example if it's an expired lease and the server is
 	 * in partner-down state.  'atsfp' is zeroed whenever a lease is
 	 * updated - and only set when the peer acknowledges it.  This
-	 * ensures every state change is transmitted.
+	 * ensures every state change is transmitted.  (tsfp itself is kept
+	 * in struct lease, as lease_mine_to_reallocate() checks it for every
+	 * candidate lease.)
 	 */
 	TIME tstp;	/* Time sent to partner. */
-	TIME tsfp;	/* Time sent from partner. */
 	TIME atsfp;	/* Actual time sent from partner. */
 	TIME cltt;	/* Client last transaction time. */
 	u_int32_t last_xid; /* XID we sent in this lease's BNDUPD */
@@ -645,11 +693,18 @@ struct lease {
 	 * update if we want to do a different update.
 	 */
 	struct dhcp_ddns_cb *ddns_cb;
-
-	/* Set when a lease has been disqualified for cache-threshold reuse */
-	unsigned short cannot_reuse;
 };
 
+/* LEASE_COLD() gives the cold part of a lease, allocating it if the
+   lease has none yet, and must be used to change any of its fields.
+   LEASE_COLD_RO() only reads them: a lease without a cold part reads
+   as all zeroes, and the compiler refuses writes through it. */
+#define LEASE_COLD(l) \
+	((l)->cold != NULL ? (l)->cold : lease_cold_allocate(l))
+#define LEASE_COLD_RO(l) \
+	((l)->cold != NULL ? (const struct lease_cold *)(l)->cold : \
+			     &lease_cold_none)
+
 struct lease_state {
 	struct lease_state *next;
 
@@ -951,6 +1006,7 @@ struct group {
 	struct shared_network *shared_network;
 	int authoritative;
 	struct executable_statement *statements;
+	struct group_flat *flat;	/* flattened option scopes */
 };
 
 /* A dhcp host declaration structure. */
@@ -1036,6 +1092,10 @@ struct pool {
 #endif
 	int logged;		/* already logged a message */
 	int low_threshold;	/* low threshold to restart logging */
+
+	/* dhcp-cache-threshold reuse decisions, see reuse_lease() */
+	unsigned long reuse_hits;
+	unsigned long reuse_misses;
 };
 
 struct shared_network {
@@ -1050,6 +1110,7 @@ struct shared_network {
 	struct interface_info *interface;
 	struct pool *pools;
 	struct ipv6_pond *ipv6_pond;
+	int ipv6_pool_types;	/* IPV6_POOL_TYPE_BIT()s of its pools */
 	struct group *group;
 #if defined (FAILOVER_PROTOCOL)
 	dhcp_failover_state_t *failover_peer;
@@ -1069,11 +1130,20 @@ struct subnet {
 	struct group *group;
 };
 
+/* Number of relay link addresses (giaddr, link selection or DHCPv6
+   link-address) whose shared network find_link_network() remembers. */
+#ifndef LINK_NETWORK_CACHE_SIZE
+#define LINK_NETWORK_CACHE_SIZE	256
+#endif
+
 struct collection {
 	struct collection *next;
 
 	const char *name;
 	struct class *classes;
+
+	/* Compiled form of the classes' match expressions (class.c). */
+	struct class_matcher *matcher;
 };
 
 /* Used as an argument to parse_class_decl() */
@@ -1654,6 +1724,11 @@ struct iasubopt {
 	/* space for the on * executable statements */
 	struct on_star on_star;
 	int static_lease;
+
+	/* lease file serial of the last full IA record written for this
+	 * iasubopt (0 if none), and a fingerprint of what it held */
+	u_int32_t write_serial;
+	u_int32_t write_hash;
 };
 
 struct ia_xx {
@@ -1664,6 +1739,8 @@ struct ia_xx {
 	int max_iasubopt;		/* space available for IAADDR/PREFIX */
 	time_t cltt;			/* client last transaction time */
 	struct iasubopt **iasubopt;	/* pointers to the IAADDR/IAPREFIXs */
+	struct ia_xx *duid_next;	/* next in the DUID index */
+	int duid_indexed;		/* on the DUID index */
 };
 
 extern ia_hash_t *ia_na_active;
@@ -1696,6 +1773,9 @@ struct ipv6_pool {
 	struct in6_addr start_addr;		/* first IPv6 address */
 	int bits;				/* number of bits, CIDR style */
 	int units;				/* allocation unit in bits */
+	isc_uint64_t num_total;			/* addresses or prefixes in
+						   the pool, ISC_UINT64_MAX
+						   if there are more */
 	iasubopt_hash_t *leases;		/* non-free leases */
 	isc_uint64_t num_active;		/* count of active leases */
 	isc_uint64_t num_abandoned;		/* count of abandoned leases */
@@ -1707,8 +1787,70 @@ struct ipv6_pool {
 						   this pool */
 	struct subnet *subnet;			/* subnet for this pool */
 	struct ipv6_pond *ipv6_pond;		/* pond for this pool */
+	isc_uint64_t *in_use_map;		/* bit set for each address
+						   in leases, NULL for large
+						   and prefix pools */
+	isc_uint32_t map_size;			/* number of bits in map */
+	time_t next_timeout;			/* when expiry work is next
+						   due */
+	unsigned int timeout_index;		/* place in the expiry heap,
+						   0 if not on it */
+	time_t drain_end;			/* when every binding must
+						   be gone, 0 if the pool
+						   is not being drained */
+	struct iasubopt **drain_list;		/* bindings the drain has
+						   still to shorten */
+	unsigned int drain_count;		/* entries in drain_list */
+	unsigned int drain_next;		/* next one to shorten */
+	struct pool6_object *pool6;		/* OMAPI handle on the pool,
+						   made on first lookup */
+	struct prefix_tree *prefix_tree;	/* free blocks of a prefix
+						   pool, shared by prefix
+						   pools over the same
+						   range */
+};
+
+/* OMAPI handle on an IPv6 pool.  The pool holds the only reference
+   to it, so that its handle stays good for as long as the pool does;
+   the back pointer is not counted, and is cleared when the pool goes
+   away. */
+struct pool6_object {
+	OMAPI_OBJECT_PREAMBLE;
+	struct ipv6_pool *ipv6_pool;
 };
 
+/* Flag for a pool of the given IA type in shared_network.ipv6_pool_types. */
+#define IPV6_POOL_TYPE_BIT(type) \
+	(((type) == D6O_IA_NA) ? 1 : (((type) == D6O_IA_TA) ? 2 : 4))
+
+/*
+ * Address pools of no more than 2^V6_POOL_MAP_BITS addresses keep an
+ * in_use_map, so that once the hashed choice for a client is taken the
+ * next free one is found by scanning the map rather than by probing the
+ * lease hash at random.  Larger pools fall back to hashing alone.  0
+ * turns the maps off.  Prefix delegation pools keep a prefix_tree of
+ * their free blocks instead (see server/mdb6.c).
+ */
+#ifndef V6_POOL_MAP_BITS
+#define V6_POOL_MAP_BITS	20
+#endif
+
+/*
+ * The most leases expired (or expired leases cleaned up) in one go by
+ * the IPv6 expiry timer before it lets the server get back to packets.
+ */
+#ifndef V6_EXPIRY_SLICE
+#define V6_EXPIRY_SLICE		1000
+#endif
+
+/*
+ * The most bindings a pool drain shortens in one go before it lets the
+ * server get back to packets.
+ */
+#ifndef V6_DRAIN_SLICE
+#define V6_DRAIN_SLICE		1000
+#endif
+
 /*!
  *
  * \brief ipv6_pond structure
@@ -1731,9 +1873,9 @@ struct ipv6_pond {
 	TIME valid_from;		/* deny pool use before this date */
 	TIME valid_until;		/* deny pool use after this date */
 
-	struct ipv6_pool **ipv6_pools;	/* NULL-terminated array */
-	int last_ipv6_pool;		/* offset of last IPv6 pool
-					   used to issue a lease */
+	struct ipv6_pool **ipv6_pools;	/* NULL-terminated array, in
+					   order of free capacity when
+					   allocating */
 	isc_uint64_t num_total;	    /* Total number of elements in the pond */
 	isc_uint64_t num_active;    /* Number of elements in the pond in use */
 	isc_uint64_t num_abandoned;	/* count of abandoned leases */
@@ -1851,7 +1993,11 @@ HASH_FUNCTIONS_DECL (class, const char *, struct class, class_hash_t)
 /* options.c */
 
 extern struct option *vendor_cfg_option;
+extern int lazy_option_decode;
 int parse_options (struct packet *);
+int option_index_attach (struct option_state *, struct universe *);
+void option_index_detach (struct option_state *);
+void option_state_materialize (struct option_state *, struct universe *);
 int parse_option_buffer (struct option_state *, const unsigned char *,
 			 unsigned, struct universe *);
 struct universe *find_option_universe (struct option *, const char *);
@@ -2326,6 +2472,7 @@ int make_let (struct executable_statement **, const char *);
 int option_cache (struct option_cache **, struct data_string *,
 		  struct expression *, struct option *,
 		  const char *, int);
+void option_cache_fold_constant (struct option_cache *);
 int evaluate_expression (struct binding_value **, struct packet *,
 			 struct lease *, struct client_state *,
 			 struct option_state *, struct option_state *,
@@ -2374,6 +2521,16 @@ int evaluate_boolean_expression_result (int *,
 					struct option_state *,
 					struct binding_scope **,
 					struct expression *);
+extern int expression_compile_enabled;
+extern int expression_memo_enabled;
+void expr_memo_forget(struct packet *);
+int evaluate_boolean_expression_compiled (int *,
+					  struct packet *, struct lease *,
+					  struct client_state *,
+					  struct option_state *,
+					  struct option_state *,
+					  struct binding_scope **,
+					  struct expression *);
 void expression_dereference (struct expression **, const char *, int);
 int is_dns_expression (struct expression *);
 int is_boolean_expression (struct expression *);
@@ -2407,6 +2564,25 @@ extern int max_outstanding_acks;
 extern int max_ack_delay_secs;
 extern int max_ack_delay_usecs;
 
+/* Outcomes of the dhcp-cache-threshold reuse decision made by reuse_lease().
+   REUSE_OK is the only verdict which allows the existing lease to be
+   returned unaltered; all others are counted as misses.  The order of the
+   entries matches the order in which reuse_lease() applies its tests. */
+enum reuse_verdict {
+	REUSE_OK = 0,
+	REUSE_DISQUALIFIED,
+	REUSE_NOT_ACTIVE,
+	REUSE_DDNS,
+	REUSE_HOST_CHANGED,
+	REUSE_UID_CHANGED,
+	REUSE_HW_CHANGED,
+	REUSE_DISABLED,
+	REUSE_TOO_OLD,
+	REUSE_FAILOVER_MCLT,
+	REUSE_VERDICT_COUNT
+};
+extern unsigned long reuse_verdict_counts[REUSE_VERDICT_COUNT];
+
 void dhcp (struct packet *);
 void dhcpdiscover (struct packet *, int);
 void dhcprequest (struct packet *, int, struct lease *);
@@ -2420,6 +2596,9 @@ void echo_client_id(struct packet*, struct lease*, struct option_state*,
 		    struct option_state*);
 
 void dhcp_reply (struct lease *);
+int reuse_lease (struct packet *, struct lease *, struct lease *,
+		 struct lease_state *, int);
+void log_lease_reuse_statistics (void);
 int find_lease (struct lease **, struct packet *,
 		struct shared_network *, int *, int *, struct lease *,
 		const char *, int);
@@ -2446,6 +2625,9 @@ void eval_network_statements(struct option_state **options,
 			    struct group *network_group);
 
 u_int16_t dhcp_check_relayport(struct packet *packet);
+void packet_index_relay_ids(struct packet *packet);
+int packet_relay_id(struct packet *packet, unsigned code,
+		    struct data_string *result);
 
 /* dhcpleasequery.c */
 void dhcpleasequery (struct packet *, int);
@@ -2485,7 +2667,11 @@ OMAPI_OBJECT_ALLOC_DECL (lease, struct lease, dhcp_type_lease)
 OMAPI_OBJECT_ALLOC_DECL (class, struct class, dhcp_type_class)
 OMAPI_OBJECT_ALLOC_DECL (subclass, struct class, dhcp_type_subclass)
 OMAPI_OBJECT_ALLOC_DECL (pool, struct pool, dhcp_type_pool)
+OMAPI_OBJECT_ALLOC_DECL (pool6, struct pool6_object, dhcp_type_pool6)
 OMAPI_OBJECT_ALLOC_DECL (host, struct host_decl, dhcp_type_host)
+char *intern_string(const char *, unsigned, const char *, int);
+char *intern_string_reference(char *);
+void intern_string_release(char **, const char *, int);
 
 /* alloc.c */
 OMAPI_OBJECT_ALLOC_DECL (subnet, struct subnet, dhcp_type_subnet)
@@ -2502,6 +2688,7 @@ void relinquish_free_expressions (void);
 void relinquish_free_binding_values (void);
 void relinquish_free_option_caches (void);
 void relinquish_free_packets (void);
+void relinquish_packet_arena (void);
 #endif
 
 int option_chain_head_allocate (struct option_chain_head **,
@@ -2564,6 +2751,11 @@ int dns_host_entry_reference (struct dns_host_entry **,
 			      const char *, int);
 int dns_host_entry_dereference (struct dns_host_entry **,
 				const char *, int);
+extern int packet_arena_enabled;
+void packet_arena_begin (void);
+void packet_arena_end (void);
+void *packet_arena_alloc (unsigned, const char *, int);
+void packet_arena_free (void *, const char *, int);
 int option_state_allocate (struct option_state **, const char *, int);
 int option_state_reference (struct option_state **,
 			    struct option_state *, const char *, int);
@@ -2590,6 +2782,8 @@ int binding_scope_allocate (struct binding_scope **,
 int binding_scope_reference (struct binding_scope **,
 			     struct binding_scope *,
 			     const char *, int);
+extern const struct lease_cold lease_cold_none;
+struct lease_cold *lease_cold_allocate (struct lease *);
 int dns_zone_allocate (struct dns_zone **, const char *, int);
 int dns_zone_reference (struct dns_zone **,
 			struct dns_zone *, const char *, int);
@@ -2610,6 +2804,7 @@ void dump_packet_option (struct option_cache *, struct packet *,
 			 struct binding_scope **, struct universe *, void *);
 void dump_packet (struct packet *);
 void hash_dump (struct hash_table *);
+char *hex_encode (char *, const unsigned char *, unsigned, int);
 char *print_hex (unsigned, const u_int8_t *, unsigned, unsigned);
 void print_hex_only (unsigned, const u_int8_t *, unsigned, char *);
 void print_hex_or_string (unsigned, const u_int8_t *, unsigned, char *);
@@ -2911,6 +3106,11 @@ extern int universe_count, universe_max;
 extern struct universe **universes;
 extern universe_hash_t *universe_hash;
 void initialize_common_option_spaces (void);
+void option_code_index_init(struct universe *, struct option *);
+void option_code_index_set(struct universe *, struct option *);
+void option_code_index_clear(struct universe *, unsigned);
+int option_code_lookup(struct option **, struct universe *, unsigned,
+		       const char *, int);
 extern struct universe *config_universe;
 
 /* stables.c */
@@ -3233,7 +3433,9 @@ extern struct executable_statement *default_classification_rules;
 
 void classification_setup (void);
 void classify_client (struct packet *);
+void class_match_invalidate (void);
 int check_collection (struct packet *, struct lease *, struct collection *);
+int check_classes (struct packet *, struct lease *, struct class *);
 void classify (struct packet *, struct class *);
 isc_result_t unlink_class (struct class **class);
 isc_result_t find_class (struct class **, const char *,
@@ -3259,6 +3461,8 @@ void execute_statements_in_scope (struct binding_value **result,
 				  struct on_star *);
 int executable_statement_dereference (struct executable_statement **,
 				      const char *, int);
+extern unsigned config_generation;
+void group_flat_free (struct group *);
 void write_statements (FILE *, struct executable_statement *, int);
 int find_matching_case (struct executable_statement **,
 			struct packet *, struct lease *, struct client_state *,
@@ -3361,6 +3565,7 @@ extern int (*dhcp_interface_shutdown_hook) (struct interface_info *);
 
 extern omapi_object_type_t *dhcp_type_lease;
 extern omapi_object_type_t *dhcp_type_pool;
+extern omapi_object_type_t *dhcp_type_pool6;
 extern omapi_object_type_t *dhcp_type_class;
 extern omapi_object_type_t *dhcp_type_subclass;
 
@@ -3426,6 +3631,20 @@ isc_result_t dhcp_pool_create (omapi_object_t **,
 			       omapi_object_t *);
 isc_result_t dhcp_pool_remove (omapi_object_t *,
 			       omapi_object_t *);
+isc_result_t dhcp_pool6_set_value  (omapi_object_t *, omapi_object_t *,
+				    omapi_data_string_t *,
+				    omapi_typed_data_t *);
+isc_result_t dhcp_pool6_get_value (omapi_object_t *, omapi_object_t *,
+				   omapi_data_string_t *,
+				   omapi_value_t **);
+isc_result_t dhcp_pool6_destroy (omapi_object_t *, const char *, int);
+isc_result_t dhcp_pool6_signal_handler (omapi_object_t *,
+					const char *, va_list);
+isc_result_t dhcp_pool6_stuff_values (omapi_object_t *,
+				      omapi_object_t *,
+				      omapi_object_t *);
+isc_result_t dhcp_pool6_lookup (omapi_object_t **,
+				omapi_object_t *, omapi_object_t *);
 isc_result_t dhcp_class_set_value  (omapi_object_t *, omapi_object_t *,
 				    omapi_data_string_t *,
 				    omapi_typed_data_t *);
@@ -3540,6 +3759,8 @@ isc_result_t dhcp_lease_get (omapi_object_t **, const char *, int);
 int find_grouped_subnet (struct subnet **, struct shared_network *,
 			 struct iaddr, const char *, int);
 int find_subnet(struct subnet **, struct iaddr, const char *, int);
+int find_link_network (struct shared_network **, struct iaddr,
+		       const char *, int);
 void enter_shared_network (struct shared_network *);
 void new_shared_network_interface (struct parse *,
 				   struct shared_network *,
@@ -3825,6 +4046,11 @@ isc_result_t decline_lease6(struct ipv6_pool *pool, struct iasubopt *lease);
 isc_boolean_t lease6_exists(const struct ipv6_pool *pool,
 			    const struct in6_addr *addr);
 isc_boolean_t lease6_usable(struct iasubopt *lease);
+void ia_active_add(ia_hash_t *, struct ia_xx *, const char *, int);
+void ia_active_delete(ia_hash_t *, const unsigned char *, unsigned,
+		      const char *, int);
+int ia_foreach_by_duid(const unsigned char *, unsigned,
+		       isc_result_t (*)(struct ia_xx *, void *), void *);
 isc_result_t cleanup_lease6(ia_hash_t *ia_table,
 			    struct ipv6_pool *pool,
 			    struct iasubopt *lease,
@@ -3842,6 +4068,8 @@ isc_boolean_t prefix6_exists(const struct ipv6_pool *pool,
 isc_result_t add_ipv6_pool(struct ipv6_pool *pool);
 isc_result_t find_ipv6_pool(struct ipv6_pool **pool, u_int16_t type,
 			    const struct in6_addr *addr);
+isc_result_t find_ipv6_prefix_pool(struct ipv6_pool **pool,
+				   const struct in6_addr *pref, int plen);
 isc_boolean_t ipv6_in_pool(const struct in6_addr *addr,
 			   const struct ipv6_pool *pool);
 isc_result_t ipv6_pond_allocate(struct ipv6_pond **pond,
@@ -3851,6 +4079,11 @@ isc_result_t ipv6_pond_reference(struct ipv6_pond **pond,
 				 const char *file, int line);
 isc_result_t ipv6_pond_dereference(struct ipv6_pond **pond,
 				   const char *file, int line);
+isc_uint64_t ipv6_pool_free(const struct ipv6_pool *pool);
+isc_result_t ipv6_pool_drain(struct ipv6_pool *pool, u_int32_t valid);
+void ipv6_pool_drain_lifetimes(const struct ipv6_pool *pool,
+			       u_int32_t *prefer, u_int32_t *valid);
+void ipv6_pond_order_pools(struct ipv6_pond *pond);
 
 isc_result_t renew_leases(struct ia_xx *ia);
 isc_result_t release_leases(struct ia_xx *ia);
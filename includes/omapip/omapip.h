@@ -565,6 +565,43 @@ void dmalloc_dump_outstanding (void);
 #define dmalloc_reuse(x,y,l,z)
 #endif
 #define MDL __FILE__, __LINE__
+
+/* A pool of fixed-size objects of one type, carved out of slabs of
+   per_slab objects each.  Freed objects go back on the pool's free
+   list; once more than high_water of them are idle, slabs that are
+   entirely free are returned to the system.  Pools are declared
+   statically with OMAPI_POOL_INITIALIZER; the remaining fields are
+   filled in on first use. */
+struct omapi_pool_slab;
+typedef struct omapi_pool {
+	const char *name;
+	size_t size;
+	unsigned per_slab;
+	unsigned long high_water;
+	int initialized;
+	void *free_list;
+	struct omapi_pool_slab *slabs;
+	struct omapi_pool *next;
+	unsigned long trim_at;
+
+	/* Statistics. */
+	unsigned long in_use;
+	unsigned long peak;
+	unsigned long nfree;
+	unsigned long nslabs;
+	unsigned long allocs;
+	unsigned long trims;
+} omapi_pool_t;
+
+#define OMAPI_POOL_INITIALIZER(name, type, per_slab, high_water) \
+	{ (name), sizeof (type), (per_slab), (high_water) }
+
+void *omapi_pool_get (omapi_pool_t *, const char *, int);
+void omapi_pool_put (omapi_pool_t *, void *, const char *, int);
+void omapi_pool_trim (omapi_pool_t *);
+void omapi_pool_relinquish (omapi_pool_t *);
+void omapi_pool_log_statistics (void);
+
 #if defined (DEBUG_RC_HISTORY)
 void dump_rc_history (void *);
 void rc_history_next (int);
@@ -282,6 +282,10 @@ struct expression {
 	} data;
 	int flags;
 #	define EXPR_EPHEMERAL	1
+#	define EXPR_COMPILED	2	/* program has been built */
+#	define EXPR_MEMO_CHECKED 4	/* EXPR_MEMOIZABLE is valid */
+#	define EXPR_MEMOIZABLE	8	/* depends on the packet alone */
+	struct expr_program *program;
 };		
 
 /* DNS host entry structure... */
@@ -336,6 +340,10 @@ struct universe {
 	unsigned site_code_min, end;
 	option_name_hash_t *name_hash;
 	option_code_hash_t *code_hash;
+	/* Options with codes below code_index_size, indexed by code;
+	   see option_code_lookup(). */
+	struct option **code_index;
+	unsigned code_index_size;
 	struct option *enc_opt;
 	int index;
 
@@ -512,6 +512,245 @@ void omapi_print_dmalloc_usage_by_caller ()
 }
 #endif /* DEBUG_MEMORY_LEAKAGE || DEBUG_MALLOC_POOL */
 
+/* Object pools.   Each slab starts with this header, followed by
+   per_slab objects of the pool's (rounded-up) size.  Free objects
+   are chained through their first word. */
+
+struct omapi_pool_slab {
+	struct omapi_pool_slab *next;
+	unsigned long nfree;
+};
+
+typedef union {
+	void *p;
+	long l;
+	double d;
+} omapi_pool_align_t;
+
+#define POOL_ROUND(x) \
+	(((x) + sizeof (omapi_pool_align_t) - 1) & \
+	 ~(sizeof (omapi_pool_align_t) - 1))
+#define SLAB_OBJECTS(s) \
+	((unsigned char *)(s) + POOL_ROUND (sizeof (struct omapi_pool_slab)))
+#define SLAB_RELEASE ((unsigned long)-1)
+
+static omapi_pool_t *omapi_pools;
+
+static isc_result_t omapi_pool_grow (omapi_pool_t *pool,
+				     const char *file, int line)
+{
+	struct omapi_pool_slab *slab;
+	unsigned char *obj;
+	unsigned i;
+
+	if (!pool -> initialized) {
+		if (pool -> size < sizeof (void *))
+			pool -> size = sizeof (void *);
+		pool -> size = POOL_ROUND (pool -> size);
+		if (!pool -> per_slab)
+			pool -> per_slab = 1;
+		pool -> next = omapi_pools;
+		omapi_pools = pool;
+		pool -> initialized = 1;
+	}
+
+	slab = dmalloc (POOL_ROUND (sizeof *slab) +
+			pool -> per_slab * pool -> size, file, line);
+	if (!slab)
+		return ISC_R_NOMEMORY;
+	slab -> next = pool -> slabs;
+	pool -> slabs = slab;
+	pool -> nslabs++;
+
+	obj = SLAB_OBJECTS (slab);
+	for (i = 0; i < pool -> per_slab; i++) {
+		*(void **)obj = pool -> free_list;
+		pool -> free_list = obj;
+		obj += pool -> size;
+	}
+	pool -> nfree += pool -> per_slab;
+
+	/* We only grow when the free list has run dry, so any earlier
+	   trim back-off no longer applies. */
+	pool -> trim_at = 2 * pool -> high_water;
+	return ISC_R_SUCCESS;
+}
+
+/* Return a zeroed object from the pool, or NULL if memory ran out. */
+void *omapi_pool_get (omapi_pool_t *pool, const char *file, int line)
+{
+	void *rval;
+
+	if (!pool -> free_list &&
+	    omapi_pool_grow (pool, file, line) != ISC_R_SUCCESS)
+		return (void *)0;
+
+	rval = pool -> free_list;
+	pool -> free_list = *(void **)rval;
+	pool -> nfree--;
+	pool -> allocs++;
+	if (++pool -> in_use > pool -> peak)
+		pool -> peak = pool -> in_use;
+	memset (rval, 0, pool -> size);
+	return rval;
+}
+
+void omapi_pool_put (omapi_pool_t *pool, void *ptr,
+		     const char *file, int line)
+{
+#if defined (DEBUG_MALLOC_POOL)
+	void *fp;
+
+	for (fp = pool -> free_list; fp; fp = *(void **)fp) {
+		if (fp == ptr) {
+			log_error ("%s(%d): %s freed twice!",
+				   file, line, pool -> name);
+			abort ();
+		}
+	}
+#endif
+	*(void **)ptr = pool -> free_list;
+	pool -> free_list = ptr;
+	pool -> nfree++;
+	pool -> in_use--;
+
+	if (pool -> high_water && pool -> nfree > pool -> trim_at)
+		omapi_pool_trim (pool);
+}
+
+static int omapi_pool_slab_cmp (const void *a, const void *b)
+{
+	const struct omapi_pool_slab *sa =
+		*(const struct omapi_pool_slab * const *)a;
+	const struct omapi_pool_slab *sb =
+		*(const struct omapi_pool_slab * const *)b;
+
+	if (sa < sb)
+		return -1;
+	return sa > sb;
+}
+
+static struct omapi_pool_slab *
+omapi_pool_find_slab (omapi_pool_t *pool,
+		      struct omapi_pool_slab **slabs, unsigned long count,
+		      unsigned char *obj)
+{
+	unsigned long lo = 0, hi = count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (obj < (unsigned char *)slabs [mid])
+			hi = mid;
+		else if (obj >= SLAB_OBJECTS (slabs [mid]) +
+				pool -> per_slab * pool -> size)
+			lo = mid + 1;
+		else
+			return slabs [mid];
+	}
+	return (struct omapi_pool_slab *)0;
+}
+
+/* Give back slabs none of whose objects are in use, keeping at least
+   high_water free objects on hand. */
+void omapi_pool_trim (omapi_pool_t *pool)
+{
+	struct omapi_pool_slab **slabs, *slab, **sp;
+	void *fp, *next, **tail;
+	unsigned long i, count, released;
+
+	count = pool -> nslabs;
+	if (!count)
+		return;
+	slabs = dmalloc (count * sizeof *slabs, MDL);
+	if (!slabs)
+		return;
+	i = 0;
+	for (slab = pool -> slabs; slab; slab = slab -> next) {
+		slab -> nfree = 0;
+		slabs [i++] = slab;
+	}
+	qsort (slabs, count, sizeof *slabs, omapi_pool_slab_cmp);
+
+	for (fp = pool -> free_list; fp; fp = *(void **)fp) {
+		slab = omapi_pool_find_slab (pool, slabs, count, fp);
+		if (slab)
+			slab -> nfree++;
+	}
+
+	released = 0;
+	for (i = 0; i < count; i++) {
+		if (slabs [i] -> nfree == pool -> per_slab &&
+		    pool -> nfree >= ((released + 1) * pool -> per_slab +
+				      pool -> high_water)) {
+			slabs [i] -> nfree = SLAB_RELEASE;
+			released++;
+		}
+	}
+
+	if (released) {
+		/* Drop the released slabs' objects from the free list... */
+		tail = &pool -> free_list;
+		for (fp = pool -> free_list; fp; fp = next) {
+			next = *(void **)fp;
+			slab = omapi_pool_find_slab (pool, slabs, count, fp);
+			if (slab && slab -> nfree == SLAB_RELEASE)
+				continue;
+			*tail = fp;
+			tail = (void **)fp;
+		}
+		*tail = (void *)0;
+
+		/* ...and then the slabs themselves. */
+		for (sp = &pool -> slabs; (slab = *sp) != NULL; ) {
+			if (slab -> nfree == SLAB_RELEASE) {
+				*sp = slab -> next;
+				dfree (slab, MDL);
+			} else
+				sp = &slab -> next;
+		}
+		pool -> nslabs -= released;
+		pool -> nfree -= released * pool -> per_slab;
+		pool -> trims++;
+	}
+	dfree (slabs, MDL);
+
+	/* Don't look again until another high_water objects come back. */
+	pool -> trim_at = pool -> nfree + pool -> high_water;
+	if (pool -> trim_at < 2 * pool -> high_water)
+		pool -> trim_at = 2 * pool -> high_water;
+}
+
+/* Free every slab in the pool, complaining about objects still in use. */
+void omapi_pool_relinquish (omapi_pool_t *pool)
+{
+	struct omapi_pool_slab *slab, *next;
+
+	if (pool -> in_use)
+		log_info ("%s pool: %lu objects still in use",
+			  pool -> name, pool -> in_use);
+	for (slab = pool -> slabs; slab; slab = next) {
+		next = slab -> next;
+		dfree (slab, MDL);
+	}
+	pool -> slabs = (struct omapi_pool_slab *)0;
+	pool -> free_list = (void *)0;
+	pool -> nslabs = 0;
+	pool -> nfree = 0;
+	pool -> in_use = 0;
+}
+
+void omapi_pool_log_statistics ()
+{
+	omapi_pool_t *pool;
+
+	for (pool = omapi_pools; pool; pool = pool -> next)
+		log_info ("%s pool: %lu in use (peak %lu), %lu free "
+			  "in %lu slabs, %lu allocations, %lu trims",
+			  pool -> name, pool -> in_use, pool -> peak,
+			  pool -> nfree, pool -> nslabs, pool -> allocs,
+			  pool -> trims);
+}
+
 isc_result_t omapi_object_allocate (omapi_object_t **o,
 				    omapi_object_type_t *type,
 				    size_t size,
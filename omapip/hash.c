@@ -139,39 +139,13 @@ void free_hash_table (tp, file, line)
 	*tp = (struct hash_table *)0;
 }
 
-struct hash_bucket *free_hash_buckets;
+static omapi_pool_t hash_bucket_pool =
+	OMAPI_POOL_INITIALIZER ("hash bucket", struct hash_bucket, 127, 4096);
 
 #if defined (DEBUG_MEMORY_LEAKAGE_ON_EXIT)
-struct hash_bucket *hash_bucket_hunks;
-
 void relinquish_hash_bucket_hunks ()
 {
-	struct hash_bucket *c, *n, **p;
-
-	/* Account for all the hash buckets on the free list. */
-	p = &free_hash_buckets;
-	for (c = free_hash_buckets; c; c = c -> next) {
-		for (n = hash_bucket_hunks; n; n = n -> next) {
-			if (c > n && c < n + 127) {
-				*p = c -> next;
-				n -> len++;
-				break;
-			}
-		}
-		/* If we didn't delete the hash bucket from the free list,
-		   advance the pointer. */
-		if (!n)
-			p = &c -> next;
-	}
-		
-	for (c = hash_bucket_hunks; c; c = n) {
-		n = c -> next;
-		if (c -> len != 126) {
-			log_info ("hashbucket %lx hash_buckets %d free %u",
-				  (unsigned long)c, 127, c -> len);
-		}
-		dfree (c, MDL);
-	}
+	omapi_pool_relinquish (&hash_bucket_pool);
 }
 #endif
 
@@ -183,37 +157,13 @@ Description:  
 Input:	      
 Output:       
 Return:       struct hash_bucket *
-Caution : 	  free_hash_bucketshashͰ
+Caution : 	  hash_bucket_poolhashͰ
 *********************************************************************/
 struct hash_bucket *new_hash_bucket (file, line)
 	const char *file;
 	int line;
 {
-	struct hash_bucket *rval;
-	int i = 0;
-	if (!free_hash_buckets) 
-	{
-		rval = dmalloc(127 * sizeof (struct hash_bucket), file, line);
-		if (!rval)
-			return rval;
-# if defined (DEBUG_MEMORY_LEAKAGE_ON_EXIT)
-		rval->next = hash_bucket_hunks;
-		hash_bucket_hunks = rval;
-		hash_bucket_hunks->len = 0;
-		i++;
-		rval++;
-#endif
-		/* ֮free_hash_bucketsһ127ڵͷ */
-		for (; i < 127; i++) 
-		{
-			rval->next = free_hash_buckets;
-			free_hash_buckets = rval;
-			rval++;
-		}
-	}
-	rval = free_hash_buckets;
-	free_hash_buckets = rval->next;
-	return rval;
+	return omapi_pool_get (&hash_bucket_pool, file, line);
 }
 
 void free_hash_bucket
@@ -223,20 +173,7 @@ void free_hash_bucket
 	int line
 )
 {
-#if defined (DEBUG_MALLOC_POOL)
-	struct hash_bucket *hp;
-
-	for (hp = free_hash_buckets; hp; hp = hp->next) 
-	{
-		if (hp == ptr) 
-		{
-			log_error ("hash bucket freed twice!");
-			abort ();
-		}
-	}
-#endif
-	ptr->next = free_hash_buckets;
-	free_hash_buckets = ptr;
+	omapi_pool_put (&hash_bucket_pool, ptr, file, line);
 }
 
 /*********************************************************************
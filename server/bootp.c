@@ -77,8 +77,8 @@ void bootp
 	find_lease (&lease, packet, packet -> shared_network,
 		    0, 0, (struct lease *)0, MDL);
 
-	if (lease && lease->host)
-		host_reference(&hp, lease->host, MDL);
+	if (lease && LEASE_COLD_RO(lease)->host)
+		host_reference(&hp, LEASE_COLD_RO(lease)->host, MDL);
 
 	if (!lease || ((lease->flags & STATIC_LEASE) == 0)) {
 		struct host_decl *h;
@@ -157,14 +157,14 @@ void bootp
 	/* Execute the subnet statements. */
 	execute_statements_in_scope (NULL, packet, lease, NULL,
 				     packet->options, options,
-				     &lease->scope, lease->subnet->group,
+				     &LEASE_COLD(lease)->scope, lease->subnet->group,
 				     NULL, NULL);
 
 	/* Execute statements from class scopes. */
 	for (i = packet -> class_count; i > 0; i--) {
 		execute_statements_in_scope(NULL, packet, lease, NULL,
 					    packet->options, options,
-					    &lease->scope,
+					    &LEASE_COLD(lease)->scope,
 					    packet->classes[i - 1]->group,
 					    lease->subnet->group, NULL);
 	}
@@ -173,7 +173,7 @@ void bootp
 	if (hp != NULL) {
 		execute_statements_in_scope(NULL, packet, lease, NULL,
 					    packet->options, options,
-					    &lease->scope, hp->group,
+					    &LEASE_COLD(lease)->scope, hp->group,
 					    lease->subnet->group, NULL);
 	}
 	
@@ -182,7 +182,7 @@ void bootp
 	    !evaluate_boolean_option_cache(&ignorep, packet, lease,
 					   NULL,
 					   packet->options, options,
-					   &lease->scope, oc, MDL)) {
+					   &LEASE_COLD(lease)->scope, oc, MDL)) {
 		if (!ignorep)
 			log_info ("%s: bootp disallowed", msgbuf);
 		goto out;
@@ -193,7 +193,7 @@ void bootp
 	    !evaluate_boolean_option_cache(&ignorep, packet, lease,
 					   NULL,
 					   packet->options, options,
-					   &lease->scope, oc, MDL)) {
+					   &LEASE_COLD(lease)->scope, oc, MDL)) {
 		if (!ignorep)
 			log_info ("%s: booting disallowed", msgbuf);
 		goto out;
@@ -210,7 +210,7 @@ void bootp
 	if (!packet->options_valid &&
 	    !(evaluate_boolean_option_cache(&ignorep, packet, lease, NULL,
 					    packet->options, options,
-					    &lease->scope,
+					    &LEASE_COLD(lease)->scope,
 					    lookup_option (&server_universe,
 							   options, i), MDL))) {
 		if (packet->packet_length > DHCP_FIXED_NON_UDP) {
@@ -235,9 +235,8 @@ void bootp
 				     lease -> subnet -> netmask.iabuf,
 				     lease -> subnet -> netmask.len,
 				     0, 0, MDL)) {
-					option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash,
-								&i, 0, MDL);
+					option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 					save_option (&dhcp_universe,
 						     options, oc);
 				}
@@ -258,7 +257,7 @@ void bootp
 			cons_options (packet, outgoing.raw, lease,
 				      (struct client_state *)0, 0,
 				      packet -> options, options,
-				      &lease -> scope,
+				      &LEASE_COLD(lease)->scope,
 				      0, 0, 1, (struct data_string *)0,
 				      (const char *)0);
 		if (outgoing.packet_length < BOOTP_MIN_LEN)
@@ -286,7 +285,7 @@ void bootp
 	    evaluate_boolean_option_cache (&ignorep, packet, lease,
 					   (struct client_state *)0,
 					   packet -> options, options,
-					   &lease -> scope, oc, MDL))
+					   &LEASE_COLD(lease)->scope, oc, MDL))
 		raw.flags |= htons (BOOTP_BROADCAST);
 
 	/* Figure out the address of the next server. */
@@ -296,7 +295,7 @@ void bootp
 	    evaluate_option_cache (&d1, packet, lease,
 				   (struct client_state *)0,
 				   packet -> options, options,
-				   &lease -> scope, oc, MDL)) {
+				   &LEASE_COLD(lease)->scope, oc, MDL)) {
 		/* If there was more than one answer, take the first. */
 		if (d1.len >= 4 && d1.data)
 			memcpy (&raw.siaddr, d1.data, 4);
@@ -318,7 +317,7 @@ void bootp
 	    evaluate_option_cache (&d1, packet, lease,
 				   (struct client_state *)0,
 				   packet -> options, options,
-				   &lease -> scope, oc, MDL)) {
+				   &LEASE_COLD(lease)->scope, oc, MDL)) {
 		memcpy (raw.file, d1.data,
 			d1.len > sizeof raw.file ? sizeof raw.file : d1.len);
 		if (sizeof raw.file > d1.len)
@@ -334,7 +333,7 @@ void bootp
 	    evaluate_option_cache (&d1, packet, lease,
 				   (struct client_state *)0,
 				   packet -> options, options,
-				   &lease -> scope, oc, MDL)) {
+				   &LEASE_COLD(lease)->scope, oc, MDL)) {
 		memcpy (raw.sname, d1.data,
 			d1.len > sizeof raw.sname ? sizeof raw.sname : d1.len);
 		if (sizeof raw.sname > d1.len)
@@ -345,7 +344,7 @@ void bootp
 
 	/* Execute the commit statements, if there are any. */
 	execute_statements (NULL, packet, lease, NULL, packet->options,
-			    options, &lease->scope, lease->on_star.on_commit,
+			    options, &LEASE_COLD(lease)->scope, LEASE_COLD_RO(lease)->on_star.on_commit,
 			    NULL);
 
 	/* We're done with the option state. */
@@ -68,6 +68,478 @@ void classify_client
 			    &global_scope, default_classification_rules, NULL);
 }
 
+/* Compiled class matching.
+
+   Most "match if" expressions in real configurations compare a single
+   data expression - substring (option vendor-class-identifier, 0, 4),
+   option agent.remote-id and the like - with a constant, or "or"
+   several such comparisons together.  For each collection we group
+   those classes by the expression they examine and hash the constants,
+   so that a packet costs one evaluation and one lookup per distinct
+   expression no matter how many classes share it.  Classes whose match
+   expression has any other shape, and classes that match on subclasses,
+   are still checked one by one, and the two sets are merged so that the
+   packet is classified in collection order exactly as before.
+
+   The compiled form is built the first time a collection is checked and
+   dropped by class_match_invalidate() whenever its classes change. */
+
+struct class_match_entry {
+	struct class_match_entry *next;
+	struct data_string value;
+	unsigned position;
+};
+
+struct class_match_key {
+	struct class_match_key *next;
+	struct expression *expr;
+	struct class_match_entry *entries;
+	unsigned count;
+	unsigned mask;
+	struct class_match_entry **buckets;
+};
+
+struct class_matcher {
+	struct class_match_key *keys;
+	unsigned count;
+	struct class **classes;		/* All classes, in collection order. */
+	unsigned nfallback;
+	unsigned *fallback;		/* Positions of classes not compiled. */
+};
+
+/* Most classes a packet can match by lookup before we give up and
+   check the collection the slow way. */
+#define CLASS_MATCH_MAX_HITS	32
+
+static unsigned class_match_hash (const unsigned char *data, unsigned len)
+{
+	unsigned hash = 2166136261U;
+
+	while (len--) {
+		hash ^= *data++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* Return nonzero if expr can be evaluated once per packet and shared
+   between classes: it depends only on the packet and has no side
+   effects. */
+static int class_key_usable (struct expression *expr)
+{
+	if (!expr)
+		return 0;
+	switch (expr -> op) {
+	      case expr_substring:
+		return (class_key_usable (expr -> data.substring.expr) &&
+			class_key_usable (expr -> data.substring.offset) &&
+			class_key_usable (expr -> data.substring.len));
+	      case expr_suffix:
+		return (class_key_usable (expr -> data.suffix.expr) &&
+			class_key_usable (expr -> data.suffix.len));
+	      case expr_lcase:
+		return class_key_usable (expr -> data.lcase);
+	      case expr_ucase:
+		return class_key_usable (expr -> data.ucase);
+	      case expr_packet:
+		return (class_key_usable (expr -> data.packet.offset) &&
+			class_key_usable (expr -> data.packet.len));
+	      case expr_option:
+	      case expr_hardware:
+	      case expr_const_int:
+	      case expr_const_data:
+		return 1;
+	      default:
+		return 0;
+	}
+}
+
+static int class_key_equal (struct expression *a, struct expression *b)
+{
+	if (a == b)
+		return 1;
+	if (!a || !b || a -> op != b -> op)
+		return 0;
+	switch (a -> op) {
+	      case expr_substring:
+		return (class_key_equal (a -> data.substring.expr,
+					 b -> data.substring.expr) &&
+			class_key_equal (a -> data.substring.offset,
+					 b -> data.substring.offset) &&
+			class_key_equal (a -> data.substring.len,
+					 b -> data.substring.len));
+	      case expr_suffix:
+		return (class_key_equal (a -> data.suffix.expr,
+					 b -> data.suffix.expr) &&
+			class_key_equal (a -> data.suffix.len,
+					 b -> data.suffix.len));
+	      case expr_lcase:
+		return class_key_equal (a -> data.lcase, b -> data.lcase);
+	      case expr_ucase:
+		return class_key_equal (a -> data.ucase, b -> data.ucase);
+	      case expr_packet:
+		return (class_key_equal (a -> data.packet.offset,
+					 b -> data.packet.offset) &&
+			class_key_equal (a -> data.packet.len,
+					 b -> data.packet.len));
+	      case expr_option:
+		return a -> data.option == b -> data.option;
+	      case expr_hardware:
+		return 1;
+	      case expr_const_int:
+		return a -> data.const_int == b -> data.const_int;
+	      case expr_const_data:
+		return (a -> data.const_data.len == b -> data.const_data.len &&
+			!memcmp (a -> data.const_data.data,
+				 b -> data.const_data.data,
+				 a -> data.const_data.len));
+	      default:
+		return 0;
+	}
+}
+
+/* If expr compares a usable key with a constant, return the key and
+   store the constant in *value. */
+static struct expression *class_match_split (struct expression *expr,
+					     struct data_string **value)
+{
+	struct expression *key, *cst;
+
+	if (expr -> op != expr_equal)
+		return (struct expression *)0;
+	key = expr -> data.equal [0];
+	cst = expr -> data.equal [1];
+	if (key && key -> op == expr_const_data) {
+		cst = key;
+		key = expr -> data.equal [1];
+	}
+	if (!key || !cst || cst -> op != expr_const_data ||
+	    key -> op == expr_const_data || key -> op == expr_const_int ||
+	    !class_key_usable (key))
+		return (struct expression *)0;
+	*value = &cst -> data.const_data;
+	return key;
+}
+
+/* A match expression can be compiled if it is a comparison of a key
+   with a constant, or an "or" of such comparisons. */
+static int class_match_compilable (struct expression *expr)
+{
+	struct data_string *value;
+
+	if (!expr)
+		return 0;
+	if (expr -> op == expr_or)
+		return (class_match_compilable (expr -> data.or [0]) &&
+			class_match_compilable (expr -> data.or [1]));
+	return class_match_split (expr, &value) != NULL;
+}
+
+static isc_result_t class_match_add (struct class_matcher *matcher,
+				     struct expression *expr,
+				     unsigned position)
+{
+	struct class_match_key *key;
+	struct class_match_entry *entry;
+	struct expression *kexpr;
+	struct data_string *value = (struct data_string *)0;
+	isc_result_t status;
+
+	if (expr -> op == expr_or) {
+		status = class_match_add (matcher, expr -> data.or [0],
+					  position);
+		if (status != ISC_R_SUCCESS)
+			return status;
+		return class_match_add (matcher, expr -> data.or [1],
+					position);
+	}
+
+	kexpr = class_match_split (expr, &value);
+	if (!kexpr)
+		return DHCP_R_INVALIDARG;
+	for (key = matcher -> keys; key; key = key -> next)
+		if (class_key_equal (key -> expr, kexpr))
+			break;
+	if (!key) {
+		key = dmalloc (sizeof *key, MDL);
+		if (!key)
+			return ISC_R_NOMEMORY;
+		expression_reference (&key -> expr, kexpr, MDL);
+		key -> next = matcher -> keys;
+		matcher -> keys = key;
+	}
+
+	entry = dmalloc (sizeof *entry, MDL);
+	if (!entry)
+		return ISC_R_NOMEMORY;
+	data_string_copy (&entry -> value, value, MDL);
+	entry -> position = position;
+	entry -> next = key -> entries;
+	key -> entries = entry;
+	key -> count++;
+	return ISC_R_SUCCESS;
+}
+
+static void class_matcher_free (struct class_matcher **mp)
+{
+	struct class_matcher *matcher = *mp;
+	struct class_match_key *key;
+	struct class_match_entry *entry;
+	unsigned i;
+
+	while ((key = matcher -> keys) != NULL) {
+		matcher -> keys = key -> next;
+		for (i = 0; key -> buckets && i <= key -> mask; i++) {
+			while ((entry = key -> buckets [i]) != NULL) {
+				key -> buckets [i] = entry -> next;
+				data_string_forget (&entry -> value, MDL);
+				dfree (entry, MDL);
+			}
+		}
+		while ((entry = key -> entries) != NULL) {
+			key -> entries = entry -> next;
+			data_string_forget (&entry -> value, MDL);
+			dfree (entry, MDL);
+		}
+		if (key -> buckets)
+			dfree (key -> buckets, MDL);
+		expression_dereference (&key -> expr, MDL);
+		dfree (key, MDL);
+	}
+	if (matcher -> classes) {
+		for (i = 0; i < matcher -> count; i++)
+			if (matcher -> classes [i])
+				class_dereference (&matcher -> classes [i],
+						   MDL);
+		dfree (matcher -> classes, MDL);
+	}
+	if (matcher -> fallback)
+		dfree (matcher -> fallback, MDL);
+	dfree (matcher, MDL);
+	*mp = (struct class_matcher *)0;
+}
+
+static struct class_matcher *class_matcher_build (struct collection *lp)
+{
+	struct class_matcher *matcher;
+	struct class_match_key *key;
+	struct class_match_entry *entry, *next;
+	struct class *class;
+	unsigned i, size;
+
+	matcher = dmalloc (sizeof *matcher, MDL);
+	if (!matcher)
+		return matcher;
+	for (class = lp -> classes; class; class = class -> nic)
+		matcher -> count++;
+	if (matcher -> count) {
+		matcher -> classes = dmalloc (matcher -> count *
+					      sizeof *matcher -> classes,
+					      MDL);
+		matcher -> fallback = dmalloc (matcher -> count *
+					       sizeof *matcher -> fallback,
+					       MDL);
+		if (!matcher -> classes || !matcher -> fallback)
+			goto fail;
+	}
+
+	for (i = 0, class = lp -> classes; class; i++, class = class -> nic) {
+		class_reference (&matcher -> classes [i], class, MDL);
+		if (class -> expr && !class -> submatch &&
+		    class_match_compilable (class -> expr)) {
+			if (class_match_add (matcher, class -> expr, i) !=
+			    ISC_R_SUCCESS)
+				goto fail;
+		} else
+			matcher -> fallback [matcher -> nfallback++] = i;
+	}
+
+	/* Now that each key's entries have been counted, hash them. */
+	for (key = matcher -> keys; key; key = key -> next) {
+		for (size = 1; size < key -> count; size <<= 1)
+			;
+		key -> buckets = dmalloc (size * sizeof *key -> buckets, MDL);
+		if (!key -> buckets)
+			goto fail;
+		key -> mask = size - 1;
+		for (entry = key -> entries; entry; entry = next) {
+			next = entry -> next;
+			i = class_match_hash (entry -> value.data,
+					      entry -> value.len) & key -> mask;
+			entry -> next = key -> buckets [i];
+			key -> buckets [i] = entry;
+		}
+		key -> entries = (struct class_match_entry *)0;
+	}
+	return matcher;
+
+      fail:
+	log_error ("no memory to compile class matches; "
+		   "classes will be checked one by one.");
+	class_matcher_free (&matcher);
+	return matcher;
+}
+
+/* Drop the compiled form of every collection; it will be rebuilt the
+   next time the collection is checked. */
+void class_match_invalidate ()
+{
+	struct collection *lp;
+
+	for (lp = collections; lp; lp = lp -> next)
+		if (lp -> matcher)
+			class_matcher_free (&lp -> matcher);
+}
+
+/* Check one class the way check_collection() always has, classifying
+   the packet into it (or one of its subclasses) if it matches. */
+static int check_class (struct packet *packet, struct lease *lease,
+			struct class *class)
+{
+	struct class *nc;
+	struct data_string data;
+	int status;
+	int ignorep;
+	int classfound;
+
+#if defined (DEBUG_CLASS_MATCHING)
+	log_info ("checking against class %s...", class -> name);
+#endif
+	memset(&data, 0, sizeof(data));
+
+	/* If there is a "match if" expression, check it.   If
+	   we get a match, and there's no subclass expression,
+	   it's a match.   If we get a match and there is a subclass
+	   expression, then we check the submatch.   If it's not a
+	   match, that's final - we don't check the submatch. */
+
+	if (class->expr)
+	{
+		status = (evaluate_boolean_expression_result
+			  (&ignorep, packet, lease,
+			   (struct client_state *)0,
+			   packet->options, (struct option_state *)0,
+			   lease ? &LEASE_COLD(lease)->scope : &global_scope,
+			   class->expr));
+		/* 鲼ʽֵ1ʾƥˣpacketclassָϵ */
+		if (status) 
+		{
+			if (!class->submatch) 
+			{
+#if defined (DEBUG_CLASS_MATCHING)
+				log_info ("matches class.");
+#endif
+				classify(packet, class);
+				return 1;
+			}
+		} 
+		else
+			return 0;
+	}
+
+	/* Check to see if the client matches an existing subclass.
+	   If it doesn't, and this is a spawning class, spawn a new
+	   subclass and put the client in it. */
+	if (class->submatch) 
+	{
+		status = (evaluate_data_expression
+			  (&data, packet, lease,
+			   (struct client_state *)0,
+			   packet -> options, (struct option_state *)0,
+			   lease ? &LEASE_COLD(lease)->scope : &global_scope,
+			   class -> submatch, MDL));
+		if (status && data.len) {
+			nc = (struct class *)0;
+			classfound = class_hash_lookup (&nc, class -> hash,
+				(const char *)data.data, data.len, MDL);
+
+#ifdef LDAP_CONFIGURATION
+			if (!classfound && find_subclass_in_ldap (class, &nc, &data))
+				classfound = 1;
+#endif
+
+			if (classfound) {
+#if defined (DEBUG_CLASS_MATCHING)
+				log_info ("matches subclass %s.",
+				      print_hex_1 (data.len,
+						   data.data, 60));
+#endif
+				data_string_forget (&data, MDL);
+				classify (packet, nc);
+				class_dereference (&nc, MDL);
+				return 1;
+			}
+			if (!class -> spawning) {
+				data_string_forget (&data, MDL);
+				return 0;
+			}
+			/* XXX Write out the spawned class? */
+#if defined (DEBUG_CLASS_MATCHING)
+			log_info ("spawning subclass %s.",
+			      print_hex_1 (data.len, data.data, 60));
+#endif
+			status = class_allocate (&nc, MDL);
+			group_reference (&nc -> group,
+					 class -> group, MDL);
+			class_reference (&nc -> superclass,
+					 class, MDL);
+			nc -> lease_limit = class -> lease_limit;
+			nc -> dirty = 1;
+			if (nc -> lease_limit) {
+				nc -> billed_leases =
+					(dmalloc
+					 (nc -> lease_limit *
+					  sizeof (struct lease *),
+					  MDL));
+				if (!nc -> billed_leases) {
+					log_error ("no memory for%s",
+						   " billing");
+					data_string_forget
+						(&nc -> hash_string,
+						 MDL);
+					class_dereference (&nc, MDL);
+					data_string_forget (&data,
+							    MDL);
+					return 0;
+				}
+				memset (nc -> billed_leases, 0,
+					(nc -> lease_limit *
+					 sizeof (struct lease *)));
+			}
+			data_string_copy (&nc -> hash_string, &data,
+					  MDL);
+			data_string_forget (&data, MDL);
+			if (!class -> hash)
+			    class_new_hash(&class->hash,
+					   SCLASS_HASH_SIZE, MDL);
+			class_hash_add (class -> hash,
+					(const char *)
+					nc -> hash_string.data,
+					nc -> hash_string.len,
+					nc, MDL);
+			classify (packet, nc);
+			class_dereference (&nc, MDL);
+		}
+	}
+
+	return 0;
+}
+
+/* Check each class in a list in turn; this is what check_collection()
+   falls back on when it cannot use a compiled matcher. */
+int check_classes (struct packet *packet, struct lease *lease,
+		   struct class *classes)
+{
+	struct class *class;
+	int matched = 0;
+
+	/* classһȫֱcollectionṩ */
+	for (class = classes; class; class = class->nic)
+		if (check_class(packet, lease, class))
+			matched = 1;
+	return matched;
+}
+
 /*********************************************************************
 Func Name :   check_collection
 Date Created: 2018/07/24
@@ -85,137 +557,81 @@ int check_collection
 	struct collection *collection
 )
 {
-	struct class *class, *nc;
+	struct class_matcher *matcher;
+	struct class_match_key *key;
+	struct class_match_entry *entry;
 	struct data_string data;
+	unsigned hits [CLASS_MATCH_MAX_HITS];
+	unsigned nhits = 0, i, j, pos;
 	int matched = 0;
-	int status;
-	int ignorep;
-	int classfound;
 
-	/* classһȫֱcollectionṩ */
-	for (class = collection->classes; class; class = class->nic) 
+	if (!collection->matcher)
+		collection->matcher = class_matcher_build(collection);
+	matcher = collection->matcher;
+	if (!matcher)
+		return check_classes(packet, lease, collection->classes);
+
+	/* Evaluate each distinct key once and collect the positions of
+	   the classes whose constant it matches. */
+	for (key = matcher->keys; key; key = key->next) 
 	{
-#if defined (DEBUG_CLASS_MATCHING)
-		log_info ("checking against class %s...", class -> name);
-#endif
 		memset(&data, 0, sizeof(data));
-
-		/* If there is a "match if" expression, check it.   If
-		   we get a match, and there's no subclass expression,
-		   it's a match.   If we get a match and there is a subclass
-		   expression, then we check the submatch.   If it's not a
-		   match, that's final - we don't check the submatch. */
-
-		if (class->expr)
+		if (!evaluate_data_expression(&data, packet, lease,
+					      (struct client_state *)0,
+					      packet->options,
+					      (struct option_state *)0,
+					      lease ? &LEASE_COLD(lease)->scope : &global_scope,
+					      key->expr, MDL))
+			continue;
+
+		i = class_match_hash(data.data, data.len) & key->mask;
+		for (entry = key->buckets[i]; entry; entry = entry->next) 
 		{
-			status = (evaluate_boolean_expression_result
-				  (&ignorep, packet, lease,
-				   (struct client_state *)0,
-				   packet->options, (struct option_state *)0,
-				   lease ? &lease->scope : &global_scope,
-				   class->expr));
-			/* 鲼ʽֵ1ʾƥˣpacketclassָϵ */
-			if (status) 
-			{
-				if (!class->submatch) 
-				{
-					matched = 1;
-#if defined (DEBUG_CLASS_MATCHING)
-					log_info ("matches class.");
-#endif
-					classify(packet, class);
-					continue;
-				}
-			} 
-			else
+			if (entry->value.len != data.len ||
+			    memcmp(entry->value.data, data.data, data.len))
+				continue;
+			for (j = 0; j < nhits && hits[j] != entry->position; j++)
+				;
+			if (j < nhits)
 				continue;
+			if (nhits == CLASS_MATCH_MAX_HITS) 
+			{
+				data_string_forget(&data, MDL);
+				return check_classes(packet, lease,
+						     collection->classes);
+			}
+			hits[nhits++] = entry->position;
 		}
+		data_string_forget(&data, MDL);
+	}
 
-		/* Check to see if the client matches an existing subclass.
-		   If it doesn't, and this is a spawning class, spawn a new
-		   subclass and put the client in it. */
-		if (class->submatch) 
-		{
-			status = (evaluate_data_expression
-				  (&data, packet, lease,
-				   (struct client_state *)0,
-				   packet -> options, (struct option_state *)0,
-				   lease ? &lease -> scope : &global_scope,
-				   class -> submatch, MDL));
-			if (status && data.len) {
-				nc = (struct class *)0;
-				classfound = class_hash_lookup (&nc, class -> hash,
-					(const char *)data.data, data.len, MDL);
-
-#ifdef LDAP_CONFIGURATION
-				if (!classfound && find_subclass_in_ldap (class, &nc, &data))
-					classfound = 1;
-#endif
+	/* Put the hits in collection order. */
+	for (i = 1; i < nhits; i++) 
+	{
+		pos = hits[i];
+		for (j = i; j > 0 && hits[j - 1] > pos; j--)
+			hits[j] = hits[j - 1];
+		hits[j] = pos;
+	}
 
-				if (classfound) {
-#if defined (DEBUG_CLASS_MATCHING)
-					log_info ("matches subclass %s.",
-					      print_hex_1 (data.len,
-							   data.data, 60));
-#endif
-					data_string_forget (&data, MDL);
-					classify (packet, nc);
-					matched = 1;
-					class_dereference (&nc, MDL);
-					continue;
-				}
-				if (!class -> spawning) {
-					data_string_forget (&data, MDL);
-					continue;
-				}
-				/* XXX Write out the spawned class? */
+	/* Merge the hits with the classes that still have to be checked
+	   one by one, so the packet is classified in collection order. */
+	i = j = 0;
+	while (i < matcher->nfallback || j < nhits) 
+	{
+		if (j < nhits &&
+		    (i == matcher->nfallback || hits[j] < matcher->fallback[i])) 
+		{
 #if defined (DEBUG_CLASS_MATCHING)
-				log_info ("spawning subclass %s.",
-				      print_hex_1 (data.len, data.data, 60));
+			log_info ("matches class %s.",
+				  matcher->classes[hits[j]]->name);
 #endif
-				status = class_allocate (&nc, MDL);
-				group_reference (&nc -> group,
-						 class -> group, MDL);
-				class_reference (&nc -> superclass,
-						 class, MDL);
-				nc -> lease_limit = class -> lease_limit;
-				nc -> dirty = 1;
-				if (nc -> lease_limit) {
-					nc -> billed_leases =
-						(dmalloc
-						 (nc -> lease_limit *
-						  sizeof (struct lease *),
-						  MDL));
-					if (!nc -> billed_leases) {
-						log_error ("no memory for%s",
-							   " billing");
-						data_string_forget
-							(&nc -> hash_string,
-							 MDL);
-						class_dereference (&nc, MDL);
-						data_string_forget (&data,
-								    MDL);
-						continue;
-					}
-					memset (nc -> billed_leases, 0,
-						(nc -> lease_limit *
-						 sizeof (struct lease *)));
-				}
-				data_string_copy (&nc -> hash_string, &data,
-						  MDL);
-				data_string_forget (&data, MDL);
-				if (!class -> hash)
-				    class_new_hash(&class->hash,
-						   SCLASS_HASH_SIZE, MDL);
-				class_hash_add (class -> hash,
-						(const char *)
-						nc -> hash_string.data,
-						nc -> hash_string.len,
-						nc, MDL);
-				classify (packet, nc);
-				class_dereference (&nc, MDL);
-			}
-		}
+			classify(packet, matcher->classes[hits[j++]]);
+			matched = 1;
+		} 
+		else if (check_class(packet, lease,
+				     matcher->classes[matcher->fallback[i++]]))
+			matched = 1;
 	}
 	return matched;
 }
@@ -269,6 +685,7 @@ isc_result_t unlink_class(struct class **class)
 				
 				cp->nic = 0;
 				class_dereference(class, MDL);
+				class_match_invalidate();
 
 				return ISC_R_SUCCESS;
 			}
@@ -328,7 +745,7 @@ void unbill_class (lease)
 	struct lease *lease;
 {
 	int i;
-	struct class* class = lease->billing_class;
+	struct class* class = LEASE_COLD_RO(lease)->billing_class;
 	struct lease* refholder = NULL;
 
 	/* if there's no billing to remove, nothing to do */
@@ -357,7 +774,7 @@ void unbill_class (lease)
 	}
 
 	/* Remove the class from the lease */
-	class_dereference(&lease->billing_class, MDL);
+	class_dereference(&LEASE_COLD(lease)->billing_class, MDL);
 
 	/* Ditch our guard reference */
 	lease_dereference(&refholder, MDL);
@@ -369,7 +786,7 @@ int bill_class (lease, class)
 {
 	int i;
 
-	if (lease -> billing_class) {
+	if (LEASE_COLD_RO(lease)->billing_class) {
 		log_error ("lease billed with existing billing arrangement.");
 		unbill_class (lease);
 	}
@@ -387,7 +804,7 @@ int bill_class (lease, class)
 	}
 
 	lease_reference (&class -> billed_leases [i], lease, MDL);
-	class_reference (&lease -> billing_class, class, MDL);
+	class_reference (&LEASE_COLD(lease)->billing_class, class, MDL);
 	class -> leases_consumed++;
 	return 1;
 }
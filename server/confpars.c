@@ -48,6 +48,8 @@ static void parse_lease_id_format (struct parse *cfile);
 #ifdef DHCPv6
 static int parse_iaid_duid(struct parse *cfile, struct ia_xx** ia,
 			   u_int32_t *iaid, const char* file, int line);
+static void parse_ia_renew(struct parse *cfile, struct ia_xx *ia,
+			   ia_hash_t *ia_table);
 #endif
 
 #if defined (TRACING)
@@ -934,6 +936,9 @@ int parse_statement
 					option_code_hash_delete(
 						option->universe->code_hash,
 							&option->code, 0, MDL);
+					option_code_index_clear(
+						option->universe,
+							option->code);
 				}
 
 				parse_option_code_definition(cfile, option);
@@ -1021,6 +1026,7 @@ int parse_statement
 		if (!et)
 			return declaration;
 	      insert_statement:
+		config_generation++;
 		if (group->statements) 
 		{
 			int multi = 0;
@@ -2928,6 +2934,9 @@ int parse_class_declaration
 		}
 	}
 
+	/* The class list or a match expression may have changed. */
+	class_match_invalidate();
+
 	if (cp)				/* should always be 0??? */
 		status = class_reference(cp, class, MDL);
 	class_dereference(&class, MDL);
@@ -3576,6 +3585,7 @@ int parse_lease_declaration
 	binding_state_t new_state;
 	unsigned buflen = 0;
 	struct class *class;
+	char *s;
 
 	lease = (struct lease *)0;
 	status = lease_allocate (&lease, MDL);
@@ -3629,7 +3639,7 @@ int parse_lease_declaration
 				
 			      case TSTP:
 				seenbit = 65536;
-				lease -> tstp = t;
+				LEASE_COLD(lease)->tstp = t;
 				break;
 				
 			      case TSFP:
@@ -3639,12 +3649,12 @@ int parse_lease_declaration
 
 			      case ATSFP:
 				seenbit = 262144;
-				lease->atsfp = t;
+				LEASE_COLD(lease)->atsfp = t;
 				break;
 				
 			      case CLTT:
 				seenbit = 524288;
-				lease -> cltt = t;
+				LEASE_COLD(lease)->cltt = t;
 				break;
 				
 			      default: /* for gcc, we'll never get here. */
@@ -3845,17 +3855,15 @@ int parse_lease_declaration
 		      case CLIENT_HOSTNAME:
 			seenbit = 1024;
 			token = peek_token (&val, (unsigned *)0, cfile);
+			s = NULL;
 			if (token == STRING) {
-				if (!parse_string (cfile,
-						   &lease -> client_hostname,
-						   (unsigned *)0)) {
+				if (!parse_string (cfile, &s, (unsigned *)0)) {
 					lease_dereference (&lease, MDL);
 					return 0;
 				}
 			} else {
-				lease -> client_hostname =
-					parse_host_name (cfile);
-				if (lease -> client_hostname)
+				s = parse_host_name (cfile);
+				if (s)
 					parse_semi (cfile);
 				else {
 					parse_warn (cfile,
@@ -3865,6 +3873,13 @@ int parse_lease_declaration
 					return 0;
 				}
 			}
+			LEASE_COLD(lease)->client_hostname =
+				intern_string (s, strlen (s), MDL);
+			dfree (s, MDL);
+			if (!LEASE_COLD_RO(lease)->client_hostname) {
+				lease_dereference (&lease, MDL);
+				return 0;
+			}
 			break;
 			
 		      case BILLING:
@@ -3881,8 +3896,8 @@ int parse_lease_declaration
 					token = BILLING;
 					break;
 				}
-				if (lease -> billing_class)
-				    class_dereference (&lease -> billing_class,
+				if (LEASE_COLD_RO(lease)->billing_class)
+				    class_dereference (&LEASE_COLD(lease)->billing_class,
 						       MDL);
 				find_class (&class, val, MDL);
 				if (!class)
@@ -3890,8 +3905,8 @@ int parse_lease_declaration
 						    "unknown class %s", val);
 				parse_semi (cfile);
 			} else if (token == SUBCLASS) {
-				if (lease -> billing_class)
-				    class_dereference (&lease -> billing_class,
+				if (LEASE_COLD_RO(lease)->billing_class)
+				    class_dereference (&LEASE_COLD(lease)->billing_class,
 						       MDL);
 				parse_class_declaration(&class, cfile, NULL,
 							CLASS_TYPE_SUBCLASS);
@@ -3901,7 +3916,7 @@ int parse_lease_declaration
 					skip_to_semi (cfile);
 			}
 			if (class) {
-				class_reference (&lease -> billing_class,
+				class_reference (&LEASE_COLD(lease)->billing_class,
 						 class, MDL);
 				class_dereference (&class, MDL);
 			}
@@ -3920,14 +3935,14 @@ int parse_lease_declaration
 			    on->data.on.statements) {
 				seenbit |= 16384;
 				executable_statement_reference
-					(&lease->on_star.on_expiry,
+					(&LEASE_COLD(lease)->on_star.on_expiry,
 					 on->data.on.statements, MDL);
 			}
 			if ((on->data.on.evtypes & ON_RELEASE) &&
 			    on->data.on.statements) {
 				seenbit |= 32768;
 				executable_statement_reference
-					(&lease->on_star.on_release,
+					(&LEASE_COLD(lease)->on_star.on_release,
 					 on->data.on.statements, MDL);
 			}
 			executable_statement_dereference (&on, MDL);
@@ -3946,13 +3961,13 @@ int parse_lease_declaration
 				    option_cache_dereference (&oc, MDL);
 				    break;
 			    }
-			    if (!lease -> agent_options &&
+			    if (!LEASE_COLD_RO(lease)->agent_options &&
 				!(option_chain_head_allocate
-				  (&lease -> agent_options, MDL))) {
+				  (&LEASE_COLD(lease)->agent_options, MDL))) {
 				log_error ("no memory to stash agent option");
 				break;
 			    }
-			    for (p = &lease -> agent_options -> first;
+			    for (p = &LEASE_COLD_RO(lease)->agent_options -> first;
 				 *p; p = &((*p) -> cdr))
 				    ;
 			    *p = cons (0, 0);
@@ -3978,15 +3993,15 @@ int parse_lease_declaration
 			
 			seenbit = 0;
 		      special_set:
-			if (lease -> scope)
-				binding = find_binding (lease -> scope, val);
+			if (LEASE_COLD_RO(lease)->scope)
+				binding = find_binding (LEASE_COLD_RO(lease)->scope, val);
 			else
 				binding = (struct binding *)0;
 
 			if (!binding) {
-			    if (!lease -> scope)
+			    if (!LEASE_COLD_RO(lease)->scope)
 				if (!(binding_scope_allocate
-				      (&lease -> scope, MDL)))
+				      (&LEASE_COLD(lease)->scope, MDL)))
 					log_fatal ("no memory for scope");
 			    binding = dmalloc (sizeof *binding, MDL);
 			    if (!binding)
@@ -4026,8 +4041,8 @@ int parse_lease_declaration
 			if (newbinding) {
 				binding_value_reference(&binding->value,
 							nv, MDL);
-				binding->next = lease->scope->bindings;
-				lease->scope->bindings = binding;
+				binding->next = LEASE_COLD_RO(lease)->scope->bindings;
+				LEASE_COLD_RO(lease)->scope->bindings = binding;
 			} else {
 				binding_value_dereference(&binding->value, MDL);
 				binding_value_reference(&binding->value,
@@ -4069,7 +4084,7 @@ int parse_lease_declaration
 	/* If no binding state is specified, make one up. */
 	if (!(seenmask & 256)) {
 		if (lease->ends > cur_time ||
-		    lease->on_star.on_expiry || lease->on_star.on_release)
+		    LEASE_COLD_RO(lease)->on_star.on_expiry || LEASE_COLD_RO(lease)->on_star.on_release)
 			lease->binding_state = FTS_ACTIVE;
 #if defined (FAILOVER_PROTOCOL)
 		else if (lease->pool && lease->pool->failover_peer)
@@ -4092,7 +4107,7 @@ int parse_lease_declaration
 	}
 
 	if (!(seenmask & 65536))
-		lease->tstp = lease->ends;
+		LEASE_COLD(lease)->tstp = lease->ends;
 
 	lease_reference (lp, lease, MDL);
 	lease_dereference (&lease, MDL);
@@ -4457,6 +4472,7 @@ add_ipv6_pool_to_subnet(struct subnet *subnet, u_int16_t type,
 	 */
 	ipv6_pool_reference(&pond->ipv6_pools[num_pools], pool, MDL);
 	pond->ipv6_pools[num_pools+1] = NULL;
+	subnet->shared_network->ipv6_pool_types |= IPV6_POOL_TYPE_BIT(type);
 
 	/* Update the number of elements in the pond.  Conveniently
 	 * we have the total size of the block in bits and the amount
@@ -5227,6 +5243,11 @@ parse_ia_na_declaration(struct parse *cfile) {
 	ia->ia_type = D6O_IA_NA;
 
 	token = next_token(&val, NULL, cfile);
+	if (token == RENEW) {
+		parse_ia_renew(cfile, ia, ia_na_active);
+		ia_dereference(&ia, MDL);
+		return;
+	}
 	if (token != LBRACE) {
 		parse_warn(cfile, "corrupt lease file; expecting left brace");
 		skip_to_semi(cfile);
@@ -5617,9 +5638,9 @@ parse_ia_na_declaration(struct parse *cfile) {
 	if (ia_hash_lookup(&old_ia, ia_na_active,
 			   (unsigned char *)ia->iaid_duid.data,
 			   ia->iaid_duid.len, MDL)) {
-		ia_hash_delete(ia_na_active, 
-			       (unsigned char *)ia->iaid_duid.data,
-			       ia->iaid_duid.len, MDL);
+		ia_active_delete(ia_na_active,
+				 (unsigned char *)ia->iaid_duid.data,
+				 ia->iaid_duid.len, MDL);
 		ia_dereference(&old_ia, MDL);
 	}
 
@@ -5627,9 +5648,7 @@ parse_ia_na_declaration(struct parse *cfile) {
 	 * If we have addresses, add this, otherwise don't bother.
 	 */
 	if (ia->num_iasubopt > 0) {
-		ia_hash_add(ia_na_active, 
-			    (unsigned char *)ia->iaid_duid.data,
-			    ia->iaid_duid.len, ia, MDL);
+		ia_active_add(ia_na_active, ia, MDL);
 	}
 	ia_dereference(&ia, MDL);
 #endif /* defined(DHCPv6) */
@@ -5674,6 +5693,11 @@ parse_ia_ta_declaration(struct parse *cfile) {
 	ia->ia_type = D6O_IA_TA;
 
 	token = next_token(&val, NULL, cfile);
+	if (token == RENEW) {
+		parse_ia_renew(cfile, ia, ia_ta_active);
+		ia_dereference(&ia, MDL);
+		return;
+	}
 	if (token != LBRACE) {
 		parse_warn(cfile, "corrupt lease file; expecting left brace");
 		skip_to_semi(cfile);
@@ -6053,9 +6077,9 @@ parse_ia_ta_declaration(struct parse *cfile) {
 	if (ia_hash_lookup(&old_ia, ia_ta_active,
 			   (unsigned char *)ia->iaid_duid.data,
 			   ia->iaid_duid.len, MDL)) {
-		ia_hash_delete(ia_ta_active, 
-			       (unsigned char *)ia->iaid_duid.data,
-			       ia->iaid_duid.len, MDL);
+		ia_active_delete(ia_ta_active,
+				 (unsigned char *)ia->iaid_duid.data,
+				 ia->iaid_duid.len, MDL);
 		ia_dereference(&old_ia, MDL);
 	}
 
@@ -6063,9 +6087,7 @@ parse_ia_ta_declaration(struct parse *cfile) {
 	 * If we have addresses, add this, otherwise don't bother.
 	 */
 	if (ia->num_iasubopt > 0) {
-		ia_hash_add(ia_ta_active, 
-			    (unsigned char *)ia->iaid_duid.data,
-			    ia->iaid_duid.len, ia, MDL);
+		ia_active_add(ia_ta_active, ia, MDL);
 	}
 	ia_dereference(&ia, MDL);
 #endif /* defined(DHCPv6) */
@@ -6111,6 +6133,11 @@ parse_ia_pd_declaration(struct parse *cfile) {
 	ia->ia_type = D6O_IA_PD;
 
 	token = next_token(&val, NULL, cfile);
+	if (token == RENEW) {
+		parse_ia_renew(cfile, ia, ia_pd_active);
+		ia_dereference(&ia, MDL);
+		return;
+	}
 	if (token != LBRACE) {
 		parse_warn(cfile, "corrupt lease file; expecting left brace");
 		skip_to_semi(cfile);
@@ -6450,9 +6477,8 @@ parse_ia_pd_declaration(struct parse *cfile) {
 		/* Find the pool this address is in. We need to check prefix
 		 * lengths too in case the pool has been reconfigured. */
 		pool = NULL;
-		if ((find_ipv6_pool(&pool, D6O_IA_PD,
-				   &iapref->addr) != ISC_R_SUCCESS) ||
-		     (pool->units != iapref->plen)) {
+		if (find_ipv6_prefix_pool(&pool, &iapref->addr,
+					  iapref->plen) != ISC_R_SUCCESS) {
 			inet_ntop(AF_INET6, &iapref->addr,
 				  addr_buf, sizeof(addr_buf));
 			log_error("No pool found for prefix %s/%d", addr_buf,
@@ -6492,9 +6518,9 @@ parse_ia_pd_declaration(struct parse *cfile) {
 	if (ia_hash_lookup(&old_ia, ia_pd_active,
 			   (unsigned char *)ia->iaid_duid.data,
 			   ia->iaid_duid.len, MDL)) {
-		ia_hash_delete(ia_pd_active,
-			       (unsigned char *)ia->iaid_duid.data,
-			       ia->iaid_duid.len, MDL);
+		ia_active_delete(ia_pd_active,
+				 (unsigned char *)ia->iaid_duid.data,
+				 ia->iaid_duid.len, MDL);
 		ia_dereference(&old_ia, MDL);
 	}
 
@@ -6502,9 +6528,7 @@ parse_ia_pd_declaration(struct parse *cfile) {
 	 * If we have prefixes, add this, otherwise don't bother.
 	 */
 	if (ia->num_iasubopt > 0) {
-		ia_hash_add(ia_pd_active, 
-			    (unsigned char *)ia->iaid_duid.data,
-			    ia->iaid_duid.len, ia, MDL);
+		ia_active_add(ia_pd_active, ia, MDL);
 	}
 	ia_dereference(&ia, MDL);
 #endif /* defined(DHCPv6) */
@@ -6835,6 +6859,111 @@ uint32_t parse_byte_order_uint32(const void *source) {
 	return (value);
 }
 
+/*
+ * Parse the rest of an IA renew record, which follows the IAID_DUID and
+ * the "renew" keyword:
+ *
+ *   renew <cltt> { <address>[/<plen>] <prefer> <valid> <ends>; ... }
+ *
+ * db.c writes these in place of a full record when only the times of an
+ * IA have changed since its last full record.  Rather than building a new
+ * IA we update the one that record left in ia_table: each listed address
+ * takes its new lifetimes and end time, and anything not listed is left
+ * as it was.  ia only supplies the key and type.
+ */
+static void
+parse_ia_renew(struct parse *cfile, struct ia_xx *ia, ia_hash_t *ia_table) {
+	enum dhcp_token token;
+	const char *val;
+	struct ia_xx *old_ia = NULL;
+	struct iasubopt *iasubopt;
+	struct iaddr iaddr;
+	u_int8_t plen = 0;
+	u_int32_t nums[3];
+	TIME cltt;
+	int i;
+
+	token = next_token(&val, NULL, cfile);
+	if (token != NUMBER) {
+		parse_warn(cfile, "corrupt lease file; expecting renew cltt");
+		skip_to_semi(cfile);
+		return;
+	}
+	cltt = (TIME)strtoul(val, NULL, 10);
+
+	token = next_token(&val, NULL, cfile);
+	if (token != LBRACE) {
+		parse_warn(cfile, "corrupt lease file; expecting left brace");
+		skip_to_semi(cfile);
+		return;
+	}
+
+	if (!ia_hash_lookup(&old_ia, ia_table,
+			    (unsigned char *)ia->iaid_duid.data,
+			    ia->iaid_duid.len, MDL)) {
+		/* The full record was dropped, e.g. its pool is gone. */
+		skip_to_rbrace(cfile, 1);
+		return;
+	}
+
+	for (;;) {
+		token = peek_token(&val, NULL, cfile);
+		if (token == RBRACE) {
+			skip_token(&val, NULL, cfile);
+			break;
+		}
+
+		if (ia->ia_type == D6O_IA_PD) {
+			if (!parse_ip6_prefix(cfile, &iaddr, &plen))
+				goto corrupt;
+		} else if (!parse_ip6_addr(cfile, &iaddr)) {
+			goto corrupt;
+		}
+
+		for (i = 0; i < 3; i++) {
+			token = next_token(&val, NULL, cfile);
+			if (token != NUMBER) {
+				parse_warn(cfile, "corrupt lease file; "
+					   "%s is not a valid renew time",
+					   val);
+				goto corrupt;
+			}
+			nums[i] = (u_int32_t)strtoul(val, NULL, 10);
+		}
+		if (!parse_semi(cfile))
+			goto corrupt;
+
+		iasubopt = NULL;
+		for (i = 0; i < old_ia->num_iasubopt; i++) {
+			if ((old_ia->iasubopt[i]->plen == plen) &&
+			    (memcmp(&old_ia->iasubopt[i]->addr, iaddr.iabuf,
+				    sizeof(struct in6_addr)) == 0)) {
+				iasubopt = old_ia->iasubopt[i];
+				break;
+			}
+		}
+		if ((iasubopt == NULL) || (iasubopt->ipv6_pool == NULL) ||
+		    (iasubopt->state != FTS_ACTIVE)) {
+			log_error("No active lease found for renew of %s",
+				  piaddr(iaddr));
+			continue;
+		}
+
+		iasubopt->prefer = nums[0];
+		iasubopt->valid = nums[1];
+		iasubopt->soft_lifetime_end_time = (TIME)nums[2];
+		renew_lease6(iasubopt->ipv6_pool, iasubopt);
+	}
+
+	old_ia->cltt = cltt;
+	ia_dereference(&old_ia, MDL);
+	return;
+
+      corrupt:
+	skip_to_rbrace(cfile, 1);
+	ia_dereference(&old_ia, MDL);
+}
+
 /* !brief Parses an iaid/duid string into an iaid and struct ia
  *
  * Given a string containing the iaid-duid value read from the file,
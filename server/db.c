@@ -39,6 +39,13 @@ FILE *db_file;
 
 static int counting = 0;
 static int count = 0;
+
+/* Serial number of the last full IA record written, and its value when
+ * the current lease file was started.  An IA whose iasubopts were all
+ * stamped with the same serial above the floor is known to have a full
+ * record in the current file. */
+static u_int32_t ia_write_serial = 0;
+static u_int32_t ia_write_floor = 0;
 TIME write_time;
 int lease_file_is_corrupt = 0;
 
@@ -129,8 +136,8 @@ int write_lease
 	     fprintf(db_file, "\n  ends %s", tval) < 0))
 		++errors;
 
-	if (lease->tstp &&
-	    ((tval = print_time(lease->tstp)) == NULL ||
+	if (LEASE_COLD_RO(lease)->tstp &&
+	    ((tval = print_time(LEASE_COLD_RO(lease)->tstp)) == NULL ||
 	     fprintf(db_file, "\n  tstp %s", tval) < 0))
 		++errors;
 
@@ -139,13 +146,13 @@ int write_lease
 	     fprintf(db_file, "\n  tsfp %s", tval) < 0))
 		++errors;
 
-	if (lease->atsfp &&
-	    ((tval = print_time(lease->atsfp)) == NULL ||
+	if (LEASE_COLD_RO(lease)->atsfp &&
+	    ((tval = print_time(LEASE_COLD_RO(lease)->atsfp)) == NULL ||
 	     fprintf(db_file, "\n  atsfp %s", tval) < 0))
 		++errors;
 
-	if (lease->cltt &&
-	    ((tval = print_time(lease->cltt)) == NULL ||
+	if (LEASE_COLD_RO(lease)->cltt &&
+	    ((tval = print_time(LEASE_COLD_RO(lease)->cltt)) == NULL ||
 	     fprintf(db_file, "\n  cltt %s", tval) < 0))
 		++errors;
 
@@ -189,10 +196,10 @@ int write_lease
 
 	/* If this lease is billed to a class and is still valid,
 	   write it out. */
-	if (lease -> billing_class && lease -> ends > cur_time) {
-		if (!write_billing_class (lease -> billing_class)) {
+	if (LEASE_COLD_RO(lease)->billing_class && lease -> ends > cur_time) {
+		if (!write_billing_class (LEASE_COLD_RO(lease)->billing_class)) {
 			log_error ("unable to write class %s",
-				   lease -> billing_class -> name);
+				   LEASE_COLD_RO(lease)->billing_class -> name);
 			++errors;
 		}
 	}
@@ -220,8 +227,8 @@ int write_lease
 			++errors;
 	}
 
-	if (lease->scope != NULL) {
-	    for (b = lease->scope->bindings; b; b = b->next) {
+	if (LEASE_COLD_RO(lease)->scope != NULL) {
+	    for (b = LEASE_COLD_RO(lease)->scope->bindings; b; b = b->next) {
 		if (!b->value)
 			continue;
 
@@ -230,13 +237,13 @@ int write_lease
 	    }
 	}
 
-	if (lease -> agent_options) {
+	if (LEASE_COLD_RO(lease)->agent_options) {
 	    struct option_cache *oc;
 	    struct data_string ds;
 	    pair p;
 
 	    memset (&ds, 0, sizeof ds);
-	    for (p = lease -> agent_options -> first; p; p = p -> cdr) {
+	    for (p = LEASE_COLD_RO(lease)->agent_options -> first; p; p = p -> cdr) {
 	        oc = (struct option_cache *)p -> car;
 	        if (oc -> data.len) {
 	    	errno = 0;
@@ -249,9 +256,9 @@ int write_lease
 	        }
 	    }
 	}
-	if (lease -> client_hostname &&
-	    db_printable((unsigned char *)lease->client_hostname)) {
-		s = quotify_string (lease -> client_hostname, MDL);
+	if (LEASE_COLD_RO(lease)->client_hostname &&
+	    db_printable((unsigned char *)LEASE_COLD_RO(lease)->client_hostname)) {
+		s = quotify_string (LEASE_COLD_RO(lease)->client_hostname, MDL);
 		if (s) {
 			errno = 0;
 			fprintf (db_file, "\n  client-hostname \"%s\";", s);
@@ -261,22 +268,22 @@ int write_lease
 		} else
 			++errors;
 	}
-	if (lease->on_star.on_expiry) {
+	if (LEASE_COLD_RO(lease)->on_star.on_expiry) {
 		errno = 0;
 		fprintf (db_file, "\n  on expiry%s {",
-			 lease->on_star.on_expiry == lease->on_star.on_release
+			 LEASE_COLD_RO(lease)->on_star.on_expiry == LEASE_COLD_RO(lease)->on_star.on_release
 			 ? " or release" : "");
-		write_statements (db_file, lease->on_star.on_expiry, 4);
+		write_statements (db_file, LEASE_COLD_RO(lease)->on_star.on_expiry, 4);
 		/* XXX */
 		fprintf (db_file, "\n  }");
 		if (errno)
 			++errors;
 	}
-	if (lease->on_star.on_release &&
-	    lease->on_star.on_release != lease->on_star.on_expiry) {
+	if (LEASE_COLD_RO(lease)->on_star.on_release &&
+	    LEASE_COLD_RO(lease)->on_star.on_release != LEASE_COLD_RO(lease)->on_star.on_expiry) {
 		errno = 0;
 		fprintf (db_file, "\n  on release {");
-		write_statements (db_file, lease->on_star.on_release, 4);
+		write_statements (db_file, LEASE_COLD_RO(lease)->on_star.on_release, 4);
 		/* XXX */
 		fprintf (db_file, "\n  }");
 		if (errno)
@@ -514,6 +521,145 @@ int write_group (group)
 	return !errors;
 }
 
+static u_int32_t
+fnv_add(u_int32_t h, const void *buf, size_t len) {
+	const unsigned char *p = buf;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Fingerprint everything a full IA record would write for an iasubopt
+ * other than its times and lifetimes: the IA key and size, the state and
+ * the "set" bindings and "on" statements.
+ */
+static u_int32_t
+iasubopt_write_hash(const struct ia_xx *ia, const struct iasubopt *iasubopt) {
+	struct binding *bnd;
+	u_int32_t h = 2166136261U;
+
+	h = fnv_add(h, &ia->ia_type, sizeof(ia->ia_type));
+	h = fnv_add(h, ia->iaid_duid.data, ia->iaid_duid.len);
+	h = fnv_add(h, &ia->num_iasubopt, sizeof(ia->num_iasubopt));
+	h = fnv_add(h, &iasubopt->state, sizeof(iasubopt->state));
+	h = fnv_add(h, &iasubopt->plen, sizeof(iasubopt->plen));
+
+	bnd = (iasubopt->scope != NULL) ? iasubopt->scope->bindings : NULL;
+	for (; bnd != NULL; bnd = bnd->next) {
+		if (bnd->value == NULL)
+			continue;
+		h = fnv_add(h, bnd->name, strlen(bnd->name) + 1);
+		h = fnv_add(h, &bnd->value->type, sizeof(bnd->value->type));
+		switch (bnd->value->type) {
+		      case binding_data:
+			h = fnv_add(h, bnd->value->value.data.data,
+				    bnd->value->value.data.len);
+			break;
+		      case binding_numeric:
+		      case binding_boolean:
+			h = fnv_add(h, &bnd->value->value.intval,
+				    sizeof(bnd->value->value.intval));
+			break;
+		      default:
+			break;
+		}
+	}
+
+	h = fnv_add(h, &iasubopt->on_star.on_expiry,
+		    sizeof(iasubopt->on_star.on_expiry));
+	h = fnv_add(h, &iasubopt->on_star.on_release,
+		    sizeof(iasubopt->on_star.on_release));
+	return h;
+}
+
+/*
+ * If the current lease file already holds a full record of this IA and
+ * nothing but its cltt, lifetimes and end times has changed since, write
+ * a one-line renew record instead:
+ *
+ *   ia-na <id> renew <cltt> { <address> <prefer> <valid> <ends>; ... }
+ *
+ * Returns 1 if a renew record was written, 0 if the caller must write a
+ * full record and -1 on a write error.
+ */
+static int
+write_ia_renew(const struct ia_xx *ia) {
+	struct iasubopt *iasubopt;
+	char addr_buf[sizeof("ffff:ffff:ffff:ffff:ffff:ffff.255.255.255.255")];
+	const char *type;
+	u_int32_t serial;
+	char *s;
+	int i;
+
+	switch (ia->ia_type) {
+	      case D6O_IA_NA:
+		type = "ia-na";
+		break;
+	      case D6O_IA_TA:
+		type = "ia-ta";
+		break;
+	      case D6O_IA_PD:
+		type = "ia-pd";
+		break;
+	      default:
+		return 0;
+	}
+
+	if (!counting || (ia->num_iasubopt <= 0) || (ia->cltt == MIN_TIME))
+		return 0;
+
+	serial = ia->iasubopt[0]->write_serial;
+	if ((serial == 0) || (serial <= ia_write_floor))
+		return 0;
+
+	for (i = 0; i < ia->num_iasubopt; i++) {
+		iasubopt = ia->iasubopt[i];
+		if ((iasubopt->state != FTS_ACTIVE) ||
+		    (iasubopt->hard_lifetime_end_time == MAX_TIME) ||
+		    (iasubopt->write_serial != serial) ||
+		    (iasubopt->write_hash !=
+		     iasubopt_write_hash(ia, iasubopt)))
+			return 0;
+	}
+
+	s = format_lease_id(ia->iaid_duid.data, ia->iaid_duid.len,
+			    lease_id_format, MDL);
+	if (s == NULL)
+		return -1;
+	i = fprintf(db_file, "%s %s renew %lu {", type, s,
+		    (unsigned long)ia->cltt);
+	dfree(s, MDL);
+	if (i < 0)
+		return -1;
+
+	for (i = 0; i < ia->num_iasubopt; i++) {
+		iasubopt = ia->iasubopt[i];
+
+		inet_ntop(AF_INET6, &iasubopt->addr,
+			  addr_buf, sizeof(addr_buf));
+		if ((ia->ia_type == D6O_IA_PD) &&
+		    (fprintf(db_file, " %s/%d", addr_buf,
+			     (int)iasubopt->plen) < 0))
+			return -1;
+		if ((ia->ia_type != D6O_IA_PD) &&
+		    (fprintf(db_file, " %s", addr_buf) < 0))
+			return -1;
+		if (fprintf(db_file, " %u %u %lu;",
+			    (unsigned)iasubopt->prefer,
+			    (unsigned)iasubopt->valid,
+			    (unsigned long)iasubopt->hard_lifetime_end_time) < 0)
+			return -1;
+	}
+	if (fprintf(db_file, " }\n") < 0)
+		return -1;
+
+	return 1;
+}
+
 /*
  * Write an IA and the options it has.
  */
@@ -563,6 +709,27 @@ write_ia(const struct ia_xx *ia) {
 		++count;
 	}
 
+	switch (write_ia_renew(ia)) {
+	      case 1:
+		fflush(db_file);
+		return 1;
+	      case -1:
+		goto error_exit;
+	      default:
+		break;
+	}
+
+	/* Stamp each iasubopt with this record, so later changes that
+	 * touch only its times can be written as renew records. */
+	++ia_write_serial;
+	if (ia_write_serial == 0)
+		++ia_write_serial;
+	for (i = 0; i < ia->num_iasubopt; i++) {
+		ia->iasubopt[i]->write_serial = ia_write_serial;
+		ia->iasubopt[i]->write_hash =
+			iasubopt_write_hash(ia, ia->iasubopt[i]);
+	}
+
 	s = format_lease_id(ia->iaid_duid.data, ia->iaid_duid.len,
 			    lease_id_format, MDL);
 	if (s == NULL) {
@@ -1228,6 +1395,7 @@ int new_lease_file (int test_mode)
 
 	/* Write out all the leases that we know of... */
 	counting = 0;
+	ia_write_floor = ia_write_serial;
 	if (!write_leases ())
 		goto fail;
 
@@ -130,9 +130,9 @@ ddns_updates(struct packet *packet, struct lease *lease, struct lease *old,
 	 */
 
 	if (lease != NULL) {
-		if ((old != NULL) && (old->ddns_cb != NULL)) {
-			ddns_cancel(old->ddns_cb, MDL);
-			old->ddns_cb = NULL;
+		if ((old != NULL) && (LEASE_COLD_RO(old)->ddns_cb != NULL)) {
+			ddns_cancel(LEASE_COLD_RO(old)->ddns_cb, MDL);
+			LEASE_COLD(old)->ddns_cb = NULL;
 		}
 	} else if (lease6 != NULL) {
 		if ((old6 != NULL) && (old6->ddns_cb != NULL)) {
@@ -164,7 +164,7 @@ ddns_updates(struct packet *packet, struct lease *lease, struct lease *old,
 	 * get static leases and don't need to flag them.
 	 */
 	if (lease != NULL) {
-		scope = &(lease->scope);
+		scope = &(LEASE_COLD(lease)->scope);
 		ddns_cb->address = lease->ip_addr;
 		if (lease->flags & STATIC_LEASE)
 			ddns_cb->flags |= DDNS_STATIC_LEASE;
@@ -258,15 +258,15 @@ ddns_updates(struct packet *packet, struct lease *lease, struct lease *old,
 	/* If we don't have a host name based on ddns-hostname then use
 	 * the host declaration name if there is one and use-host-decl-names
 	 * is turned on. */
-	if ((s1 == 0) && (lease && lease->host && lease->host->name)) {
+	if ((s1 == 0) && (lease && LEASE_COLD_RO(lease)->host && LEASE_COLD_RO(lease)->host->name)) {
 		oc = lookup_option(&server_universe, options,
 				   SV_USE_HOST_DECL_NAMES);
 		if (evaluate_boolean_option_cache(NULL, packet, lease,
 						  NULL, packet->options,
 						  options, scope, oc, MDL)) {
 			s1 = ((data_string_new(&ddns_hostname,
-					      lease->host->name,
-					      strlen(lease->host->name),
+					      LEASE_COLD_RO(lease)->host->name,
+					      strlen(LEASE_COLD_RO(lease)->host->name),
                                               MDL) && ddns_hostname.len > 0));
 		}
 	}
@@ -849,7 +849,7 @@ ddns_update_lease_text(dhcp_ddns_cb_t        *ddns_cb,
 		scope = inscope;
 	} else if (ddns_cb->address.len == 4) {
 		if (find_lease_by_ip_addr(&lease, ddns_cb->address, MDL) != 0){
-			scope = &(lease->scope);
+			scope = &(LEASE_COLD(lease)->scope);
 		}
 	} else if (ddns_cb->address.len == 16) {
 		memcpy(&addr, &ddns_cb->address.iabuf, 16);
@@ -1028,7 +1028,7 @@ safe_lease_update(struct lease *lease,
 			  MDL, file, line);
 	}
 
-	if ( (lease->ddns_cb == NULL) && (newcb == NULL) ) {
+	if ( (LEASE_COLD_RO(lease)->ddns_cb == NULL) && (newcb == NULL) ) {
 		/*
 		 * Trying to clean up pointer that is already null. We
 		 * are most likely trying to update wrong lease here.
@@ -1055,7 +1055,7 @@ safe_lease_update(struct lease *lease,
 		return;
 	}
 
-	if ( (lease->ddns_cb != NULL) && (lease->ddns_cb != oldcb) ) {
+	if ( (LEASE_COLD_RO(lease)->ddns_cb != NULL) && (LEASE_COLD_RO(lease)->ddns_cb != oldcb) ) {
 		/*
 		 * There is existing cb structure, but it differs from
 		 * what we expected to see there. Most likely we are
@@ -1081,7 +1081,7 @@ safe_lease_update(struct lease *lease,
 	/* additional IPv4 specific checks may be added here */
 
 	/* update the lease */
-	lease->ddns_cb = newcb;
+	LEASE_COLD(lease)->ddns_cb = newcb;
 }
 
 void
@@ -1960,8 +1960,8 @@ ddns_removals(struct lease    *lease,
 	 */
 
 	if (add_ddns_cb == NULL) {
-		if ((lease != NULL) && (lease->ddns_cb != NULL)) {
-			ddns_cb = lease->ddns_cb;
+		if ((lease != NULL) && (LEASE_COLD_RO(lease)->ddns_cb != NULL)) {
+			ddns_cb = LEASE_COLD_RO(lease)->ddns_cb;
 
 			/*
 			 * Is the old request an update or did the
@@ -1973,8 +1973,8 @@ ddns_removals(struct lease    *lease,
 			    ((active == ISC_FALSE) &&
 			     ((ddns_cb->flags & DDNS_ACTIVE_LEASE) != 0))) {
 				/* Cancel the current request */
-				ddns_cancel(lease->ddns_cb, MDL);
-				lease->ddns_cb = NULL;
+				ddns_cancel(LEASE_COLD_RO(lease)->ddns_cb, MDL);
+				LEASE_COLD(lease)->ddns_cb = NULL;
 			} else {
 				/* Remvoval, check and remove updates */
 				if (ddns_cb->next_op != NULL) {
@@ -2035,7 +2035,7 @@ ddns_removals(struct lease    *lease,
 	 * get static leases and don't need to flag them.
 	 */
 	if (lease != NULL) {
-		scope = &(lease->scope);
+		scope = &(LEASE_COLD(lease)->scope);
 		ddns_cb->address = lease->ip_addr;
 		if (lease->flags & STATIC_LEASE)
 			ddns_cb->flags |= DDNS_STATIC_LEASE;
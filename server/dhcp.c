@@ -42,9 +42,6 @@ unsigned int dit_count = 0;
 
 static void maybe_return_agent_options(struct packet *packet,
 				       struct option_state *options);
-static int reuse_lease (struct packet* packet, struct lease* new_lease,
-			struct lease* lease, struct lease_state *state,
-			int offer);
 #if defined(DHCPv6) && defined(DHCP4o6)
 static int locate_network6(struct packet *packet);
 #endif
@@ -196,7 +193,7 @@ void dhcp(struct packet *packet)
 			goto nolease;
 
 		/* If there are no agent options on the lease, it's not interesting. */
-		if (!lease->agent_options)
+		if (!LEASE_COLD_RO(lease)->agent_options)
 			goto nolease;
 
 		/* The client should not be unicasting a renewal if its lease
@@ -240,15 +237,18 @@ void dhcp(struct packet *packet)
 		/* ҽagent_universepacket->optionuniverses */
 		option_chain_head_reference((struct option_chain_head **)
 					     &(packet->options->universes[agent_universe.index]),
-					     lease->agent_options, MDL);
+					     LEASE_COLD_RO(lease)->agent_options, MDL);
 
 		if (packet->options->universe_count <= agent_universe.index)
 			packet->options->universe_count = agent_universe.index + 1;
 
 		packet->agent_options_stashed = ISC_TRUE;
+		packet->options->generation++;
 	}
       nolease:
 
+	packet_index_relay_ids(packet);
+
 	/* If a client null terminates options it sends, it probably
 	 * expects the server to reciprocate.
 	 */
@@ -333,9 +333,9 @@ void dhcpdiscover
 	find_lease(&lease, packet, packet->shared_network, 0, &peer_has_leases, (struct lease *)0, MDL);
 
     /* discoverÿͻһʱֻܷһdiscover */
-	if (dit && dit_count && lease && lease->cltt)
+	if (dit && dit_count && lease && LEASE_COLD_RO(lease)->cltt)
 	{
-		if (cur_time - lease->cltt < dit)
+		if (cur_time - LEASE_COLD_RO(lease)->cltt < dit)
 		{
 			if (lease->it_count >= dit_count)
 			{
@@ -361,12 +361,12 @@ void dhcpdiscover
 	}
 
 	/* hostnameǷɴӡsֵ */
-	if (lease && lease->client_hostname)
+	if (lease && LEASE_COLD_RO(lease)->client_hostname)
 	{
-		if ((strlen(lease->client_hostname) <= 64) && 
-			db_printable((unsigned char *)lease->client_hostname))
+		if ((strlen(LEASE_COLD_RO(lease)->client_hostname) <= 64) && 
+			db_printable((unsigned char *)LEASE_COLD_RO(lease)->client_hostname))
 		{
-			s = lease->client_hostname;
+			s = LEASE_COLD_RO(lease)->client_hostname;
 		}
 		else
 		{
@@ -473,9 +473,9 @@ void dhcpdiscover
 #endif
 
 	/* If it's an expired lease, get rid of any bindings. */
-	if (lease->ends < cur_time && lease->scope)
+	if (lease->ends < cur_time && LEASE_COLD_RO(lease)->scope)
 	{
-		binding_scope_dereference(&lease->scope, MDL);
+		binding_scope_dereference(&LEASE_COLD(lease)->scope, MDL);
 	}
 
 	/* Set the lease to really expire in 2 minutes, unless it has
@@ -556,11 +556,11 @@ void dhcprequest
 		find_lease(&lease, packet,
 			    subnet->shared_network, &ours, 0, ip_lease, MDL);
 
-	if (lease && lease->client_hostname) 
+	if (lease && LEASE_COLD_RO(lease)->client_hostname) 
 	{
-		if ((strlen(lease->client_hostname) <= 64) &&
-		    db_printable((unsigned char *)lease->client_hostname))
-			s = lease->client_hostname;
+		if ((strlen(LEASE_COLD_RO(lease)->client_hostname) <= 64) &&
+		    db_printable((unsigned char *)LEASE_COLD_RO(lease)->client_hostname))
+			s = LEASE_COLD_RO(lease)->client_hostname;
 		else
 			s = "Hostname Unsuitable for Printing";
 	} 
@@ -912,11 +912,11 @@ void dhcprelease
 		     packet->raw->chaddr, packet->raw->hlen)))
 		lease_dereference (&lease, MDL);
 
-	if (lease && lease->client_hostname) 
+	if (lease && LEASE_COLD_RO(lease)->client_hostname) 
 	{
-		if ((strlen(lease->client_hostname) <= 64) &&
-		    db_printable((unsigned char *)lease->client_hostname))
-			s = lease->client_hostname;
+		if ((strlen(LEASE_COLD_RO(lease)->client_hostname) <= 64) &&
+		    db_printable((unsigned char *)LEASE_COLD_RO(lease)->client_hostname))
+			s = LEASE_COLD_RO(lease)->client_hostname;
 		else
 			s = "Hostname Unsuitable for Printing";
 	} 
@@ -1024,11 +1024,11 @@ void dhcpdecline
 	data_string_forget(&data, MDL);
 	find_lease_by_ip_addr(&lease, cip, MDL);
 
-	if (lease && lease->client_hostname) 
+	if (lease && LEASE_COLD_RO(lease)->client_hostname) 
 	{
-		if ((strlen(lease->client_hostname) <= 64) &&
-		    db_printable((unsigned char *)lease->client_hostname))
-			s = lease->client_hostname;
+		if ((strlen(LEASE_COLD_RO(lease)->client_hostname) <= 64) &&
+		    db_printable((unsigned char *)LEASE_COLD_RO(lease)->client_hostname))
+			s = LEASE_COLD_RO(lease)->client_hostname;
 		else
 			s = "Hostname Unsuitable for Printing";
 	}
@@ -1075,7 +1075,7 @@ void dhcpdecline
 	    evaluate_boolean_option_cache (&ignorep, packet, lease,
 					   (struct client_state *)0,
 					   packet -> options, options,
-					   &lease -> scope, oc, MDL)) {
+					   &LEASE_COLD(lease)->scope, oc, MDL)) {
 	    /* If we found a lease, mark it as unusable and complain. */
 	    if (lease) 
         {
@@ -1135,6 +1135,96 @@ u_int16_t dhcp_check_relayport(packet)
 }
 #endif
 
+/* Point *data and *len at the value of an option received in the
+   packet, if it is there and has one. */
+static void
+relay_id_option(struct option_state *options, struct universe *universe,
+		unsigned code, u_int8_t **data, int *len)
+{
+	struct option_cache *oc;
+
+	*data = NULL;
+	*len = 0;
+
+	oc = lookup_option(universe, options, code);
+	if (oc == NULL || oc->expression != NULL || oc->data.len == 0)
+		return;
+
+	*data = (u_int8_t *)oc->data.data;
+	*len = oc->data.len;
+}
+
+/*!
+ * \brief Index the relay agent identifiers of a packet
+ *
+ * Records where the circuit-id and remote-id suboptions of the relay
+ * agent information option are, including ones stashed from the lease
+ * for a unicast renewal, so that code keyed on them can read them
+ * through packet_relay_id() without going back to the option state.
+ * For a DHCPv6 relay-forward message the interface-id and remote-id
+ * options are recorded instead.
+ *
+ * The recorded pointers refer to option data held by the packet's
+ * option state and are good for as long as the packet is.
+ *
+ * \param packet the received packet, after its options are parsed
+ */
+void
+packet_index_relay_ids(struct packet *packet)
+{
+	struct universe *universe = &agent_universe;
+	unsigned circuit_code = RAI_CIRCUIT_ID;
+	unsigned remote_code = RAI_REMOTE_ID;
+
+#if defined(DHCPv6)
+	if (packet->dhcpv6_msg_type != 0) {
+		if (packet->dhcpv6_msg_type != DHCPV6_RELAY_FORW) {
+			packet->circuit_id = packet->remote_id = NULL;
+			packet->circuit_id_len = packet->remote_id_len = 0;
+			return;
+		}
+		universe = &dhcpv6_universe;
+		circuit_code = D6O_INTERFACE_ID;
+		remote_code = D6O_REMOTE_ID;
+	}
+#endif
+
+	relay_id_option(packet->options, universe, circuit_code,
+			&packet->circuit_id, &packet->circuit_id_len);
+	relay_id_option(packet->options, universe, remote_code,
+			&packet->remote_id, &packet->remote_id_len);
+}
+
+/*!
+ * \brief Get a relay agent identifier of a packet
+ *
+ * \param packet a packet indexed by packet_index_relay_ids()
+ * \param code RAI_CIRCUIT_ID or RAI_REMOTE_ID; for a DHCPv6 relay
+ *        message these select the interface-id and remote-id
+ * \param result set to the identifier, which is not copied and needs
+ *        no forgetting
+ *
+ * \return 1 if the packet carries the identifier, 0 otherwise
+ */
+int
+packet_relay_id(struct packet *packet, unsigned code,
+		struct data_string *result)
+{
+	memset(result, 0, sizeof(*result));
+
+	if (code == RAI_CIRCUIT_ID && packet->circuit_id != NULL) {
+		result->data = packet->circuit_id;
+		result->len = packet->circuit_id_len;
+	} else if (code == RAI_REMOTE_ID && packet->remote_id != NULL) {
+		result->data = packet->remote_id;
+		result->len = packet->remote_id_len;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
 /* ѾȡIPַĿͻoption */
 void dhcpinform
 (
@@ -1597,9 +1687,8 @@ void dhcpinform
 	if (option_cache_allocate (&oc, MDL)) {
 		if (make_const_data (&oc -> expression,
 				     &dhcpack, 1, 0, 0, MDL)) {
-			option_code_hash_lookup(&oc->option,
-						dhcp_universe.code_hash,
-						&i, 0, MDL);
+			option_code_lookup(&oc->option,
+						&dhcp_universe, i, MDL);
 			save_option (&dhcp_universe, options, oc);
 		}
 		option_cache_dereference (&oc, MDL);
@@ -1617,9 +1706,8 @@ void dhcpinform
 					     subnet -> netmask.iabuf,
 					     subnet -> netmask.len,
 					     0, 0, MDL)) {
-				option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash,
-							&i, 0, MDL);
+				option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 				save_option (&dhcp_universe, options, oc);
 			}
 			option_cache_dereference (&oc, MDL);
@@ -1879,8 +1967,7 @@ void nak_lease (packet, cip, network_group)
 		return;
 	}
 	i = DHO_DHCP_MESSAGE_TYPE;
-	option_code_hash_lookup(&oc->option, dhcp_universe.code_hash,
-				&i, 0, MDL);
+	option_code_lookup(&oc->option, &dhcp_universe, i, MDL);
 	save_option (&dhcp_universe, options, oc);
 	option_cache_dereference (&oc, MDL);
 		     
@@ -1903,8 +1990,7 @@ void nak_lease (packet, cip, network_group)
 		return;
 	}
 	i = DHO_DHCP_MESSAGE;
-	option_code_hash_lookup(&oc->option, dhcp_universe.code_hash,
-				&i, 0, MDL);
+	option_code_lookup(&oc->option, &dhcp_universe, i, MDL);
 	save_option (&dhcp_universe, options, oc);
 	option_cache_dereference (&oc, MDL);
 
@@ -2117,7 +2203,7 @@ void echo_client_id
 	oc = lookup_option(&server_universe, in_options, SV_ECHO_CLIENT_ID);
 	if (oc && evaluate_boolean_option_cache(&ignorep, packet, lease,
                                                 NULL, packet->options, in_options,
-                                                (lease ? &lease->scope : NULL), oc, MDL)) 
+                                                (lease ? &LEASE_COLD(lease)->scope : NULL), oc, MDL)) 
 	{
 		struct data_string client_id;
 		unsigned int opcode = DHO_DHCP_CLIENT_IDENTIFIER;
@@ -2131,7 +2217,7 @@ void echo_client_id
 		if (oc && evaluate_option_cache(&client_id,
 						packet, NULL, NULL,
 						packet->options, NULL,
-						(lease ? &lease->scope : NULL),
+						(lease ? &LEASE_COLD(lease)->scope : NULL),
 						oc, MDL)) {
 			/* Packet contained client-id, add it to out_options. */
 			oc = NULL;
@@ -2141,8 +2227,8 @@ void echo_client_id
 						    client_id.data,
 						    client_id.len, 1, 0, MDL)) 
                 {
-					option_code_hash_lookup(&oc->option,
-							        dhcp_universe.code_hash, &opcode, 0, MDL);
+					option_code_lookup(&oc->option,
+							        &dhcp_universe, opcode, MDL);
 					save_option(&dhcp_universe, out_options, oc);
 				}
 				option_cache_dereference(&oc, MDL);
@@ -2199,7 +2285,7 @@ void check_pool_threshold (packet, lease, state)
 	/* find the high threshold */
 	if (get_option_int(&poolhigh, &server_universe, packet, lease,  NULL,
 			   packet->options, state->options, state->options,
-			   &lease->scope, SV_LOG_THRESHOLD_HIGH, MDL) == 0) {
+			   &LEASE_COLD(lease)->scope, SV_LOG_THRESHOLD_HIGH, MDL) == 0) {
 		/* no threshold bail out */
 		return;
 	}
@@ -2227,7 +2313,7 @@ void check_pool_threshold (packet, lease, state)
 	 * have a valid one we default to 0. */
 	if ((get_option_int(&poollow, &server_universe, packet, lease,  NULL,
 			    packet->options, state->options, state->options,
-			    &lease->scope, SV_LOG_THRESHOLD_LOW, MDL) == 0) ||
+			    &LEASE_COLD(lease)->scope, SV_LOG_THRESHOLD_LOW, MDL) == 0) ||
 	    (poollow > 100)) {
 		poollow = 0;
 	}
@@ -2293,18 +2379,18 @@ void ack_lease
 	struct timeval tv;
 
 	/* If we're already acking this lease, don't do it again. */
-	if (lease->state)
+	if (LEASE_COLD_RO(lease)->state)
 		return;
 
 	/* Save original cltt for comparison later. */
-	lease_cltt = lease->cltt;
+	lease_cltt = LEASE_COLD_RO(lease)->cltt;
 
 	/* If the lease carries a host record, remember it. */
 	if (hp)
 		host_reference(&host, hp, MDL);
     /* ǹ̶Լ */
-	else if (lease->host)
-		host_reference(&host, lease->host, MDL);
+	else if (LEASE_COLD_RO(lease)->host)
+		host_reference(&host, LEASE_COLD_RO(lease)->host, MDL);
 
 	/* Allocate a lease state structure... */
 	state = new_lease_state(MDL);
@@ -2335,29 +2421,29 @@ void ack_lease
 		/* Get rid of any old expiry or release statements - by
 		   executing the statements below, we will be inserting new
 		   ones if there are any to insert. */
-		if (lease->on_star.on_expiry)
+		if (LEASE_COLD_RO(lease)->on_star.on_expiry)
 			executable_statement_dereference
-				(&lease->on_star.on_expiry, MDL);
-		if (lease->on_star.on_commit)
+				(&LEASE_COLD(lease)->on_star.on_expiry, MDL);
+		if (LEASE_COLD_RO(lease)->on_star.on_commit)
 			executable_statement_dereference
-				(&lease->on_star.on_commit, MDL);
-		if (lease->on_star.on_release)
+				(&LEASE_COLD(lease)->on_star.on_commit, MDL);
+		if (LEASE_COLD_RO(lease)->on_star.on_release)
 			executable_statement_dereference
-				(&lease->on_star.on_release, MDL);
+				(&LEASE_COLD(lease)->on_star.on_release, MDL);
 	}
 
 	/* subnetpoolͬãmin-lease-timeôpoolµЧ */
 	/* Execute statements in scope starting with the subnet scope. */
 	execute_statements_in_scope(NULL, packet, lease,
 				     NULL, packet->options,
-				     state->options, &lease->scope,
+				     state->options, &LEASE_COLD(lease)->scope,
 				     lease->subnet->group, NULL, NULL);
 
 	/* If the lease is from a pool, run the pool scope. */
 	if (lease->pool)
 		(execute_statements_in_scope(NULL, packet, lease, NULL,
 					     packet->options, state->options,
-					     &lease->scope, lease->pool->group,
+					     &LEASE_COLD(lease)->scope, lease->pool->group,
 					     lease->pool->shared_network->group,
 					     NULL));
 
@@ -2366,7 +2452,7 @@ void ack_lease
 	{
 		execute_statements_in_scope(NULL, packet, lease, NULL,
 					    packet->options, state->options,
-					    &lease->scope,
+					    &LEASE_COLD(lease)->scope,
 					    packet->classes[i - 1]->group,
 					    (lease->pool ? lease->pool->group
 					     : lease->subnet->group),
@@ -2389,7 +2475,7 @@ void ack_lease
 					   packet, lease,
 					   (struct client_state *)0,
 					   packet->options,
-					   state->options, &lease->scope,
+					   state->options, &LEASE_COLD(lease)->scope,
 					   oc, MDL)) 
 	{
 	    struct lease *seek;
@@ -2457,7 +2543,7 @@ void ack_lease
 						 (struct client_state *)0,
 						 packet->options,
 						 state->options,
-						 &lease->scope,
+						 &LEASE_COLD(lease)->scope,
 						 oc, MDL))) 
 		{
 			do {
@@ -2513,7 +2599,7 @@ void ack_lease
 		if (evaluate_option_cache(&d1, packet, lease,
 					   (struct client_state *)0,
 					   packet->options, state->options,
-					   &lease->scope, oc, MDL)) 
+					   &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			if (d1.len && ntohs(packet->raw->secs) < d1.data[0]) 
 			{
@@ -2548,7 +2634,7 @@ void ack_lease
 		    evaluate_option_cache (&d1, packet, lease,
 					   (struct client_state *)0,
 					   packet->options, state->options,
-					   &lease->scope, oc, MDL)) 
+					   &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			/* uid */
 			find_hosts_by_uid(&hp, d1.data, d1.len, MDL);
@@ -2605,7 +2691,7 @@ void ack_lease
 	if (host)
 		execute_statements_in_scope (NULL, packet, lease, NULL,
 					     packet->options, state->options,
-					     &lease->scope, host->group,
+					     &LEASE_COLD(lease)->scope, host->group,
 					     (lease->pool
 					      ? lease->pool->group
 					      : lease->subnet->group),
@@ -2620,7 +2706,7 @@ void ack_lease
 					    (struct client_state *)0,
 					    packet -> options,
 					    state -> options,
-					    &lease -> scope, oc, MDL)) 
+					    &LEASE_COLD(lease)->scope, oc, MDL)) 
 	{
 		if (!ignorep)
 			log_info ("%s: unknown client", msg);
@@ -2638,7 +2724,7 @@ void ack_lease
 					    (struct client_state *)0,
 					    packet->options,
 					    state->options,
-					    &lease->scope, oc, MDL)) 
+					    &LEASE_COLD(lease)->scope, oc, MDL)) 
 	{
 		if (!ignorep)
 			log_info ("%s: bootp disallowed", msg);
@@ -2656,7 +2742,7 @@ void ack_lease
 					    (struct client_state *)0,
 					    packet->options,
 					    state->options,
-					    &lease->scope, oc, MDL)) 
+					    &LEASE_COLD(lease)->scope, oc, MDL)) 
 	{
 		if (!ignorep)
 			log_info ("%s: booting disallowed", msg);
@@ -2672,10 +2758,10 @@ void ack_lease
 		/* See if the lease is currently being billed to a
 		   class, and if so, whether or not it can continue to
 		   be billed to that class. */
-		if (lease->billing_class) 
+		if (LEASE_COLD_RO(lease)->billing_class) 
 		{
 			for (i = 0; i < packet->class_count; i++)
-				if (packet->classes[i] == lease->billing_class)
+				if (packet->classes[i] == LEASE_COLD_RO(lease)->billing_class)
 					break;
 			if (i == packet->class_count) 
 			{
@@ -2690,7 +2776,7 @@ void ack_lease
 
 		/* If we don't have an active billing, see if we need
 		   one, and if we do, try to do so. */
-		if (lease->billing_class == NULL) 
+		if (LEASE_COLD_RO(lease)->billing_class == NULL) 
 		{
 			char *cname = "";
 			int bill = 0;
@@ -2734,12 +2820,12 @@ void ack_lease
 			 * lease again (if there is a REQUEST).
 			 */
 			if (offer == DHCPOFFER &&
-			    lease->billing_class != NULL &&
+			    LEASE_COLD_RO(lease)->billing_class != NULL &&
 			    lease->binding_state != FTS_ACTIVE)
 				unbill_class(lease);
 
 			/* Lease billing change negates reuse */
-			if (lease->billing_class != NULL) {
+			if (LEASE_COLD_RO(lease)->billing_class != NULL) {
 				lease->cannot_reuse = 1;
 			}
 		}
@@ -2751,7 +2837,7 @@ void ack_lease
 		evaluate_option_cache (&state->filename, packet, lease,
 				       (struct client_state *)0,
 				       packet->options, state->options,
-				       &lease->scope, oc, MDL);
+				       &LEASE_COLD(lease)->scope, oc, MDL);
 
 	/* Choose a server name as above. */
 	oc = lookup_option (&server_universe, state->options, SV_SERVER_NAME);
@@ -2759,7 +2845,7 @@ void ack_lease
 		evaluate_option_cache (&state->server_name, packet, lease,
 				       (struct client_state *)0,
 				       packet->options, state -> options,
-				       &lease->scope, oc, MDL);
+				       &LEASE_COLD(lease)->scope, oc, MDL);
 
 	/* At this point, we have a lease that we can offer the client.
 	   Now we construct a lease structure that contains what we want,
@@ -2797,7 +2883,7 @@ void ack_lease
 						   (struct client_state *)0,
 						   packet->options,
 						   state->options,
-						   &lease->scope, oc, MDL)) 
+						   &LEASE_COLD(lease)->scope, oc, MDL)) 
 			{
 				if (d1.len == sizeof (u_int32_t))
 					default_lease_time = getULong (d1.data);
@@ -2810,7 +2896,7 @@ void ack_lease
 						    (struct client_state *)0,
 						    packet->options,
 						    state->options,
-						    &lease->scope, oc, MDL);
+						    &LEASE_COLD(lease)->scope, oc, MDL);
 		else
 			s1 = 0;
 
@@ -2847,7 +2933,7 @@ void ack_lease
 						SV_RESERVE_INFINITE)) &&
 			    evaluate_boolean_option_cache(&ignorep, packet,
 						lease, NULL, packet->options,
-						state->options, &lease->scope,
+						state->options, &LEASE_COLD(lease)->scope,
 						oc, MDL)) 
 			{
 				lt->flags |= RESERVED_LEASE;
@@ -2872,7 +2958,7 @@ void ack_lease
 						   (struct client_state *)0,
 						   packet->options,
 						   state->options,
-						   &lease->scope, oc, MDL)) 
+						   &LEASE_COLD(lease)->scope, oc, MDL)) 
 			{
 				if (d1.len == sizeof (u_int32_t))
 					max_lease_time = getULong (d1.data);
@@ -2894,7 +2980,7 @@ void ack_lease
 						   (struct client_state *)0,
 						   packet->options,
 						   state->options,
-						   &lease->scope, oc, MDL)) 
+						   &LEASE_COLD(lease)->scope, oc, MDL)) 
 			{
 				if (d1.len == sizeof (u_int32_t))
 					min_lease_time = getULong(d1.data);
@@ -2912,7 +2998,7 @@ void ack_lease
 					SV_ADAPTIVE_LEASE_TIME_THRESHOLD)) &&
 		    evaluate_option_cache(&d1, packet, lease, NULL,
 					  packet->options, state->options,
-					  &lease->scope, oc, MDL)) 
+					  &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			if (d1.len == 1 && d1.data[0] > 0 && d1.data[0] < 100) 
 			{
@@ -3036,7 +3122,7 @@ void ack_lease
 
 			/* Copy previous lease failover ack-state. */
 			lt->tsfp = lease->tsfp;
-			lt->atsfp = lease->atsfp;
+			LEASE_COLD(lt)->atsfp = LEASE_COLD_RO(lease)->atsfp;
 
 			/* cltt set below */
 
@@ -3065,9 +3151,9 @@ void ack_lease
 			 */
 			if (offer == DHCPACK) {
 				if (lease_time == INFINITE_TIME) {
-					lt->tstp = MAX_TIME;
+					LEASE_COLD(lt)->tstp = MAX_TIME;
 				} else {
-					lt->tstp =
+					LEASE_COLD(lt)->tstp =
 						leaseTimeCheck(
 						    (cur_time + lease_time
 						     + (new_lease_time / 2)),
@@ -3079,10 +3165,10 @@ void ack_lease
 				 * lease for this lease before the change is
 				 * ack'd.
 				 */
-				if (lt->tstp < lt->tsfp)
-					lt->tsfp = lt->tstp;
+				if (LEASE_COLD_RO(lt)->tstp < lt->tsfp)
+					lt->tsfp = LEASE_COLD_RO(lt)->tstp;
 			} else
-				lt->tstp = lease->tstp;
+				LEASE_COLD(lt)->tstp = LEASE_COLD_RO(lease)->tstp;
 
 			/* Use failover-modified lease time.  */
 			lease_time = new_lease_time;
@@ -3126,7 +3212,7 @@ void ack_lease
 						   (struct client_state *)0,
 						   packet -> options,
 						   state -> options,
-						   &lease -> scope, oc, MDL)) {
+						   &LEASE_COLD(lease)->scope, oc, MDL)) {
 				if (d1.len == sizeof (u_int32_t))
 					lease_time = getULong (d1.data);
 				data_string_forget (&d1, MDL);
@@ -3139,7 +3225,7 @@ void ack_lease
 						   (struct client_state *)0,
 						   packet -> options,
 						   state -> options,
-						   &lease -> scope, oc, MDL)) {
+						   &LEASE_COLD(lease)->scope, oc, MDL)) {
 				if (d1.len == sizeof (u_int32_t))
 					lease_time = (getULong (d1.data) -
 						      cur_time);
@@ -3153,14 +3239,14 @@ void ack_lease
 
 	/* Update Client Last Transaction Time. */
 	/* clttleaseϴ޸ʱ */
-	lt->cltt = cur_time;
+	LEASE_COLD(lt)->cltt = cur_time;
 
 	/* See if we want to record the uid for this client */
 	oc = lookup_option(&server_universe, state->options, SV_IGNORE_CLIENT_UIDS);
 	if ((oc == NULL) ||
 	    !evaluate_boolean_option_cache(&ignorep, packet, lease, NULL,
 					   packet->options, state->options,
-					   &lease->scope, oc, MDL)) 
+					   &LEASE_COLD(lease)->scope, oc, MDL)) 
 	{	
 		/* Record the uid, if given... */
 		/* uidǴӱõ */
@@ -3168,7 +3254,7 @@ void ack_lease
 		if (oc &&
 		    evaluate_option_cache(&d1, packet, lease, NULL,
 					  packet->options, state->options,
-					  &lease->scope, oc, MDL)) 
+					  &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			if (d1.len <= sizeof(lt->uid_buf)) 
 			{
@@ -3196,15 +3282,15 @@ void ack_lease
 	/* lthostsubnetbilling_classֵ */
 	if (host) 
 	{
-		host_reference(&lt->host, host, MDL);
+		host_reference(&LEASE_COLD(lt)->host, host, MDL);
 		host_dereference(&host, MDL);
 	}
 	
 	if (lease->subnet)
 		subnet_reference(&lt->subnet, lease->subnet, MDL);
-	if (lease->billing_class)
-		class_reference(&lt->billing_class,
-				 lease->billing_class, MDL);
+	if (LEASE_COLD_RO(lease)->billing_class)
+		class_reference(&LEASE_COLD(lt)->billing_class,
+				 LEASE_COLD_RO(lease)->billing_class, MDL);
 
 	/* Set a flag if this client is a broken client that NUL
 	   terminates string options and expects us to do likewise. */
@@ -3214,23 +3300,23 @@ void ack_lease
 		lease->flags &= ~MS_NULL_TERMINATION;
 
 	/* Save any bindings. */
-	if (lease->scope) 
+	if (LEASE_COLD_RO(lease)->scope) 
 	{
-		binding_scope_reference(&lt->scope, lease->scope, MDL);
-		binding_scope_dereference(&lease->scope, MDL);
+		binding_scope_reference(&LEASE_COLD(lt)->scope, LEASE_COLD_RO(lease)->scope, MDL);
+		binding_scope_dereference(&LEASE_COLD(lease)->scope, MDL);
 	}
-	if (lease->agent_options)
-		option_chain_head_reference(&lt->agent_options, lease->agent_options, MDL);
+	if (LEASE_COLD_RO(lease)->agent_options)
+		option_chain_head_reference(&LEASE_COLD(lt)->agent_options, LEASE_COLD_RO(lease)->agent_options, MDL);
 
 	/* Save the vendor-class-identifier for DHCPLEASEQUERY. */
 	oc = lookup_option(&dhcp_universe, packet->options, DHO_VENDOR_CLASS_IDENTIFIER);
 	if (oc != NULL &&
 	    evaluate_option_cache(&d1, packet, NULL, NULL, packet->options,
-				  NULL, &lt->scope, oc, MDL)) 
+				  NULL, &LEASE_COLD(lt)->scope, oc, MDL)) 
 	{
 		if (d1.len != 0) 
 		{
-			bind_ds_value(&lt->scope, "vendor-class-identifier", &d1);
+			bind_ds_value(&LEASE_COLD(lt)->scope, "vendor-class-identifier", &d1);
 		}
 
 		data_string_forget(&d1, MDL);
@@ -3253,11 +3339,11 @@ void ack_lease
 					       (struct client_state *)0,
 					       packet->options,
 					       state->options,
-					       &lease->scope, oc, MDL)) 
+					       &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
-			if (lt->agent_options)
-			    option_chain_head_dereference(&lt->agent_options, MDL);
-			option_chain_head_reference(&lt->agent_options,
+			if (LEASE_COLD_RO(lt)->agent_options)
+			    option_chain_head_dereference(&LEASE_COLD(lt)->agent_options, MDL);
+			option_chain_head_reference(&LEASE_COLD(lt)->agent_options,
 				 (struct option_chain_head *)
 				 packet->options->universes[agent_universe.index],
 				 MDL);
@@ -3276,25 +3362,21 @@ void ack_lease
 		s1 = 0;
 
 	if (oc && s1 &&
-	    lease->client_hostname &&
-	    strlen(lease->client_hostname) == d1.len &&
-	    !memcmp(lease->client_hostname, d1.data, d1.len)) 
+	    LEASE_COLD_RO(lease)->client_hostname &&
+	    strlen(LEASE_COLD_RO(lease)->client_hostname) == d1.len &&
+	    !memcmp(LEASE_COLD_RO(lease)->client_hostname, d1.data, d1.len)) 
 	{
 		/* Hasn't changed. */
 		data_string_forget(&d1, MDL);
-		lt->client_hostname = lease->client_hostname;
-		lease->client_hostname = (char *)0;
+		LEASE_COLD(lt)->client_hostname = LEASE_COLD_RO(lease)->client_hostname;
+		LEASE_COLD(lease)->client_hostname = (char *)0;
 	} 
 	else if (oc && s1) 
 	{
-		lt->client_hostname = dmalloc(d1.len + 1, MDL);
-		if (!lt->client_hostname)
+		LEASE_COLD(lt)->client_hostname = intern_string((const char *)d1.data,
+						    d1.len, MDL);
+		if (!LEASE_COLD_RO(lt)->client_hostname)
 			log_error ("no memory for client hostname.");
-		else 
-		{
-			memcpy (lt->client_hostname, d1.data, d1.len);
-			lt->client_hostname [d1.len] = 0;
-		}
 		data_string_forget (&d1, MDL);
 		/* hostname changed, can't reuse lease */
 		lease->cannot_reuse = 1;
@@ -3321,14 +3403,14 @@ void ack_lease
 
 	/* If there are statements to execute when the lease is
 	   committed, execute them. */
-	if (lease->on_star.on_commit && (!offer || offer == DHCPACK)) 
+	if (LEASE_COLD_RO(lease)->on_star.on_commit && (!offer || offer == DHCPACK)) 
 	{
 		execute_statements (NULL, packet, lt, NULL, packet->options,
-				    state->options, &lt->scope,
-				    lease->on_star.on_commit, NULL);
-		if (lease->on_star.on_commit)
+				    state->options, &LEASE_COLD(lt)->scope,
+				    LEASE_COLD_RO(lease)->on_star.on_commit, NULL);
+		if (LEASE_COLD_RO(lease)->on_star.on_commit)
 			executable_statement_dereference
-				(&lease->on_star.on_commit, MDL);
+				(&LEASE_COLD(lease)->on_star.on_commit, MDL);
 	}
 
 	/* Don't call supersede_lease on a mocked-up lease. */
@@ -3416,7 +3498,7 @@ void ack_lease
 	    evaluate_boolean_option_cache(&ignorep, packet, lease,
 					   (struct client_state *)0,
 					   packet->options, state->options,
-					   &lease->scope, oc, MDL))
+					   &LEASE_COLD(lease)->scope, oc, MDL))
 		state->bootp_flags |= htons(BOOTP_BROADCAST);
 
 	/* Get the Maximum Message Size option from the packet, if one was sent. */
@@ -3425,7 +3507,7 @@ void ack_lease
 	    evaluate_option_cache (&d1, packet, lease,
 				   (struct client_state *)0,
 				   packet->options, state->options,
-				   &lease->scope, oc, MDL)) 
+				   &LEASE_COLD(lease)->scope, oc, MDL)) 
 	{
 		if (d1.len == sizeof(u_int16_t))
 			state->max_message_size = getUShort(d1.data);
@@ -3438,7 +3520,7 @@ void ack_lease
 		    evaluate_option_cache(&d1, packet, lease,
 					   (struct client_state *)0,
 					   packet->options, state->options,
-					   &lease->scope, oc, MDL)) 
+					   &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			if (d1.len == sizeof (u_int16_t))
 				state->max_message_size = getUShort(d1.data);
@@ -3474,9 +3556,8 @@ void ack_lease
 		{
 			if (make_const_data(&oc->expression, &state->offer, 1, 0, 0, MDL)) 
 			{
-				option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash,
-							&i, 0, MDL);
+				option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 				save_option(&dhcp_universe, state->options, oc);
 			}
 			option_cache_dereference(&oc, MDL);
@@ -3496,9 +3577,8 @@ void ack_lease
 			if (make_const_data(&oc->expression, state->expiry,
 					    4, 0, 0, MDL)) 
 			{
-				option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash,
-							&i, 0, MDL);
+				option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 				save_option(&dhcp_universe, state->options, oc);
 			}
 			option_cache_dereference (&oc, MDL);
@@ -3515,7 +3595,7 @@ void ack_lease
 					DHO_DHCP_REBINDING_TIME)) != NULL &&
 		    evaluate_option_cache(&d1, packet, lease, NULL,
 					  packet->options, state->options,
-					  &lease->scope, oc, MDL)) {
+					  &LEASE_COLD(lease)->scope, oc, MDL)) {
 			TIME rebind_time = getULong(d1.data);
 
 			/* Drop the configured (invalid) rebinding time. */
@@ -3532,7 +3612,7 @@ void ack_lease
 					DHO_DHCP_RENEWAL_TIME)) != NULL &&
 		    evaluate_option_cache(&d1, packet, lease, NULL,
 					  packet->options, state->options,
-					  &lease->scope, oc, MDL)) 
+					  &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			if (getULong(d1.data) >= offered_lease_time)
 				delete_option(&dhcp_universe, state->options, DHO_DHCP_RENEWAL_TIME);
@@ -3558,7 +3638,7 @@ void ack_lease
 		if (evaluate_option_cache(&d1, packet, lease,
 					   (struct client_state *)0,
 					   packet->options, state->options,
-					   &lease->scope, oc, MDL)) 
+					   &LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			/* If there was more than one answer,
 			   take the first. */
@@ -3581,9 +3661,8 @@ void ack_lease
 					     lease->subnet->netmask.len,
 					     0, 0, MDL)) 
 			{
-				option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash,
-							&i, 0, MDL);
+				option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 				save_option(&dhcp_universe, state->options, oc);
 			}
 			option_cache_dereference(&oc, MDL);
@@ -3605,7 +3684,7 @@ void ack_lease
 	if (!lookup_option(&dhcp_universe, state->options, i) &&
 	    evaluate_boolean_option_cache
 	     (&ignorep, packet, lease, NULL,
-	      packet->options, state->options, &lease->scope,
+	      packet->options, state->options, &LEASE_COLD(lease)->scope,
 	      lookup_option(&server_universe, state->options, j), MDL)) 
 	{
 		struct in_addr ia;
@@ -3626,8 +3705,8 @@ void ack_lease
 						      h->h_name),
 						     strlen(h->h_name) + 1, 1, 1, MDL)) 
 				{
-					option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash, &i, 0, MDL);
+					option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 					save_option(&dhcp_universe, state->options, oc);
 				}
 				option_cache_dereference (&oc, MDL);
@@ -3640,7 +3719,7 @@ void ack_lease
 	   so if the local router does proxy arp, you win. */
 	if (evaluate_boolean_option_cache
 	    (&ignorep, packet, lease, (struct client_state *)0,
-	     packet->options, state->options, &lease->scope,
+	     packet->options, state->options, &LEASE_COLD(lease)->scope,
 	     lookup_option(&server_universe, state->options,
 			    SV_USE_LEASE_ADDR_FOR_DEFAULT_ROUTE), MDL)) 
 	{
@@ -3656,8 +3735,8 @@ void ack_lease
 						     lease->ip_addr.len,
 						     0, 0, MDL)) 
 				{
-					option_code_hash_lookup(&oc->option,
-							dhcp_universe.code_hash, &i, 0, MDL);
+					option_code_lookup(&oc->option,
+							&dhcp_universe, i, MDL);
 					save_option (&dhcp_universe, state->options, oc);
 				}
 				option_cache_dereference (&oc, MDL);	
@@ -3672,7 +3751,7 @@ void ack_lease
 	    evaluate_option_cache(&d1, packet, lease,
 				   (struct client_state *)0,
 				   packet->options, state->options,
-				   &lease->scope, oc, MDL)) 
+				   &LEASE_COLD(lease)->scope, oc, MDL)) 
 	{
 		struct universe *u = (struct universe *)0;
 
@@ -3708,19 +3787,19 @@ void ack_lease
 		evaluate_option_cache (&state->parameter_request_list,
 				       packet, lease, (struct client_state *)0,
 				       packet->options, state->options,
-				       &lease->scope, oc, MDL);
+				       &LEASE_COLD(lease)->scope, oc, MDL);
 
 #ifdef DEBUG_PACKET
 	dump_packet (packet);
 	dump_raw ((unsigned char *)packet -> raw, packet -> packet_length);
 #endif
 
-	lease->state = state;
+	LEASE_COLD(lease)->state = state;
 
 	log_info ("%s", msg);
 
 	/* Hang the packet off the lease state. */
-	packet_reference(&lease->state->packet, packet, MDL);
+	packet_reference(&LEASE_COLD_RO(lease)->state->packet, packet, MDL);
 
 	/* If this is a DHCPOFFER, ping the lease address before actually
 	   sending the offer. */
@@ -3733,7 +3812,7 @@ void ack_lease
 					    (struct client_state *)0,
 					    packet->options,
 					    state->options,
-					    &lease->scope, oc, MDL))) 
+					    &LEASE_COLD(lease)->scope, oc, MDL))) 
 	{
 		/* ָIPַping */
 		icmp_echorequest(&lease->ip_addr);
@@ -3744,7 +3823,7 @@ void ack_lease
 		    evaluate_option_cache (&d1, packet, lease, NULL,
 						packet->options,
 						state->options,
-						&lease->scope, oc, MDL)) 
+						&LEASE_COLD(lease)->scope, oc, MDL)) 
 		{
 			if (d1.len == sizeof (u_int32_t))
 				ping_timeout = getULong (d1.data);
@@ -3775,7 +3854,7 @@ void ack_lease
 	} 
 	else 
 	{
-  		lease->cltt = cur_time;
+  		LEASE_COLD(lease)->cltt = cur_time;
 #if defined(DELAYED_ACK)
 		if (enqueue)
 			delayed_ack_enqueue(lease);
@@ -3907,7 +3986,7 @@ delayed_acks_timer(void *foo)
 #endif
 
 		/* dhcp_reply() requires that the reply state still be valid */
-		if (ack->lease->state == NULL)
+		if (LEASE_COLD_RO(ack->lease)->state == NULL)
 			log_error("delayed ack for %s has gone stale",
 				  piaddr(ack->lease->ip_addr));
 		else {
@@ -3965,7 +4044,7 @@ void dhcp_reply
 	struct in_addr from;
 	struct hardware hto;			//Ӳַڷ
 	int result;
-	struct lease_state *state = lease->state;
+	struct lease_state *state = LEASE_COLD_RO(lease)->state;
 	int nulltp, bootpp, unicastp = 1;
 #if defined(RELAY_PORT)
 	u_int16_t relay_port = 0;
@@ -4064,11 +4143,11 @@ void dhcp_reply
 	raw.op 	  = BOOTREPLY;
 
 	/* sֻڴӡ */
-	if (lease->client_hostname) 
+	if (LEASE_COLD_RO(lease)->client_hostname) 
 	{
-		if ((strlen(lease->client_hostname) <= 64) &&
-		    db_printable((unsigned char *)lease->client_hostname))
-			s = lease->client_hostname;
+		if ((strlen(LEASE_COLD_RO(lease)->client_hostname) <= 64) &&
+		    db_printable((unsigned char *)LEASE_COLD_RO(lease)->client_hostname))
+			s = LEASE_COLD_RO(lease)->client_hostname;
 		else
 			s = "Hostname Unsuitable for Printing";
 	}
@@ -4176,7 +4255,7 @@ void dhcp_reply
 			}
 
 			free_lease_state(state, MDL);
-			lease->state = (struct lease_state *)0;
+			LEASE_COLD(lease)->state = (struct lease_state *)0;
 			return;
 		}
 
@@ -4217,7 +4296,7 @@ void dhcp_reply
 			}
 
 			free_lease_state(state, MDL);
-			lease->state = (struct lease_state *)0;
+			LEASE_COLD(lease)->state = (struct lease_state *)0;
 			return;
 		}
 
@@ -4259,7 +4338,7 @@ void dhcp_reply
 	   now that we're done with them. */
 
 	free_lease_state(state, MDL);
-	lease->state = (struct lease_state *)0;
+	LEASE_COLD(lease)->state = (struct lease_state *)0;
 }
 
 /*********************************************************************
@@ -4716,9 +4795,9 @@ int find_lease
 			log_error ("Dynamic and static leases present for %s.",
 				   piaddr (cip));
 			log_error ("Remove host declaration %s or remove %s",
-				   (fixed_lease && fixed_lease->host
-				    ? (fixed_lease->host->name
-				       ? fixed_lease->host->name
+				   (fixed_lease && LEASE_COLD_RO(fixed_lease)->host
+				    ? (LEASE_COLD_RO(fixed_lease)->host->name
+				       ? LEASE_COLD_RO(fixed_lease)->host->name
 				       : piaddr (cip))
 				    : piaddr (cip)),
 				    piaddr (cip));
@@ -4831,8 +4910,8 @@ int find_lease
 		else 
 		{
 			lease_reference (&lease, ip_lease, MDL);
-			if (lease->host)
-				host_dereference(&lease->host, MDL);
+			if (LEASE_COLD_RO(lease)->host)
+				host_dereference(&LEASE_COLD(lease)->host, MDL);
 		}
 	}
 
@@ -4859,8 +4938,8 @@ int find_lease
 		else 
 		{
 			lease_reference(&lease, uid_lease, MDL);
-			if (lease->host)
-				host_dereference(&lease->host, MDL);
+			if (LEASE_COLD_RO(lease)->host)
+				host_dereference(&LEASE_COLD(lease)->host, MDL);
 		}
 		lease_dereference (&uid_lease, MDL);
 	}
@@ -4887,8 +4966,8 @@ int find_lease
 			     : packet->packet_type == 0)) 
 			{
 				lease_reference(&lease, hw_lease, MDL);
-				if (lease->host)
-					host_dereference(&lease->host, MDL);
+				if (LEASE_COLD_RO(lease)->host)
+					host_dereference(&LEASE_COLD(lease)->host, MDL);
 			} 
 			else 
 			{
@@ -4903,7 +4982,7 @@ int find_lease
 	 * hang it off the lease so that we can use the supplied
 	 * options.
 	 */
-	if (lease && host && !lease->host) 
+	if (lease && host && !LEASE_COLD_RO(lease)->host) 
 	{
 		struct host_decl *p = NULL;
 		struct host_decl *n = NULL;
@@ -4930,7 +5009,7 @@ int find_lease
 				 * more common than DHCPDISCOVER.
 				 */
 				if (lease->binding_state == FTS_ACTIVE)
-					host_reference(&lease->host, p, MDL);
+					host_reference(&LEASE_COLD(lease)->host, p, MDL);
 
 				host_dereference(&p, MDL);
 				break;
@@ -5039,7 +5118,7 @@ int mockup_lease
 	}
 
 	/* lease->hostֵ */
-	host_reference(&lease->host, rhp, MDL);
+	host_reference(&LEASE_COLD(lease)->host, rhp, MDL);
 
 	/* uidֵʹuid_buf[7]߶̬ڴ */
 	if (rhp->client_identifier.len > sizeof(lease->uid_buf))
@@ -5063,7 +5142,7 @@ int mockup_lease
 	lease->uid_len 	     = rhp->client_identifier.len;
 	lease->hardware_addr = rhp->interface;
 	lease->starts 		 = MIN_TIME;
-	lease->cltt 		 = MIN_TIME;
+	LEASE_COLD(lease)->cltt 		 = MIN_TIME;
 	lease->ends			 = MIN_TIME;
 	lease->flags         = STATIC_LEASE;
 	lease->binding_state = FTS_FREE;
@@ -5262,13 +5341,13 @@ int allocate_lease
 		 * are any other stale host vectors, we want to find them.
 		 */
 		/* leaseҪleasehostṹ */
-		if (lease->host != NULL) 
+		if (LEASE_COLD_RO(lease)->host != NULL) 
 		{
 			log_debug("soft impossible condition (%s:%d): stale "
 				  "host \"%s\" found on lease %s", MDL,
-				  lease->host->name,
+				  LEASE_COLD_RO(lease)->host->name,
 				  piaddr(lease->ip_addr));
-			host_dereference(&lease->host, MDL);
+			host_dereference(&LEASE_COLD(lease)->host, MDL);
 		}
 
 		lease_reference(lp, lease, MDL);
@@ -5362,7 +5441,6 @@ static int locate_network6 (packet)
 	const struct in6_addr *link_addr, *first_link_addr;
 	struct iaddr ia;
 	struct data_string data;
-	struct subnet *subnet = NULL;
 	struct option_cache *oc;
 
 	/* from locate_network() */
@@ -5401,13 +5479,7 @@ static int locate_network6 (packet)
 		memcpy(ia.iabuf, data.data, 4);
 		data_string_forget(&data, MDL);
 
-		if (find_subnet(&subnet, ia, MDL)) {
-			shared_network_reference(&packet->shared_network,
-						 subnet->shared_network, MDL);
-			subnet_dereference(&subnet, MDL);
-			return (1);
-		}
-		return (0);
+		return (find_link_network(&packet->shared_network, ia, MDL));
 	}
 
 	/* See if there is a giaddr (still unlikely), if there is one
@@ -5417,13 +5489,7 @@ static int locate_network6 (packet)
 		ia.len = 4;
 		memcpy(ia.iabuf, &packet->raw->giaddr, 4);
 
-		if (find_subnet(&subnet, ia, MDL)) {
-			shared_network_reference(&packet->shared_network,
-						 subnet->shared_network, MDL);
-			subnet_dereference(&subnet, MDL);
-			return (1);
-		}
-		return (0);
+		return (find_link_network(&packet->shared_network, ia, MDL));
 	}
 
 	/* from shared_network_from_packet6() */
@@ -5449,13 +5515,7 @@ static int locate_network6 (packet)
 	if (first_link_addr != NULL) {
 		ia.len = sizeof(*first_link_addr);
 		memcpy(ia.iabuf, first_link_addr, sizeof(*first_link_addr));
-		if (find_subnet (&subnet, ia, MDL)) {
-			shared_network_reference(&packet->shared_network,
-						 subnet->shared_network, MDL);
-			subnet_dereference(&subnet, MDL);
-			return (1);
-		}
-		return (0);
+		return (find_link_network(&packet->shared_network, ia, MDL));
 	}
 
 	/* If there is no link address, we will use the interface
@@ -5497,7 +5557,6 @@ int locate_network
 {
 	struct iaddr ia;
 	struct data_string data;
-	struct subnet *subnet = (struct subnet *)0;
 	struct option_cache *oc;
 
 #if defined(DHCPv6) && defined(DHCP4o6)
@@ -5570,16 +5629,9 @@ int locate_network
 		memcpy(ia.iabuf, &packet->raw->giaddr, 4);
 	}
 
-	/* If we know the subnet on which the IP address lives, use it. */
-	if (find_subnet(&subnet, ia, MDL)) 
-	{
-		shared_network_reference(&packet->shared_network, subnet->shared_network, MDL);
-		subnet_dereference(&subnet, MDL);
-		return 1;
-	}
-
-	/* Otherwise, fail. */
-	return 0;
+	/* If we know the subnet on which the IP address lives, use it.
+	   Otherwise, fail. */
+	return find_link_network(&packet->shared_network, ia, MDL);
 }
 
 /*
@@ -5688,9 +5740,8 @@ void get_server_source_address
 				    (unsigned char *)a, sizeof(*a),
 				    0, allocate, MDL)) 
 		{
-			option_code_hash_lookup(&oc->option, 
-						dhcp_universe.code_hash,
-						&option_num, 0, MDL);
+			option_code_lookup(&oc->option, 
+						&dhcp_universe, option_num, MDL);
 			save_option(&dhcp_universe, out_options, oc);
 		}
 		option_cache_dereference(&oc, MDL);
@@ -5914,23 +5965,23 @@ void use_host_decl_name
 ) 
 {
 	unsigned int ocode = SV_USE_HOST_DECL_NAMES;
-    if ((lease->host && lease->host->name) &&
+    if ((LEASE_COLD_RO(lease)->host && LEASE_COLD_RO(lease)->host->name) &&
     	!lookup_option(&dhcp_universe, options, DHO_HOST_NAME) &&
         (evaluate_boolean_option_cache(NULL, packet, lease, NULL,
 				   packet->options, options,
-				   &lease->scope,
+				   &LEASE_COLD(lease)->scope,
 				   lookup_option(&server_universe, options, ocode), MDL))) 
 	{
 		struct option_cache *oc = NULL;
         if (option_cache_allocate(&oc, MDL)) 
 		{
         	if (make_const_data(&oc->expression,
-                     ((unsigned char*)lease->host->name),
-                     strlen(lease->host->name), 1, 0, MDL)) 
+                     ((unsigned char*)LEASE_COLD_RO(lease)->host->name),
+                     strlen(LEASE_COLD_RO(lease)->host->name), 1, 0, MDL)) 
 			{
 				ocode = DHO_HOST_NAME;
-                option_code_hash_lookup(&oc->option,
-                                 dhcp_universe.code_hash, &ocode, 0, MDL);
+                option_code_lookup(&oc->option,
+                                 &dhcp_universe, ocode, MDL);
                 save_option(&dhcp_universe, options, oc);
             }
             option_cache_dereference(&oc, MDL);
@@ -5938,6 +5989,21 @@ void use_host_decl_name
     }
 }
 
+static const char *reuse_verdict_names[REUSE_VERDICT_COUNT] = {
+	"reused",
+	"disqualified",
+	"not active",
+	"ddns update",
+	"host changed",
+	"uid changed",
+	"hardware changed",
+	"threshold disabled",
+	"threshold exceeded",
+	"failover mclt"
+};
+
+unsigned long reuse_verdict_counts[REUSE_VERDICT_COUNT];
+
 /*!
  * \brief Checks and preps for lease resuse based on dhcp-cache-threshold
  *
@@ -5946,16 +6012,39 @@ void use_host_decl_name
  * can be resused the function returns 1, O if not.  This function is called
  * by ack_lease when responding to both DISCOVERs and REQUESTS.
  *
- * The current lease can be reused only if all of the following are true:
- *  a. dhcp-cache-threshold is > 0
- *  b. The current lease is active
- *  c. The lease "age" is less than that allowed by the threshold
- *  d. DNS updates are not being performed on the new lease.
- *  e. Lease has not been otherwise disqualified for reuse (Ex: billing class
- *  or hostname changed)
- *  f. The host declaration has changed (either a new one was added
- *  or an older one was found due to something like a change in the uid)
- *  g. The UID or hardware address have changed.
+ * The decision is made by walking the table below in order; the first test
+ * that fails determines the verdict (see enum reuse_verdict):
+ *
+ *  test                                             verdict on failure
+ *  a. not otherwise disqualified (billing class,    REUSE_DISQUALIFIED
+ *     hostname, reservation changed or an earlier
+ *     OFFER could not reuse it)
+ *  b. the current lease is active                   REUSE_NOT_ACTIVE
+ *  c. no DNS update is pending for the new lease    REUSE_DDNS
+ *  d. the host declaration has not changed          REUSE_HOST_CHANGED
+ *  e. the uid has not changed                       REUSE_UID_CHANGED
+ *  f. the hardware address has not changed          REUSE_HW_CHANGED
+ *  g. dhcp-cache-threshold is > 0                   REUSE_DISABLED
+ *  h. the lease "age" is under the threshold        REUSE_TOO_OLD
+ *  i. for failover pools, the unaltered expiry is   REUSE_FAILOVER_MCLT
+ *     still within what the peer has acknowledged
+ *     plus MCLT
+ *
+ * A changed client hostname prevents reuse: ack_lease() sets cannot_reuse
+ * on the lease, which fails test (a).  Changes to the binding scope do not;
+ * the new scope, and the unchanged hostname, are carried over to the
+ * existing lease in memory.  They will be written out with the next lease
+ * change that does reach the lease file.
+ *
+ * A lease with a DNS update pending for it (test c) is never reused, as
+ * the update would have to be moved over to the existing lease.
+ *
+ * Test (i) only restricts reuse; leases in failover pools were reused
+ * before it as well.  A reused lease keeps its expiry, and while the peer
+ * has not acknowledged that expiry (for instance when it cannot be
+ * reached) handing it out again could promise the client more than MCLT
+ * beyond what the peer knows of.  Such leases now go through
+ * supersede_lease() like any other that cannot be reused.
  *
  * Clients may renew leases using full DORA cycles or just RAs. This means
  * that reusability must be checked when acking both DISCOVERs and REQUESTs.
@@ -5966,6 +6055,9 @@ void use_host_decl_name
  * to the lease file.  The lease.cannot_reuse flag is used to handle this
  * this situation.
  *
+ * Every verdict is counted, per pool as a hit or a miss and globally per
+ * verdict; see log_lease_reuse_statistics().
+ *
  * \param packet inbound packet received from the client
  * \param new_lease candidate new lease to associate with the client
  * \param lease current lease associated with the client
@@ -5979,26 +6071,28 @@ reuse_lease (struct packet* packet,
 	     struct lease* lease,
 	     struct lease_state *state,
 	     int offer) {
-	int reusable = 0;
-
-	/* To even consider reuse all of the following must be true:
-	 * 1 - reuse hasn't already disqualified
-	 * 2 - current lease is active
-	 * 3 - DNS info hasn't changed
-	 * 4 - the host declaration hasn't changed
-	 * 5 - the uid hasn't changed
-	 * 6 - the hardware address hasn't changed */
-	if ((lease->cannot_reuse == 0) &&
-	    (lease->binding_state == FTS_ACTIVE) &&
-	    (new_lease->ddns_cb == NULL) &&
-	    (lease->host == new_lease->host) &&
-	    (lease->uid_len == new_lease->uid_len) &&
-	    (memcmp(lease->uid, new_lease->uid, lease->uid_len) == 0) &&
-	    (lease->hardware_addr.hlen == new_lease->hardware_addr.hlen) &&
-	    (memcmp(&lease->hardware_addr.hbuf[0],
-		    &new_lease->hardware_addr.hbuf[0],
-		    lease->hardware_addr.hlen) == 0)) {
-		int thresh = DEFAULT_CACHE_THRESHOLD;
+	enum reuse_verdict verdict = REUSE_OK;
+	int thresh = DEFAULT_CACHE_THRESHOLD;
+	long lease_age = 0;
+
+	if (lease->cannot_reuse != 0)
+		verdict = REUSE_DISQUALIFIED;
+	else if (lease->binding_state != FTS_ACTIVE)
+		verdict = REUSE_NOT_ACTIVE;
+	else if (LEASE_COLD_RO(new_lease)->ddns_cb != NULL)
+		verdict = REUSE_DDNS;
+	else if (LEASE_COLD_RO(lease)->host != LEASE_COLD_RO(new_lease)->host)
+		verdict = REUSE_HOST_CHANGED;
+	else if ((lease->uid_len != new_lease->uid_len) ||
+		 (memcmp(lease->uid, new_lease->uid, lease->uid_len) != 0))
+		verdict = REUSE_UID_CHANGED;
+	else if ((lease->hardware_addr.hlen != new_lease->hardware_addr.hlen) ||
+		 (memcmp(&lease->hardware_addr.hbuf[0],
+			 &new_lease->hardware_addr.hbuf[0],
+			 lease->hardware_addr.hlen) != 0))
+		verdict = REUSE_HW_CHANGED;
+
+	if (verdict == REUSE_OK) {
 		struct option_cache* oc = NULL;
 		struct data_string d1;
 
@@ -6008,68 +6102,139 @@ reuse_lease (struct packet* packet,
 					SV_CACHE_THRESHOLD)) &&
 		     (evaluate_option_cache(&d1, packet, new_lease, NULL,
 				      packet->options, state->options,
-				      &new_lease->scope, oc, MDL))) {
+				      &LEASE_COLD(new_lease)->scope, oc, MDL))) {
 			if (d1.len == 1 && (d1.data[0] < 100))
 				thresh = d1.data[0];
 
 			data_string_forget(&d1, MDL);
 		}
 
-		/* If threshold is enabled, check lease age */
-		if (thresh > 0) {
-			int limit = 0;
-			int lease_length = 0;
-			long lease_age = 0;
+		if (thresh <= 0)
+			verdict = REUSE_DISABLED;
+	}
 
-			/* Calculate limit in seconds */
-			lease_length = lease->ends - lease->starts;
-			if (lease_length <= (INT_MAX / thresh))
-				limit = lease_length * thresh / 100;
-			else
-				limit = lease_length / 100 * thresh;
-
-			/* Note new_lease->starts is really just cur_time */
-			lease_age = new_lease->starts - lease->starts;
-
-			/* Is the lease young enough to reuse? */
-			if (lease_age <= limit) {
-				/* Restore expiry to its original value */
-				state->offered_expiry = lease->ends;
-
-				/* Restore bindings. This fixes 37368. */
-				if (new_lease->scope != NULL) {
-					if (lease->scope != NULL) {
-						binding_scope_dereference(
-								&lease->scope,
-								MDL);
-					}
+	/* If threshold is enabled, check lease age */
+	if (verdict == REUSE_OK) {
+		int limit = 0;
+		int lease_length = 0;
 
-					binding_scope_reference(&lease->scope,
-							new_lease->scope, MDL);
-				}
+		/* Calculate limit in seconds */
+		lease_length = lease->ends - lease->starts;
+		if (lease_length <= (INT_MAX / thresh))
+			limit = lease_length * thresh / 100;
+		else
+			limit = lease_length / 100 * thresh;
 
-				/* restore client hostname, fixes 42849. */
-				if (new_lease->client_hostname) {
-					lease->client_hostname =
-					  new_lease->client_hostname;
-					new_lease->client_hostname = NULL;
-				}
+		/* Note new_lease->starts is really just cur_time */
+		lease_age = new_lease->starts - lease->starts;
+
+		/* Is the lease young enough to reuse? */
+		if (lease_age > limit)
+			verdict = REUSE_TOO_OLD;
+	}
 
-				/* We're cleared to reuse it */
-				log_debug("reuse_lease: lease age %ld (secs)"
-					  " under %d%% threshold, reply with "
-					  "unaltered, existing lease for %s",
-					  lease_age, thresh, piaddr(lease->ip_addr));
+#if defined (FAILOVER_PROTOCOL)
+	/* The unaltered expiry must not exceed what the peer has agreed to
+	 * plus MCLT, otherwise a binding update is required anyway. */
+	if (verdict == REUSE_OK && lease->pool && lease->pool->failover_peer) {
+		dhcp_failover_state_t *peer = lease->pool->failover_peer;
 
-				reusable = 1;
+		if ((lease->ends > cur_time + peer->mclt) &&
+		    (lease->ends > lease->tsfp + peer->mclt))
+			verdict = REUSE_FAILOVER_MCLT;
+	}
+#endif
+
+	if (verdict == REUSE_OK) {
+		/* Restore expiry to its original value */
+		state->offered_expiry = lease->ends;
+
+		/* Restore bindings. This fixes 37368. */
+		if (LEASE_COLD_RO(new_lease)->scope != NULL) {
+			if (LEASE_COLD_RO(lease)->scope != NULL) {
+				binding_scope_dereference(&LEASE_COLD(lease)->scope, MDL);
 			}
+
+			binding_scope_reference(&LEASE_COLD(lease)->scope,
+						LEASE_COLD_RO(new_lease)->scope, MDL);
 		}
+
+		/* restore client hostname, fixes 42849. */
+		if (LEASE_COLD_RO(new_lease)->client_hostname) {
+			intern_string_release(&LEASE_COLD(lease)->client_hostname, MDL);
+			LEASE_COLD(lease)->client_hostname = LEASE_COLD_RO(new_lease)->client_hostname;
+			LEASE_COLD(new_lease)->client_hostname = NULL;
+		}
+
+		/* We're cleared to reuse it */
+		log_debug("reuse_lease: lease age %ld (secs)"
+			  " under %d%% threshold, reply with "
+			  "unaltered, existing lease for %s",
+			  lease_age, thresh, piaddr(lease->ip_addr));
+	} else if (verdict != REUSE_NOT_ACTIVE && verdict != REUSE_DISABLED) {
+		log_debug("reuse_lease: cannot reuse lease for %s: %s",
+			  piaddr(lease->ip_addr), reuse_verdict_names[verdict]);
+	}
+
+	reuse_verdict_counts[verdict]++;
+	if (lease->pool) {
+		if (verdict == REUSE_OK)
+			lease->pool->reuse_hits++;
+		else
+			lease->pool->reuse_misses++;
 	}
 
 	/* If we can't reuse it and this is an offer disqualify reuse for
 	 * ensuing REQUEST, otherwise clear the flag. */
-	lease->cannot_reuse = (!reusable && offer == DHCPOFFER);
-	return (reusable);
+	lease->cannot_reuse = (verdict != REUSE_OK && offer == DHCPOFFER);
+	return (verdict == REUSE_OK);
+}
+
+/*!
+ * \brief Logs the dhcp-cache-threshold reuse counters
+ *
+ * Logs one line with the global count of each reuse_lease() verdict and
+ * one line per pool that has seen any reuse decision, giving its hits,
+ * misses and hit rate.  Pools are identified by their shared network and
+ * their position within it, counting from zero in configuration order.
+ */
+void
+log_lease_reuse_statistics (void)
+{
+	struct shared_network *share;
+	struct pool *pool;
+	unsigned long total = 0;
+	char buf[512];
+	size_t len = 0;
+	int i, pool_no;
+
+	for (i = 0; i < REUSE_VERDICT_COUNT; i++)
+		total += reuse_verdict_counts[i];
+	if (total == 0)
+		return;
+
+	for (i = 0; i < REUSE_VERDICT_COUNT && len < sizeof(buf); i++) {
+		len += snprintf(buf + len, sizeof(buf) - len, "%s%s %lu",
+				i ? ", " : "", reuse_verdict_names[i],
+				reuse_verdict_counts[i]);
+	}
+	log_info("lease reuse: %lu decisions: %s", total, buf);
+
+	for (share = shared_networks; share; share = share->next) {
+		pool_no = 0;
+		for (pool = share->pools; pool; pool = pool->next, pool_no++) {
+			unsigned long count = pool->reuse_hits +
+					      pool->reuse_misses;
+
+			if (count == 0)
+				continue;
+			log_info("lease reuse: shared network %s pool %d: "
+				 "hits %lu, misses %lu (%lu%%)",
+				 share->name, pool_no,
+				 pool->reuse_hits, pool->reuse_misses,
+				 pool->reuse_hits * 100 / count);
+		}
+	}
 }
 
 /* \brief Validates a proposed value for use as a lease time
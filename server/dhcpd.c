@@ -847,6 +847,10 @@ int main
 	/* Set up various hooks. */
 	dhcp_interface_setup_hook = dhcpd_interface_setup_hook;
 	bootp_packet_handler = do_packet;
+	lazy_option_decode = 1;
+	packet_arena_enabled = 1;
+	expression_compile_enabled = 1;
+	expression_memo_enabled = 1;
 #ifdef DHCPv6
 	add_enumeration (&prefix_length_modes);
 	dhcpv6_packet_handler = do_packet6;
@@ -1668,7 +1672,7 @@ void lease_pinged
 		return;
 	}
 
-	if (!lp->state)
+	if (!LEASE_COLD_RO(lp)->state)
 	{
 #if defined (FAILOVER_PROTOCOL)
 		if (!lp -> pool ||
@@ -1686,9 +1690,9 @@ void lease_pinged
 
 	/* At this point it looks like we pinged a lease and got a
 	   response, which shouldn't have happened. */
-	data_string_forget(&lp->state->parameter_request_list, MDL);
-	free_lease_state(lp->state, MDL);
-	lp->state = (struct lease_state *)0;
+	data_string_forget(&LEASE_COLD_RO(lp)->state->parameter_request_list, MDL);
+	free_lease_state(LEASE_COLD_RO(lp)->state, MDL);
+	LEASE_COLD(lp)->state = (struct lease_state *)0;
 
 	abandon_lease(lp, "pinged before offer");
 	cancel_timeout(lease_ping_timeout, lp);
@@ -1943,6 +1947,8 @@ isc_result_t dhcp_set_control_state (control_object_state_t oldstate,
 		return ISC_R_SUCCESS;
 	shutdown_time = cur_time;
 	shutdown_state = shutdown_listeners;
+	log_lease_reuse_statistics();
+	omapi_pool_log_statistics();
 	/* Called by user. */
 	if (shutdown_signal == 0) {
 		shutdown_signal = SIGUSR1;
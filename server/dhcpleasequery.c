@@ -79,7 +79,7 @@ get_newest_lease(struct lease **retval,
 	for (p=next(lease); p != NULL; p=next(p)) {
 		if (newest->binding_state == FTS_ACTIVE) {
 			if ((p->binding_state == FTS_ACTIVE) && 
-		    	(p->cltt > newest->cltt)) {
+		    	(LEASE_COLD_RO(p)->cltt > LEASE_COLD_RO(newest)->cltt)) {
 				newest = p;
 			}
 		} else {
@@ -417,6 +417,7 @@ dhcpleasequery(struct packet *packet, int ms_nulltp) {
 		memcpy(packet->raw->chaddr, 
 		       &lease->hardware_addr.hbuf[1], 
 		       sizeof(packet->raw->chaddr));
+		expr_memo_forget(packet);
 
 		/*
 		 * Set client identifier option.
@@ -497,12 +498,12 @@ dhcpleasequery(struct packet *packet, int ms_nulltp) {
 		}
 
 		/* Supply the Vendor-Class-Identifier. */
-		if (lease->scope != NULL) {
+		if (LEASE_COLD_RO(lease)->scope != NULL) {
 			struct data_string vendor_class;
 
 			memset(&vendor_class, 0, sizeof(vendor_class));
 
-			if (find_bound_string(&vendor_class, lease->scope,
+			if (find_bound_string(&vendor_class, LEASE_COLD_RO(lease)->scope,
 					      "vendor-class-identifier")) {
 				if (!add_option(options,
 						DHO_VENDOR_CLASS_IDENTIFIER,
@@ -530,14 +531,14 @@ dhcpleasequery(struct packet *packet, int ms_nulltp) {
 		 * not.
 		 */
 
-		if (lease->agent_options != NULL) {
+		if (LEASE_COLD_RO(lease)->agent_options != NULL) {
 			int idx = agent_universe.index;
 			struct option_chain_head **tmp1 = 
 				(struct option_chain_head **)
 				&(options->universes[idx]);
 				struct option_chain_head *tmp2 = 
 				(struct option_chain_head *)
-				lease->agent_options;
+				LEASE_COLD_RO(lease)->agent_options;
 
 			option_chain_head_reference(tmp1, tmp2, MDL);
 		}
@@ -550,10 +551,10 @@ dhcpleasequery(struct packet *packet, int ms_nulltp) {
 		 * not be set.
 	 	 */
 
-		if (lease->cltt != MIN_TIME) {
-			if (cur_time > lease->cltt) {
+		if (LEASE_COLD_RO(lease)->cltt != MIN_TIME) {
+			if (cur_time > LEASE_COLD_RO(lease)->cltt) {
 				client_last_transaction_time = 
-					htonl(cur_time - lease->cltt);
+					htonl(cur_time - LEASE_COLD_RO(lease)->cltt);
 			} else {
 				client_last_transaction_time = htonl(0);
 			}
@@ -710,8 +711,6 @@ dhcpleasequery(struct packet *packet, int ms_nulltp) {
 #ifdef DHCPv6
 
 /*
- * TODO: RFC5007 query-by-clientid.
- *
  * TODO: RFC5007 look at the pools according to the link-address.
  *
  * TODO: get fixed leases too.
@@ -1061,6 +1060,141 @@ process_lq_by_address(struct lq6_state *lq) {
 	return ret_val;
 }
 
+/*
+ * State for collecting the bindings of a by-clientid lease query.
+ */
+struct lq6_client_data {
+	struct lq6_state *lq;
+	time_t cltt;
+	int bindings;
+};
+
+/*
+ * Append the active IAADDRs or IAPREFIXes of an IA to the client-data
+ * option being built (called by ia_foreach_by_duid()).
+ */
+static isc_result_t
+store_lq_bindings(struct ia_xx *ia, void *arg) {
+	struct lq6_client_data *cd = (struct lq6_client_data *)arg;
+	struct lq6_state *lq = cd->lq;
+	struct iasubopt *tmp;
+	unsigned char *p;
+	unsigned len;
+	int i;
+
+	len = (ia->ia_type == D6O_IA_PD) ? IAPREFIX_OFFSET : IAADDR_OFFSET;
+	for (i = 0; i < ia->num_iasubopt; i++) {
+		tmp = ia->iasubopt[i];
+		if (tmp->state != FTS_ACTIVE)
+			continue;
+
+		/* Leave room for the clt-time. */
+		if (lq->cursor + 4 + len + 8 > sizeof(lq->buf))
+			return ISC_R_NOSPACE;
+
+		p = lq->buf.data + lq->cursor;
+		if (ia->ia_type == D6O_IA_PD) {
+			putUShort(p, (unsigned)D6O_IAPREFIX);
+			putUShort(p + 2, len);
+			putULong(p + 4, tmp->prefer);
+			putULong(p + 8, tmp->valid);
+			p[12] = (unsigned char)tmp->plen;
+			memcpy(p + 13, &tmp->addr, 16);
+		} else {
+			putUShort(p, (unsigned)D6O_IAADDR);
+			putUShort(p + 2, len);
+			memcpy(p + 4, &tmp->addr, 16);
+			putULong(p + 20, tmp->prefer);
+			putULong(p + 24, tmp->valid);
+		}
+		lq->cursor += 4 + len;
+		cd->bindings++;
+	}
+	if (ia->cltt > cd->cltt)
+		cd->cltt = ia->cltt;
+
+	return ISC_R_SUCCESS;
+}
+
+/*
+ * Process a by-clientid lease query.
+ */
+static int
+process_lq_by_clientid(struct lq6_state *lq) {
+	struct packet *packet = lq->packet;
+	struct option_cache *oc;
+	struct data_string data;
+	struct lq6_client_data cd;
+	u_int32_t cltt;
+	unsigned opt_cursor;
+
+	/*
+	 * Get the client-id we are asked about.
+	 */
+	oc = lookup_option(&dhcpv6_universe, lq->query_opts, D6O_CLIENTID);
+	if (oc == NULL) {
+		if (!set_error(lq, STATUS_MalformedQuery,
+			       "No OPTION_CLIENTID.")) {
+			log_error("process_lq_by_clientid: unable "
+				  "to set MalformedQuery status code.");
+			return 0;
+		}
+		return 1;
+	}
+	memset(&data, 0, sizeof(data));
+	if (!evaluate_option_cache(&data, packet,
+				   NULL, NULL,
+				   lq->query_opts, NULL,
+				   &global_scope, oc, MDL) ||
+	    (data.len == 0)) {
+		log_error("process_lq_by_clientid: error evaluating "
+			  "client-id.");
+		if (data.data != NULL)
+			data_string_forget(&data, MDL);
+		return 0;
+	}
+
+	/*
+	 * Start the client-data option with the client-id, then add
+	 * the bindings of every active IA the client holds, found
+	 * through the DUID index.  As for the by-address query the
+	 * link-address is ignored.
+	 */
+	if (lq->cursor + 8 + data.len > sizeof(lq->buf)) {
+		data_string_forget(&data, MDL);
+		return 1;
+	}
+	opt_cursor = lq->cursor;
+	putUShort(lq->buf.data + lq->cursor, (unsigned)D6O_CLIENT_DATA);
+	lq->cursor += 4;
+	putUShort(lq->buf.data + lq->cursor, (unsigned)D6O_CLIENTID);
+	putUShort(lq->buf.data + lq->cursor + 2, data.len);
+	memcpy(lq->buf.data + lq->cursor + 4, data.data, data.len);
+	lq->cursor += 4 + data.len;
+
+	memset(&cd, 0, sizeof(cd));
+	cd.lq = lq;
+	ia_foreach_by_duid(data.data, data.len, store_lq_bindings, &cd);
+	data_string_forget(&data, MDL);
+
+	/* No bindings: send no client-data. */
+	if (cd.bindings == 0) {
+		lq->cursor = opt_cursor;
+		return 1;
+	}
+
+	putUShort(lq->buf.data + lq->cursor, (unsigned)D6O_CLT_TIME);
+	putUShort(lq->buf.data + lq->cursor + 2, 4);
+	cltt = cd.cltt;
+	putULong(lq->buf.data + lq->cursor + 4, cltt);
+	lq->cursor += 8;
+
+	/* Set the length. */
+	putUShort(lq->buf.data + opt_cursor + 2,
+		  lq->cursor - (opt_cursor + 4));
+
+	return 1;
+}
 
 /*
  * Process a lease query.
@@ -1188,13 +1322,7 @@ dhcpv6_leasequery(struct data_string *reply_ret, struct packet *packet) {
 		case LQ6QT_BY_ADDRESS:
 			break;
 		case LQ6QT_BY_CLIENTID:
-			if (!set_error(&lq, STATUS_UnknownQueryType,
-				       "QUERY_BY_CLIENTID not supported.")) {
-				log_error("dhcpv6_leasequery: unable to "
-					  "set UnknownQueryType status code.");
-				goto exit;
-			}
-			goto done;
+			break;
 		default:
 			if (!set_error(&lq, STATUS_UnknownQueryType,
 				       "Unknown query-type.")) {
@@ -1224,7 +1352,10 @@ dhcpv6_leasequery(struct data_string *reply_ret, struct packet *packet) {
 	}
 
 	/* Do it. */
-	if (!process_lq_by_address(&lq))
+	if (lq.query_type == LQ6QT_BY_CLIENTID) {
+		if (!process_lq_by_clientid(&lq))
+			goto exit;
+	} else if (!process_lq_by_address(&lq))
 		goto exit;
 
       done:
@@ -53,6 +53,9 @@ static int offset_data4o6 = 36; /* 16+16+4 */
  *       a single interface)
  */
 
+/* Number of pond permit verdicts remembered per message. */
+#define REPLY_POND_CACHE	16
+
 /*
  * DHCPv6 Reply workflow assist.  A Reply packet is built by various
  * different functions; this gives us one location where we keep state
@@ -67,6 +70,21 @@ struct reply_state {
 	struct packet *packet;
 	struct data_string client_id;
 
+	/*
+	 * Client state worked out once and shared by all the IAs of the
+	 * message: the host's fixed address and its subnet, and whether
+	 * the client may use each pond seen so far.
+	 */
+	isc_boolean_t host_fixed_done;
+	isc_result_t host_fixed_status;
+	struct data_string host_fixed;
+	struct subnet *host_subnet;
+	unsigned pond_count;
+	struct {
+		struct ipv6_pond *pond;
+		isc_boolean_t permitted;
+	} ponds[REPLY_POND_CACHE];
+
 	/* IA level persistent state */
 	unsigned ia_count;
 	unsigned pd_count;
@@ -188,6 +206,9 @@ static const char *iasubopt_plen_str(struct iasubopt *lease);
 static int release_on_roam(struct reply_state *reply);
 
 static int reuse_lease6(struct reply_state *reply, struct iasubopt *lease);
+static isc_boolean_t pond_permitted(struct reply_state *reply,
+				    struct ipv6_pond *pond);
+static isc_result_t host_fixed_address(struct reply_state *reply);
 static void shorten_lifetimes(struct reply_state *reply, struct iasubopt *lease,
 			      time_t age, int threshold);
 static void write_to_packet(struct reply_state *reply, unsigned ia_cursor);
@@ -1256,7 +1277,7 @@ try_client_v6_address(struct iasubopt **addr,
 	 * The address is not covered by this (or possibly any) dynamic
 	 * range.
 	 */
-	if (!ipv6_in_pool(&tmp_addr, pool)) {
+	if (!ipv6_in_pool(&tmp_addr, pool) || (pool->drain_end != 0)) {
 		return ISC_R_ADDRNOTAVAIL;
 	}
 
@@ -1306,7 +1327,6 @@ pick_v6_address(struct reply_state *reply)
 	struct ipv6_pool *p = NULL;
 	struct ipv6_pond *pond;
 	int i;
-	int start_pool;
 	unsigned int attempts;
 	char tmp_buf[INET6_ADDRSTRLEN];
 	struct iasubopt **addr = &reply->lease;
@@ -1317,24 +1337,9 @@ pick_v6_address(struct reply_state *reply)
 	char *shared_name = (reply->shared->name ?
 			     reply->shared->name : "(no name)");
 
-	/*
-	 * Do a quick walk through of the ponds and pools
-	 * to see if we have any NA address pools
-	 */
-	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (pond->ipv6_pools == NULL)
-			continue;
-
-		for (i = 0; (p = pond->ipv6_pools[i]) != NULL; i++) {
-			if (p->pool_type == D6O_IA_NA)
-				break;
-		}
-		if (p != NULL)
-			break;
-	}
-
-	/* If we get here and p is NULL we have no useful pools */
-	if (p == NULL) {
+	/* See if the shared network has any NA address pools. */
+	if ((reply->shared->ipv6_pool_types &
+	     IPV6_POOL_TYPE_BIT(D6O_IA_NA)) == 0) {
 		log_debug("Unable to pick client address: "
 			  "no IPv6 pools on this shared network");
 		return ISC_R_NORESOURCES;
@@ -1342,22 +1347,20 @@ pick_v6_address(struct reply_state *reply)
 
 	/*
 	 * We have at least one pool that could provide an address
-	 * Now we walk through the ponds and pools again and check
+	 * Now we walk through the ponds and pools and check
 	 * to see if the client is permitted and if an address is
 	 * available
 	 *
-	 * Within a given pond we start looking at the last pool we
-	 * allocated from, unless it had a collision trying to allocate
-	 * an address. This will tend to move us into less-filled pools.
+	 * Within a given pond we try the pool with the most free
+	 * addresses first, which spreads clients over the pools rather
+	 * than filling them one at a time, and stop at the first
+	 * exhausted pool since all the ones after it are too.
 	 */
 
 	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
 		isc_result_t result = ISC_R_FAILURE;
 
-		if (((pond->prohibit_list != NULL) &&
-		     (permitted(reply->packet, pond->prohibit_list))) ||
-		    ((pond->permit_list != NULL) &&
-		     (!permitted(reply->packet, pond->permit_list))))
+		if (!pond_permitted(reply, pond))
 			continue;
 
 #ifdef EUI_64
@@ -1369,56 +1372,35 @@ pick_v6_address(struct reply_state *reply)
 		}
 #endif
 
-		start_pool = pond->last_ipv6_pool;
-		i = start_pool;
-		do {
-			p = pond->ipv6_pools[i];
-			if (p->pool_type == D6O_IA_NA) {
+		ipv6_pond_order_pools(pond);
+		for (i = 0; (p = pond->ipv6_pools[i]) != NULL; i++) {
+			if (p->pool_type != D6O_IA_NA)
+				continue;
+			if (ipv6_pool_free(p) == 0) {
+				result = ISC_R_NORESOURCES;
+				break;
+			}
 #ifdef EUI_64
-				if (pond->use_eui_64) {
-					result =
-					create_lease6_eui_64(p, addr,
-					              &reply->ia->iaid_duid,
-					              cur_time + 120);
-				}
-				else
-#endif
-				{
-					result =
-					create_lease6(p, addr, &attempts,
+			if (pond->use_eui_64) {
+				result = create_lease6_eui_64(p, addr,
 						      &reply->ia->iaid_duid,
-					              cur_time + 120);
-
-				}
-
-				if (result == ISC_R_SUCCESS) {
-					/*
-					 * Record the pool used (or next one if
-					 * there was a collision).
-					 */
-					if (attempts > 1) {
-						i++;
-						if (pond->ipv6_pools[i]
-						    == NULL) {
-							i = 0;
-						}
-					}
-
-					pond->last_ipv6_pool = i;
-
-					log_debug("Picking pool address %s",
-						  inet_ntop(AF_INET6,
-						  &((*addr)->addr),
-						  tmp_buf, sizeof(tmp_buf)));
-					return (ISC_R_SUCCESS);
-				}
+						      cur_time + 120);
+			}
+			else
+#endif
+			{
+				result = create_lease6(p, addr, &attempts,
+						       &reply->ia->iaid_duid,
+						       cur_time + 120);
 			}
 
-			i++;
-			if (pond->ipv6_pools[i] == NULL) {
-				i = 0;
+			if (result == ISC_R_SUCCESS) {
+				log_debug("Picking pool address %s",
+					  inet_ntop(AF_INET6, &((*addr)->addr),
+						    tmp_buf, sizeof(tmp_buf)));
+				return (ISC_R_SUCCESS);
 			}
-		} while (i != start_pool);
+		}
 
 		if (result == ISC_R_NORESOURCES) {
 			jumbo_range += pond->jumbo_range;
@@ -1486,7 +1468,7 @@ try_client_v6_prefix(struct iasubopt **pref,
 	}
 
 	if (!ipv6_in_pool(&tmp_pref, pool) ||
-	    ((int)tmp_plen != pool->units)) {
+	    ((int)tmp_plen != pool->units) || (pool->drain_end != 0)) {
 		return ISC_R_ADDRNOTAVAIL;
 	}
 
@@ -1552,29 +1534,11 @@ try_client_v6_prefix(struct iasubopt **pref,
  */
 static isc_result_t
 pick_v6_prefix(struct reply_state *reply) {
-        struct ipv6_pool *p = NULL;
-        struct ipv6_pond *pond;
-        int i;
 	isc_result_t result;
 
-	/*
-	 * Do a quick walk through of the ponds and pools
-	 * to see if we have any prefix pools
-	*/
-	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (pond->ipv6_pools == NULL)
-			continue;
-
-		for (i = 0; (p = pond->ipv6_pools[i]) != NULL; i++) {
-			if (p->pool_type == D6O_IA_PD)
-				break;
-		}
-		if (p != NULL)
-			break;
-	}
-
-	/* If we get here and p is NULL we have no useful pools */
-	if (p == NULL) {
+	/* See if the shared network has any prefix pools. */
+	if ((reply->shared->ipv6_pool_types &
+	     IPV6_POOL_TYPE_BIT(D6O_IA_PD)) == 0) {
 		log_debug("Unable to pick client prefix: "
 			  "no IPv6 pools on this shared network");
 		return ISC_R_NORESOURCES;
@@ -1669,15 +1633,17 @@ pick_v6_prefix_helper(struct reply_state *reply, int prefix_mode) {
 	struct iasubopt **pref = &reply->lease;
 
 	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (((pond->prohibit_list != NULL) &&
-		     (permitted(reply->packet, pond->prohibit_list))) ||
-		    ((pond->permit_list != NULL) &&
-		     (!permitted(reply->packet, pond->permit_list))))
+		if (!pond_permitted(reply, pond))
 			continue;
 
+		/* Emptiest pools first, as for addresses. */
+		ipv6_pond_order_pools(pond);
 		for (i = 0; (p = pond->ipv6_pools[i]) != NULL; i++) {
-			if ((p->pool_type == D6O_IA_PD) &&
-			    (eval_prefix_mode(p->units, reply->preflen,
+			if (p->pool_type != D6O_IA_PD)
+				continue;
+			if (ipv6_pool_free(p) == 0)
+				break;
+			if ((eval_prefix_mode(p->units, reply->preflen,
 					      prefix_mode) == 1) &&
 			    (create_prefix6(p, pref, &attempts,
 					    &reply->ia->iaid_duid,
@@ -1762,6 +1728,81 @@ eval_prefix_mode(int len, int preflen, int prefix_mode) {
  */
 /* TODO: look at client hints for lease times */
 
+/*
+ * Check the pond's permit and prohibit lists against the client.  The
+ * verdict cannot change within a message, so it is remembered for the
+ * other IAs and addresses of the same message.
+ */
+static isc_boolean_t
+pond_permitted(struct reply_state *reply, struct ipv6_pond *pond) {
+	isc_boolean_t result;
+	unsigned i;
+
+	if ((pond->prohibit_list == NULL) && (pond->permit_list == NULL))
+		return (ISC_TRUE);
+
+	for (i = 0; i < reply->pond_count; i++) {
+		if (reply->ponds[i].pond == pond)
+			return (reply->ponds[i].permitted);
+	}
+
+	if (((pond->prohibit_list != NULL) &&
+	     (permitted(reply->packet, pond->prohibit_list))) ||
+	    ((pond->permit_list != NULL) &&
+	     (!permitted(reply->packet, pond->permit_list))))
+		result = ISC_FALSE;
+	else
+		result = ISC_TRUE;
+
+	if (reply->pond_count < REPLY_POND_CACHE) {
+		reply->ponds[reply->pond_count].pond = pond;
+		reply->ponds[reply->pond_count].permitted = result;
+		reply->pond_count++;
+	}
+
+	return (result);
+}
+
+/*
+ * Evaluate the fixed address of the client's host record and find the
+ * subnet it is on, once per message.  The caller has already tested
+ * that reply->host has a fixed address.  Returns ISC_R_NOTFOUND if
+ * the address is on none of the shared network's subnets.
+ */
+static isc_result_t
+host_fixed_address(struct reply_state *reply) {
+	struct iaddr tmp_addr;
+
+	if (reply->host_fixed_done)
+		return (reply->host_fixed_status);
+	reply->host_fixed_done = ISC_TRUE;
+
+	if (!evaluate_option_cache(&reply->host_fixed, NULL, NULL, NULL,
+				   NULL, NULL, &global_scope,
+				   reply->host->fixed_addr, MDL)) {
+		log_error("host_fixed_address: unable to evaluate "
+			  "fixed address.");
+		reply->host_fixed_status = ISC_R_FAILURE;
+		return (reply->host_fixed_status);
+	}
+
+	if (reply->host_fixed.len < 16) {
+		log_error("host_fixed_address: invalid fixed address.");
+		reply->host_fixed_status = DHCP_R_INVALIDARG;
+		return (reply->host_fixed_status);
+	}
+
+	tmp_addr.len = 16;
+	memcpy(tmp_addr.iabuf, reply->host_fixed.data, 16);
+	if (find_grouped_subnet(&reply->host_subnet, reply->shared,
+				tmp_addr, MDL) == 0)
+		reply->host_fixed_status = ISC_R_NOTFOUND;
+	else
+		reply->host_fixed_status = ISC_R_SUCCESS;
+
+	return (reply->host_fixed_status);
+}
+
 static void
 lease_to_client(struct data_string *reply_ret,
 		struct packet *packet,
@@ -1981,8 +2022,14 @@ lease_to_client(struct data_string *reply_ret,
 		packet_dereference(&reply.packet, MDL);
 	if (reply.client_id.data != NULL)
 		data_string_forget(&reply.client_id, MDL);
+	if (reply.host_fixed.data != NULL)
+		data_string_forget(&reply.host_fixed, MDL);
+	if (reply.host_subnet != NULL)
+		subnet_dereference(&reply.host_subnet, MDL);
 	if (packet_oro.buffer != NULL)
 		data_string_forget(&packet_oro, MDL);
+	reply.host_fixed_done = ISC_FALSE;
+	reply.pond_count = 0;
 	reply.renew = reply.rebind = reply.min_prefer = reply.min_valid = 0;
 	reply.cursor = 0;
 }
@@ -2052,30 +2099,15 @@ reply_process_ia_na(struct reply_state *reply, struct option_cache *ia) {
 
 	/* Check & cache the fixed host record. */
 	if ((reply->host != NULL) && (reply->host->fixed_addr != NULL)) {
-		struct iaddr tmp_addr;
-
-		if (!evaluate_option_cache(&reply->fixed, NULL, NULL, NULL,
-					   NULL, NULL, &global_scope,
-					   reply->host->fixed_addr, MDL)) {
-			log_error("reply_process_ia_na: unable to evaluate "
-				  "fixed address.");
-			status = ISC_R_FAILURE;
-			goto cleanup;
-		}
-
-		if (reply->fixed.len < 16) {
-			log_error("reply_process_ia_na: invalid fixed address.");
-			status = DHCP_R_INVALIDARG;
+		status = host_fixed_address(reply);
+		if (status == ISC_R_NOTFOUND)
+			log_fatal("Impossible condition at %s:%d.", MDL);
+		if (status != ISC_R_SUCCESS)
 			goto cleanup;
-		}
 
-		/* Find the static lease's subnet. */
-		tmp_addr.len = 16;
-		memcpy(tmp_addr.iabuf, reply->fixed.data, 16);
-
-		if (find_grouped_subnet(&reply->subnet, reply->shared,
-					tmp_addr, MDL) == 0)
-			log_fatal("Impossible condition at %s:%d.", MDL);
+		/* The static lease and its subnet. */
+		data_string_copy(&reply->fixed, &reply->host_fixed, MDL);
+		subnet_reference(&reply->subnet, reply->host_subnet, MDL);
 
 		reply->static_lease = ISC_TRUE;
 	} else
@@ -2364,9 +2396,9 @@ reply_process_ia_na(struct reply_state *reply, struct option_cache *ia) {
 		if (reply->old_ia != NULL) {
 			if (!release_on_roam(reply)) {
 				ia_id = &reply->old_ia->iaid_duid;
-				ia_hash_delete(ia_na_active,
-					       (unsigned char *)ia_id->data,
-					       ia_id->len, MDL);
+				ia_active_delete(ia_na_active,
+						 (unsigned char *)ia_id->data,
+						 ia_id->len, MDL);
 			}
 
 			ia_dereference(&reply->old_ia, MDL);
@@ -2375,8 +2407,7 @@ reply_process_ia_na(struct reply_state *reply, struct option_cache *ia) {
 		/* Put new ia into the hash. */
 		reply->ia->cltt = cur_time;
 		ia_id = &reply->ia->iaid_duid;
-		ia_hash_add(ia_na_active, (unsigned char *)ia_id->data,
-			    ia_id->len, reply->ia, MDL);
+		ia_active_add(ia_na_active, reply->ia, MDL);
 
 		/* If we couldn't reuse all of the iasubopts, we
 		* must update udpate the lease db */
@@ -2810,10 +2841,7 @@ address_is_owned(struct reply_state *reply, struct iaddr *addr) {
 			}
 
 			pond = tmp->ipv6_pool->ipv6_pond;
-			if (((pond->prohibit_list != NULL) &&
-			     (permitted(reply->packet, pond->prohibit_list))) ||
-			    ((pond->permit_list != NULL) &&
-			     (!permitted(reply->packet, pond->permit_list))))
+			if (!pond_permitted(reply, pond))
 				return (ISC_FALSE);
 
 			iasubopt_reference(&reply->lease, tmp, MDL);
@@ -3146,9 +3174,9 @@ reply_process_ia_ta(struct reply_state *reply, struct option_cache *ia) {
 		if (reply->old_ia != NULL) {
 			if (!release_on_roam(reply)) {
 				ia_id = &reply->old_ia->iaid_duid;
-				ia_hash_delete(ia_ta_active,
-					       (unsigned char *)ia_id->data,
-					       ia_id->len, MDL);
+				ia_active_delete(ia_ta_active,
+						 (unsigned char *)ia_id->data,
+						 ia_id->len, MDL);
 			}
 
 			ia_dereference(&reply->old_ia, MDL);
@@ -3157,8 +3185,7 @@ reply_process_ia_ta(struct reply_state *reply, struct option_cache *ia) {
 		/* Put new ia into the hash. */
 		reply->ia->cltt = cur_time;
 		ia_id = &reply->ia->iaid_duid;
-		ia_hash_add(ia_ta_active, (unsigned char *)ia_id->data,
-			    ia_id->len, reply->ia, MDL);
+		ia_active_add(ia_ta_active, reply->ia, MDL);
 
 		/* If we couldn't reuse all of the iasubopts, we
 		* must update udpate the lease db */
@@ -3228,6 +3255,11 @@ reuse_lease6(struct reply_state *reply, struct iasubopt *lease) {
 		return (0);
 	}
 
+	/* Nor if its pool is being drained, which shortens it instead. */
+	if ((lease->ipv6_pool != NULL) && (lease->ipv6_pool->drain_end != 0)) {
+		return (0);
+	}
+
 	/* Look up threshold value */
 	memset(&d1, 0, sizeof(struct data_string));
 	oc = lookup_option(&server_universe, reply->opt_state,
@@ -3405,10 +3437,7 @@ temporary_is_available(struct reply_state *reply, struct iaddr *addr) {
 	 * Verify that this address is in a temporary pool and try to get it.
 	 */
 	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (((pond->prohibit_list != NULL) &&
-		     (permitted(reply->packet, pond->prohibit_list))) ||
-		    ((pond->permit_list != NULL) &&
-		     (!permitted(reply->packet, pond->permit_list))))
+		if (!pond_permitted(reply, pond))
 			continue;
 
 		for (i = 0 ; (pool = pond->ipv6_pools[i]) != NULL ; i++) {
@@ -3450,24 +3479,9 @@ find_client_temporaries(struct reply_state *reply) {
 	unsigned int attempts;
 	struct iaddr send_addr;
 
-	/*
-	 * Do a quick walk through of the ponds and pools
-	 * to see if we have any prefix pools
-	 */
-	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (pond->ipv6_pools == NULL)
-			continue;
-
-		for (i = 0; (p = pond->ipv6_pools[i]) != NULL; i++) {
-			if (p->pool_type == D6O_IA_TA)
-				break;
-		}
-		if (p != NULL)
-			break;
-	}
-
-	/* If we get here and p is NULL we have no useful pools */
-	if (p == NULL) {
+	/* See if the shared network has any temporary address pools. */
+	if ((reply->shared->ipv6_pool_types &
+	     IPV6_POOL_TYPE_BIT(D6O_IA_TA)) == 0) {
 		log_debug("Unable to get client addresses: "
 			  "no IPv6 pools on this shared network");
 		return ISC_R_NORESOURCES;
@@ -3481,10 +3495,7 @@ find_client_temporaries(struct reply_state *reply) {
 	 */
 
 	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (((pond->prohibit_list != NULL) &&
-		     (permitted(reply->packet, pond->prohibit_list))) ||
-		    ((pond->permit_list != NULL) &&
-		     (!permitted(reply->packet, pond->permit_list))))
+		if (!pond_permitted(reply, pond))
 			continue;
 
 		for (i = 0; (p = pond->ipv6_pools[i]) != NULL; i++) {
@@ -3586,10 +3597,7 @@ reply_process_try_addr(struct reply_state *reply, struct iaddr *addr) {
 	 */
 
 	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (((pond->prohibit_list != NULL) &&
-		     (permitted(reply->packet, pond->prohibit_list))) ||
-		    ((pond->permit_list != NULL) &&
-		     (!permitted(reply->packet, pond->permit_list))))
+		if (!pond_permitted(reply, pond))
 			continue;
 
 		for (i = 0 ; (pool = pond->ipv6_pools[i]) != NULL ; i++) {
@@ -3655,10 +3663,7 @@ find_client_address(struct reply_state *reply) {
 			    (lease6_usable(lease) != ISC_TRUE))
 				continue;
 
-			if (((pond->prohibit_list != NULL) &&
-			     (permitted(reply->packet, pond->prohibit_list))) ||
-			    ((pond->permit_list != NULL) &&
-			     (!permitted(reply->packet, pond->permit_list))))
+			if (!pond_permitted(reply, pond))
 				continue;
 
 			best_lease = lease_compare(lease, best_lease);
@@ -3849,6 +3854,12 @@ reply_process_is_addressed(struct reply_state *reply,
 		data_string_forget(&data, MDL);
 	}
 
+	/* A binding from a pool being drained must not outlast the drain. */
+	if ((reply->lease != NULL) && (reply->lease->ipv6_pool != NULL))
+		ipv6_pool_drain_lifetimes(reply->lease->ipv6_pool,
+					  &reply->send_prefer,
+					  &reply->send_valid);
+
 	/* Note lowest values for later calculation of renew/rebind times. */
 	if (reply->min_prefer > reply->send_prefer)
 		reply->min_prefer = reply->send_prefer;
@@ -4372,9 +4383,9 @@ reply_process_ia_pd(struct reply_state *reply, struct option_cache *ia) {
 		if (reply->old_ia != NULL) {
 			if (!release_on_roam(reply)) {
 				ia_id = &reply->old_ia->iaid_duid;
-				ia_hash_delete(ia_pd_active,
-					       (unsigned char *)ia_id->data,
-					       ia_id->len, MDL);
+				ia_active_delete(ia_pd_active,
+						 (unsigned char *)ia_id->data,
+						 ia_id->len, MDL);
 			}
 
 			ia_dereference(&reply->old_ia, MDL);
@@ -4383,8 +4394,7 @@ reply_process_ia_pd(struct reply_state *reply, struct option_cache *ia) {
 		/* Put new ia into the hash. */
 		reply->ia->cltt = cur_time;
 		ia_id = &reply->ia->iaid_duid;
-		ia_hash_add(ia_pd_active, (unsigned char *)ia_id->data,
-			    ia_id->len, reply->ia, MDL);
+		ia_active_add(ia_pd_active, reply->ia, MDL);
 
 		/* If we couldn't reuse all of the iasubopts, we
 		* must udpate the lease db */
@@ -4451,8 +4461,6 @@ find_group_by_prefix(struct reply_state *reply) {
 	/* default group if we don't find anything better */
 	struct group *group = reply->shared->group;
 	struct subnet *subnet = NULL;
-	struct iaddr tmp_addr;
-	struct data_string fixed_addr;
 
 	/* Try with the prefix first */
 	if (find_grouped_subnet(&subnet, reply->shared,
@@ -4465,23 +4473,9 @@ find_group_by_prefix(struct reply_state *reply) {
 	/* Didn't find a subnet via prefix, what about fixed address */
 	/* The caller has already tested reply->host != NULL */
 
-	memset(&fixed_addr, 0, sizeof(fixed_addr));
-
 	if ((reply->host->fixed_addr != NULL) &&
-	    (evaluate_option_cache(&fixed_addr, NULL, NULL, NULL,
-				   NULL, NULL, &global_scope,
-				   reply->host->fixed_addr, MDL))) {
-		if (fixed_addr.len >= 16) {
-			tmp_addr.len = 16;
-			memcpy(tmp_addr.iabuf, fixed_addr.data, 16);
-			if (find_grouped_subnet(&subnet, reply->shared,
-						tmp_addr, MDL) != 0) {
-				group = subnet->group;
-				subnet_dereference(&subnet, MDL);
-			}
-		}
-		data_string_forget(&fixed_addr, MDL);
-	}
+	    (host_fixed_address(reply) == ISC_R_SUCCESS))
+		group = reply->host_subnet->group;
 
 	/* return whatever we got */
 	return (group);
@@ -4757,10 +4751,7 @@ prefix_is_owned(struct reply_state *reply, struct iaddrcidrnet *pref) {
 			}
 
 			pond = tmp->ipv6_pool->ipv6_pond;
-			if (((pond->prohibit_list != NULL) &&
-			     (permitted(reply->packet, pond->prohibit_list))) ||
-			    ((pond->permit_list != NULL) &&
-			     (!permitted(reply->packet, pond->permit_list))))
+			if (!pond_permitted(reply, pond))
 				return (ISC_FALSE);
 
 			iasubopt_reference(&reply->lease, tmp, MDL);
@@ -4828,10 +4819,7 @@ reply_process_try_prefix(struct reply_state *reply,
 	 */
 
 	for (pond = reply->shared->ipv6_pond; pond != NULL; pond = pond->next) {
-		if (((pond->prohibit_list != NULL) &&
-		     (permitted(reply->packet, pond->prohibit_list))) ||
-		    ((pond->permit_list != NULL) &&
-		     (!permitted(reply->packet, pond->permit_list))))
+		if (!pond_permitted(reply, pond))
 			continue;
 
 		for (i = 0; (pool = pond->ipv6_pools[i]) != NULL; i++) {
@@ -4921,10 +4909,7 @@ find_client_prefix(struct reply_state *reply) {
 			 * And check if the prefix is still permitted
 			 */
 
-			if (((pond->prohibit_list != NULL) &&
-			     (permitted(reply->packet, pond->prohibit_list))) ||
-			    ((pond->permit_list != NULL) &&
-			     (!permitted(reply->packet, pond->permit_list))))
+			if (!pond_permitted(reply, pond))
 				continue;
 
 			best_prefix = prefix_compare(reply, prefix,
@@ -5124,6 +5109,12 @@ reply_process_is_prefixed(struct reply_state *reply,
 		data_string_forget(&data, MDL);
 	}
 
+	/* A binding from a pool being drained must not outlast the drain. */
+	if ((reply->lease != NULL) && (reply->lease->ipv6_pool != NULL))
+		ipv6_pool_drain_lifetimes(reply->lease->ipv6_pool,
+					  &reply->send_prefer,
+					  &reply->send_valid);
+
 	/* Note lowest values for later calculation of renew/rebind times. */
 	if (reply->min_prefer > reply->send_prefer)
 		reply->min_prefer = reply->send_prefer;
@@ -5409,7 +5400,6 @@ shared_network_from_packet6(struct shared_network **shared,
 	const struct packet *chk_packet;
 	const struct in6_addr *link_addr, *first_link_addr;
 	struct iaddr tmp_addr;
-	struct subnet *subnet;
 	isc_result_t status;
 
 	if ((shared == NULL) || (*shared != NULL) || (packet == NULL))
@@ -5440,15 +5430,12 @@ shared_network_from_packet6(struct shared_network **shared,
 		tmp_addr.len = sizeof(*first_link_addr);
 		memcpy(tmp_addr.iabuf,
 		       first_link_addr, sizeof(*first_link_addr));
-		subnet = NULL;
-		if (!find_subnet(&subnet, tmp_addr, MDL)) {
+		if (!find_link_network(shared, tmp_addr, MDL)) {
 			log_debug("No subnet found for link-address %s.",
 				  piaddr(tmp_addr));
 			return ISC_R_NOTFOUND;
 		}
-		status = shared_network_reference(shared,
-						  subnet->shared_network, MDL);
-		subnet_dereference(&subnet, MDL);
+		status = ISC_R_SUCCESS;
 
 	/*
 	 * If there is no link address, we will use the interface
@@ -7578,6 +7565,8 @@ static void
 build_dhcpv6_reply(struct data_string *reply, struct packet *packet) {
 	memset(reply, 0, sizeof(*reply));
 
+	packet_index_relay_ids(packet);
+
 	/* I would like to classify the client once here, but
 	 * as I don't want to classify all of the incoming packets
 	 * I need to do it before handling specific types.
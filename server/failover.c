@@ -2000,13 +2000,13 @@ void dhcp_failover_rescind_updates(dhcp_failover_state_t *state)
 	    return;
 
     /* Zap the flags. */
-    for (lp = state->ack_queue_head; lp; lp = lp->next_pending)
+    for (lp = state->ack_queue_head; lp; lp = LEASE_COLD_RO(lp)->next_pending)
 	    lp->flags = ((lp->flags & ~ON_ACK_QUEUE) | ON_UPDATE_QUEUE);
 
     /* Now hook the ack queue to the beginning of the update queue. */
     if (state->update_queue_head) 
 	{
-	    lease_reference(&state->ack_queue_tail->next_pending,
+	    lease_reference(&LEASE_COLD(state->ack_queue_tail)->next_pending,
 			    state->update_queue_head, MDL);
 	    lease_dereference(&state->update_queue_head, MDL);
     }
@@ -2015,7 +2015,7 @@ void dhcp_failover_rescind_updates(dhcp_failover_state_t *state)
     if (!state->update_queue_tail)
 	{
 #if defined (POINTER_DEBUG)
-	    if (state->ack_queue_tail->next_pending) {
+	    if (LEASE_COLD_RO(state->ack_queue_tail)->next_pending) {
 		    log_error("next pending on ack queue tail.");
 		    abort();
 	    }
@@ -2922,7 +2922,7 @@ dhcp_failover_pool_dobalance(dhcp_failover_state_t *state,
 			    --lts;
 			    ++leases_queued;
 			    lp->next_binding_state = peer_lease_state;
-			    lp->tstp = cur_time;
+			    LEASE_COLD(lp)->tstp = cur_time;
 			    lp->starts = cur_time;
 
 			    scrub_lease(lp, MDL);
@@ -3131,10 +3131,10 @@ isc_result_t dhcp_failover_send_updates
 		/* Take it off the head of the update queue and put the next
 		   item in the update queue at the head. */
 		lease_dereference(&state->update_queue_head, MDL);
-		if (lp->next_pending) 
+		if (LEASE_COLD_RO(lp)->next_pending) 
 		{
-			lease_reference(&state->update_queue_head, lp->next_pending, MDL);
-			lease_dereference(&lp->next_pending, MDL);
+			lease_reference(&state->update_queue_head, LEASE_COLD_RO(lp)->next_pending, MDL);
+			lease_dereference(&LEASE_COLD(lp)->next_pending, MDL);
 		} 
 		else 
 		{
@@ -3143,7 +3143,7 @@ isc_result_t dhcp_failover_send_updates
 
 		if (state->ack_queue_head) 
 		{
-			lease_reference(&state->ack_queue_tail->next_pending, lp, MDL);
+			lease_reference(&LEASE_COLD(state->ack_queue_tail)->next_pending, lp, MDL);
 			lease_dereference(&state->ack_queue_tail, MDL);
 		}
 		else 
@@ -3200,7 +3200,7 @@ int dhcp_failover_queue_update(struct lease *lease, int immediate)
 
 	if (state->update_queue_head) 
 	{
-		lease_reference(&state->update_queue_tail->next_pending, lease, MDL);
+		lease_reference(&LEASE_COLD(state->update_queue_tail)->next_pending, lease, MDL);
 		lease_dereference(&state->update_queue_tail, MDL);
 	} 
 	else 
@@ -3360,10 +3360,10 @@ void dhcp_failover_ack_queue_remove
 	if (state->ack_queue_head == lease) 
 	{
 		lease_dereference(&state->ack_queue_head, MDL);
-		if (lease->next_pending) 
+		if (LEASE_COLD_RO(lease)->next_pending) 
 		{
-			lease_reference(&state->ack_queue_head, lease->next_pending, MDL);
-			lease_dereference(&lease->next_pending, MDL);
+			lease_reference(&state->ack_queue_head, LEASE_COLD_RO(lease)->next_pending, MDL);
+			lease_dereference(&LEASE_COLD(lease)->next_pending, MDL);
 		} 
 		else 
 		{
@@ -3373,23 +3373,23 @@ void dhcp_failover_ack_queue_remove
 	else 
 	{
 		for (lp = state->ack_queue_head;
-		     lp && lp->next_pending != lease;
-		     lp = lp->next_pending)
+		     lp && LEASE_COLD_RO(lp)->next_pending != lease;
+		     lp = LEASE_COLD_RO(lp)->next_pending)
 			;
 
 		if (!lp)
 			return;
 
-		lease_dereference(&lp->next_pending, MDL);
-		if (lease->next_pending) 
+		lease_dereference(&LEASE_COLD(lp)->next_pending, MDL);
+		if (LEASE_COLD_RO(lease)->next_pending) 
 		{
-			lease_reference(&lp->next_pending, lease->next_pending, MDL);
-			lease_dereference(&lease->next_pending, MDL);
+			lease_reference(&LEASE_COLD(lp)->next_pending, LEASE_COLD_RO(lease)->next_pending, MDL);
+			lease_dereference(&LEASE_COLD(lease)->next_pending, MDL);
 		}
 		else 
 		{
 			lease_dereference(&state->ack_queue_tail, MDL);
-			if (lp->next_pending) 
+			if (LEASE_COLD_RO(lp)->next_pending) 
 			{
 				log_error("state->ack_queue_tail");
 				abort();
@@ -3400,7 +3400,7 @@ void dhcp_failover_ack_queue_remove
 
 	lease->flags &= ~ON_ACK_QUEUE;
 	/* Multiple acks on one XID is an error and may cause badness. */
-	lease->last_xid = 0;
+	LEASE_COLD(lease)->last_xid = 0;
 	/* XXX: this violates draft-failover.  We can't send another
 	 * update just because we forgot about an old one that hasn't
 	 * been acked yet.
@@ -5214,7 +5214,7 @@ isc_result_t dhcp_failover_send_bind_update
 	if (link->xid == 0)
 		link->xid = 1;
 
-	lease->last_xid = link->xid++;
+	LEASE_COLD(lease)->last_xid = link->xid++;
 
 	/*
 	 * Our very next action is to transmit a binding update relating to
@@ -5250,7 +5250,7 @@ isc_result_t dhcp_failover_send_bind_update
 	/* Send the update. */
 	status = (dhcp_failover_put_message
 		  (link, link -> outer,
-		   FTM_BNDUPD, lease->last_xid,
+		   FTM_BNDUPD, LEASE_COLD_RO(lease)->last_xid,
 		   dhcp_failover_make_option (FTO_ASSIGNED_IP_ADDRESS, FMA,
 					      lease -> ip_addr.len,
 					      lease -> ip_addr.iabuf),
@@ -5269,11 +5269,11 @@ isc_result_t dhcp_failover_send_bind_update
 		   dhcp_failover_make_option (FTO_LEASE_EXPIRY, FMA,
 					      lease -> ends),
 		   dhcp_failover_make_option (FTO_POTENTIAL_EXPIRY, FMA,
-					      lease -> tstp),
+					      LEASE_COLD_RO(lease)->tstp),
 		   dhcp_failover_make_option (FTO_STOS, FMA,
 					      lease -> starts),
-		   (lease->cltt != 0) ?
-			dhcp_failover_make_option(FTO_CLTT, FMA, lease->cltt) :
+		   (LEASE_COLD_RO(lease)->cltt != 0) ?
+			dhcp_failover_make_option(FTO_CLTT, FMA, LEASE_COLD_RO(lease)->cltt) :
 			&skip_failover_option, /* No CLTT */
 		   flags ? dhcp_failover_make_option(FTO_IP_FLAGS, FMA,
 						     flags) :
@@ -5662,9 +5662,9 @@ failover_lease_is_better
 	      case FTS_ACTIVE:
 		if (msg->binding_status == FTS_ACTIVE) 
 		{
-			if (msg_cltt < lease->cltt)
+			if (msg_cltt < LEASE_COLD_RO(lease)->cltt)
 				return ISC_TRUE;
-			else if (msg_cltt > lease->cltt)
+			else if (msg_cltt > LEASE_COLD_RO(lease)->cltt)
 				return ISC_FALSE;
 			else if (state->i_am == primary)
 				return ISC_TRUE;
@@ -5826,8 +5826,8 @@ isc_result_t dhcp_failover_process_bind_update
 	{
 		chaddr_changed = ISC_TRUE;
 		lt->hardware_addr.hlen = 0;
-		if (lt->scope)
-			binding_scope_dereference(&lt->scope, MDL);
+		if (LEASE_COLD_RO(lt)->scope)
+			binding_scope_dereference(&LEASE_COLD(lt)->scope, MDL);
 	}
 
 	/* There is no explicit message content to indicate that the client
@@ -5916,8 +5916,8 @@ isc_result_t dhcp_failover_process_bind_update
 		(void) ddns_removals(lease, NULL, NULL, ISC_FALSE);
 #endif /* NSUPDATE */
 
-		if (lease->scope != NULL)
-			binding_scope_dereference(&lease->scope, MDL);
+		if (LEASE_COLD_RO(lease)->scope != NULL)
+			binding_scope_dereference(&LEASE_COLD(lease)->scope, MDL);
 	}
 
 	/* XXX Times may need to be adjusted based on clock skew! */
@@ -5931,7 +5931,7 @@ isc_result_t dhcp_failover_process_bind_update
 	}
 	if (msg->options_present & FTB_POTENTIAL_EXPIRY) 
 	{
-		lt->atsfp = lt->tsfp = msg->potential_expiry;
+		LEASE_COLD(lt)->atsfp = lt->tsfp = msg->potential_expiry;
 	}
 	if (msg->options_present & FTB_IP_FLAGS) 
 	{
@@ -6063,7 +6063,7 @@ isc_result_t dhcp_failover_process_bind_update
 	if (send_to_backup && secondary_not_hoarding(state, lease->pool)) 
 	{
 		lease->next_binding_state = FTS_BACKUP;
-		lease->tstp = cur_time;
+		LEASE_COLD(lease)->tstp = cur_time;
 		lease->starts = cur_time;
 
 		if (!supersede_lease(lease, NULL, 0, 1, 0, 0) ||
@@ -6162,10 +6162,10 @@ isc_result_t dhcp_failover_process_bind_ack
 	/* Silently discard acks for leases we did not update (or multiple
 	 * acks).
 	 */
-	if (!lease->last_xid)
+	if (!LEASE_COLD_RO(lease)->last_xid)
 		goto unqueue;
 
-	if (lease->last_xid != msg->xid) 
+	if (LEASE_COLD_RO(lease)->last_xid != msg->xid) 
 	{
 		message = "xid mismatch";
 		goto bad;
@@ -6175,7 +6175,7 @@ isc_result_t dhcp_failover_process_bind_ack
 	if (msg->options_present & FTO_POTENTIAL_EXPIRY)
 		pot_expire = msg->potential_expiry;
 	else
-		pot_expire = lease->tstp;
+		pot_expire = LEASE_COLD_RO(lease)->tstp;
 
 	/* If the lease was desired to enter a binding state, we set
 	 * such a value upon transmitting a bndupd.  We do not clear it
@@ -6195,7 +6195,7 @@ isc_result_t dhcp_failover_process_bind_ack
 		 * supersede_lease immediately after: the lease is requeued
 		 * even if its sort order (tsfp) has changed.
 		 */
-		lease->atsfp = lease->tsfp = pot_expire;
+		LEASE_COLD(lease)->atsfp = lease->tsfp = pot_expire;
 		if ((state->i_am == secondary) &&
 		    (lease->flags & RESERVED_LEASE))
 			lease->next_binding_state = FTS_BACKUP;
@@ -6231,7 +6231,7 @@ isc_result_t dhcp_failover_process_bind_ack
 		/* XXX It could be a problem to do this directly if the lease
 		 * XXX is sorted by tsfp.
 		 */
-		lease->atsfp = lease->tsfp = pot_expire;
+		LEASE_COLD(lease)->atsfp = lease->tsfp = pot_expire;
 		if (lease->desired_binding_state != lease->binding_state) 
 		{
 			lease->next_binding_state =
@@ -6266,7 +6266,7 @@ isc_result_t dhcp_failover_process_bind_ack
 	if (send_to_backup && secondary_not_hoarding(state, lease->pool)) 
 	{
 		lease->next_binding_state = FTS_BACKUP;
-		lease->tstp = lease->starts = cur_time;
+		LEASE_COLD(lease)->tstp = lease->starts = cur_time;
 
 		if (!supersede_lease(lease, NULL, 0, 1, 0, 0) ||
 		    !write_lease(lease))
@@ -6342,7 +6342,7 @@ isc_result_t dhcp_failover_generate_update_queue
 				{
 					/* tstpatsfp˵atsfp0ûpartner */
 					if ((l->flags & ON_QUEUE) == 0 &&
-					    (everythingp || (l->tstp > l->atsfp) || (i == EXPIRED_LEASES))) 
+					    (everythingp || (LEASE_COLD_RO(l)->tstp > LEASE_COLD_RO(l)->atsfp) || (i == EXPIRED_LEASES))) 
 					{
 						l->desired_binding_state = l->binding_state;
 						dhcp_failover_queue_update(l, 0);
@@ -7250,10 +7250,8 @@ const char *printable(const char* value) {
  */
 void scrub_lease(struct lease* lease, const char *file, int line) {
 	log_debug ("%s(%d):scrubbing lease for %s, hostname: %s", file, line,
-		   piaddr(lease->ip_addr), printable(lease->client_hostname));
+		   piaddr(lease->ip_addr), printable(LEASE_COLD_RO(lease)->client_hostname));
 
-        if (lease->client_hostname) {
-                dfree (lease->client_hostname, MDL);
-                lease->client_hostname = (char *)0;
-        }
+        if (LEASE_COLD_RO(lease)->client_hostname)
+                intern_string_release(&LEASE_COLD(lease)->client_hostname, MDL);
 }
@@ -118,6 +118,7 @@ isc_result_t enter_class
 		for (c = collections->classes; c->nic; c = c->nic);
 		class_reference(&c->nic, cd, MDL);
 	}
+	class_match_invalidate();
 
 	if (dynamicp && commit) 
 	{
@@ -836,6 +837,29 @@ int find_hosts_by_uid
 	return host_hash_lookup(hp, host_uid_hash, data, len, file, line);
 }
 
+/* If option is a relay agent identifier that packet_index_relay_ids()
+   indexes on packet, return the code to ask packet_relay_id() for. */
+static unsigned
+host_id_relay_code(struct option *option, struct packet *packet)
+{
+	if (option->universe == &agent_universe &&
+	    packet->dhcpv6_msg_type == 0) {
+		if (option->code == RAI_CIRCUIT_ID ||
+		    option->code == RAI_REMOTE_ID)
+			return option->code;
+	}
+#if defined(DHCPv6)
+	if (option->universe == &dhcpv6_universe &&
+	    packet->dhcpv6_msg_type == DHCPV6_RELAY_FORW) {
+		if (option->code == D6O_INTERFACE_ID)
+			return RAI_CIRCUIT_ID;
+		if (option->code == D6O_REMOTE_ID)
+			return RAI_REMOTE_ID;
+	}
+#endif
+	return 0;
+}
+
 /*********************************************************************
 Func Name :   find_hosts_by_options
 Date Created: 2018/06/02
@@ -865,6 +889,7 @@ int find_hosts_by_option
 	int found;
 	struct packet *relay_packet;
 	struct option_state *relay_state;
+	unsigned relay_code;
 
 #if defined(LDAP_CONFIGURATION)
 	if ((found = find_client_in_ldap (hp, packet, opt_state, file, line)))
@@ -897,6 +922,18 @@ int find_hosts_by_option
 			relay_state = relay_packet->options;
 		}
 
+		/* Relay agent identifiers are indexed on the packet. */
+		if (relay_state == relay_packet->options &&
+		    (relay_code = host_id_relay_code(p->option,
+						     relay_packet)) != 0 &&
+		    packet_relay_id(relay_packet, relay_code, &data)) {
+			if (host_hash_lookup(hp, p->values_hash,
+					     data.data, data.len,
+					     file, line))
+				return 1;
+			continue;
+		}
+
 		oc = lookup_option(p->option->universe, relay_state, p->option->code);
 		if (oc != NULL) 
 		{
@@ -1117,8 +1154,8 @@ void new_address_range
 #if defined (COMPACT_LEASES)
 	s = (num_addrs + 1) * sizeof (struct lease);
 	/* Check unsigned overflow in new_leases().
-	   With 304 byte lease structure (x64_86), this happens at
-	   range 10.0.0.0 10.215.148.52; */
+	   With 184 byte lease structure (x64_86), this happens at
+	   range 10.0.0.0 11.100.44.132; */
 	/* unsigned */
 	if (((s % sizeof(struct lease)) != 0) ||
 	    ((s / sizeof(struct lease)) != (num_addrs + 1))) 
@@ -1248,6 +1285,59 @@ int find_subnet
 	return 0;
 }
 
+/* Find the shared network a relay's link address is on.  Relayed
+   traffic comes from a handful of relays, so rather than searching the
+   subnets for every packet, the answers (including "none") are kept in
+   a small direct-mapped cache.  Entries are stale once a subnet or
+   shared network has been entered since they were made; other
+   configuration changes (groups, classes, hosts) do not move a subnet,
+   so they leave the cache alone. */
+
+struct link_network {
+	struct iaddr addr;
+	struct shared_network *share;
+	unsigned generation;
+	int valid;
+};
+
+static struct link_network link_networks [LINK_NETWORK_CACHE_SIZE];
+static unsigned link_network_generation;
+
+int find_link_network (struct shared_network **share, struct iaddr addr,
+		       const char *file, int line)
+{
+	struct link_network *ln;
+	struct subnet *subnet = (struct subnet *)0;
+	u_int32_t hash = 2166136261U;
+	unsigned i;
+
+	for (i = 0; i < addr.len; i++)
+		hash = (hash ^ addr.iabuf [i]) * 16777619U;
+	ln = &link_networks [hash % LINK_NETWORK_CACHE_SIZE];
+
+	if (!ln -> valid || ln -> generation != link_network_generation ||
+	    !addr_eq (ln -> addr, addr)) {
+		if (ln -> share)
+			shared_network_dereference (&ln -> share, MDL);
+		if (find_subnet (&subnet, addr, MDL)) {
+			shared_network_reference (&ln -> share,
+						  subnet -> shared_network,
+						  MDL);
+			subnet_dereference (&subnet, MDL);
+		}
+		ln -> addr = addr;
+		ln -> generation = link_network_generation;
+		ln -> valid = 1;
+	}
+
+	if (!ln -> share)
+		return 0;
+	if (shared_network_reference (share, ln -> share,
+				      file, line) != ISC_R_SUCCESS)
+		return 0;
+	return 1;
+}
+
 /*********************************************************************
 Func Name :   find_sunbet
 Date Created: 2018/06/02
@@ -1360,6 +1450,9 @@ void enter_subnet
 	struct subnet *next = (struct subnet *)0;
 	struct subnet *prev = (struct subnet *)0;
 
+	/* Cached link networks may now be in this subnet. */
+	link_network_generation++;
+
 	/* Check for duplicates... */
 	if (subnets)
 	{
@@ -1429,6 +1522,8 @@ void enter_shared_network
 	struct shared_network * share
 )
 {
+	link_network_generation++;
+
 	if (shared_networks) 
 	{
 		shared_network_reference(&share->next, shared_networks, MDL);
@@ -1589,6 +1684,8 @@ int supersede_lease
 )
 {
 	LEASE_STRUCT_PTR lq;
+	const struct lease_cold *from;
+	struct lease_cold *to;
 	struct timeval tv;
 #if defined (FAILOVER_PROTOCOL)
 	int do_pool_check = 0;
@@ -1655,12 +1752,12 @@ int supersede_lease
 		hw_hash_delete(comp);
 
 	/* If the lease has been billed to a class, remove the billing. */
-	if (comp->billing_class != lease->billing_class) 
+	if (LEASE_COLD_RO(comp)->billing_class != LEASE_COLD_RO(lease)->billing_class) 
 	{
-		if (comp->billing_class)
+		if (LEASE_COLD_RO(comp)->billing_class)
 			unbill_class(comp);
-		if (lease->billing_class)
-			bill_class(comp, lease->billing_class);
+		if (LEASE_COLD_RO(lease)->billing_class)
+			bill_class(comp, LEASE_COLD_RO(lease)->billing_class);
 	}
 
 	/* Copy the data files, but not the linkages. */
@@ -1697,78 +1794,79 @@ int supersede_lease
 		comp->uid_len = comp->uid_max = 0;
 	}
 
-	/* host */
-	if (comp->host)
-	{
-		host_dereference(&comp->host, MDL);
-	}
-	host_reference(&comp->host, lease->host, MDL);
-
 	/* Ӳַ */
 	comp->hardware_addr = lease->hardware_addr;
 
-	/* scope */
-	if (comp->scope)
-	{
-		binding_scope_dereference(&comp->scope, MDL);
-	}
-	
-	if (lease->scope) 
-	{
-		binding_scope_reference(&comp->scope, lease->scope, MDL);
-		binding_scope_dereference(&lease->scope, MDL);
-	}
+	/* The remaining fields live in the cold parts.  A lease that
+	   never had any of them set has no cold part, so only give comp
+	   one if there is something to copy or to clear. */
+	from = LEASE_COLD_RO(lease);
+	to = (lease->cold || comp->cold) ? LEASE_COLD(comp) : NULL;
 
-	/* agent_options */
-	if (comp->agent_options)
-	{
-		option_chain_head_dereference(&comp->agent_options, MDL);
-	}
-	
-	if (lease->agent_options) 
+	if (to) 
 	{
-		/* Only retain the agent options if the lease is still
-		   affirmatively associated with a client. */
-		/* agentϢleaseclientʱ */
-		if (lease->next_binding_state == FTS_ACTIVE ||
-		    lease->next_binding_state == FTS_EXPIRED)
+		/* host */
+		if (to->host)
+			host_dereference(&to->host, MDL);
+		host_reference(&to->host, from->host, MDL);
+
+		/* scope */
+		if (to->scope)
+			binding_scope_dereference(&to->scope, MDL);
+		if (from->scope) 
 		{
-			option_chain_head_reference(&comp->agent_options,
-						     lease->agent_options, MDL);
+			binding_scope_reference(&to->scope, from->scope, MDL);
+			binding_scope_dereference(&lease->cold->scope, MDL);
 		}
-		option_chain_head_dereference(&lease->agent_options, MDL);
-	}
 
-	/*  */
-	if (comp->client_hostname)
-	{
-		dfree(comp->client_hostname, MDL);
-	}
-	
-	comp->client_hostname = lease->client_hostname;
-	lease->client_hostname = (char *)0;
+		/* agent_options */
+		if (to->agent_options)
+			option_chain_head_dereference(&to->agent_options, MDL);
+		if (from->agent_options) 
+		{
+			/* Only retain the agent options if the lease is still
+			   affirmatively associated with a client. */
+			/* agentϢleaseclientʱ */
+			if (lease->next_binding_state == FTS_ACTIVE ||
+			    lease->next_binding_state == FTS_EXPIRED)
+			{
+				option_chain_head_reference(&to->agent_options,
+							    from->agent_options,
+							    MDL);
+			}
+			option_chain_head_dereference(&lease->cold->agent_options,
+						      MDL);
+		}
 
-	/* on_starµ3ֶ */
-	if (lease->on_star.on_expiry) 
-	{
-		if (comp->on_star.on_expiry)
-			executable_statement_dereference(&comp->on_star.on_expiry, MDL);
-		executable_statement_reference(&comp->on_star.on_expiry,
-						lease->on_star.on_expiry, MDL);
-	}
-	if (lease->on_star.on_commit) 
-	{
-		if (comp->on_star.on_commit)
-			executable_statement_dereference(&comp->on_star.on_commit, MDL);
-		executable_statement_reference (&comp->on_star.on_commit,
-						lease->on_star.on_commit, MDL);
-	}
-	if (lease->on_star.on_release) 
-	{
-		if (comp->on_star.on_release)
-			executable_statement_dereference(&comp->on_star.on_release, MDL);
-		executable_statement_reference (&comp->on_star.on_release,
-						lease->on_star.on_release,MDL);
+		/*  */
+		if (to->client_hostname)
+			intern_string_release(&to->client_hostname, MDL);
+		to->client_hostname = from->client_hostname;
+		if (lease->cold)
+			lease->cold->client_hostname = (char *)0;
+
+		/* on_starµ3ֶ */
+		if (from->on_star.on_expiry) 
+		{
+			if (to->on_star.on_expiry)
+				executable_statement_dereference(&to->on_star.on_expiry, MDL);
+			executable_statement_reference(&to->on_star.on_expiry,
+						       from->on_star.on_expiry, MDL);
+		}
+		if (from->on_star.on_commit) 
+		{
+			if (to->on_star.on_commit)
+				executable_statement_dereference(&to->on_star.on_commit, MDL);
+			executable_statement_reference(&to->on_star.on_commit,
+						       from->on_star.on_commit, MDL);
+		}
+		if (from->on_star.on_release) 
+		{
+			if (to->on_star.on_release)
+				executable_statement_dereference(&to->on_star.on_release, MDL);
+			executable_statement_reference(&to->on_star.on_release,
+						       from->on_star.on_release, MDL);
+		}
 	}
 
 	/* Record the lease in the uid hash if necessary. */
@@ -1784,24 +1882,30 @@ int supersede_lease
 	}
 
 	/* ֶ */
-	comp->cltt = lease->cltt;
 #if defined (FAILOVER_PROTOCOL)
-	comp->tstp  = lease->tstp;
 	comp->tsfp  = lease->tsfp;
-	comp->atsfp = lease->atsfp;
 #endif /* FAILOVER_PROTOCOL */
 	comp->ends = lease->ends;
 	comp->next_binding_state = lease->next_binding_state;
 
-	/*
-	 * If we have a control block pointer copy it in.
-	 * We don't zero out an older ponter as it is still
-	 * in use.  We shouldn't need to overwrite an
-	 * old pointer with a new one as the old transaction
-	 * should have been cancelled before getting here.
-	 */
-	if (lease->ddns_cb != NULL)
-		comp->ddns_cb = lease->ddns_cb;
+	if (to) 
+	{
+		to->cltt = from->cltt;
+#if defined (FAILOVER_PROTOCOL)
+		to->tstp  = from->tstp;
+		to->atsfp = from->atsfp;
+#endif /* FAILOVER_PROTOCOL */
+
+		/*
+		 * If we have a control block pointer copy it in.
+		 * We don't zero out an older ponter as it is still
+		 * in use.  We shouldn't need to overwrite an
+		 * old pointer with a new one as the old transaction
+		 * should have been cancelled before getting here.
+		 */
+		if (from->ddns_cb != NULL)
+			to->ddns_cb = from->ddns_cb;
+	}
 
       just_move_it:
 #if defined (FAILOVER_PROTOCOL)
@@ -1810,8 +1914,8 @@ int supersede_lease
 	 * propagation whether supersede_lease was given a copy lease
 	 * structure or not (often from the pool_timer()).
 	 */
-	if (propogate)
-		comp->atsfp = 0;
+	if (propogate && comp->cold)
+		comp->cold->atsfp = 0;
 #endif /* FAILOVER_PROTOCOL */
 
 	if (!comp->pool) 
@@ -2021,41 +2125,40 @@ void make_binding_state_transition
 #if defined (NSUPDATE)
 		(void)ddns_removals(lease, NULL, NULL, ISC_TRUE);
 #endif
-		if (lease->on_star.on_expiry) 
+		if (LEASE_COLD_RO(lease)->on_star.on_expiry) 
 		{
 			execute_statements(NULL, NULL, lease,
 					   NULL, NULL, NULL,
-					   &lease->scope,
-					   lease->on_star.on_expiry,
+					   &LEASE_COLD(lease)->scope,
+					   LEASE_COLD_RO(lease)->on_star.on_expiry,
 					   NULL);
-			if (lease->on_star.on_expiry)
+			if (LEASE_COLD_RO(lease)->on_star.on_expiry)
 			{
-				executable_statement_dereference(&lease->on_star.on_expiry, MDL);
+				executable_statement_dereference(&LEASE_COLD(lease)->on_star.on_expiry, MDL);
 			}
 		}
 		
 		/* No sense releasing a lease after it's expired. */
-		if (lease->on_star.on_release)
+		if (LEASE_COLD_RO(lease)->on_star.on_release)
 		{
-			executable_statement_dereference(&lease->on_star.on_release, MDL);
+			executable_statement_dereference(&LEASE_COLD(lease)->on_star.on_release, MDL);
 		}
 		/* Get rid of client-specific bindings that are only
 		   correct when the lease is active. */
-		if (lease->billing_class)
+		if (LEASE_COLD_RO(lease)->billing_class)
 			unbill_class(lease);
-		if (lease->agent_options)
-			option_chain_head_dereference (&lease -> agent_options,
+		if (LEASE_COLD_RO(lease)->agent_options)
+			option_chain_head_dereference (&LEASE_COLD(lease)->agent_options,
 						       MDL);
-		if (lease->client_hostname) 
+		if (LEASE_COLD_RO(lease)->client_hostname) 
 		{
-			dfree(lease->client_hostname, MDL);
-			lease->client_hostname = (char *)0;
+			intern_string_release(&LEASE_COLD(lease)->client_hostname, MDL);
 		}
-		if (lease->host)
-			host_dereference(&lease->host, MDL);
+		if (LEASE_COLD_RO(lease)->host)
+			host_dereference(&LEASE_COLD(lease)->host, MDL);
 
 		/* Send the expiry time to the peer. */
-		lease->tstp = lease->ends;
+		LEASE_COLD(lease)->tstp = lease->ends;
 	}
 
 	/* If the lease was active and is now released, do the release event. */
@@ -2089,37 +2192,36 @@ void make_binding_state_transition
 		 */
 		(void)ddns_removals(lease, NULL, NULL, ISC_TRUE);
 #endif
-		if (lease->on_star.on_release) 
+		if (LEASE_COLD_RO(lease)->on_star.on_release) 
 		{
 			execute_statements(NULL, NULL, lease,
 					   NULL, NULL, NULL,
-					   &lease->scope,
-					   lease->on_star.on_release,
+					   &LEASE_COLD(lease)->scope,
+					   LEASE_COLD_RO(lease)->on_star.on_release,
 					   NULL);
-			executable_statement_dereference(&lease->on_star.on_release, MDL);
+			executable_statement_dereference(&LEASE_COLD(lease)->on_star.on_release, MDL);
 		}
 		
 		/* A released lease can't expire. */
-		if (lease->on_star.on_expiry)
-			executable_statement_dereference(&lease->on_star.on_expiry, MDL);
+		if (LEASE_COLD_RO(lease)->on_star.on_expiry)
+			executable_statement_dereference(&LEASE_COLD(lease)->on_star.on_expiry, MDL);
 
 		/* Get rid of client-specific bindings that are only
 		   correct when the lease is active. */
-		if (lease->billing_class)
+		if (LEASE_COLD_RO(lease)->billing_class)
 			unbill_class(lease);
-		if (lease->agent_options)
-			option_chain_head_dereference(&lease->agent_options,
+		if (LEASE_COLD_RO(lease)->agent_options)
+			option_chain_head_dereference(&LEASE_COLD(lease)->agent_options,
 						       MDL);
-		if (lease->client_hostname) {
-			dfree(lease->client_hostname, MDL);
-			lease->client_hostname = (char *)0;
+		if (LEASE_COLD_RO(lease)->client_hostname) {
+			intern_string_release(&LEASE_COLD(lease)->client_hostname, MDL);
 		}
-		if (lease->host)
-			host_dereference(&lease->host, MDL);
+		if (LEASE_COLD_RO(lease)->host)
+			host_dereference(&LEASE_COLD(lease)->host, MDL);
 
 		/* Send the release time (should be == cur_time) to the
 		   peer. */
-		lease->tstp = lease->ends;
+		LEASE_COLD(lease)->tstp = lease->ends;
 	}
 
 #if defined (DEBUG_LEASE_STATE_TRANSITIONS)
@@ -2229,65 +2331,59 @@ int lease_copy
 		memcpy(lt->uid, lease->uid, lease->uid_max);
 	}
 
-	/* hostname */
-	if (lease->client_hostname) 
-	{
-		lt->client_hostname =
-			dmalloc(strlen(lease->client_hostname) + 1, MDL);
-		if (!lt->client_hostname) 
-		{
-			lease_dereference(&lt, MDL);
-			return 0;
-		}
-		strcpy(lt->client_hostname, lease->client_hostname);
-	}
-
-	/* scopeagent_options */
-	if (lease->scope)
-		binding_scope_reference(&lt->scope, lease->scope, MDL);
-	if (lease->agent_options)
-		option_chain_head_reference(&lt->agent_options,
-					     lease->agent_options, MDL);
-
 	/* ָ */
-	host_reference(&lt->host, lease->host, file, line);
 	subnet_reference(&lt->subnet, lease->subnet, file, line);
 	pool_reference(&lt->pool, lease->pool, file, line);
-	class_reference(&lt->billing_class, lease->billing_class, file, line);
 	lt->hardware_addr = lease->hardware_addr;
 
-	/* on_starµ3ֶ */
-	if (lease->on_star.on_expiry)
-	{
-		executable_statement_reference(&lt->on_star.on_expiry,
-						lease->on_star.on_expiry,
-						file, line);
-	}
-	
-	if (lease->on_star.on_commit)
-	{
-		executable_statement_reference(&lt->on_star.on_commit,
-						lease->on_star.on_commit,
-						file, line);
-	}
-	
-	if (lease->on_star.on_release)
-	{
-		executable_statement_reference(&lt->on_star.on_release,
-						lease->on_star.on_release,
-						file, line);
-	}
-
 	/* ֶθֵ */
 	lt->flags 		  		 = lease->flags;
-	lt->tstp  		 		 = lease->tstp;
 	lt->tsfp  		 		 = lease->tsfp;
-	lt->atsfp 		 		 = lease->atsfp;
-	lt->cltt  		 		 = lease->cltt;
 	lt->binding_state 	   	 = lease->binding_state;
 	lt->next_binding_state 	 = lease->next_binding_state;
 	lt->rewind_binding_state = lease->rewind_binding_state;
 
+	/* Only give the copy a cold part if the original has one. */
+	if (lease->cold) 
+	{
+		const struct lease_cold *from = lease->cold;
+		struct lease_cold *to = LEASE_COLD(lt);
+
+		/* hostname */
+		if (from->client_hostname)
+			to->client_hostname =
+				intern_string_reference(from->client_hostname);
+
+		/* scopeagent_options */
+		if (from->scope)
+			binding_scope_reference(&to->scope, from->scope, MDL);
+		if (from->agent_options)
+			option_chain_head_reference(&to->agent_options,
+						    from->agent_options, MDL);
+
+		host_reference(&to->host, from->host, file, line);
+		class_reference(&to->billing_class, from->billing_class,
+				file, line);
+
+		/* on_starµ3ֶ */
+		if (from->on_star.on_expiry)
+			executable_statement_reference(&to->on_star.on_expiry,
+						       from->on_star.on_expiry,
+						       file, line);
+		if (from->on_star.on_commit)
+			executable_statement_reference(&to->on_star.on_commit,
+						       from->on_star.on_commit,
+						       file, line);
+		if (from->on_star.on_release)
+			executable_statement_reference(&to->on_star.on_release,
+						       from->on_star.on_release,
+						       file, line);
+
+		to->tstp  = from->tstp;
+		to->atsfp = from->atsfp;
+		to->cltt  = from->cltt;
+	}
+
 	/* ltҽӵlpͷltʱṹ */
 	status = lease_reference(lp, lt, file, line);
 	lease_dereference(&lt, MDL);
@@ -2317,22 +2413,22 @@ void release_lease
 #if defined (NSUPDATE)
 	(void) ddns_removals(lease, NULL, NULL, ISC_FALSE);
 #endif
-	if (lease->on_star.on_release) 
+	if (LEASE_COLD_RO(lease)->on_star.on_release) 
 	{
 		execute_statements(NULL, packet, lease,
 				    NULL, packet->options,
-				    NULL, &lease->scope,
-				    lease->on_star.on_release, NULL);
-		if (lease->on_star.on_release)
+				    NULL, &LEASE_COLD(lease)->scope,
+				    LEASE_COLD_RO(lease)->on_star.on_release, NULL);
+		if (LEASE_COLD_RO(lease)->on_star.on_release)
 			executable_statement_dereference
-				(&lease->on_star.on_release, MDL);
+				(&LEASE_COLD(lease)->on_star.on_release, MDL);
 	}
 
 	/* We do either the on_release or the on_expiry events, but
 	   not both (it's possible that they could be the same,
 	   in any case). */
-	if (lease->on_star.on_expiry)
-		executable_statement_dereference(&lease->on_star.on_expiry, MDL);
+	if (LEASE_COLD_RO(lease)->on_star.on_expiry)
+		executable_statement_dereference(&LEASE_COLD(lease)->on_star.on_expiry, MDL);
 
 	if (lease->binding_state != FTS_FREE &&
 	    lease->binding_state != FTS_BACKUP &&
@@ -2340,12 +2436,12 @@ void release_lease
 	    lease->binding_state != FTS_EXPIRED &&
 	    lease->binding_state != FTS_RESET) 
 	{
-		if (lease->on_star.on_commit)
-			executable_statement_dereference(&lease->on_star.on_commit, MDL);
+		if (LEASE_COLD_RO(lease)->on_star.on_commit)
+			executable_statement_dereference(&LEASE_COLD(lease)->on_star.on_commit, MDL);
 
 		/* Blow away any bindings. */
-		if (lease->scope)
-			binding_scope_dereference(&lease->scope, MDL);
+		if (LEASE_COLD_RO(lease)->scope)
+			binding_scope_dereference(&LEASE_COLD(lease)->scope, MDL);
 
 		/* Set sort times to the present. */
 		lease->ends = cur_time;
@@ -2353,7 +2449,7 @@ void release_lease
 		 * protocol messages before this.  So it is best to set
 		 * tstp now anyway.
 		 */
-		lease->tstp = cur_time;
+		LEASE_COLD(lease)->tstp = cur_time;
 #if defined (FAILOVER_PROTOCOL)
 		if (lease -> pool && lease -> pool -> failover_peer) {
 			dhcp_failover_state_t *peer = NULL;
@@ -2410,9 +2506,9 @@ void abandon_lease
 	}
 
 	/* ͷscope */
-	if (lt->scope) 
+	if (LEASE_COLD_RO(lt)->scope) 
 	{
-		binding_scope_dereference(&lt->scope, MDL);
+		binding_scope_dereference(&LEASE_COLD(lt)->scope, MDL);
 	}
 
 	/* Calculate the abandone expiry time.  If it wraps,
@@ -2783,7 +2879,7 @@ static isc_boolean_t client_lease_preferred
 		/* ǹ״̬ͷ״̬cltt */
 		if ((lease->binding_state == FTS_EXPIRED ||
 		     lease->binding_state == FTS_RELEASED) &&
-		    lease->cltt >= cand->cltt)
+		    LEASE_COLD_RO(lease)->cltt >= LEASE_COLD_RO(cand)->cltt)
 			return ISC_TRUE;
 	} 
 	else if (cand->binding_state != FTS_ABANDONED) 
@@ -2794,13 +2890,13 @@ static isc_boolean_t client_lease_preferred
 			return ISC_TRUE;
 
 		if (lease->binding_state != FTS_ABANDONED &&
-		    lease->cltt >= cand->cltt)
+		    LEASE_COLD_RO(lease)->cltt >= LEASE_COLD_RO(cand)->cltt)
 			return ISC_TRUE;
 	} 
 	else /* (cand->binding_state == FTS_ABANDONED) */ 
 	{
 		if (lease->binding_state != FTS_ABANDONED ||
-		    lease->cltt >= cand->cltt)
+		    LEASE_COLD_RO(lease)->cltt >= LEASE_COLD_RO(cand)->cltt)
 			return ISC_TRUE;
 	}
 
@@ -3701,11 +3797,11 @@ isc_result_t lease_instantiate
 	}
 
 	/* If the lease has a billing class, set up the billing. */
-	if (lease->billing_class) 
+	if (LEASE_COLD_RO(lease)->billing_class) 
 	{
 		class = (struct class *)0;
-		class_reference(&class, lease->billing_class, MDL);
-		class_dereference(&lease->billing_class, MDL);
+		class_reference(&class, LEASE_COLD_RO(lease)->billing_class, MDL);
+		class_dereference(&LEASE_COLD(lease)->billing_class, MDL);
 		/* If the lease is available for allocation, the billing
 		   is invalid, so we don't keep it. */
 		if (lease->binding_state == FTS_ACTIVE ||
@@ -3823,7 +3919,7 @@ void expire_all_pools()
 						}
 					}
 #if defined (FAILOVER_PROTOCOL)
-					if (p->failover_peer && l->tstp > l->atsfp && !(l->flags & ON_UPDATE_QUEUE)) 
+					if (p->failover_peer && LEASE_COLD_RO(l)->tstp > LEASE_COLD_RO(l)->atsfp && !(l->flags & ON_UPDATE_QUEUE)) 
 					{
 						l->desired_binding_state = l->binding_state;
 						dhcp_failover_queue_update (l, 1);
@@ -3984,6 +4080,7 @@ void free_everything(void)
 
 	omapi_object_dereference((omapi_object_t **)&dhcp_control_object, MDL);
 
+	class_match_invalidate();
 	/* ȫclass */
 	for (lp = collections; lp; lp = lp->next) 
 	{
@@ -4054,6 +4151,14 @@ void free_everything(void)
 	    interface_dereference(&interfaces, MDL);
 	}
 
+	/* The link network cache holds shared networks too. */
+	for (i = 0; i < LINK_NETWORK_CACHE_SIZE; i++) {
+		if (link_networks[i].share)
+			shared_network_dereference(&link_networks[i].share,
+						   MDL);
+		link_networks[i].valid = 0;
+	}
+
 	/* Subnets are complicated because of the extra links. */
 	if (subnets) 
 	{
@@ -4157,12 +4262,13 @@ void free_everything(void)
 							    /* remove the current lease from the queue */
 							    LEASE_REMOVEP(lptr[i], lc);
 
-							    if (lc->billing_class)
-							       class_dereference(&lc->billing_class,
+							    if (LEASE_COLD_RO(lc)->billing_class)
+							       class_dereference(&LEASE_COLD(lc)->billing_class,
 										  MDL);
-							    if (lc->state)
-								free_lease_state(lc->state, MDL);
-							    lc->state = (struct lease_state *)0;
+							    if (LEASE_COLD_RO(lc)->state) {
+								free_lease_state(LEASE_COLD(lc)->state, MDL);
+								LEASE_COLD(lc)->state = (struct lease_state *)0;
+							    }
 							    if (lc->n_hw)
 									lease_dereference(&lc->n_hw, MDL);
 							    if (lc->n_uid)
@@ -4239,6 +4345,7 @@ void free_everything(void)
 	relinquish_free_binding_values();
 	relinquish_free_option_caches();
 	relinquish_free_packets();
+	relinquish_packet_arena();
 #if defined(COMPACT_LEASES)
 	relinquish_lease_hunks();
 #endif
@@ -431,6 +431,167 @@ ia_dereference(struct ia_xx **ia, const char *file, int line) {
 	return ISC_R_SUCCESS;
 }
 
+/*
+ * Index of active IAs by client DUID.
+ *
+ * The ia_na_active, ia_ta_active and ia_pd_active hashes are keyed by
+ * IAID and DUID together, so finding every binding a client has would
+ * otherwise mean walking all three.  Every IA in one of those hashes
+ * is also chained here, in a table keyed by the DUID alone which
+ * doubles in size as it fills.  IAs must be put into and taken out of
+ * the active hashes with ia_active_add() and ia_active_delete() to
+ * keep the index in step.
+ */
+#define IA_DUID_INDEX_MIN	256
+
+static struct ia_xx **ia_duid_index;
+static unsigned ia_duid_index_size;
+static unsigned ia_duid_index_count;
+
+static unsigned
+ia_duid_hash(const unsigned char *duid, unsigned len) {
+	unsigned hash = 2166136261U;
+
+	while (len-- > 0)
+		hash = (hash ^ *duid++) * 16777619U;
+	return hash;
+}
+
+static void
+ia_duid_index_grow(void) {
+	struct ia_xx **table, *ia, *next;
+	unsigned size, i, b;
+
+	size = ia_duid_index_size ? ia_duid_index_size * 2 :
+				    IA_DUID_INDEX_MIN;
+	table = dmalloc(size * sizeof(*table), MDL);
+	if (table == NULL)
+		return;
+
+	for (i = 0; i < ia_duid_index_size; i++) {
+		for (ia = ia_duid_index[i]; ia != NULL; ia = next) {
+			next = ia->duid_next;
+			b = ia_duid_hash(ia->iaid_duid.data + 4,
+					 ia->iaid_duid.len - 4) & (size - 1);
+			ia->duid_next = table[b];
+			table[b] = ia;
+		}
+	}
+	if (ia_duid_index != NULL)
+		dfree(ia_duid_index, MDL);
+	ia_duid_index = table;
+	ia_duid_index_size = size;
+}
+
+static void
+ia_duid_index_add(struct ia_xx *ia) {
+	struct ia_xx *ref;
+	unsigned b;
+
+	if (ia->duid_indexed || (ia->iaid_duid.len < 4))
+		return;
+	if (ia_duid_index_count >= ia_duid_index_size)
+		ia_duid_index_grow();
+	if (ia_duid_index == NULL)
+		return;
+
+	b = ia_duid_hash(ia->iaid_duid.data + 4,
+			 ia->iaid_duid.len - 4) & (ia_duid_index_size - 1);
+	ref = NULL;
+	ia_reference(&ref, ia, MDL);
+	ia->duid_next = ia_duid_index[b];
+	ia_duid_index[b] = ia;
+	ia->duid_indexed = 1;
+	ia_duid_index_count++;
+}
+
+static void
+ia_duid_index_remove(struct ia_xx *ia) {
+	struct ia_xx **iap, *ref;
+	unsigned b;
+
+	if (!ia->duid_indexed)
+		return;
+
+	b = ia_duid_hash(ia->iaid_duid.data + 4,
+			 ia->iaid_duid.len - 4) & (ia_duid_index_size - 1);
+	for (iap = &ia_duid_index[b]; *iap != NULL;
+	     iap = &(*iap)->duid_next) {
+		if (*iap == ia) {
+			*iap = ia->duid_next;
+			break;
+		}
+	}
+	ia->duid_next = NULL;
+	ia->duid_indexed = 0;
+	ia_duid_index_count--;
+	ref = ia;
+	ia_dereference(&ref, MDL);
+}
+
+/*
+ * Add an IA to one of the active IA hashes.
+ */
+void
+ia_active_add(ia_hash_t *table, struct ia_xx *ia,
+	      const char *file, int line) {
+	ia_hash_add(table, (unsigned char *)ia->iaid_duid.data,
+		    ia->iaid_duid.len, ia, file, line);
+	ia_duid_index_add(ia);
+}
+
+/*
+ * Remove the IA with the given IAID and DUID from one of the active
+ * IA hashes.
+ */
+void
+ia_active_delete(ia_hash_t *table, const unsigned char *key, unsigned len,
+		 const char *file, int line) {
+	struct ia_xx *ia;
+
+	ia = NULL;
+	if (ia_hash_lookup(&ia, table, (unsigned char *)key, len, MDL)) {
+		ia_hash_delete(table, (unsigned char *)key, len, file, line);
+		ia_duid_index_remove(ia);
+		ia_dereference(&ia, MDL);
+	}
+}
+
+/*
+ * Call func for each active IA (of any type) belonging to the client
+ * with the given DUID, stopping early if it returns anything but
+ * ISC_R_SUCCESS.  func may take the IA it is given out of the active
+ * hashes, but no other.  Returns the number of IAs func was called for.
+ */
+int
+ia_foreach_by_duid(const unsigned char *duid, unsigned len,
+		   isc_result_t (*func)(struct ia_xx *, void *), void *arg) {
+	struct ia_xx *ia, *next, *ref;
+	unsigned b;
+	int count = 0;
+
+	if (ia_duid_index == NULL)
+		return 0;
+
+	b = ia_duid_hash(duid, len) & (ia_duid_index_size - 1);
+	for (ia = ia_duid_index[b]; ia != NULL; ia = next) {
+		next = ia->duid_next;
+		if ((ia->iaid_duid.len != len + 4) ||
+		    (memcmp(ia->iaid_duid.data + 4, duid, len) != 0))
+			continue;
+
+		ref = NULL;
+		ia_reference(&ref, ia, MDL);
+		count++;
+		if ((*func)(ia, arg) != ISC_R_SUCCESS) {
+			ia_dereference(&ref, MDL);
+			break;
+		}
+		ia_dereference(&ref, MDL);
+	}
+	return count;
+}
+
 
 /*
  * Add an IAADDR/PREFIX entry to an IA structure.
@@ -614,6 +775,471 @@ inactive_changed(void *iasubopt, unsigned int new_heap_index) {
 	((struct iasubopt *)iasubopt)->inactive_index = new_heap_index;
 }
 
+/*
+ * Free space of prefix delegation pools.
+ *
+ * A prefix pool keeps a binary tree of the aligned blocks below its
+ * network, buddy fashion: each node is a block that is either free,
+ * delegated, or split into its two halves.  A block is split when a
+ * longer prefix is taken out of it, and put back together when both
+ * halves are free again.  Each node also has a mask of the depths at
+ * which its part of the tree has a free block, so the best fitting
+ * free block for a prefix length (the smallest free one that is big
+ * enough) is found by walking down from the root rather than by
+ * probing.
+ *
+ * Prefix pools of different lengths declared over the same range share
+ * one tree (see add_ipv6_pool()), so that no prefix is delegated over
+ * another of a different length, and longer prefixes are packed into
+ * blocks that are already split, keeping whole blocks for the shorter
+ * ones.  Only the nodes along split paths exist, so the tree is small
+ * however large the pool.
+ *
+ * A lease file written by an older server, or with pools changed in
+ * between, may hold live prefixes that overlap.  The one loaded second
+ * cannot be taken, so it is kept on the tree's list of overlaps, and
+ * whenever a prefix is given back the overlaps are taken again where
+ * they now fit: space stays delegated while any live prefix covers it.
+ */
+#define PREFIX_TREE_MAX_DEPTH	63
+
+#define PREFIX_BLOCK_FREE	0
+#define PREFIX_BLOCK_USED	1
+#define PREFIX_BLOCK_SPLIT	2
+
+struct prefix_block {
+	struct prefix_block *half[2];	/* when split */
+	isc_uint64_t free_depths;	/* bit n set if there is a free
+					   block n levels below the root
+					   in this part of the tree */
+	int state;
+};
+
+struct prefix_overlap {
+	struct iasubopt *lease;		/* not referenced: it is in the
+					   pool's hash while listed here */
+	int plen;
+};
+
+struct prefix_tree {
+	int refcnt;
+	int bits;			/* of the root block */
+	struct prefix_block root;
+	struct prefix_overlap *overlaps;
+	int num_overlaps;
+	int max_overlaps;
+};
+
+static struct prefix_tree *
+prefix_tree_new(int bits, const char *file, int line) {
+	struct prefix_tree *tree;
+
+	tree = dmalloc(sizeof(*tree), file, line);
+	if (tree != NULL) {
+		tree->refcnt = 1;
+		tree->bits = bits;
+		tree->root.state = PREFIX_BLOCK_FREE;
+		tree->root.free_depths = 1;
+		tree->overlaps = NULL;
+		tree->num_overlaps = 0;
+		tree->max_overlaps = 0;
+	}
+	return tree;
+}
+
+static void
+prefix_block_join(struct prefix_block *block) {
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (block->half[i] != NULL) {
+			prefix_block_join(block->half[i]);
+			dfree(block->half[i], MDL);
+			block->half[i] = NULL;
+		}
+	}
+}
+
+static void
+prefix_tree_dereference(struct prefix_tree **tree,
+			const char *file, int line) {
+	struct prefix_tree *tmp;
+
+	tmp = *tree;
+	*tree = NULL;
+	if (--tmp->refcnt == 0) {
+		prefix_block_join(&tmp->root);
+		if (tmp->overlaps != NULL)
+			dfree(tmp->overlaps, file, line);
+		dfree(tmp, file, line);
+	}
+}
+
+static int
+prefix_bit(const struct in6_addr *addr, int bit) {
+	return (addr->s6_addr[bit / 8] >> (7 - (bit % 8))) & 1;
+}
+
+/*
+ * Bring the nodes on a path from the root back up to date after the
+ * last of them has changed, joining free halves on the way.
+ */
+static void
+prefix_tree_fix(struct prefix_block **path, int depth) {
+	struct prefix_block *block;
+	int d;
+
+	for (d = depth; d >= 0; d--) {
+		block = path[d];
+		switch (block->state) {
+		case PREFIX_BLOCK_FREE:
+			block->free_depths = (isc_uint64_t)1 << d;
+			break;
+		case PREFIX_BLOCK_USED:
+			block->free_depths = 0;
+			break;
+		default:
+			if ((block->half[0]->state == PREFIX_BLOCK_FREE) &&
+			    (block->half[1]->state == PREFIX_BLOCK_FREE)) {
+				prefix_block_join(block);
+				block->state = PREFIX_BLOCK_FREE;
+				block->free_depths = (isc_uint64_t)1 << d;
+			} else {
+				block->free_depths =
+					block->half[0]->free_depths |
+					block->half[1]->free_depths;
+			}
+			break;
+		}
+	}
+}
+
+/*
+ * Mark a prefix as delegated, splitting the free block it is in.
+ * Returns ISC_FALSE if any of it is delegated already.
+ */
+static isc_boolean_t
+prefix_tree_take(struct prefix_tree *tree, const struct in6_addr *pref,
+		 int plen) {
+	struct prefix_block *path[PREFIX_TREE_MAX_DEPTH + 1];
+	struct prefix_block *block;
+	int depth, d, i;
+
+	depth = plen - tree->bits;
+	if ((depth < 0) || (depth > PREFIX_TREE_MAX_DEPTH))
+		return ISC_FALSE;
+
+	block = &tree->root;
+	for (d = 0; d < depth; d++) {
+		path[d] = block;
+		if (block->state == PREFIX_BLOCK_USED)
+			return ISC_FALSE;
+		if (block->state == PREFIX_BLOCK_FREE) {
+			for (i = 0; i < 2; i++) {
+				block->half[i] = dmalloc(sizeof(*block), MDL);
+				if (block->half[i] == NULL) {
+					prefix_block_join(block);
+					return ISC_FALSE;
+				}
+				block->half[i]->state = PREFIX_BLOCK_FREE;
+				block->half[i]->free_depths =
+					(isc_uint64_t)1 << (d + 1);
+			}
+			block->state = PREFIX_BLOCK_SPLIT;
+		}
+		block = block->half[prefix_bit(pref, tree->bits + d)];
+	}
+	path[depth] = block;
+	if (block->state != PREFIX_BLOCK_FREE)
+		return ISC_FALSE;
+
+	block->state = PREFIX_BLOCK_USED;
+	prefix_tree_fix(path, depth);
+	return ISC_TRUE;
+}
+
+/*
+ * Give a delegated prefix back, joining it with its buddies.
+ */
+static void
+prefix_tree_put(struct prefix_tree *tree, const struct in6_addr *pref,
+		int plen) {
+	struct prefix_block *path[PREFIX_TREE_MAX_DEPTH + 1];
+	struct prefix_block *block;
+	int depth, d;
+
+	depth = plen - tree->bits;
+	if ((depth < 0) || (depth > PREFIX_TREE_MAX_DEPTH))
+		return;
+
+	block = &tree->root;
+	for (d = 0; d < depth; d++) {
+		if (block->state != PREFIX_BLOCK_SPLIT)
+			return;
+		path[d] = block;
+		block = block->half[prefix_bit(pref, tree->bits + d)];
+	}
+	path[depth] = block;
+	if (block->state != PREFIX_BLOCK_USED)
+		return;
+
+	block->state = PREFIX_BLOCK_FREE;
+	prefix_tree_fix(path, depth);
+}
+
+/*
+ * Remember a live prefix that overlaps one already taken.
+ */
+static void
+prefix_tree_hold(struct prefix_tree *tree, struct iasubopt *lease,
+		 int plen) {
+	struct prefix_overlap *new;
+	int max;
+
+	if (tree->max_overlaps <= tree->num_overlaps) {
+		max = tree->max_overlaps + 4;
+		new = dmalloc(max * sizeof(*new), MDL);
+		if (new == NULL) {
+			log_error("No memory to keep an overlapping prefix.");
+			return;
+		}
+		if (tree->overlaps != NULL) {
+			memcpy(new, tree->overlaps,
+			       tree->num_overlaps * sizeof(*new));
+			dfree(tree->overlaps, MDL);
+		}
+		tree->overlaps = new;
+		tree->max_overlaps = max;
+	}
+	tree->overlaps[tree->num_overlaps].lease = lease;
+	tree->overlaps[tree->num_overlaps].plen = plen;
+	tree->num_overlaps++;
+}
+
+/*
+ * Forget a prefix if it is on the overlap list, in which case it holds
+ * no block of its own.  Returns ISC_FALSE if it was not listed.
+ */
+static isc_boolean_t
+prefix_tree_unhold(struct prefix_tree *tree, const struct iasubopt *lease) {
+	int i;
+
+	for (i = 0; i < tree->num_overlaps; i++) {
+		if (tree->overlaps[i].lease == lease) {
+			tree->overlaps[i] =
+				tree->overlaps[--tree->num_overlaps];
+			return ISC_TRUE;
+		}
+	}
+	return ISC_FALSE;
+}
+
+/*
+ * After a prefix has been given back, take the overlapping prefixes
+ * that now fit.
+ */
+static void
+prefix_tree_retake(struct prefix_tree *tree) {
+	int i;
+
+	for (i = 0; i < tree->num_overlaps; ) {
+		if (prefix_tree_take(tree, &tree->overlaps[i].lease->addr,
+				     tree->overlaps[i].plen)) {
+			tree->overlaps[i] =
+				tree->overlaps[--tree->num_overlaps];
+		} else {
+			i++;
+		}
+	}
+}
+
+static isc_boolean_t
+prefix_tree_is_free(const struct prefix_tree *tree,
+		    const struct in6_addr *pref, int plen) {
+	const struct prefix_block *block;
+	int depth, d;
+
+	depth = plen - tree->bits;
+	if ((depth < 0) || (depth > PREFIX_TREE_MAX_DEPTH))
+		return ISC_FALSE;
+
+	block = &tree->root;
+	for (d = 0; block->state == PREFIX_BLOCK_SPLIT; d++) {
+		if (d == depth)
+			return ISC_FALSE;
+		block = block->half[prefix_bit(pref, tree->bits + d)];
+	}
+	return (block->state == PREFIX_BLOCK_FREE) ? ISC_TRUE : ISC_FALSE;
+}
+
+/*
+ * Find a prefix of the given length in the smallest free block that can
+ * hold one.  pref comes in as the prefix we would like, and where there
+ * is a choice, the one nearest to it is given back.
+ */
+static isc_boolean_t
+prefix_tree_pick(const struct prefix_tree *tree, struct in6_addr *pref,
+		 int plen) {
+	const struct prefix_block *block;
+	isc_uint64_t fits;
+	int depth, d, side, bit;
+
+	depth = plen - tree->bits;
+	if ((depth < 0) || (depth > PREFIX_TREE_MAX_DEPTH))
+		return ISC_FALSE;
+
+	/* (2 << 63) - 1 is all ones, as it needs to be. */
+	fits = tree->root.free_depths & (((isc_uint64_t)2 << depth) - 1);
+	if (fits == 0)
+		return ISC_FALSE;
+	for (depth = PREFIX_TREE_MAX_DEPTH; (fits >> depth) == 0; depth--)
+		;
+
+	block = &tree->root;
+	for (d = 0; d < depth; d++) {
+		bit = tree->bits + d;
+		side = prefix_bit(pref, bit);
+		if (((block->half[side]->free_depths >> depth) & 1) == 0)
+			side = !side;
+		if (side)
+			pref->s6_addr[bit / 8] |= 0x80 >> (bit % 8);
+		else
+			pref->s6_addr[bit / 8] &= ~(0x80 >> (bit % 8));
+		block = block->half[side];
+	}
+	return ISC_TRUE;
+}
+
+/*
+ * Helper functions for the in-use map of small pools.
+ *
+ * The map has a bit for each address (or prefix) the pool can hand
+ * out, numbered by the bits between pool->bits and pool->units, and the
+ * bit is set while that address is in pool->leases.  Every addition to
+ * and removal from pool->leases goes through pool_hash_add() and
+ * pool_hash_delete() to keep the two in step.
+ */
+static isc_boolean_t
+pool_map_index(const struct ipv6_pool *pool, const struct in6_addr *addr,
+	       isc_uint32_t *index) {
+	isc_uint32_t idx;
+	int i, mask;
+
+	if (pool->in_use_map == NULL)
+		return ISC_FALSE;
+
+	/* Make sure the address is on the pool's network. */
+	for (i = 0; i < pool->bits / 8; i++) {
+		if (addr->s6_addr[i] != pool->start_addr.s6_addr[i])
+			return ISC_FALSE;
+	}
+	if (pool->bits % 8 != 0) {
+		mask = 0xff << (8 - pool->bits % 8);
+		if (((addr->s6_addr[i] ^ pool->start_addr.s6_addr[i]) &
+		     mask) != 0)
+			return ISC_FALSE;
+	}
+
+	idx = 0;
+	for (i = pool->bits; i < pool->units; i++) {
+		idx = (idx << 1) |
+		      ((addr->s6_addr[i / 8] >> (7 - (i % 8))) & 1);
+	}
+	*index = idx;
+	return ISC_TRUE;
+}
+
+static void
+pool_map_address(const struct ipv6_pool *pool, isc_uint32_t index,
+		 struct in6_addr *addr) {
+	int i;
+
+	*addr = pool->start_addr;
+	for (i = 127; i >= pool->units; i--) {
+		addr->s6_addr[i / 8] &= ~(0x80 >> (i % 8));
+	}
+	for (i = pool->units - 1; i >= pool->bits; i--) {
+		if (index & 1)
+			addr->s6_addr[i / 8] |= 0x80 >> (i % 8);
+		else
+			addr->s6_addr[i / 8] &= ~(0x80 >> (i % 8));
+		index >>= 1;
+	}
+}
+
+/*
+ * Find the first clear bit in the map at or after index, wrapping
+ * around at the end.  Returns ISC_FALSE if every bit is set.
+ */
+static isc_boolean_t
+pool_map_next_free(const struct ipv6_pool *pool, isc_uint32_t index,
+		   isc_uint32_t *found) {
+	isc_uint32_t words, w, n, bit;
+	isc_uint64_t free_bits;
+
+	words = (pool->map_size + 63) / 64;
+	w = index / 64;
+	free_bits = ~pool->in_use_map[w] & (~(isc_uint64_t)0 << (index % 64));
+	for (n = 0; n <= words; n++) {
+		if (free_bits != 0) {
+			for (bit = 0; (free_bits & 1) == 0; bit++)
+				free_bits >>= 1;
+			if (w * 64 + bit < pool->map_size) {
+				*found = w * 64 + bit;
+				return ISC_TRUE;
+			}
+		}
+		if (++w == words)
+			w = 0;
+		free_bits = ~pool->in_use_map[w];
+	}
+	return ISC_FALSE;
+}
+
+static void
+pool_hash_add(struct ipv6_pool *pool, struct iasubopt *lease) {
+	char tmp_addr[INET6_ADDRSTRLEN];
+	char tmp_pool[INET6_ADDRSTRLEN];
+	isc_uint32_t index;
+	int plen;
+
+	iasubopt_hash_add(pool->leases, &lease->addr,
+			  sizeof(lease->addr), lease, MDL);
+	if (pool_map_index(pool, &lease->addr, &index))
+		pool->in_use_map[index / 64] |= (isc_uint64_t)1 << (index % 64);
+	if (pool->prefix_tree != NULL) {
+		plen = (lease->plen != 0) ? lease->plen : pool->units;
+		if (!prefix_tree_take(pool->prefix_tree, &lease->addr, plen)) {
+			log_error("Prefix %s/%d overlaps one already "
+				  "delegated from %s/%d, keeping both.",
+				  inet_ntop(AF_INET6, &lease->addr,
+					    tmp_addr, sizeof(tmp_addr)),
+				  plen,
+				  inet_ntop(AF_INET6, &pool->start_addr,
+					    tmp_pool, sizeof(tmp_pool)),
+				  pool->bits);
+			prefix_tree_hold(pool->prefix_tree, lease, plen);
+		}
+	}
+}
+
+static void
+pool_hash_delete(struct ipv6_pool *pool, struct iasubopt *lease) {
+	isc_uint32_t index;
+
+	iasubopt_hash_delete(pool->leases, &lease->addr,
+			     sizeof(lease->addr), MDL);
+	if (pool_map_index(pool, &lease->addr, &index))
+		pool->in_use_map[index / 64] &=
+			~((isc_uint64_t)1 << (index % 64));
+	if ((pool->prefix_tree != NULL) &&
+	    !prefix_tree_unhold(pool->prefix_tree, lease)) {
+		prefix_tree_put(pool->prefix_tree, &lease->addr,
+				(lease->plen != 0) ? lease->plen : pool->units);
+		prefix_tree_retake(pool->prefix_tree);
+	}
+}
+
 /*!
  *
  * \brief Create a new IPv6 lease pool structure
@@ -661,13 +1287,43 @@ ipv6_pool_allocate(struct ipv6_pool **pool, u_int16_t type,
 	tmp->start_addr = *start_addr;
 	tmp->bits = bits;
 	tmp->units = units;
+	if ((units < bits) || (units - bits >= 64))
+		tmp->num_total = ISC_UINT64_MAX;
+	else
+		tmp->num_total = (isc_uint64_t)1 << (units - bits);
+	if (type == D6O_IA_PD) {
+		if ((units >= bits) &&
+		    (units - bits <= PREFIX_TREE_MAX_DEPTH)) {
+			tmp->prefix_tree = prefix_tree_new(bits, file, line);
+			if (tmp->prefix_tree == NULL) {
+				dfree(tmp, file, line);
+				return ISC_R_NOMEMORY;
+			}
+		}
+	} else if ((units >= bits) && (units - bits <= V6_POOL_MAP_BITS)) {
+		tmp->map_size = (isc_uint32_t)1 << (units - bits);
+		tmp->in_use_map = dmalloc(((tmp->map_size + 63) / 64) *
+					  sizeof(isc_uint64_t), file, line);
+		if (tmp->in_use_map == NULL) {
+			dfree(tmp, file, line);
+			return ISC_R_NOMEMORY;
+		}
+	}
 	if (!iasubopt_new_hash(&tmp->leases, DEFAULT_HASH_SIZE, file, line)) {
+		if (tmp->in_use_map != NULL)
+			dfree(tmp->in_use_map, file, line);
+		if (tmp->prefix_tree != NULL)
+			prefix_tree_dereference(&tmp->prefix_tree, file, line);
 		dfree(tmp, file, line);
 		return ISC_R_NOMEMORY;
 	}
 	if (isc_heap_create(dhcp_gbl_ctx.mctx, lease_older, active_changed,
 			    0, &(tmp->active_timeouts)) != ISC_R_SUCCESS) {
 		iasubopt_free_hash_table(&(tmp->leases), file, line);
+		if (tmp->in_use_map != NULL)
+			dfree(tmp->in_use_map, file, line);
+		if (tmp->prefix_tree != NULL)
+			prefix_tree_dereference(&tmp->prefix_tree, file, line);
 		dfree(tmp, file, line);
 		return ISC_R_NOMEMORY;
 	}
@@ -675,6 +1331,10 @@ ipv6_pool_allocate(struct ipv6_pool **pool, u_int16_t type,
 			    0, &(tmp->inactive_timeouts)) != ISC_R_SUCCESS) {
 		isc_heap_destroy(&(tmp->active_timeouts));
 		iasubopt_free_hash_table(&(tmp->leases), file, line);
+		if (tmp->in_use_map != NULL)
+			dfree(tmp->in_use_map, file, line);
+		if (tmp->prefix_tree != NULL)
+			prefix_tree_dereference(&tmp->prefix_tree, file, line);
 		dfree(tmp, file, line);
 		return ISC_R_NOMEMORY;
 	}
@@ -791,6 +1451,10 @@ ipv6_pool_dereference(struct ipv6_pool **pool, const char *file, int line) {
 		tmp->refcnt = 0;
 	}
 	if (tmp->refcnt == 0) {
+		if (tmp->pool6 != NULL) {
+			tmp->pool6->ipv6_pool = NULL;
+			pool6_dereference(&tmp->pool6, file, line);
+		}
 		iasubopt_hash_foreach(tmp->leases, dereference_hash_entry);
 		iasubopt_free_hash_table(&(tmp->leases), file, line);
 		isc_heap_foreach(tmp->active_timeouts, 
@@ -799,6 +1463,10 @@ ipv6_pool_dereference(struct ipv6_pool **pool, const char *file, int line) {
 		isc_heap_foreach(tmp->inactive_timeouts, 
 				 dereference_heap_entry, NULL);
 		isc_heap_destroy(&(tmp->inactive_timeouts));
+		if (tmp->in_use_map != NULL)
+			dfree(tmp->in_use_map, file, line);
+		if (tmp->prefix_tree != NULL)
+			prefix_tree_dereference(&tmp->prefix_tree, file, line);
 		dfree(tmp, file, line);
 	}
 
@@ -1007,6 +1675,55 @@ static struct in6_addr rtany;
 /* Reserved Subnet Anycasts ::fdff:ffff:ffff:ff80-::fdff:ffff:ffff:ffff. */
 static struct in6_addr resany;
 
+/*
+ * Avoid reserved interface IDs. (cf. RFC 5453)
+ */
+static isc_boolean_t
+reserved_iid6(const struct in6_addr *addr) {
+	if (memcmp(&addr->s6_addr[8], &rtany.s6_addr[8], 8) == 0) {
+		return ISC_TRUE;
+	}
+	if ((memcmp(&addr->s6_addr[8], &resany.s6_addr[8], 7) == 0) &&
+	    ((addr->s6_addr[15] & 0x80) == 0x80)) {
+		return ISC_TRUE;
+	}
+	return ISC_FALSE;
+}
+
+/*
+ * Find a free address or prefix in a pool with an in-use map, starting
+ * from the one the hash picked, and put it in addr.  Each candidate is
+ * checked against the lease hash as well, so an address the map has
+ * lost track of is never handed out twice.
+ */
+static isc_boolean_t
+pool_map_pick(struct ipv6_pool *pool, struct in6_addr *addr) {
+	struct iasubopt *test_iasubopt;
+	isc_uint32_t index, tried;
+
+	if (!pool_map_index(pool, addr, &index))
+		return ISC_FALSE;
+
+	for (tried = 0; tried < pool->map_size; tried++) {
+		if (++index == pool->map_size)
+			index = 0;
+		if (!pool_map_next_free(pool, index, &index))
+			return ISC_FALSE;
+		pool_map_address(pool, index, addr);
+
+		if ((pool->pool_type != D6O_IA_PD) && reserved_iid6(addr))
+			continue;
+
+		test_iasubopt = NULL;
+		if (iasubopt_hash_lookup(&test_iasubopt, pool->leases,
+					 addr, sizeof(*addr), MDL) == 0)
+			return ISC_TRUE;
+		pool->in_use_map[index / 64] |= (isc_uint64_t)1 << (index % 64);
+		iasubopt_dereference(&test_iasubopt, MDL);
+	}
+	return ISC_FALSE;
+}
+
 /*
  * Create a lease for the given address and client duid.
  *
@@ -1025,8 +1742,10 @@ static struct in6_addr resany;
  * a free lease. Realistically this will only happen in very full
  * pools.
  *
- * We probably want different algorithms depending on the network size, in
- * the long term.
+ * Pools small enough to have an in-use map don't rehash: if the first
+ * address is taken the map is searched for the next free one, so the
+ * allocation only fails when the pool is really full.  The attempts
+ * count is then 2.
  */
 isc_result_t
 create_lease6(struct ipv6_pool *pool, struct iasubopt **addr, 
@@ -1038,7 +1757,6 @@ create_lease6(struct ipv6_pool *pool, struct iasubopt **addr,
 	struct data_string new_ds;
 	struct iasubopt *iaaddr;
 	isc_result_t result;
-	isc_boolean_t reserved_iid;
 	static isc_boolean_t init_resiid = ISC_FALSE;
 
 	/*
@@ -1091,24 +1809,11 @@ create_lease6(struct ipv6_pool *pool, struct iasubopt **addr,
 			return DHCP_R_INVALIDARG;
 		}
 
-		/*
-		 * Avoid reserved interface IDs. (cf. RFC 5453)
-		 */
-		reserved_iid = ISC_FALSE;
-		if (memcmp(&tmp.s6_addr[8], &rtany.s6_addr[8], 8) == 0) {
-			reserved_iid = ISC_TRUE;
-		}
-		if (!reserved_iid &&
-		    (memcmp(&tmp.s6_addr[8], &resany.s6_addr[8], 7) == 0) &&
-		    ((tmp.s6_addr[15] & 0x80) == 0x80)) {
-			reserved_iid = ISC_TRUE;
-		}
-
 		/*
 		 * If this address is not in use, we're happy with it
 		 */
 		test_iaaddr = NULL;
-		if (!reserved_iid &&
+		if (!reserved_iid6(&tmp) &&
 		    (iasubopt_hash_lookup(&test_iaaddr, pool->leases,
 					  &tmp, sizeof(tmp), MDL) == 0)) {
 			break;
@@ -1116,6 +1821,17 @@ create_lease6(struct ipv6_pool *pool, struct iasubopt **addr,
 		if (test_iaaddr != NULL)
 			iasubopt_dereference(&test_iaaddr, MDL);
 
+		/*
+		 * With a map, look for the next free address instead.
+		 */
+		if (pool->in_use_map != NULL) {
+			++(*attempts);
+			if (pool_map_pick(pool, &tmp))
+				break;
+			data_string_forget(&ds, MDL);
+			return ISC_R_NORESOURCES;
+		}
+
 		/* 
 		 * Otherwise, we create a new input, adding the address
 		 */
@@ -1377,13 +2093,12 @@ cleanup_lease6(ia_hash_t *ia_table,
 			pool->ipv6_pond->num_abandoned--;
 	}
 
-	iasubopt_hash_delete(pool->leases, &test_iasubopt->addr,
-			     sizeof(test_iasubopt->addr), MDL);
+	pool_hash_delete(pool, test_iasubopt);
 	ia_remove_iasubopt(old_ia, test_iasubopt, MDL);
 	if (old_ia->num_iasubopt <= 0) {
-		ia_hash_delete(ia_table,
-			       (unsigned char *)old_ia->iaid_duid.data,
-			       old_ia->iaid_duid.len, MDL);
+		ia_active_delete(ia_table,
+				 (unsigned char *)old_ia->iaid_duid.data,
+				 old_ia->iaid_duid.len, MDL);
 	}
 
 	/*
@@ -1455,8 +2170,7 @@ add_lease6(struct ipv6_pool *pool, struct iasubopt *lease,
 			pool->num_inactive--;
 		}
 
-		iasubopt_hash_delete(pool->leases, &test_iasubopt->addr, 
-				     sizeof(test_iasubopt->addr), MDL);
+		pool_hash_delete(pool, test_iasubopt);
 
 		/*
 		 * We're going to do a bit of evil trickery here.
@@ -1479,8 +2193,7 @@ add_lease6(struct ipv6_pool *pool, struct iasubopt *lease,
 	if ((tmp_iasubopt->state == FTS_ACTIVE) ||
 	    (tmp_iasubopt->state == FTS_ABANDONED)) {
 		tmp_iasubopt->hard_lifetime_end_time = valid_lifetime_end_time;
-		iasubopt_hash_add(pool->leases, &tmp_iasubopt->addr, 
-				  sizeof(tmp_iasubopt->addr), lease, MDL);
+		pool_hash_add(pool, tmp_iasubopt);
 		insert_result = isc_heap_insert(pool->active_timeouts,
 						tmp_iasubopt);
 		if (insert_result == ISC_R_SUCCESS) {
@@ -1503,8 +2216,7 @@ add_lease6(struct ipv6_pool *pool, struct iasubopt *lease,
 			pool->num_inactive++;
 	}
 	if (insert_result != ISC_R_SUCCESS) {
-		iasubopt_hash_delete(pool->leases, &lease->addr, 
-				     sizeof(lease->addr), MDL);
+		pool_hash_delete(pool, lease);
 		iasubopt_dereference(&tmp_iasubopt, MDL);
 		return insert_result;
 	}
@@ -1575,8 +2287,7 @@ move_lease_to_active(struct ipv6_pool *pool, struct iasubopt *lease) {
 
 	insert_result = isc_heap_insert(pool->active_timeouts, lease);
 	if (insert_result == ISC_R_SUCCESS) {
-       		iasubopt_hash_add(pool->leases, &lease->addr, 
-				  sizeof(lease->addr), lease, MDL);
+		pool_hash_add(pool, lease);
 		isc_heap_delete(pool->inactive_timeouts,
 				lease->inactive_index);
 		pool->num_active++;
@@ -1708,8 +2419,7 @@ move_lease_to_inactive(struct ipv6_pool *pool, struct iasubopt *lease,
 			binding_scope_dereference(&lease->scope, MDL);
 		}
 
-		iasubopt_hash_delete(pool->leases, 
-				     &lease->addr, sizeof(lease->addr), MDL);
+		pool_hash_delete(pool, lease);
 		isc_heap_delete(pool->active_timeouts, lease->active_index);
 		lease->state = state;
 		pool->num_active--;
@@ -1885,8 +2595,11 @@ build_prefix6(struct in6_addr *pref,
  * a free prefix. Realistically this will only happen in very full
  * pools.
  *
- * We probably want different algorithms depending on the network size, in
- * the long term.
+ * Pools with a prefix tree (all but the very largest) look there
+ * instead.  The hashed prefix is used if it is free, unless pools of
+ * other prefix lengths share the tree; otherwise the prefix comes from
+ * the best fitting free block, as near the hashed one as that allows,
+ * so at most two attempts are made.
  */
 isc_result_t
 create_prefix6(struct ipv6_pool *pool, struct iasubopt **pref, 
@@ -1922,6 +2635,23 @@ create_prefix6(struct ipv6_pool *pool, struct iasubopt **pref,
 		build_prefix6(&tmp, &pool->start_addr,
 			      pool->bits, pool->units, &ds);
 
+		/*
+		 * With a prefix tree, it knows what is free.
+		 */
+		if (pool->prefix_tree != NULL) {
+			if (pool->prefix_tree->refcnt == 1) {
+				if (prefix_tree_is_free(pool->prefix_tree,
+							&tmp, pool->units))
+					break;
+				++(*attempts);
+			}
+			if (prefix_tree_pick(pool->prefix_tree, &tmp,
+					     pool->units))
+				break;
+			data_string_forget(&ds, MDL);
+			return ISC_R_NORESOURCES;
+		}
+
 		/*
 		 * If this prefix is not in use, we're happy with it
 		 */
@@ -2009,8 +2739,7 @@ mark_lease_unavailable(struct ipv6_pool *pool, const struct in6_addr *addr) {
 	result = iasubopt_allocate(&dummy_iasubopt, MDL);
 	if (result == ISC_R_SUCCESS) {
 		dummy_iasubopt->addr = *addr;
-		iasubopt_hash_add(pool->leases, &dummy_iasubopt->addr,
-				  sizeof(*addr), dummy_iasubopt, MDL);
+		pool_hash_add(pool, dummy_iasubopt);
 	}
 	return result;
 }
@@ -2021,6 +2750,28 @@ mark_lease_unavailable(struct ipv6_pool *pool, const struct in6_addr *addr) {
 isc_result_t
 add_ipv6_pool(struct ipv6_pool *pool) {
 	struct ipv6_pool **new_pools;
+	int i;
+
+	/*
+	 * A prefix pool over the same range as one already added shares
+	 * its tree of free blocks, as long as nothing is in ours yet.
+	 */
+	if ((pool->prefix_tree != NULL) &&
+	    (pool->prefix_tree->root.state == PREFIX_BLOCK_FREE)) {
+		for (i = 0; i < num_pools; i++) {
+			if ((pools[i]->prefix_tree != NULL) &&
+			    (pools[i]->prefix_tree != pool->prefix_tree) &&
+			    (pools[i]->bits == pool->bits) &&
+			    (memcmp(&pools[i]->start_addr, &pool->start_addr,
+				    sizeof(pool->start_addr)) == 0)) {
+				prefix_tree_dereference(&pool->prefix_tree,
+							MDL);
+				pool->prefix_tree = pools[i]->prefix_tree;
+				pool->prefix_tree->refcnt++;
+				break;
+			}
+		}
+	}
 
 	new_pools = dmalloc(sizeof(struct ipv6_pool *) * (num_pools+1), MDL);
 	if (new_pools == NULL) {
@@ -2040,15 +2791,45 @@ add_ipv6_pool(struct ipv6_pool *pool) {
 	return ISC_R_SUCCESS;
 }
 
+/*
+ * Expiry timers.
+ *
+ * Rather than each pool having its own timer, pools with something to
+ * expire or clean up are kept in a heap ordered by when that is due,
+ * and a single timer is set for the first of them.  When it fires,
+ * due pools are worked through V6_EXPIRY_SLICE leases at a time: if
+ * more are due than that (after an outage, say), the timer is set to
+ * go off again straight away, so that packets which arrived in the
+ * meantime are answered before the next slice is done.  The lease file
+ * is committed once per slice rather than once per pool.
+ */
+static isc_heap_t *pool_timeouts;
+static time_t pool_timeouts_armed;
+static isc_boolean_t pool_timeouts_running;
+
+static void pool_timeouts_fire(void *);
+
+static isc_boolean_t
+pool_timeout_earlier(void *a, void *b) {
+	return ((struct ipv6_pool *)a)->next_timeout <
+	       ((struct ipv6_pool *)b)->next_timeout ? ISC_TRUE : ISC_FALSE;
+}
+
 static void
-cleanup_old_expired(struct ipv6_pool *pool) {
+pool_timeout_changed(void *pool, unsigned int new_heap_index) {
+	((struct ipv6_pool *)pool)->timeout_index = new_heap_index;
+}
+
+static int
+cleanup_old_expired(struct ipv6_pool *pool, int limit) {
 	struct iasubopt *tmp;
 	struct ia_xx *ia;
 	struct ia_xx *ia_active;
 	unsigned char *tmpd;
 	time_t timeout;
+	int count = 0;
 	
-	while (pool->num_inactive > 0) {
+	while ((pool->num_inactive > 0) && (count < limit)) {
 		tmp = (struct iasubopt *)
 				isc_heap_element(pool->inactive_timeouts, 1);
 		if (tmp->hard_lifetime_end_time != 0) {
@@ -2063,6 +2844,7 @@ cleanup_old_expired(struct ipv6_pool *pool) {
 
 		isc_heap_delete(pool->inactive_timeouts, tmp->inactive_index);
 		pool->num_inactive--;
+		count++;
 
 		if (tmp->ia != NULL) {
 			/*
@@ -2080,38 +2862,41 @@ cleanup_old_expired(struct ipv6_pool *pool) {
 			    (ia_hash_lookup(&ia_active, ia_na_active, tmpd,
 					    ia->iaid_duid.len, MDL) == 0) &&
 			    (ia_active == ia)) {
-				ia_hash_delete(ia_na_active, tmpd, 
-					       ia->iaid_duid.len, MDL);
+				ia_active_delete(ia_na_active, tmpd,
+						 ia->iaid_duid.len, MDL);
 			}
 			if ((ia->ia_type == D6O_IA_TA) &&
 			    (ia->num_iasubopt <= 0) &&
 			    (ia_hash_lookup(&ia_active, ia_ta_active, tmpd,
 					    ia->iaid_duid.len, MDL) == 0) &&
 			    (ia_active == ia)) {
-				ia_hash_delete(ia_ta_active, tmpd, 
-					       ia->iaid_duid.len, MDL);
+				ia_active_delete(ia_ta_active, tmpd,
+						 ia->iaid_duid.len, MDL);
 			}
 			if ((ia->ia_type == D6O_IA_PD) &&
 			    (ia->num_iasubopt <= 0) &&
 			    (ia_hash_lookup(&ia_active, ia_pd_active, tmpd,
 					    ia->iaid_duid.len, MDL) == 0) &&
 			    (ia_active == ia)) {
-				ia_hash_delete(ia_pd_active, tmpd, 
-					       ia->iaid_duid.len, MDL);
+				ia_active_delete(ia_pd_active, tmpd,
+						 ia->iaid_duid.len, MDL);
 			}
 			ia_dereference(&ia, MDL);
 		}
 		iasubopt_dereference(&tmp, MDL);
 	}
+	return count;
 }
 
-static void
-lease_timeout_support(void *vpool) {
-	struct ipv6_pool *pool;
+/*
+ * Expire up to limit leases in a pool, returning how many were.
+ */
+static int
+lease_timeout_support(struct ipv6_pool *pool, int limit) {
 	struct iasubopt *lease;
+	int count;
 	
-	pool = (struct ipv6_pool *)vpool;
-	for (;;) {
+	for (count = 0; count < limit; count++) {
 		/*
 		 * Get the next lease scheduled to expire.
 		 *
@@ -2136,6 +2921,74 @@ lease_timeout_support(void *vpool) {
 
 		iasubopt_dereference(&lease, MDL);
 	}
+	return count;
+}
+
+/*
+ * Set the expiry timer for the first pool that has work due, or
+ * cancel it if none has.
+ */
+static void
+arm_pool_timeouts(void) {
+	struct ipv6_pool *first;
+	struct timeval tv;
+
+	first = NULL;
+	if (pool_timeouts != NULL)
+		first = (struct ipv6_pool *)isc_heap_element(pool_timeouts, 1);
+
+	if (first == NULL) {
+		if (pool_timeouts_armed != 0) {
+			cancel_timeout(pool_timeouts_fire, NULL);
+			pool_timeouts_armed = 0;
+		}
+		return;
+	}
+
+	tv.tv_sec = first->next_timeout;
+	if (tv.tv_sec < cur_time)
+		tv.tv_sec = cur_time;
+	if (tv.tv_sec == pool_timeouts_armed)
+		return;
+	tv.tv_usec = 0;
+	add_timeout(&tv, pool_timeouts_fire, NULL, 0, 0);
+	pool_timeouts_armed = tv.tv_sec;
+}
+
+/*
+ * The expiry timer: do one slice of the work that is due.
+ */
+static void
+pool_timeouts_fire(void *unused) {
+	struct ipv6_pool *pool;
+	int budget;
+
+	pool_timeouts_armed = 0;
+	pool_timeouts_running = ISC_TRUE;
+
+	budget = V6_EXPIRY_SLICE;
+	while (budget > 0) {
+		pool = (struct ipv6_pool *)isc_heap_element(pool_timeouts, 1);
+		if ((pool == NULL) || (pool->next_timeout > cur_time))
+			break;
+
+		budget -= lease_timeout_support(pool, budget);
+
+		/*
+		 * Do some cleanup of our expired leases.
+		 */
+		budget -= cleanup_old_expired(pool, budget);
+
+		/* Always make progress, even if nothing was actually due. */
+		budget--;
+
+		/*
+		 * Schedule next round of expirations.
+		 */
+		schedule_lease_timeout(pool);
+	}
+
+	pool_timeouts_running = ISC_FALSE;
 
 	/*
 	 * If appropriate commit and rotate the lease file
@@ -2144,27 +2997,21 @@ lease_timeout_support(void *vpool) {
 	 */
 	(void) commit_leases_timed();
 
-	/*
-	 * Do some cleanup of our expired leases.
-	 */
-	cleanup_old_expired(pool);
-
-	/*
-	 * Schedule next round of expirations.
-	 */
-	schedule_lease_timeout(pool);
+	arm_pool_timeouts();
 }
 
 /*
- * For a given pool, add a timer that will remove the next
- * lease to expire.
+ * For a given pool, note when its next lease is due to expire (or its
+ * next expired lease is due to be cleaned up), and make sure the
+ * expiry timer will go off by then.
  */
 void 
 schedule_lease_timeout(struct ipv6_pool *pool) {
 	struct iasubopt *tmp;
 	time_t timeout;
 	time_t next_timeout;
-	struct timeval tv;
+	time_t old_timeout;
+	struct ipv6_pool *ref;
 
 	next_timeout = MAX_TIME;
 
@@ -2190,13 +3037,45 @@ schedule_lease_timeout(struct ipv6_pool *pool) {
 		}
 	}
 
-	if (next_timeout < MAX_TIME) {
-		tv.tv_sec = next_timeout;
-		tv.tv_usec = 0;
-		add_timeout(&tv, lease_timeout_support, pool,
-			    (tvref_t)ipv6_pool_reference, 
-			    (tvunref_t)ipv6_pool_dereference);
+	if (pool_timeouts == NULL) {
+		if (isc_heap_create(dhcp_gbl_ctx.mctx, pool_timeout_earlier,
+				    pool_timeout_changed, 0,
+				    &pool_timeouts) != ISC_R_SUCCESS) {
+			log_fatal("Out of memory for pool timeouts.");
+		}
+	}
+
+	/*
+	 * The heap holds a reference to each pool on it.
+	 */
+	if (pool->timeout_index != 0) {
+		if (next_timeout == MAX_TIME) {
+			isc_heap_delete(pool_timeouts, pool->timeout_index);
+			pool->timeout_index = 0;
+			ref = pool;
+			ipv6_pool_dereference(&ref, MDL);
+		} else {
+			old_timeout = pool->next_timeout;
+			pool->next_timeout = next_timeout;
+			if (next_timeout < old_timeout)
+				isc_heap_increased(pool_timeouts,
+						   pool->timeout_index);
+			else if (next_timeout > old_timeout)
+				isc_heap_decreased(pool_timeouts,
+						   pool->timeout_index);
+		}
+	} else if (next_timeout < MAX_TIME) {
+		pool->next_timeout = next_timeout;
+		if (isc_heap_insert(pool_timeouts, pool) != ISC_R_SUCCESS) {
+			log_error("Unable to schedule lease expiry.");
+			return;
+		}
+		ref = NULL;
+		ipv6_pool_reference(&ref, pool, MDL);
 	}
+
+	if (!pool_timeouts_running)
+		arm_pool_timeouts();
 }
 
 /*
@@ -2211,6 +3090,169 @@ schedule_all_ipv6_lease_timeouts(void) {
 	}
 }
 
+/*
+ * Whether a binding still has to be shortened by the drain of its pool:
+ * anything that has ended, been abandoned, moved on or already runs out
+ * in time since the drain list was taken is left alone.
+ */
+static isc_boolean_t
+ipv6_pool_drain_wanted(const struct ipv6_pool *pool,
+		       const struct iasubopt *lease) {
+	return (((lease->state == FTS_ACTIVE) &&
+		 (lease->ipv6_pool == pool) && (lease->ia != NULL) &&
+		 (lease->hard_lifetime_end_time > pool->drain_end))
+		? ISC_TRUE : ISC_FALSE);
+}
+
+/*
+ * Shorten up to V6_DRAIN_SLICE more of the bindings of a pool that is
+ * being drained, then either come back for the rest once pending
+ * packets have been seen to, or commit the lease file and finish.
+ *
+ * Every binding of an IA from this pool is shortened along with the
+ * first one met, so that the IA is written out once.  The others are
+ * then passed over when their turn comes.
+ */
+static void
+ipv6_pool_drain_slice(void *vpool) {
+	struct ipv6_pool *pool = (struct ipv6_pool *)vpool;
+	struct iasubopt *lease, *tmp;
+	struct ia_xx *ia;
+	struct timeval tv;
+	u_int32_t prefer, valid;
+	int count, i;
+
+	for (count = 0;
+	     (count < V6_DRAIN_SLICE) && (pool->drain_next < pool->drain_count);
+	     count++) {
+		lease = pool->drain_list[pool->drain_next];
+		pool->drain_list[pool->drain_next++] = NULL;
+
+		if (ipv6_pool_drain_wanted(pool, lease)) {
+			ia = lease->ia;
+			for (i = 0; i < ia->num_iasubopt; i++) {
+				tmp = ia->iasubopt[i];
+				if (!ipv6_pool_drain_wanted(pool, tmp))
+					continue;
+				prefer = tmp->prefer;
+				valid = tmp->valid;
+				ipv6_pool_drain_lifetimes(pool, &prefer,
+							  &valid);
+				tmp->prefer = prefer;
+				tmp->valid = valid;
+				tmp->soft_lifetime_end_time = pool->drain_end;
+				renew_lease6(pool, tmp);
+			}
+			write_ia(ia);
+		}
+		iasubopt_dereference(&lease, MDL);
+	}
+
+	if (pool->drain_next < pool->drain_count) {
+		tv.tv_sec = cur_tv.tv_sec;
+		tv.tv_usec = cur_tv.tv_usec;
+		add_timeout(&tv, ipv6_pool_drain_slice, pool,
+			    (tvref_t)ipv6_pool_reference,
+			    (tvunref_t)ipv6_pool_dereference);
+		return;
+	}
+
+	/* One commit covers every binding the drain rewrote. */
+	dfree(pool->drain_list, MDL);
+	pool->drain_list = NULL;
+	pool->drain_count = pool->drain_next = 0;
+	(void) commit_leases();
+	schedule_lease_timeout(pool);
+
+	log_info("Finished draining pool %s/%d",
+		 pin6_addr(&pool->start_addr), pool->bits);
+}
+
+/*
+ * Start retiring a pool: stop handing out anything new from it, cap the
+ * lifetimes of any binding renewed from it, and shorten every binding
+ * it has so that all are gone within valid seconds.  The bindings are
+ * rewritten V6_DRAIN_SLICE at a time from a timer, so that a pool of
+ * any size can be drained without holding up the server.  Abandoned
+ * bindings are left as they are.
+ *
+ * A pool already being drained can only have its drain brought
+ * forward, never put back.  The drain itself is not saved in the lease
+ * file: the shortened bindings are, but after a restart the pool hands
+ * out new ones again until it is drained anew.
+ */
+isc_result_t
+ipv6_pool_drain(struct ipv6_pool *pool, u_int32_t valid) {
+	struct iasubopt *lease;
+	struct timeval tv;
+	isc_uint64_t active;
+	unsigned int i, n;
+
+	if ((pool->drain_end != 0) && (cur_time + valid > pool->drain_end))
+		return DHCP_R_INVALIDARG;
+	if (pool->drain_list != NULL)
+		return ISC_R_INPROGRESS;
+
+	pool->drain_end = cur_time + valid;
+
+	/* Take the list up front: shortening the bindings reorders the
+	 * heap, so it cannot be walked while they are changed. */
+	active = pool->num_active - pool->num_abandoned;
+	n = (active > UINT_MAX / sizeof(lease)) ?
+		UINT_MAX / sizeof(lease) : (unsigned int)active;
+	if (n == 0) {
+		log_info("Draining pool %s/%d: no bindings",
+			 pin6_addr(&pool->start_addr), pool->bits);
+		return ISC_R_SUCCESS;
+	}
+	pool->drain_list = dmalloc(n * sizeof(lease), MDL);
+	if (pool->drain_list == NULL)
+		return ISC_R_NOMEMORY;
+
+	pool->drain_count = 0;
+	pool->drain_next = 0;
+	for (i = 1; pool->drain_count < n; i++) {
+		lease = (struct iasubopt *)
+			isc_heap_element(pool->active_timeouts, i);
+		if (lease == NULL)
+			break;
+		if (lease->state != FTS_ACTIVE)
+			continue;
+		iasubopt_reference(&pool->drain_list[pool->drain_count++],
+				   lease, MDL);
+	}
+
+	log_info("Draining pool %s/%d: %u bindings to end within %u seconds",
+		 pin6_addr(&pool->start_addr), pool->bits, pool->drain_count,
+		 (unsigned)valid);
+
+	tv.tv_sec = cur_tv.tv_sec;
+	tv.tv_usec = cur_tv.tv_usec;
+	add_timeout(&tv, ipv6_pool_drain_slice, pool,
+		    (tvref_t)ipv6_pool_reference,
+		    (tvunref_t)ipv6_pool_dereference);
+	return ISC_R_SUCCESS;
+}
+
+/*
+ * Cap the lifetimes being given out for a binding from a pool that is
+ * being drained, so that a renewal cannot outlast the drain.
+ */
+void
+ipv6_pool_drain_lifetimes(const struct ipv6_pool *pool,
+			  u_int32_t *prefer, u_int32_t *valid) {
+	u_int32_t left;
+
+	if (pool->drain_end == 0)
+		return;
+
+	left = (pool->drain_end > cur_time) ?
+		(u_int32_t)(pool->drain_end - cur_time) : 0;
+	if (*valid > left)
+		*valid = left;
+	*prefer = 0;
+}
+
 /* 
  * Given an address and the length of the network mask, return
  * only the network portion.
@@ -2310,6 +3352,40 @@ find_ipv6_pool(struct ipv6_pool **pool, u_int16_t type,
 	return ISC_R_NOTFOUND;
 }
 
+/*
+ * Find the prefix pool that delegates the given prefix.  Prefix pools
+ * of different lengths may cover the same range, so the length has to
+ * match as well.
+ *
+ * - pool must be a pointer to a (struct ipv6_pool *) pointer previously
+ *   initialized to NULL
+ */
+isc_result_t
+find_ipv6_prefix_pool(struct ipv6_pool **pool, const struct in6_addr *pref,
+		      int plen) {
+	int i;
+
+	if (pool == NULL) {
+		log_error("%s(%d): NULL pointer reference", MDL);
+		return DHCP_R_INVALIDARG;
+	}
+	if (*pool != NULL) {
+		log_error("%s(%d): non-NULL pointer", MDL);
+		return DHCP_R_INVALIDARG;
+	}
+
+	for (i=0; i<num_pools; i++) {
+		if ((pools[i]->pool_type != D6O_IA_PD) ||
+		    (pools[i]->units != plen))
+			continue;
+		if (ipv6_in_pool(pref, pools[i])) {
+			ipv6_pool_reference(pool, pools[i], MDL);
+			return ISC_R_SUCCESS;
+		}
+	}
+	return ISC_R_NOTFOUND;
+}
+
 /*
  * Helper function for the various functions that act across all
  * pools.
@@ -2318,6 +3394,7 @@ static isc_result_t
 change_leases(struct ia_xx *ia, 
 	      isc_result_t (*change_func)(struct ipv6_pool *,
 					  struct iasubopt *)) {
+	isc_result_t result;
 	isc_result_t retval;
 	isc_result_t renew_retval;
 	struct ipv6_pool *pool;
@@ -2328,8 +3405,12 @@ change_leases(struct ia_xx *ia,
 	for (i=0; i<ia->num_iasubopt; i++) {
 		pool = NULL;
 		addr = &ia->iasubopt[i]->addr;
-		if (find_ipv6_pool(&pool, ia->ia_type,
-				   addr) == ISC_R_SUCCESS) {
+		if (ia->ia_type == D6O_IA_PD)
+			result = find_ipv6_prefix_pool(&pool, addr,
+						       ia->iasubopt[i]->plen);
+		else
+			result = find_ipv6_pool(&pool, ia->ia_type, addr);
+		if (result == ISC_R_SUCCESS) {
 			renew_retval = change_func(pool, ia->iasubopt[i]);
 			if (renew_retval != ISC_R_SUCCESS) {
 				retval = renew_retval;
@@ -2501,11 +3582,8 @@ mark_phosts_unavailable_support(const void *name, unsigned len, void *value) {
 		 * sit in any pool.)
 		 */
 		p = NULL;
-		if (find_ipv6_pool(&p, D6O_IA_PD, &pref) != ISC_R_SUCCESS) {
-			continue;
-		}
-		if (l->cidrnet.bits != p->units) {
-			ipv6_pool_dereference(&p, MDL);
+		if (find_ipv6_prefix_pool(&p, &pref,
+					  l->cidrnet.bits) != ISC_R_SUCCESS) {
 			continue;
 		}
 		mark_lease_unavailable(p, &pref);
@@ -2671,6 +3749,47 @@ ipv6_pond_dereference(struct ipv6_pond **pond, const char *file, int line) {
 	return ISC_R_SUCCESS;
 }
 
+/*
+ * How many more addresses (or prefixes) a pool could hand out.
+ */
+isc_uint64_t
+ipv6_pool_free(const struct ipv6_pool *pool) {
+	/* A pool being drained has nothing more to give. */
+	if (pool->drain_end != 0)
+		return 0;
+	if (pool->num_active >= pool->num_total)
+		return 0;
+	return pool->num_total - pool->num_active;
+}
+
+/*
+ * Put the pools of a pond in order of free capacity, most first, so
+ * that allocation tries the emptiest pool first and can stop at the
+ * first exhausted one.  Pools with the same capacity keep their
+ * order.  The counts move by a lease or two between allocations so
+ * the array is almost always in order already, and the insertion sort
+ * costs one pass.
+ */
+void
+ipv6_pond_order_pools(struct ipv6_pond *pond) {
+	struct ipv6_pool *pool;
+	isc_uint64_t avail;
+	int i, j;
+
+	if (pond->ipv6_pools == NULL)
+		return;
+
+	for (i = 1; (pool = pond->ipv6_pools[i]) != NULL; i++) {
+		avail = ipv6_pool_free(pool);
+		for (j = i; j > 0; j--) {
+			if (ipv6_pool_free(pond->ipv6_pools[j - 1]) >= avail)
+				break;
+			pond->ipv6_pools[j] = pond->ipv6_pools[j - 1];
+		}
+		pond->ipv6_pools[j] = pool;
+	}
+}
+
 #ifdef EUI_64
 /*
  * Enables/disables EUI-64 address assignment for a pond
@@ -45,6 +45,7 @@ static isc_result_t update_lease_flags(struct lease* lease,
 
 omapi_object_type_t *dhcp_type_lease;
 omapi_object_type_t *dhcp_type_pool;
+omapi_object_type_t *dhcp_type_pool6;
 omapi_object_type_t *dhcp_type_class;
 omapi_object_type_t *dhcp_type_subclass;
 omapi_object_type_t *dhcp_type_host;
@@ -128,6 +129,22 @@ void dhcp_db_objects_setup ()
 		log_fatal ("Can't register pool object type: %s",
 			   isc_result_totext (status));
 
+	status = omapi_object_type_register (&dhcp_type_pool6,
+					     "pool6",
+					     dhcp_pool6_set_value,
+					     dhcp_pool6_get_value,
+					     dhcp_pool6_destroy,
+					     dhcp_pool6_signal_handler,
+					     dhcp_pool6_stuff_values,
+					     dhcp_pool6_lookup,
+					     0, 0, 0, 0, 0,
+					     sizeof (struct pool6_object), 0,
+					     RC_MISC);
+
+	if (status != ISC_R_SUCCESS)
+		log_fatal ("Can't register pool6 object type: %s",
+			   isc_result_totext (status));
+
 	status = omapi_object_type_register (&dhcp_type_host,
 					     "host",
 					     dhcp_host_set_value,
@@ -278,8 +295,8 @@ isc_result_t dhcp_lease_set_value  (omapi_object_t *h,
 	    return DHCP_R_UNCHANGED;	/* XXX take change. */
 	} else if (!omapi_ds_strcmp (name, "hardware-type")) {
 	    return DHCP_R_UNCHANGED;	/* XXX take change. */
-	} else if (lease -> scope) {
-	    status = binding_scope_set_value (lease -> scope, 0, name, value);
+	} else if (LEASE_COLD_RO(lease)->scope) {
+	    status = binding_scope_set_value (LEASE_COLD_RO(lease)->scope, 0, name, value);
 	    if (status == ISC_R_SUCCESS) {
 		    if (write_lease (lease) && commit_leases ())
 			    return ISC_R_SUCCESS;
@@ -295,11 +312,11 @@ isc_result_t dhcp_lease_set_value  (omapi_object_t *h,
 			return status;
 	}
 
-	if (!lease -> scope) {
-		if (!binding_scope_allocate (&lease -> scope, MDL))
+	if (!LEASE_COLD_RO(lease)->scope) {
+		if (!binding_scope_allocate (&LEASE_COLD(lease)->scope, MDL))
 			return ISC_R_NOMEMORY;
 	}
-	status = binding_scope_set_value (lease -> scope, 1, name, value);
+	status = binding_scope_set_value (LEASE_COLD_RO(lease)->scope, 1, name, value);
 	if (status != ISC_R_SUCCESS)
 		return status;
 
@@ -416,15 +433,15 @@ isc_result_t dhcp_lease_get_value
 					       lease -> uid,
 					       lease -> uid_len, MDL);
 	} else if (!omapi_ds_strcmp (name, "client-hostname")) {
-		if (lease -> client_hostname)
+		if (LEASE_COLD_RO(lease)->client_hostname)
 			return omapi_make_string_value
-				(value, name, lease -> client_hostname, MDL);
+				(value, name, LEASE_COLD_RO(lease)->client_hostname, MDL);
 		return ISC_R_NOTFOUND;
 	} else if (!omapi_ds_strcmp (name, "host")) {
-		if (lease -> host)
+		if (LEASE_COLD_RO(lease)->host)
 			return omapi_make_handle_value
 				(value, name,
-				 ((omapi_object_t *)lease -> host), MDL);
+				 ((omapi_object_t *)LEASE_COLD_RO(lease)->host), MDL);
 	} else if (!omapi_ds_strcmp (name, "subnet"))
 		return omapi_make_handle_value (value, name,
 						((omapi_object_t *)
@@ -434,10 +451,10 @@ isc_result_t dhcp_lease_get_value
 						((omapi_object_t *)
 						 lease -> pool), MDL);
 	else if (!omapi_ds_strcmp (name, "billing-class")) {
-		if (lease -> billing_class)
+		if (LEASE_COLD_RO(lease)->billing_class)
 			return omapi_make_handle_value
 				(value, name,
-				 ((omapi_object_t *)lease -> billing_class),
+				 ((omapi_object_t *)LEASE_COLD_RO(lease)->billing_class),
 				 MDL);
 		return ISC_R_NOTFOUND;
 	} else if (!omapi_ds_strcmp (name, "hardware-address")) {
@@ -453,8 +470,8 @@ isc_result_t dhcp_lease_get_value
 				(value, name, lease -> hardware_addr.hbuf [0],
 				 MDL);
 		return ISC_R_NOTFOUND;
-	} else if (lease -> scope) {
-		status = binding_scope_get_value (value, lease -> scope, name);
+	} else if (LEASE_COLD_RO(lease)->scope) {
+		status = binding_scope_get_value (value, LEASE_COLD_RO(lease)->scope, name);
 		if (status != ISC_R_NOTFOUND)
 			return status;
 	}
@@ -472,6 +489,7 @@ isc_result_t dhcp_lease_get_value
 isc_result_t dhcp_lease_destroy (omapi_object_t *h, const char *file, int line)
 {
 	struct lease *lease;
+	struct lease_cold *cold;
 
 	if (h->type != dhcp_type_lease)
 		return DHCP_R_INVALIDARG;
@@ -481,51 +499,17 @@ isc_result_t dhcp_lease_destroy (omapi_object_t *h, const char *file, int line)
 		uid_hash_delete (lease);
 	hw_hash_delete (lease);
 
-	if (lease->on_star.on_release)
-		executable_statement_dereference (&lease->on_star.on_release,
-						  file, line);
-	if (lease->on_star.on_expiry)
-		executable_statement_dereference (&lease->on_star.on_expiry,
-						  file, line);
-	if (lease->on_star.on_commit)
-		executable_statement_dereference (&lease->on_star.on_commit,
-						  file, line);
-	if (lease->scope)
-		binding_scope_dereference (&lease->scope, file, line);
-
-	if (lease->agent_options)
-		option_chain_head_dereference (&lease->agent_options,
-					       file, line);
 	if (lease->uid && lease->uid != lease->uid_buf) {
 		dfree (lease->uid, MDL);
 		lease->uid = &lease->uid_buf [0];
 		lease->uid_len = 0;
 	}
 
-	if (lease->client_hostname) {
-		dfree (lease->client_hostname, MDL);
-		lease->client_hostname = (char *)0;
-	}
-
-	if (lease->host)
-		host_dereference (&lease->host, file, line);
 	if (lease->subnet)
 		subnet_dereference (&lease->subnet, file, line);
 	if (lease->pool)
 		pool_dereference (&lease->pool, file, line);
 
-	if (lease->state) {
-		free_lease_state (lease->state, file, line);
-		lease->state = (struct lease_state *)0;
-
-		cancel_timeout (lease_ping_timeout, lease);
-		--outstanding_pings; /* XXX */
-	}
-
-	if (lease->billing_class)
-		class_dereference
-			(&lease->billing_class, file, line);
-
 	/* We no longer check for a next pointer as that should
 	 * be cleared when we destroy the pool and as before we
 	 * should only ever be doing that on exit.
@@ -537,8 +521,50 @@ isc_result_t dhcp_lease_destroy (omapi_object_t *h, const char *file, int line)
 		lease_dereference (&lease->n_hw, file, line);
 	if (lease->n_uid)
 		lease_dereference (&lease->n_uid, file, line);
-	if (lease->next_pending)
-		lease_dereference (&lease->next_pending, file, line);
+
+	cold = lease->cold;
+	if (!cold)
+		return ISC_R_SUCCESS;
+
+	if (cold->on_star.on_release)
+		executable_statement_dereference (&cold->on_star.on_release,
+						  file, line);
+	if (cold->on_star.on_expiry)
+		executable_statement_dereference (&cold->on_star.on_expiry,
+						  file, line);
+	if (cold->on_star.on_commit)
+		executable_statement_dereference (&cold->on_star.on_commit,
+						  file, line);
+	if (cold->scope)
+		binding_scope_dereference (&cold->scope, file, line);
+
+	if (cold->agent_options)
+		option_chain_head_dereference (&cold->agent_options,
+					       file, line);
+
+	if (cold->client_hostname)
+		intern_string_release(&cold->client_hostname, MDL);
+
+	if (cold->host)
+		host_dereference (&cold->host, file, line);
+
+	if (cold->state) {
+		free_lease_state (cold->state, file, line);
+		cold->state = (struct lease_state *)0;
+
+		cancel_timeout (lease_ping_timeout, lease);
+		--outstanding_pings; /* XXX */
+	}
+
+	if (cold->billing_class)
+		class_dereference
+			(&cold->billing_class, file, line);
+
+	if (cold->next_pending)
+		lease_dereference (&cold->next_pending, file, line);
+
+	dfree (cold, file, line);
+	lease->cold = (struct lease_cold *)0;
 
 	return ISC_R_SUCCESS;
 }
@@ -612,24 +638,24 @@ isc_result_t dhcp_lease_stuff_values (omapi_object_t *c,
 		}
 	}
 
-	if (lease -> client_hostname) {
+	if (LEASE_COLD_RO(lease)->client_hostname) {
 		status = omapi_connection_put_name (c, "client-hostname");
 		if (status != ISC_R_SUCCESS)
 			return status;
 		status =
 			omapi_connection_put_string (c,
-						     lease -> client_hostname);
+						     LEASE_COLD_RO(lease)->client_hostname);
 		if (status != ISC_R_SUCCESS)
 			return status;
 	}
 
-	if (lease -> host) {
+	if (LEASE_COLD_RO(lease)->host) {
 		status = omapi_connection_put_name (c, "host");
 		if (status != ISC_R_SUCCESS)
 			return status;
 		status = omapi_connection_put_handle (c,
 						      (omapi_object_t *)
-						      lease -> host);
+						      LEASE_COLD_RO(lease)->host);
 		if (status != ISC_R_SUCCESS)
 			return status;
 	}
@@ -650,12 +676,12 @@ isc_result_t dhcp_lease_stuff_values (omapi_object_t *c,
 	if (status != ISC_R_SUCCESS)
 		return status;
 
-	if (lease -> billing_class) {
+	if (LEASE_COLD_RO(lease)->billing_class) {
 		status = omapi_connection_put_name (c, "billing-class");
 		if (status != ISC_R_SUCCESS)
 			return status;
 		status = omapi_connection_put_handle
-			(c, (omapi_object_t *)lease -> billing_class);
+			(c, (omapi_object_t *)LEASE_COLD_RO(lease)->billing_class);
 		if (status != ISC_R_SUCCESS)
 			return status;
 	}
@@ -702,7 +728,7 @@ isc_result_t dhcp_lease_stuff_values (omapi_object_t *c,
 	if (status != ISC_R_SUCCESS)
 		return (status);
 
-	bouncer = (u_int32_t)lease->tstp;
+	bouncer = (u_int32_t)LEASE_COLD_RO(lease)->tstp;
 	status = omapi_connection_put_named_uint32(c, "tstp", bouncer);
 	if (status != ISC_R_SUCCESS)
 		return (status);
@@ -712,12 +738,12 @@ isc_result_t dhcp_lease_stuff_values (omapi_object_t *c,
 	if (status != ISC_R_SUCCESS)
 		return status;
 
-	bouncer = (u_int32_t)lease->atsfp;
+	bouncer = (u_int32_t)LEASE_COLD_RO(lease)->atsfp;
 	status = omapi_connection_put_named_uint32(c, "atsfp", bouncer);
 	if (status != ISC_R_SUCCESS)
 		return status;
 
-	bouncer = (u_int32_t)lease->cltt;
+	bouncer = (u_int32_t)LEASE_COLD_RO(lease)->cltt;
 	status = omapi_connection_put_named_uint32(c, "cltt", bouncer);
 	if (status != ISC_R_SUCCESS)
 		return status;
@@ -733,8 +759,8 @@ isc_result_t dhcp_lease_stuff_values (omapi_object_t *c,
 	if (status != ISC_R_SUCCESS)
 		return status;
 
-	if (lease -> scope) {
-		status = binding_scope_stuff_values (c, lease -> scope);
+	if (LEASE_COLD_RO(lease)->scope) {
+		status = binding_scope_stuff_values (c, LEASE_COLD_RO(lease)->scope);
 		if (status != ISC_R_SUCCESS)
 			return status;
 	}
@@ -1141,6 +1167,7 @@ isc_result_t dhcp_host_set_value  (omapi_object_t *h,
 			if (status != ISC_R_SUCCESS || parse == NULL)
 				return status;
 
+			config_generation++;
 			if (!(parse_executable_statements
 			      (&host -> group -> statements, parse, &lose,
 			       context_any))) {
@@ -1830,6 +1857,18 @@ isc_result_t dhcp_pool_stuff_values (omapi_object_t *c,
 						    pool->backup_leases));
 	if (status != ISC_R_SUCCESS)
 		return (status);
+
+	status = omapi_connection_put_named_uint32(c, "reuse-hits",
+						   ((u_int32_t)
+						    pool->reuse_hits));
+	if (status != ISC_R_SUCCESS)
+		return (status);
+
+	status = omapi_connection_put_named_uint32(c, "reuse-misses",
+						   ((u_int32_t)
+						    pool->reuse_misses));
+	if (status != ISC_R_SUCCESS)
+		return (status);
 	/* we could add time stamps but lets wait on those */
 
 	/* Write out the inner object, if any. */
@@ -1867,6 +1906,276 @@ isc_result_t dhcp_pool_remove (omapi_object_t *lp,
 	return ISC_R_NOTIMPLEMENTED;
 }
 
+/*
+ * A pool6 object is a handle on an IPv6 pool, found by any address in
+ * it (plus the prefix-length for a prefix delegation pool).  Setting
+ * drain-lifetime on it starts draining the pool: see ipv6_pool_drain().
+ */
+isc_result_t dhcp_pool6_set_value  (omapi_object_t *h,
+				    omapi_object_t *id,
+				    omapi_data_string_t *name,
+				    omapi_typed_data_t *value)
+{
+	struct pool6_object *pool6;
+	unsigned long valid;
+	isc_result_t status;
+
+	if (h -> type != dhcp_type_pool6)
+		return DHCP_R_INVALIDARG;
+	pool6 = (struct pool6_object *)h;
+	if (!pool6 -> ipv6_pool)
+		return ISC_R_NOTFOUND;
+
+	if (!omapi_ds_strcmp (name, "address") ||
+	    !omapi_ds_strcmp (name, "bits") ||
+	    !omapi_ds_strcmp (name, "prefix-length") ||
+	    !omapi_ds_strcmp (name, "active-leases")) {
+		return DHCP_R_UNCHANGED;
+	} else if (!omapi_ds_strcmp (name, "drain-lifetime")) {
+		status = omapi_get_int_value (&valid, value);
+		if (status != ISC_R_SUCCESS)
+			return status;
+		if (valid > 0xffffffffUL)
+			return DHCP_R_INVALIDARG;
+		return ipv6_pool_drain (pool6 -> ipv6_pool,
+					(u_int32_t)valid);
+	}
+
+	/* Try to find some inner object that can take the value. */
+	if (h -> inner && h -> inner -> type -> set_value) {
+		status = ((*(h -> inner -> type -> set_value))
+			  (h -> inner, id, name, value));
+		if (status == ISC_R_SUCCESS || status == DHCP_R_UNCHANGED)
+			return status;
+	}
+
+	return DHCP_R_UNKNOWNATTRIBUTE;
+}
+
+isc_result_t dhcp_pool6_get_value (omapi_object_t *h, omapi_object_t *id,
+				   omapi_data_string_t *name,
+				   omapi_value_t **value)
+{
+	struct ipv6_pool *pool;
+	isc_result_t status;
+
+	if (h -> type != dhcp_type_pool6)
+		return DHCP_R_INVALIDARG;
+	pool = ((struct pool6_object *)h) -> ipv6_pool;
+	if (!pool)
+		return ISC_R_NOTFOUND;
+
+	if (!omapi_ds_strcmp (name, "address"))
+		return omapi_make_const_value (value, name,
+					       (unsigned char *)
+					       &pool -> start_addr,
+					       sizeof (pool -> start_addr),
+					       MDL);
+	if (!omapi_ds_strcmp (name, "bits"))
+		return omapi_make_int_value (value, name, pool -> bits, MDL);
+	if (!omapi_ds_strcmp (name, "prefix-length")) {
+		if (pool -> pool_type != D6O_IA_PD)
+			return ISC_R_NOTFOUND;
+		return omapi_make_int_value (value, name, pool -> units, MDL);
+	}
+	if (!omapi_ds_strcmp (name, "active-leases"))
+		return omapi_make_uint_value (value, name,
+					      (pool -> num_active > UINT_MAX)
+					      ? UINT_MAX
+					      : (unsigned)pool -> num_active,
+					      MDL);
+	if (!omapi_ds_strcmp (name, "drain-lifetime")) {
+		if (pool -> drain_end == 0)
+			return ISC_R_NOTFOUND;
+		return omapi_make_uint_value (value, name,
+					      (pool -> drain_end > cur_time)
+					      ? (unsigned)(pool -> drain_end -
+							   cur_time)
+					      : 0, MDL);
+	}
+
+	/* Try to find some inner object that can provide the value. */
+	if (h -> inner && h -> inner -> type -> get_value) {
+		status = ((*(h -> inner -> type -> get_value))
+			  (h -> inner, id, name, value));
+		if (status == ISC_R_SUCCESS)
+			return status;
+	}
+	return DHCP_R_UNKNOWNATTRIBUTE;
+}
+
+isc_result_t dhcp_pool6_destroy (omapi_object_t *h, const char *file, int line)
+{
+	struct pool6_object *pool6;
+
+	if (h -> type != dhcp_type_pool6)
+		return DHCP_R_INVALIDARG;
+	pool6 = (struct pool6_object *)h;
+
+	/* The pool owns us; the back pointer is not a reference. */
+	pool6 -> ipv6_pool = (struct ipv6_pool *)0;
+	return ISC_R_SUCCESS;
+}
+
+isc_result_t dhcp_pool6_signal_handler (omapi_object_t *h,
+					const char *name, va_list ap)
+{
+	isc_result_t status;
+
+	if (h -> type != dhcp_type_pool6)
+		return DHCP_R_INVALIDARG;
+
+	/* Try to find some inner object that can take the value. */
+	if (h -> inner && h -> inner -> type -> signal_handler) {
+		status = ((*(h -> inner -> type -> signal_handler))
+			  (h -> inner, name, ap));
+		if (status == ISC_R_SUCCESS)
+			return status;
+	}
+
+	return ISC_R_NOTFOUND;
+}
+
+isc_result_t dhcp_pool6_stuff_values (omapi_object_t *c,
+				      omapi_object_t *id,
+				      omapi_object_t *h)
+{
+	struct ipv6_pool *pool;
+	isc_result_t status;
+
+	if (h -> type != dhcp_type_pool6)
+		return DHCP_R_INVALIDARG;
+	pool = ((struct pool6_object *)h) -> ipv6_pool;
+	if (!pool)
+		return ISC_R_NOTFOUND;
+
+	status = omapi_connection_put_name (c, "address");
+	if (status != ISC_R_SUCCESS)
+		return status;
+	status = omapi_connection_put_uint32 (c, sizeof (pool -> start_addr));
+	if (status != ISC_R_SUCCESS)
+		return status;
+	status = omapi_connection_copyin (c, (unsigned char *)
+					  &pool -> start_addr,
+					  sizeof (pool -> start_addr));
+	if (status != ISC_R_SUCCESS)
+		return status;
+
+	status = omapi_connection_put_named_uint32 (c, "bits",
+						    (u_int32_t)pool -> bits);
+	if (status != ISC_R_SUCCESS)
+		return status;
+
+	if (pool -> pool_type == D6O_IA_PD) {
+		status = omapi_connection_put_named_uint32
+			(c, "prefix-length", (u_int32_t)pool -> units);
+		if (status != ISC_R_SUCCESS)
+			return status;
+	}
+
+	status = omapi_connection_put_named_uint32
+		(c, "active-leases",
+		 (pool -> num_active > 0xffffffff)
+		 ? 0xffffffff : (u_int32_t)pool -> num_active);
+	if (status != ISC_R_SUCCESS)
+		return status;
+
+	if (pool -> drain_end != 0) {
+		status = omapi_connection_put_named_uint32
+			(c, "drain-lifetime",
+			 (pool -> drain_end > cur_time)
+			 ? (u_int32_t)(pool -> drain_end - cur_time) : 0);
+		if (status != ISC_R_SUCCESS)
+			return status;
+	}
+
+	/* Write out the inner object, if any. */
+	if (h -> inner && h -> inner -> type -> stuff_values) {
+		status = ((*(h -> inner -> type -> stuff_values))
+			  (c, id, h -> inner));
+		if (status == ISC_R_SUCCESS)
+			return status;
+	}
+
+	return ISC_R_SUCCESS;
+}
+
+isc_result_t dhcp_pool6_lookup (omapi_object_t **lp,
+				omapi_object_t *id, omapi_object_t *ref)
+{
+	omapi_value_t *tv = (omapi_value_t *)0;
+	struct ipv6_pool *pool = (struct ipv6_pool *)0;
+	struct in6_addr addr;
+	unsigned long plen = 0;
+	isc_result_t status;
+
+	if (!ref)
+		return DHCP_R_NOKEYS;
+
+	/* First see if we were sent a handle. */
+	status = omapi_get_value_str (ref, id, "handle", &tv);
+	if (status == ISC_R_SUCCESS) {
+		status = omapi_handle_td_lookup (lp, tv -> value);
+
+		omapi_value_dereference (&tv, MDL);
+		if (status != ISC_R_SUCCESS)
+			return status;
+
+		/* Don't return the object if the type is wrong. */
+		if ((*lp) -> type != dhcp_type_pool6) {
+			omapi_object_dereference (lp, MDL);
+			return DHCP_R_INVALIDARG;
+		}
+		return ISC_R_SUCCESS;
+	}
+
+	status = omapi_get_value_str (ref, id, "address", &tv);
+	if (status != ISC_R_SUCCESS)
+		return DHCP_R_NOKEYS;
+	if ((tv -> value -> type != omapi_datatype_data &&
+	     tv -> value -> type != omapi_datatype_string) ||
+	    (tv -> value -> u.buffer.len != sizeof (addr))) {
+		omapi_value_dereference (&tv, MDL);
+		return DHCP_R_INVALIDARG;
+	}
+	memcpy (&addr, tv -> value -> u.buffer.value, sizeof (addr));
+	omapi_value_dereference (&tv, MDL);
+
+	status = omapi_get_value_str (ref, id, "prefix-length", &tv);
+	if (status == ISC_R_SUCCESS) {
+		status = omapi_get_int_value (&plen, tv -> value);
+		omapi_value_dereference (&tv, MDL);
+		if (status != ISC_R_SUCCESS)
+			return status;
+	}
+
+	if (plen != 0) {
+		if (plen > 128 ||
+		    (find_ipv6_prefix_pool (&pool, &addr, (int)plen)
+		     != ISC_R_SUCCESS))
+			return ISC_R_NOTFOUND;
+	} else if ((find_ipv6_pool (&pool, D6O_IA_NA, &addr)
+		    != ISC_R_SUCCESS) &&
+		   (find_ipv6_pool (&pool, D6O_IA_TA, &addr)
+		    != ISC_R_SUCCESS)) {
+		return ISC_R_NOTFOUND;
+	}
+
+	/* Hand out the same object every time, so that its handle
+	   is still good when the client comes back with an update. */
+	status = ISC_R_SUCCESS;
+	if (!pool -> pool6) {
+		status = pool6_allocate (&pool -> pool6, MDL);
+		if (status == ISC_R_SUCCESS)
+			pool -> pool6 -> ipv6_pool = pool;
+	}
+	if (status == ISC_R_SUCCESS)
+		omapi_object_reference (lp, (omapi_object_t *)pool -> pool6,
+					MDL);
+	ipv6_pool_dereference (&pool, MDL);
+	return status;
+}
+
 static isc_result_t
 class_set_value (omapi_object_t *h,
 		 omapi_object_t *id,
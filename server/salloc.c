@@ -152,6 +152,7 @@ OMAPI_OBJECT_ALLOC (lease, struct lease, dhcp_type_lease)
 OMAPI_OBJECT_ALLOC (class, struct class, dhcp_type_class)
 OMAPI_OBJECT_ALLOC (subclass, struct class, dhcp_type_subclass)
 OMAPI_OBJECT_ALLOC (pool, struct pool, dhcp_type_pool)
+OMAPI_OBJECT_ALLOC (pool6, struct pool6_object, dhcp_type_pool6)
 
 #if !defined (NO_HOST_FREES)	/* Scary debugging mode - don't enable! */
 OMAPI_OBJECT_ALLOC (host, struct host_decl, dhcp_type_host)
@@ -183,7 +184,8 @@ isc_result_t host_dereference (struct host_decl **ptr,
 }
 #endif
 
-struct lease_state *free_lease_states;
+static omapi_pool_t lease_state_pool =
+	OMAPI_POOL_INITIALIZER ("lease state", struct lease_state, 16, 64);
 
 struct lease_state *new_lease_state
 (
@@ -193,17 +195,9 @@ struct lease_state *new_lease_state
 {
 	struct lease_state *rval;
 
-	if (free_lease_states) {
-		rval = free_lease_states;
-		free_lease_states =
-			(struct lease_state *)(free_lease_states -> next);
- 		dmalloc_reuse (rval, file, line, 0);
-	} else {
-		rval = dmalloc (sizeof (struct lease_state), file, line);
-		if (!rval)
-			return rval;
-	}
-	memset (rval, 0, sizeof *rval);
+	rval = omapi_pool_get (&lease_state_pool, file, line);
+	if (!rval)
+		return rval;
 	if (!option_state_allocate (&rval -> options, file, line)) {
 		free_lease_state (rval, file, line);
 		return (struct lease_state *)0;
@@ -227,22 +221,14 @@ void free_lease_state (ptr, file, line)
 	data_string_forget (&ptr -> parameter_request_list, file, line);
 	data_string_forget (&ptr -> filename, file, line);
 	data_string_forget (&ptr -> server_name, file, line);
-	ptr -> next = free_lease_states;
-	free_lease_states = ptr;
-	dmalloc_reuse (free_lease_states, (char *)0, 0, 0);
+	omapi_pool_put (&lease_state_pool, ptr, file, line);
 }
 
 #if defined (DEBUG_MEMORY_LEAKAGE) || \
 		defined (DEBUG_MEMORY_LEAKAGE_ON_EXIT)
 void relinquish_free_lease_states ()
 {
-	struct lease_state *cs, *ns;
-
-	for (cs = free_lease_states; cs; cs = ns) {
-		ns = cs -> next;
-		dfree (cs, MDL);
-	}
-	free_lease_states = (struct lease_state *)0;
+	omapi_pool_relinquish (&lease_state_pool);
 }
 #endif
 
@@ -271,3 +257,144 @@ void free_permit (permit, file, line)
 		class_dereference (&permit -> class, MDL);
 	dfree (permit, file, line);
 }
+
+/* Interned strings.
+
+   Every lease carries the host name its client last sent, and on a
+   busy server most of those names are shared by many leases (or are
+   the same name being copied from one lease structure to the next as
+   a lease is renewed).  Such strings are kept once, in a table keyed
+   by their contents, with a reference count; holders share a single
+   copy, and two interned strings are equal exactly when they are the
+   same pointer.  Interned strings must never be written to. */
+
+struct interned_string {
+	struct interned_string *next;
+	unsigned hash;
+	unsigned len;
+	int refcnt;
+	char data [1];
+};
+
+#define INTERN_TABLE_MIN	64
+
+static struct interned_string **intern_table;
+static unsigned intern_table_size;
+static unsigned intern_count;
+
+#define INTERNED(s) ((struct interned_string *) \
+		     ((s) - offsetof(struct interned_string, data)))
+
+static unsigned
+intern_hash(const char *s, unsigned len)
+{
+	unsigned hash = 2166136261U;
+
+	while (len-- > 0)
+		hash = (hash ^ (unsigned char)*s++) * 16777619U;
+	return hash;
+}
+
+/* Double the table once it averages more than two strings a bucket. */
+static void
+intern_table_grow(void)
+{
+	struct interned_string **table, *is, *next;
+	unsigned size, i;
+
+	size = intern_table_size ? intern_table_size * 2 : INTERN_TABLE_MIN;
+	table = dmalloc(size * sizeof(*table), MDL);
+	if (table == NULL)
+		return;
+
+	for (i = 0; i < intern_table_size; i++) {
+		for (is = intern_table[i]; is != NULL; is = next) {
+			next = is->next;
+			is->next = table[is->hash & (size - 1)];
+			table[is->hash & (size - 1)] = is;
+		}
+	}
+	if (intern_table != NULL)
+		dfree(intern_table, MDL);
+	intern_table = table;
+	intern_table_size = size;
+}
+
+/*!
+ * \brief Get a reference to the interned copy of a string
+ *
+ * \param s the string, which need not be NUL terminated
+ * \param len its length
+ *
+ * \return the interned, NUL terminated copy, or NULL if no memory was
+ *         available; release it with intern_string_release()
+ */
+char *
+intern_string(const char *s, unsigned len, const char *file, int line)
+{
+	struct interned_string *is;
+	unsigned hash;
+
+	if (intern_count >= intern_table_size * 2)
+		intern_table_grow();
+	if (intern_table == NULL)
+		return NULL;
+
+	hash = intern_hash(s, len);
+	for (is = intern_table[hash & (intern_table_size - 1)];
+	     is != NULL; is = is->next) {
+		if (is->hash == hash && is->len == len &&
+		    memcmp(is->data, s, len) == 0) {
+			is->refcnt++;
+			return is->data;
+		}
+	}
+
+	is = dmalloc(offsetof(struct interned_string, data) + len + 1,
+		     file, line);
+	if (is == NULL)
+		return NULL;
+	is->hash = hash;
+	is->len = len;
+	is->refcnt = 1;
+	memcpy(is->data, s, len);
+	is->data[len] = '\0';
+	is->next = intern_table[hash & (intern_table_size - 1)];
+	intern_table[hash & (intern_table_size - 1)] = is;
+	intern_count++;
+	return is->data;
+}
+
+/* Take another reference to an interned string. */
+char *
+intern_string_reference(char *s)
+{
+	INTERNED(s)->refcnt++;
+	return s;
+}
+
+/* Drop a reference to an interned string and clear the pointer to it;
+   the string is freed along with its last reference. */
+void
+intern_string_release(char **sp, const char *file, int line)
+{
+	struct interned_string *is, **ip;
+
+	if (*sp == NULL)
+		return;
+
+	is = INTERNED(*sp);
+	*sp = NULL;
+	if (--is->refcnt > 0)
+		return;
+
+	for (ip = &intern_table[is->hash & (intern_table_size - 1)];
+	     *ip != NULL; ip = &(*ip)->next) {
+		if (*ip == is) {
+			*ip = is->next;
+			break;
+		}
+	}
+	intern_count--;
+	dfree(is, file, line);
+}
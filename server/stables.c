@@ -492,6 +492,7 @@ void initialize_server_option_spaces()
 				     agent_options[i].name, 0,
 				     &agent_options[i], MDL);
 	}
+	option_code_index_init(&agent_universe, agent_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("Relay Agent name hash: %s",
 		 option_name_hash_report(agent_universe.name_hash));
@@ -533,6 +534,7 @@ void initialize_server_option_spaces()
 				     server_options[i].name, 0,
 				     &server_options[i], MDL);
 	}
+	option_code_index_init(&server_universe, server_options);
 #if defined(REPORT_HASH_PERFORMANCE)
 	log_info("Server-Config Option name hash: %s",
 		 option_name_hash_report(server_universe.name_hash));
@@ -354,6 +354,337 @@ ATF_TC_BODY(ia_na_negative, tc)
     }
 }
 
+static isc_result_t
+count_ia(struct ia_xx *ia, void *arg)
+{
+    (*(int *)arg)++;
+    return ISC_R_SUCCESS;
+}
+
+ATF_TC(duid_index);
+ATF_TC_HEAD(duid_index, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that active IAs "
+                      "can be found by DUID alone.");
+}
+ATF_TC_BODY(duid_index, tc)
+{
+    ia_hash_t *na_table, *pd_table;
+    struct ia_xx *ia;
+    unsigned char key[20];
+    char duid[16];
+    u_int32_t iaid;
+    int i, len, seen;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+
+    na_table = pd_table = NULL;
+    if (!ia_new_hash(&na_table, DEFAULT_HASH_SIZE, MDL) ||
+        !ia_new_hash(&pd_table, DEFAULT_HASH_SIZE, MDL)) {
+        atf_tc_fail("ERROR: ia_new_hash() %s:%d", MDL);
+    }
+
+    /* enough clients to make the index grow */
+    for (i = 0; i < 300; i++) {
+        len = sprintf(duid, "client%d", i);
+        ia = NULL;
+        if (ia_allocate(&ia, i, duid, len, MDL) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: ia_allocate() %s:%d", MDL);
+        }
+        ia->ia_type = D6O_IA_NA;
+        ia_active_add(na_table, ia, MDL);
+        ia_dereference(&ia, MDL);
+    }
+
+    /* two more IAs, one of them a PD, for the same client */
+    ia = NULL;
+    if (ia_allocate(&ia, 1000, "client7", 7, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ia_allocate() %s:%d", MDL);
+    }
+    ia->ia_type = D6O_IA_NA;
+    ia_active_add(na_table, ia, MDL);
+    ia_dereference(&ia, MDL);
+    if (ia_allocate(&ia, 1001, "client7", 7, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ia_allocate() %s:%d", MDL);
+    }
+    ia->ia_type = D6O_IA_PD;
+    ia_active_add(pd_table, ia, MDL);
+    memcpy(key, ia->iaid_duid.data, ia->iaid_duid.len);
+    len = ia->iaid_duid.len;
+    ia_dereference(&ia, MDL);
+
+    seen = 0;
+    if ((ia_foreach_by_duid((const unsigned char *)"client7", 7,
+                            count_ia, &seen) != 3) || (seen != 3)) {
+        atf_tc_fail("ERROR: found %d IAs for client7 %s:%d", seen, MDL);
+    }
+    seen = 0;
+    if ((ia_foreach_by_duid((const unsigned char *)"client299", 9,
+                            count_ia, &seen) != 1) || (seen != 1)) {
+        atf_tc_fail("ERROR: found %d IAs for client299 %s:%d", seen, MDL);
+    }
+    seen = 0;
+    if (ia_foreach_by_duid((const unsigned char *)"client", 6,
+                           count_ia, &seen) != 0) {
+        atf_tc_fail("ERROR: found IAs for a DUID prefix %s:%d", MDL);
+    }
+
+    /* taking the PD out of its hash takes it out of the index too */
+    ia_active_delete(pd_table, key, len, MDL);
+    ia = NULL;
+    if (ia_hash_lookup(&ia, pd_table, key, len, MDL)) {
+        atf_tc_fail("ERROR: IA still in the hash %s:%d", MDL);
+    }
+    seen = 0;
+    if (ia_foreach_by_duid((const unsigned char *)"client7", 7,
+                           count_ia, &seen) != 2) {
+        atf_tc_fail("ERROR: found %d IAs after delete %s:%d", seen, MDL);
+    }
+
+    /* empty the hash and the index with it */
+    for (i = 0; i < 301; i++) {
+        iaid = (i < 300) ? i : 1000;
+        len = sprintf(duid, "client%d", (i < 300) ? i : 7);
+        memcpy(key, &iaid, sizeof(iaid));
+        memcpy(key + sizeof(iaid), duid, len);
+        ia_active_delete(na_table, key, sizeof(iaid) + len, MDL);
+    }
+    seen = 0;
+    if (ia_foreach_by_duid((const unsigned char *)"client7", 7,
+                           count_ia, &seen) != 0) {
+        atf_tc_fail("ERROR: found %d IAs after emptying %s:%d", seen, MDL);
+    }
+    ia_free_hash_table(&na_table, MDL);
+    ia_free_hash_table(&pd_table, MDL);
+}
+
+
+/*
+ * Read what has been appended to the lease file since it was off bytes
+ * long, and return its new length.
+ */
+static long
+lease_file_tail(long off, char *buf, size_t len)
+{
+    FILE *f;
+    size_t n;
+    long end;
+
+    f = fopen(path_dhcpd_db, "r");
+    if (f == NULL) {
+        atf_tc_fail("ERROR: can't open %s %s:%d", path_dhcpd_db, MDL);
+    }
+    fseek(f, 0, SEEK_END);
+    end = ftell(f);
+    fseek(f, off, SEEK_SET);
+    n = fread(buf, 1, len - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    return end;
+}
+
+/*
+ * Give an address new lifetimes and a new end time, as a renew would.
+ */
+static void
+renew_times(struct ipv6_pool *pool, struct iasubopt *iaaddr, u_int32_t valid)
+{
+    iaaddr->prefer = valid / 2;
+    iaaddr->valid = valid;
+    iaaddr->soft_lifetime_end_time = cur_time + valid;
+    if (renew_lease6(pool, iaaddr) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+    }
+}
+
+ATF_TC(ia_renew_record);
+ATF_TC_HEAD(ia_renew_record, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that an IA whose "
+                      "times alone have changed is written as a renew "
+                      "record, and that reading the lease file back "
+                      "applies it.");
+}
+ATF_TC_BODY(ia_renew_record, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *pool;
+    struct ia_xx *ia;
+    struct iasubopt *iaaddr;
+    struct data_string ds;
+    unsigned int attempts;
+    unsigned char key[20];
+    unsigned len;
+    char buf[4096];
+    long off;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+    local_family = AF_INET6;
+    path_dhcpd_db = "renew.leases";
+    time(&cur_time);
+    if (!ia_new_hash(&ia_na_active, DEFAULT_HASH_SIZE, MDL) ||
+        !ia_new_hash(&ia_ta_active, DEFAULT_HASH_SIZE, MDL) ||
+        !ia_new_hash(&ia_pd_active, DEFAULT_HASH_SIZE, MDL)) {
+        atf_tc_fail("ERROR: ia_new_hash() %s:%d", MDL);
+    }
+
+    memset(&ds, 0, sizeof(ds));
+    ds.len = 7;
+    if (!buffer_allocate(&ds.buffer, ds.len, MDL)) {
+        atf_tc_fail("Out of memory");
+    }
+    ds.data = ds.buffer->data;
+    memcpy((char *)ds.data, "client0", ds.len);
+
+    inet_pton(AF_INET6, "1:2:3:4::", &addr);
+    pool = NULL;
+    if ((ipv6_pool_allocate(&pool, D6O_IA_NA, &addr,
+                            64, 128, MDL) != ISC_R_SUCCESS) ||
+        (add_ipv6_pool(pool) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+
+    /* an IA_NA with one address */
+    ia = NULL;
+    if (ia_allocate(&ia, 1, "client0", 7, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ia_allocate() %s:%d", MDL);
+    }
+    ia->ia_type = D6O_IA_NA;
+    iaaddr = NULL;
+    if (create_lease6(pool, &iaaddr, &attempts, &ds,
+                      cur_time + 600) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: create_lease6() %s:%d", MDL);
+    }
+    renew_times(pool, iaaddr, 600);
+    ia_add_iasubopt(ia, iaaddr, MDL);
+    ia_reference(&iaaddr->ia, ia, MDL);
+    iasubopt_dereference(&iaaddr, MDL);
+    ia->cltt = cur_time;
+    ia_active_add(ia_na_active, ia, MDL);
+    len = ia->iaid_duid.len;
+    memcpy(key, ia->iaid_duid.data, len);
+
+    /* the startup lease file holds a full record, the next write a renew */
+    fclose(fopen(path_dhcpd_db, "w"));
+    db_startup(0);
+    off = lease_file_tail(0, buf, sizeof(buf));
+    if ((strstr(buf, "ia-na ") == NULL) || (strstr(buf, " renew ") != NULL)) {
+        atf_tc_fail("ERROR: no full record in new file %s:%d", MDL);
+    }
+    renew_times(pool, ia->iasubopt[0], 1200);
+    ia->cltt = cur_time + 10;
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if ((strncmp(buf, "ia-na ", 6) != 0) || (strstr(buf, " renew ") == NULL)) {
+        atf_tc_fail("ERROR: no renew record: %s %s:%d", buf, MDL);
+    }
+
+    /* reading the file back gives the renewed times */
+    if (read_conf_file(path_dhcpd_db, NULL, 0, 1) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: read_conf_file() %s:%d", MDL);
+    }
+    ia_dereference(&ia, MDL);
+    if (!ia_hash_lookup(&ia, ia_na_active, key, len, MDL) ||
+        (ia->num_iasubopt != 1)) {
+        atf_tc_fail("ERROR: IA not read back %s:%d", MDL);
+    }
+    iaaddr = ia->iasubopt[0];
+    if ((ia->cltt != cur_time + 10) ||
+        (iaaddr->prefer != 600) || (iaaddr->valid != 1200) ||
+        (iaaddr->hard_lifetime_end_time != cur_time + 1200)) {
+        atf_tc_fail("ERROR: renew not applied %s:%d", MDL);
+    }
+
+    /* a read back IA is written in full once, then renewed */
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if (strstr(buf, " renew ") != NULL) {
+        atf_tc_fail("ERROR: renew of a read back IA %s:%d", MDL);
+    }
+    renew_times(pool, iaaddr, 1800);
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if (strstr(buf, " renew ") == NULL) {
+        atf_tc_fail("ERROR: no renew record %s:%d", MDL);
+    }
+
+    /* a changed binding needs a full record */
+    if (!bind_ds_value(&iaaddr->scope, "test", &ds)) {
+        atf_tc_fail("ERROR: bind_ds_value() %s:%d", MDL);
+    }
+    renew_times(pool, iaaddr, 2400);
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if ((strstr(buf, " renew ") != NULL) ||
+        (strstr(buf, "set test = ") == NULL)) {
+        atf_tc_fail("ERROR: renew after a binding change %s:%d", MDL);
+    }
+
+    /* so does a second address */
+    iaaddr = NULL;
+    if (create_lease6(pool, &iaaddr, &attempts, &ds,
+                      cur_time + 600) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: create_lease6() %s:%d", MDL);
+    }
+    renew_times(pool, iaaddr, 600);
+    ia_add_iasubopt(ia, iaaddr, MDL);
+    ia_reference(&iaaddr->ia, ia, MDL);
+    iasubopt_dereference(&iaaddr, MDL);
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if (strstr(buf, " renew ") != NULL) {
+        atf_tc_fail("ERROR: renew after adding an address %s:%d", MDL);
+    }
+    renew_times(pool, ia->iasubopt[1], 1200);
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if (strstr(buf, " renew ") == NULL) {
+        atf_tc_fail("ERROR: no renew record %s:%d", MDL);
+    }
+
+    /*
+     * The full records of an old file don't count in a new one: an IA
+     * left out of the rewrite must be written in full again.
+     */
+    ia_active_delete(ia_na_active, key, len, MDL);
+    if (!new_lease_file(0)) {
+        atf_tc_fail("ERROR: new_lease_file() %s:%d", MDL);
+    }
+    ia_active_add(ia_na_active, ia, MDL);
+    off = lease_file_tail(0, buf, sizeof(buf));
+    if (strstr(buf, "ia-na ") != NULL) {
+        atf_tc_fail("ERROR: IA written to the new file %s:%d", MDL);
+    }
+    renew_times(pool, ia->iasubopt[0], 600);
+    if (!write_ia(ia)) {
+        atf_tc_fail("ERROR: write_ia() %s:%d", MDL);
+    }
+    off = lease_file_tail(off, buf, sizeof(buf));
+    if ((strncmp(buf, "ia-na ", 6) != 0) || (strstr(buf, " renew ") != NULL)) {
+        atf_tc_fail("ERROR: renew in a new file %s:%d", MDL);
+    }
+
+    ia_dereference(&ia, MDL);
+    data_string_forget(&ds, MDL);
+    ipv6_pool_dereference(&pool, MDL);
+}
+
 /*
  * Basic ipv6_pool manipulation.
  * Verify that basic pool operations work properly.
@@ -862,6 +1193,418 @@ ATF_TC_BODY(small_pool, tc)
     }
 }
 
+/*
+ * Full pools.
+ * check that pools with an in-use map can be filled completely.
+ */
+
+ATF_TC(pool_map);
+ATF_TC_HEAD(pool_map, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that address and "
+                      "prefix pools with an in-use map hand out every "
+                      "free element.");
+}
+ATF_TC_BODY(pool_map, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *pool;
+    struct iasubopt *iaaddr, *freed;
+    struct data_string ds;
+    unsigned int attempts;
+    char uid[32];
+    int i;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+
+    memset(&ds, 0, sizeof(ds));
+    ds.data = (const unsigned char *)uid;
+
+    /* a /120 of addresses, less the reserved subnet router anycast */
+    inet_pton(AF_INET6, "1:2:3:4::", &addr);
+    pool = NULL;
+    if (ipv6_pool_allocate(&pool, D6O_IA_NA, &addr,
+                           120, 128, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+    if (pool->in_use_map == NULL) {
+        atf_tc_fail("ERROR: no in-use map %s:%d", MDL);
+    }
+    freed = NULL;
+    for (i = 0; i < 255; i++) {
+        ds.len = sprintf(uid, "client%d", i);
+        iaaddr = NULL;
+        if (create_lease6(pool, &iaaddr, &attempts,
+                          &ds, 42) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: create_lease6() %d %s:%d", i, MDL);
+        }
+        if (renew_lease6(pool, iaaddr) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+        }
+        if (i == 100) {
+            iasubopt_reference(&freed, iaaddr, MDL);
+        }
+        iasubopt_dereference(&iaaddr, MDL);
+    }
+    if (pool->num_active != 255) {
+        atf_tc_fail("ERROR: bad num_active %s:%d", MDL);
+    }
+    ds.len = sprintf(uid, "one too many");
+    iaaddr = NULL;
+    if (create_lease6(pool, &iaaddr, &attempts,
+                      &ds, 42) != ISC_R_NORESOURCES) {
+        atf_tc_fail("ERROR: create_lease6() %s:%d", MDL);
+    }
+
+    /* a released address is found again */
+    if (release_lease6(pool, freed) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: release_lease6() %s:%d", MDL);
+    }
+    if (create_lease6(pool, &iaaddr, &attempts,
+                      &ds, 42) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: create_lease6() %s:%d", MDL);
+    }
+    if (memcmp(&iaaddr->addr, &freed->addr, sizeof(addr)) != 0) {
+        atf_tc_fail("ERROR: released address not reused %s:%d", MDL);
+    }
+    iasubopt_dereference(&iaaddr, MDL);
+    iasubopt_dereference(&freed, MDL);
+    if (ipv6_pool_dereference(&pool, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ipv6_pool_dereference() %s:%d", MDL);
+    }
+
+    /* a /48 delegated as /56s */
+    inet_pton(AF_INET6, "2001:db8::", &addr);
+    if (ipv6_pool_allocate(&pool, D6O_IA_PD, &addr,
+                           48, 56, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+    for (i = 0; i < 256; i++) {
+        ds.len = sprintf(uid, "router%d", i);
+        iaaddr = NULL;
+        if (create_prefix6(pool, &iaaddr, &attempts,
+                           &ds, 42) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: create_prefix6() %d %s:%d", i, MDL);
+        }
+        if (renew_lease6(pool, iaaddr) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+        }
+        iasubopt_dereference(&iaaddr, MDL);
+    }
+    if (create_prefix6(pool, &iaaddr, &attempts,
+                       &ds, 42) != ISC_R_NORESOURCES) {
+        atf_tc_fail("ERROR: create_prefix6() %s:%d", MDL);
+    }
+    if (ipv6_pool_dereference(&pool, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ipv6_pool_dereference() %s:%d", MDL);
+    }
+}
+
+ATF_TC(prefix_tree);
+ATF_TC_HEAD(prefix_tree, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that prefix "
+                      "pools of different lengths over the same range "
+                      "share their free space.");
+}
+ATF_TC_BODY(prefix_tree, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *pool56, *pool60, *pool;
+    struct iasubopt *iapref, *small[16];
+    struct data_string ds;
+    unsigned int attempts;
+    char uid[32];
+    int i;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+
+    memset(&ds, 0, sizeof(ds));
+    ds.data = (const unsigned char *)uid;
+
+    /* a /48 delegated as both /56s and /60s */
+    inet_pton(AF_INET6, "2001:db8::", &addr);
+    pool56 = pool60 = NULL;
+    if ((ipv6_pool_allocate(&pool56, D6O_IA_PD, &addr,
+                            48, 56, MDL) != ISC_R_SUCCESS) ||
+        (ipv6_pool_allocate(&pool60, D6O_IA_PD, &addr,
+                            48, 60, MDL) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+    if ((add_ipv6_pool(pool56) != ISC_R_SUCCESS) ||
+        (add_ipv6_pool(pool60) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: add_ipv6_pool() %s:%d", MDL);
+    }
+    if ((pool56->prefix_tree == NULL) ||
+        (pool56->prefix_tree != pool60->prefix_tree)) {
+        atf_tc_fail("ERROR: prefix tree not shared %s:%d", MDL);
+    }
+
+    /* the /60s are packed into one /56 */
+    for (i = 0; i < 16; i++) {
+        ds.len = sprintf(uid, "small%d", i);
+        small[i] = NULL;
+        if (create_prefix6(pool60, &small[i], &attempts,
+                           &ds, 42) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: create_prefix6() %d %s:%d", i, MDL);
+        }
+        if (renew_lease6(pool60, small[i]) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+        }
+        if (memcmp(&small[i]->addr, &small[0]->addr, 7) != 0) {
+            atf_tc_fail("ERROR: /60 outside the first /56 %s:%d", MDL);
+        }
+    }
+
+    /* which leaves 255 /56s */
+    for (i = 0; i < 255; i++) {
+        ds.len = sprintf(uid, "large%d", i);
+        iapref = NULL;
+        if (create_prefix6(pool56, &iapref, &attempts,
+                           &ds, 42) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: create_prefix6() %d %s:%d", i, MDL);
+        }
+        if (renew_lease6(pool56, iapref) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+        }
+        if (memcmp(&iapref->addr, &small[0]->addr, 7) == 0) {
+            atf_tc_fail("ERROR: /56 over the /60s %s:%d", MDL);
+        }
+        iasubopt_dereference(&iapref, MDL);
+    }
+    ds.len = sprintf(uid, "one too many");
+    if (create_prefix6(pool56, &iapref, &attempts,
+                       &ds, 42) != ISC_R_NORESOURCES) {
+        atf_tc_fail("ERROR: create_prefix6() %s:%d", MDL);
+    }
+    if (create_prefix6(pool60, &iapref, &attempts,
+                       &ds, 42) != ISC_R_NORESOURCES) {
+        atf_tc_fail("ERROR: create_prefix6() %s:%d", MDL);
+    }
+
+    /* the /56 comes back only once all of its /60s are free */
+    for (i = 0; i < 16; i++) {
+        if (release_lease6(pool60, small[i]) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: release_lease6() %s:%d", MDL);
+        }
+        if ((create_prefix6(pool56, &iapref, &attempts,
+                            &ds, 42) == ISC_R_SUCCESS) != (i == 15)) {
+            atf_tc_fail("ERROR: create_prefix6() %d %s:%d", i, MDL);
+        }
+    }
+    if (memcmp(&iapref->addr, &small[0]->addr, 7) != 0) {
+        atf_tc_fail("ERROR: freed /56 not reused %s:%d", MDL);
+    }
+    iasubopt_dereference(&iapref, MDL);
+    for (i = 0; i < 16; i++) {
+        iasubopt_dereference(&small[i], MDL);
+    }
+
+    /* prefixes map back to the pool of their own length */
+    pool = NULL;
+    if ((find_ipv6_prefix_pool(&pool, &addr, 60) != ISC_R_SUCCESS) ||
+        (pool != pool60)) {
+        atf_tc_fail("ERROR: find_ipv6_prefix_pool() %s:%d", MDL);
+    }
+    ipv6_pool_dereference(&pool, MDL);
+    if (find_ipv6_prefix_pool(&pool, &addr, 64) != ISC_R_NOTFOUND) {
+        atf_tc_fail("ERROR: find_ipv6_prefix_pool() %s:%d", MDL);
+    }
+
+    ipv6_pool_dereference(&pool56, MDL);
+    ipv6_pool_dereference(&pool60, MDL);
+}
+
+ATF_TC(prefix_overlap);
+ATF_TC_HEAD(prefix_overlap, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that prefixes "
+                      "loaded over each other keep their space until the "
+                      "last of them is gone.");
+}
+ATF_TC_BODY(prefix_overlap, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *pool56, *pool60;
+    struct iasubopt *large, *small, *iapref;
+    struct data_string ds;
+    unsigned int attempts;
+    char uid[32];
+    int i;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+
+    memset(&ds, 0, sizeof(ds));
+    ds.data = (const unsigned char *)uid;
+
+    /* a /52 delegated as both /56s and /60s */
+    inet_pton(AF_INET6, "2001:db8::", &addr);
+    pool56 = pool60 = NULL;
+    if ((ipv6_pool_allocate(&pool56, D6O_IA_PD, &addr,
+                            52, 56, MDL) != ISC_R_SUCCESS) ||
+        (ipv6_pool_allocate(&pool60, D6O_IA_PD, &addr,
+                            52, 60, MDL) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+    if ((add_ipv6_pool(pool56) != ISC_R_SUCCESS) ||
+        (add_ipv6_pool(pool60) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: add_ipv6_pool() %s:%d", MDL);
+    }
+
+    /* load a /56 and then a /60 inside it, as from a lease file */
+    large = small = NULL;
+    if ((iasubopt_allocate(&large, MDL) != ISC_R_SUCCESS) ||
+        (iasubopt_allocate(&small, MDL) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: iasubopt_allocate() %s:%d", MDL);
+    }
+    inet_pton(AF_INET6, "2001:db8:0:100::", &large->addr);
+    large->plen = 56;
+    large->state = FTS_ACTIVE;
+    inet_pton(AF_INET6, "2001:db8:0:110::", &small->addr);
+    small->plen = 60;
+    small->state = FTS_ACTIVE;
+    if ((add_lease6(pool56, large, 1000) != ISC_R_SUCCESS) ||
+        (add_lease6(pool60, small, 1000) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: add_lease6() %s:%d", MDL);
+    }
+
+    /* giving the /56 back leaves the /60 delegated */
+    if (release_lease6(pool56, large) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: release_lease6() %s:%d", MDL);
+    }
+    for (i = 0; i < 15; i++) {
+        ds.len = sprintf(uid, "large%d", i);
+        iapref = NULL;
+        if (create_prefix6(pool56, &iapref, &attempts,
+                           &ds, 42) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: create_prefix6() %d %s:%d", i, MDL);
+        }
+        if (renew_lease6(pool56, iapref) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+        }
+        if (memcmp(&iapref->addr, &large->addr, 7) == 0) {
+            atf_tc_fail("ERROR: /56 over the /60 %s:%d", MDL);
+        }
+        iasubopt_dereference(&iapref, MDL);
+    }
+    ds.len = sprintf(uid, "one too many");
+    if (create_prefix6(pool56, &iapref, &attempts,
+                       &ds, 42) != ISC_R_NORESOURCES) {
+        atf_tc_fail("ERROR: create_prefix6() %s:%d", MDL);
+    }
+
+    /* the rest of the /56 still goes to /60s */
+    ds.len = sprintf(uid, "small");
+    if (create_prefix6(pool60, &iapref, &attempts,
+                       &ds, 42) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: create_prefix6() %s:%d", MDL);
+    }
+    if ((memcmp(&iapref->addr, &large->addr, 7) != 0) ||
+        (memcmp(&iapref->addr, &small->addr, 8) == 0)) {
+        atf_tc_fail("ERROR: /60 not packed beside the loaded one %s:%d",
+                    MDL);
+    }
+    if (renew_lease6(pool60, iapref) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+    }
+
+    /* and the /56 comes back once both /60s are gone */
+    if ((release_lease6(pool60, small) != ISC_R_SUCCESS) ||
+        (release_lease6(pool60, iapref) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: release_lease6() %s:%d", MDL);
+    }
+    iasubopt_dereference(&iapref, MDL);
+    ds.len = sprintf(uid, "one too many");
+    if (create_prefix6(pool56, &iapref, &attempts,
+                       &ds, 42) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: create_prefix6() %s:%d", MDL);
+    }
+    if (memcmp(&iapref->addr, &large->addr, 7) != 0) {
+        atf_tc_fail("ERROR: freed /56 not reused %s:%d", MDL);
+    }
+    iasubopt_dereference(&iapref, MDL);
+    iasubopt_dereference(&large, MDL);
+    iasubopt_dereference(&small, MDL);
+
+    ipv6_pool_dereference(&pool56, MDL);
+    ipv6_pool_dereference(&pool60, MDL);
+}
+
+ATF_TC(pond_order);
+ATF_TC_HEAD(pond_order, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that the pools "
+                      "of a pond are put in order of free capacity.");
+}
+ATF_TC_BODY(pond_order, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pond *pond;
+    struct ipv6_pool *pools[4];
+    static const int bits[4] = { 124, 120, 122, 124 };
+    int i;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+
+    pond = NULL;
+    if (ipv6_pond_allocate(&pond, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ipv6_pond_allocate() %s:%d", MDL);
+    }
+    pond->ipv6_pools = dmalloc(5 * sizeof(*pond->ipv6_pools), MDL);
+    inet_pton(AF_INET6, "1:2:3:4::", &addr);
+    for (i = 0; i < 4; i++) {
+        pools[i] = NULL;
+        addr.s6_addr[14] = i;
+        if (ipv6_pool_allocate(&pools[i], D6O_IA_NA, &addr,
+                               bits[i], 128, MDL) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+        }
+        pond->ipv6_pools[i] = pools[i];
+    }
+
+    /* 16, 256, 64 and 16 free */
+    if ((ipv6_pool_free(pools[0]) != 16) ||
+        (ipv6_pool_free(pools[1]) != 256)) {
+        atf_tc_fail("ERROR: wrong free count %s:%d", MDL);
+    }
+    ipv6_pond_order_pools(pond);
+    if ((pond->ipv6_pools[0] != pools[1]) ||
+        (pond->ipv6_pools[1] != pools[2]) ||
+        (pond->ipv6_pools[2] != pools[0]) ||
+        (pond->ipv6_pools[3] != pools[3]) ||
+        (pond->ipv6_pools[4] != NULL)) {
+        atf_tc_fail("ERROR: pools out of order %s:%d", MDL);
+    }
+
+    /* fill up the biggest and part of the first /124 */
+    pools[1]->num_active = 256;
+    pools[0]->num_active = 10;
+    ipv6_pond_order_pools(pond);
+    if ((ipv6_pool_free(pools[1]) != 0) ||
+        (pond->ipv6_pools[0] != pools[2]) ||
+        (pond->ipv6_pools[1] != pools[3]) ||
+        (pond->ipv6_pools[2] != pools[0]) ||
+        (pond->ipv6_pools[3] != pools[1])) {
+        atf_tc_fail("ERROR: pools out of order %s:%d", MDL);
+    }
+
+    for (i = 0; i < 4; i++) {
+        pools[i]->num_active = 0;
+        ipv6_pool_dereference(&pools[i], MDL);
+    }
+    dfree(pond->ipv6_pools, MDL);
+    pond->ipv6_pools = NULL;
+    ipv6_pond_dereference(&pond, MDL);
+}
+
 /*
  * Address to pool mapping.
  * Verify that we find the proper pool for an address
@@ -955,6 +1698,449 @@ ATF_TC_BODY(many_pools, tc)
     }
 }
 
+/*
+ * Look up a pool6 object over OMAPI by address, and by prefix-length
+ * as well if plen is not 0.
+ */
+static isc_result_t
+pool6_lookup(omapi_object_t **pool6, const char *addr, int plen)
+{
+    omapi_object_t *ref;
+    omapi_typed_data_t *td;
+    struct in6_addr a;
+    isc_result_t status;
+
+    ref = NULL;
+    if (omapi_generic_new(&ref, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: omapi_generic_new() %s:%d", MDL);
+    }
+    if (addr != NULL) {
+        inet_pton(AF_INET6, addr, &a);
+        td = NULL;
+        if (omapi_typed_data_new(MDL, &td, omapi_datatype_data,
+                                 sizeof(a)) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: omapi_typed_data_new() %s:%d", MDL);
+        }
+        memcpy(td->u.buffer.value, &a, sizeof(a));
+        if (omapi_set_value_str(ref, NULL, "address", td) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: omapi_set_value_str() %s:%d", MDL);
+        }
+        omapi_typed_data_dereference(&td, MDL);
+    }
+    if ((plen != 0) &&
+        (omapi_set_int_value(ref, NULL, "prefix-length",
+                             plen) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: omapi_set_int_value() %s:%d", MDL);
+    }
+    status = dhcp_pool6_lookup(pool6, NULL, ref);
+    omapi_object_dereference(&ref, MDL);
+    return status;
+}
+
+ATF_TC(pool6_lookup);
+ATF_TC_HEAD(pool6_lookup, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that a pool6 "
+                      "object is found by an address in an address pool, "
+                      "or by an address and prefix-length in a prefix "
+                      "pool.");
+}
+ATF_TC_BODY(pool6_lookup, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *na_pool, *pd_pool;
+    omapi_object_t *pool6, *again;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+    if (omapi_init() != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: omapi_init() %s:%d", MDL);
+    }
+    dhcp_db_objects_setup();
+
+    /* an address pool and a pool of /56s */
+    inet_pton(AF_INET6, "1:2:3:4::", &addr);
+    na_pool = NULL;
+    if ((ipv6_pool_allocate(&na_pool, D6O_IA_NA, &addr,
+                            64, 128, MDL) != ISC_R_SUCCESS) ||
+        (add_ipv6_pool(na_pool) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+    inet_pton(AF_INET6, "2001:db8::", &addr);
+    pd_pool = NULL;
+    if ((ipv6_pool_allocate(&pd_pool, D6O_IA_PD, &addr,
+                            48, 56, MDL) != ISC_R_SUCCESS) ||
+        (add_ipv6_pool(pd_pool) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+
+    /* any address in the pool finds it, and always the same object */
+    pool6 = NULL;
+    if ((pool6_lookup(&pool6, "1:2:3:4::1234", 0) != ISC_R_SUCCESS) ||
+        (pool6->type != dhcp_type_pool6) ||
+        (((struct pool6_object *)pool6)->ipv6_pool != na_pool)) {
+        atf_tc_fail("ERROR: address pool not found %s:%d", MDL);
+    }
+    again = NULL;
+    if ((pool6_lookup(&again, "1:2:3:4:ffff:ffff:ffff:ffff",
+                      0) != ISC_R_SUCCESS) ||
+        (again != pool6)) {
+        atf_tc_fail("ERROR: second lookup %s:%d", MDL);
+    }
+    omapi_object_dereference(&again, MDL);
+    omapi_object_dereference(&pool6, MDL);
+
+    /* a prefix pool needs its prefix-length */
+    if ((pool6_lookup(&pool6, "2001:db8:0:1200::", 56) != ISC_R_SUCCESS) ||
+        (((struct pool6_object *)pool6)->ipv6_pool != pd_pool)) {
+        atf_tc_fail("ERROR: prefix pool not found %s:%d", MDL);
+    }
+    omapi_object_dereference(&pool6, MDL);
+    if (pool6_lookup(&pool6, "2001:db8:0:1200::", 0) != ISC_R_NOTFOUND) {
+        atf_tc_fail("ERROR: prefix pool found by address %s:%d", MDL);
+    }
+    if (pool6_lookup(&pool6, "2001:db8:0:1200::", 60) != ISC_R_NOTFOUND) {
+        atf_tc_fail("ERROR: prefix pool found by length 60 %s:%d", MDL);
+    }
+    if (pool6_lookup(&pool6, "2001:db8:0:1200::", 129) != ISC_R_NOTFOUND) {
+        atf_tc_fail("ERROR: prefix-length 129 %s:%d", MDL);
+    }
+
+    /* outside every pool, or no address at all */
+    if (pool6_lookup(&pool6, "1:2:3:5::", 0) != ISC_R_NOTFOUND) {
+        atf_tc_fail("ERROR: found outside the pools %s:%d", MDL);
+    }
+    if (pool6_lookup(&pool6, NULL, 56) != DHCP_R_NOKEYS) {
+        atf_tc_fail("ERROR: found without an address %s:%d", MDL);
+    }
+
+    ipv6_pool_dereference(&na_pool, MDL);
+    ipv6_pool_dereference(&pd_pool, MDL);
+}
+
+/*
+ * Count the records starting with prefix in the lease file from off on.
+ */
+static int
+lease_file_count(long off, const char *prefix)
+{
+    FILE *f;
+    char line[1024];
+    int count;
+
+    f = fopen(path_dhcpd_db, "r");
+    if (f == NULL) {
+        atf_tc_fail("ERROR: can't open %s %s:%d", path_dhcpd_db, MDL);
+    }
+    fseek(f, off, SEEK_SET);
+    count = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, prefix, strlen(prefix)) == 0) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+/*
+ * Run the first timeout due, which must be for what, and only that one.
+ */
+static void
+run_one_timeout(void *what)
+{
+    struct timeout *t;
+
+    t = timeouts;
+    if ((t == NULL) || (t->what != what)) {
+        atf_tc_fail("ERROR: no timeout %s:%d", MDL);
+    }
+    timeouts = t->next;
+    (*t->func)(t->what);
+    if (t->unref) {
+        (*t->unref)(&t->what, MDL);
+    }
+}
+
+ATF_TC(pool_drain);
+ATF_TC_HEAD(pool_drain, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that draining "
+                      "a pool shortens its bindings a slice at a time, "
+                      "writes each IA once, leaves abandoned bindings "
+                      "alone and can only be brought forward.");
+}
+ATF_TC_BODY(pool_drain, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *pool;
+    struct ia_xx *ia;
+    struct iasubopt *iaaddr, **all;
+    struct data_string ds;
+    unsigned int attempts;
+    char uid[32], buf[64];
+    time_t end;
+    long off;
+    int i, j, n;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+    local_family = AF_INET6;
+    path_dhcpd_db = "drain.leases";
+    time(&cur_time);
+    cur_tv.tv_sec = cur_time;
+    cur_tv.tv_usec = 0;
+    if (!ia_new_hash(&ia_na_active, DEFAULT_HASH_SIZE, MDL) ||
+        !ia_new_hash(&ia_ta_active, DEFAULT_HASH_SIZE, MDL) ||
+        !ia_new_hash(&ia_pd_active, DEFAULT_HASH_SIZE, MDL)) {
+        atf_tc_fail("ERROR: ia_new_hash() %s:%d", MDL);
+    }
+
+    memset(&ds, 0, sizeof(ds));
+    ds.data = (const unsigned char *)uid;
+
+    inet_pton(AF_INET6, "1:2:3:4::", &addr);
+    pool = NULL;
+    if ((ipv6_pool_allocate(&pool, D6O_IA_NA, &addr,
+                            64, 128, MDL) != ISC_R_SUCCESS) ||
+        (add_ipv6_pool(pool) != ISC_R_SUCCESS)) {
+        atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+    }
+
+    /* more IAs of two addresses each than fit in one slice */
+    n = V6_DRAIN_SLICE / 2 + 100;
+    all = dmalloc(2 * (n + 1) * sizeof(*all), MDL);
+    for (i = 0; i <= n; i++) {
+        ia = NULL;
+        if (ia_allocate(&ia, i, "client0", 7, MDL) != ISC_R_SUCCESS) {
+            atf_tc_fail("ERROR: ia_allocate() %s:%d", MDL);
+        }
+        ia->ia_type = D6O_IA_NA;
+        for (j = 0; j < 2; j++) {
+            ds.len = sprintf(uid, "client%d.%d", i, j);
+            iaaddr = NULL;
+            if (create_lease6(pool, &iaaddr, &attempts, &ds,
+                              cur_time + 3600) != ISC_R_SUCCESS) {
+                atf_tc_fail("ERROR: create_lease6() %s:%d", MDL);
+            }
+            renew_times(pool, iaaddr, 3600);
+            ia_add_iasubopt(ia, iaaddr, MDL);
+            ia_reference(&iaaddr->ia, ia, MDL);
+            /* the last IA holds an abandoned address */
+            if ((i == n) && (j == 1) &&
+                (decline_lease6(pool, iaaddr) != ISC_R_SUCCESS)) {
+                atf_tc_fail("ERROR: decline_lease6() %s:%d", MDL);
+            }
+            all[2 * i + j] = iaaddr;
+        }
+        ia->cltt = cur_time;
+        ia_active_add(ia_na_active, ia, MDL);
+        ia_dereference(&ia, MDL);
+    }
+    fclose(fopen(path_dhcpd_db, "w"));
+    db_startup(0);
+    off = lease_file_tail(0, buf, sizeof(buf));
+
+    /* the list leaves out the abandoned address */
+    if (ipv6_pool_drain(pool, 600) != ISC_R_SUCCESS) {
+        atf_tc_fail("ERROR: ipv6_pool_drain() %s:%d", MDL);
+    }
+    end = cur_time + 600;
+    if ((pool->drain_end != end) ||
+        (pool->drain_count != 2 * n + 1) || (pool->drain_next != 0)) {
+        atf_tc_fail("ERROR: drain list of %u %s:%d",
+                    pool->drain_count, MDL);
+    }
+
+    /* the first slice stops short, and the drain can't be put back */
+    run_one_timeout(pool);
+    if ((pool->drain_next != V6_DRAIN_SLICE) || (pool->drain_list == NULL)) {
+        atf_tc_fail("ERROR: first slice did %u %s:%d",
+                    pool->drain_next, MDL);
+    }
+    if (ipv6_pool_drain(pool, 1200) != DHCP_R_INVALIDARG) {
+        atf_tc_fail("ERROR: drain put back %s:%d", MDL);
+    }
+    if (ipv6_pool_drain(pool, 300) != ISC_R_INPROGRESS) {
+        atf_tc_fail("ERROR: drain restarted %s:%d", MDL);
+    }
+    run_one_timeout(pool);
+    if (pool->drain_list != NULL) {
+        atf_tc_fail("ERROR: drain not finished %s:%d", MDL);
+    }
+
+    /* every IA was written once, with its live addresses shortened */
+    if (lease_file_count(off, "ia-na ") != n + 1) {
+        atf_tc_fail("ERROR: %d IA records for %d IAs %s:%d",
+                    lease_file_count(off, "ia-na "), n + 1, MDL);
+    }
+    for (i = 0; i < 2 * n + 1; i++) {
+        if ((all[i]->hard_lifetime_end_time != end) ||
+            (all[i]->prefer != 0) || (all[i]->valid > 600)) {
+            atf_tc_fail("ERROR: address %d not shortened %s:%d", i, MDL);
+        }
+    }
+    if ((all[2 * n + 1]->state != FTS_ABANDONED) ||
+        (all[2 * n + 1]->hard_lifetime_end_time != MAX_TIME)) {
+        atf_tc_fail("ERROR: abandoned address drained %s:%d", MDL);
+    }
+
+    /* a finished drain can still be brought forward */
+    if ((ipv6_pool_drain(pool, 1200) != DHCP_R_INVALIDARG) ||
+        (ipv6_pool_drain(pool, 300) != ISC_R_SUCCESS) ||
+        (pool->drain_end != cur_time + 300)) {
+        atf_tc_fail("ERROR: drain not brought forward %s:%d", MDL);
+    }
+    run_one_timeout(pool);
+
+    for (i = 0; i < 2 * n + 2; i++) {
+        iasubopt_dereference(&all[i], MDL);
+    }
+    dfree(all, MDL);
+    ipv6_pool_dereference(&pool, MDL);
+}
+
+ATF_TC(expire_slices);
+ATF_TC_HEAD(expire_slices, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "This test case checks that the expiry "
+                      "timer works through due pools in order, one slice "
+                      "of leases at a time.");
+}
+ATF_TC_BODY(expire_slices, tc)
+{
+    struct in6_addr addr;
+    struct ipv6_pool *pools[2];
+    struct ia_xx *ia;
+    struct iasubopt *iaaddr, **all;
+    struct data_string ds;
+    unsigned int attempts;
+    char uid[32], buf[64];
+    time_t end;
+    long off;
+    int i, p, n, first;
+
+    /* set up dhcp globals */
+    dhcp_context_create(DHCP_CONTEXT_PRE_DB | DHCP_CONTEXT_POST_DB,
+			NULL, NULL);
+    local_family = AF_INET6;
+    path_dhcpd_db = "expire.leases";
+    time(&cur_time);
+    cur_tv.tv_sec = cur_time;
+    cur_tv.tv_usec = 0;
+
+    memset(&ds, 0, sizeof(ds));
+    ds.data = (const unsigned char *)uid;
+
+    /*
+     * Two pools with more leases due between them than fit in a
+     * slice.  Those of the first pool are due earlier; those of the
+     * second fall due in an order other than the one they were made in.
+     */
+    n = V6_EXPIRY_SLICE * 4 / 5;
+    all = dmalloc(2 * n * sizeof(*all), MDL);
+    inet_pton(AF_INET6, "1:2:3:4::", &addr);
+    for (p = 0; p < 2; p++) {
+        pools[p] = NULL;
+        addr.s6_addr[7] = p;
+        if ((ipv6_pool_allocate(&pools[p], D6O_IA_NA, &addr,
+                                64, 128, MDL) != ISC_R_SUCCESS) ||
+            (add_ipv6_pool(pools[p]) != ISC_R_SUCCESS)) {
+            atf_tc_fail("ERROR: ipv6_pool_allocate() %s:%d", MDL);
+        }
+        for (i = 0; i < n; i++) {
+            ia = NULL;
+            if (ia_allocate(&ia, p * n + i, "client0", 7,
+                            MDL) != ISC_R_SUCCESS) {
+                atf_tc_fail("ERROR: ia_allocate() %s:%d", MDL);
+            }
+            ia->ia_type = D6O_IA_NA;
+            ds.len = sprintf(uid, "client%d.%d", p, i);
+            iaaddr = NULL;
+            if (create_lease6(pools[p], &iaaddr, &attempts, &ds,
+                              cur_time + 3600) != ISC_R_SUCCESS) {
+                atf_tc_fail("ERROR: create_lease6() %s:%d", MDL);
+            }
+            if (p == 0) {
+                end = cur_time - 2000 + i;
+            } else {
+                end = cur_time - 1000 + (i * 7) % n;
+            }
+            iaaddr->prefer = 300;
+            iaaddr->valid = 600;
+            iaaddr->soft_lifetime_end_time = end;
+            if (renew_lease6(pools[p], iaaddr) != ISC_R_SUCCESS) {
+                atf_tc_fail("ERROR: renew_lease6() %s:%d", MDL);
+            }
+            ia_add_iasubopt(ia, iaaddr, MDL);
+            ia_reference(&iaaddr->ia, ia, MDL);
+            ia_dereference(&ia, MDL);
+            all[p * n + i] = iaaddr;
+        }
+    }
+    fclose(fopen(path_dhcpd_db, "w"));
+    db_startup(0);
+    off = lease_file_tail(0, buf, sizeof(buf));
+    schedule_lease_timeout(pools[1]);
+    schedule_lease_timeout(pools[0]);
+
+    /*
+     * The first slice expires all of the first pool and, with what is
+     * left of it less the step taken for that pool, the earliest due
+     * leases of the second.
+     */
+    first = V6_EXPIRY_SLICE - n - 1;
+    run_one_timeout(NULL);
+    if ((pools[0]->num_active != 0) || (pools[0]->num_inactive != n) ||
+        (pools[1]->num_active != n - first) ||
+        (pools[1]->num_inactive != first)) {
+        atf_tc_fail("ERROR: first slice left %d and %d active %s:%d",
+                    (int)pools[0]->num_active, (int)pools[1]->num_active,
+                    MDL);
+    }
+    for (i = 0; i < n; i++) {
+        if ((all[n + i]->state == FTS_EXPIRED) !=
+            ((i * 7) % n < first)) {
+            atf_tc_fail("ERROR: lease %d expired out of order %s:%d",
+                        i, MDL);
+        }
+    }
+    if (lease_file_count(off, "ia-na ") != V6_EXPIRY_SLICE - 1) {
+        atf_tc_fail("ERROR: %d IA records after the first slice %s:%d",
+                    lease_file_count(off, "ia-na "), MDL);
+    }
+
+    /* the rest are due now, so the timer goes off again straight away */
+    if ((timeouts == NULL) || (timeouts->when.tv_sec != cur_time)) {
+        atf_tc_fail("ERROR: second slice not due %s:%d", MDL);
+    }
+    run_one_timeout(NULL);
+    if ((pools[1]->num_active != 0) || (pools[1]->num_inactive != n)) {
+        atf_tc_fail("ERROR: second slice left %d active %s:%d",
+                    (int)pools[1]->num_active, MDL);
+    }
+    if (lease_file_count(off, "ia-na ") != 2 * n) {
+        atf_tc_fail("ERROR: %d IA records for %d leases %s:%d",
+                    lease_file_count(off, "ia-na "), 2 * n, MDL);
+    }
+
+    /* and nothing is due until the first expired leases are cleaned up */
+    if ((timeouts == NULL) ||
+        (timeouts->when.tv_sec !=
+         all[0]->hard_lifetime_end_time + EXPIRED_IPV6_CLEANUP_TIME)) {
+        atf_tc_fail("ERROR: cleanup not scheduled %s:%d", MDL);
+    }
+
+    for (i = 0; i < 2 * n; i++) {
+        iasubopt_dereference(&all[i], MDL);
+    }
+    dfree(all, MDL);
+    ipv6_pool_dereference(&pools[0], MDL);
+    ipv6_pool_dereference(&pools[1], MDL);
+}
+
 ATF_TP_ADD_TCS(tp)
 {
     ATF_TP_ADD_TC(tp, iaaddr_basic);
@@ -962,12 +2148,21 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, ia_na_basic);
     ATF_TP_ADD_TC(tp, ia_na_manyaddrs);
     ATF_TP_ADD_TC(tp, ia_na_negative);
+    ATF_TP_ADD_TC(tp, duid_index);
+    ATF_TP_ADD_TC(tp, ia_renew_record);
     ATF_TP_ADD_TC(tp, ipv6_pool_basic);
     ATF_TP_ADD_TC(tp, ipv6_pool_negative);
     ATF_TP_ADD_TC(tp, expire_order);
     ATF_TP_ADD_TC(tp, expire_order_reduce);
     ATF_TP_ADD_TC(tp, small_pool);
+    ATF_TP_ADD_TC(tp, pool_map);
+    ATF_TP_ADD_TC(tp, prefix_tree);
+    ATF_TP_ADD_TC(tp, prefix_overlap);
+    ATF_TP_ADD_TC(tp, pond_order);
     ATF_TP_ADD_TC(tp, many_pools);
+    ATF_TP_ADD_TC(tp, pool6_lookup);
+    ATF_TP_ADD_TC(tp, pool_drain);
+    ATF_TP_ADD_TC(tp, expire_slices);
 
     return (atf_no_error());
 }
@@ -112,12 +112,693 @@ ATF_TC_BODY(parse_byte_order, tc)
 }
 #endif /*  DHCPv6 */
 
+ATF_TC(relay_ids);
+
+ATF_TC_HEAD(relay_ids, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the relay agent identifier "
+                      "index kept on packets.");
+}
+
+/* Parses a relay agent information option into a DHCPv4 packet and,
+   with DHCPv6, an interface-id into a relay-forward message, and checks
+   packet_relay_id() returns what was sent. */
+ATF_TC_BODY(relay_ids, tc)
+{
+    struct packet *packet = NULL;
+    struct data_string id;
+    unsigned char options[] = {
+        DHO_DHCP_AGENT_OPTIONS, 10,
+        RAI_CIRCUIT_ID, 3, 'e', 't', '0',
+        RAI_REMOTE_ID, 3, 0x02, 0x00, 0x5e,
+        DHO_END
+    };
+#ifdef DHCPv6
+    unsigned char options6[] = {
+        0, D6O_INTERFACE_ID, 0, 4, 'p', 'o', 'r', 't'
+    };
+#endif
+
+    initialize_common_option_spaces();
+    initialize_server_option_spaces();
+
+    if (!packet_allocate(&packet, MDL) ||
+        !option_state_allocate(&packet->options, MDL)) {
+        atf_tc_fail("can't allocate packet");
+    }
+    if (!parse_option_buffer(packet->options, options, sizeof(options),
+                             &dhcp_universe)) {
+        atf_tc_fail("can't parse options");
+    }
+
+    packet_index_relay_ids(packet);
+    if (!packet_relay_id(packet, RAI_CIRCUIT_ID, &id) ||
+        id.len != 3 || memcmp(id.data, "et0", 3) != 0) {
+        atf_tc_fail("circuit-id not indexed");
+    }
+    if (!packet_relay_id(packet, RAI_REMOTE_ID, &id) ||
+        id.len != 3 || memcmp(id.data, "\x02\x00\x5e", 3) != 0) {
+        atf_tc_fail("remote-id not indexed");
+    }
+    packet_dereference(&packet, MDL);
+
+#ifdef DHCPv6
+    if (!packet_allocate(&packet, MDL) ||
+        !option_state_allocate(&packet->options, MDL)) {
+        atf_tc_fail("can't allocate packet");
+    }
+    packet->dhcpv6_msg_type = DHCPV6_RELAY_FORW;
+    if (!parse_option_buffer(packet->options, options6, sizeof(options6),
+                             &dhcpv6_universe)) {
+        atf_tc_fail("can't parse v6 options");
+    }
+
+    packet_index_relay_ids(packet);
+    if (!packet_relay_id(packet, RAI_CIRCUIT_ID, &id) ||
+        id.len != 4 || memcmp(id.data, "port", 4) != 0) {
+        atf_tc_fail("interface-id not indexed");
+    }
+    if (packet_relay_id(packet, RAI_REMOTE_ID, &id)) {
+        atf_tc_fail("absent remote-id reported");
+    }
+    packet_dereference(&packet, MDL);
+#endif
+}
+
+ATF_TC(intern_strings);
+
+ATF_TC_HEAD(intern_strings, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the interned string table.");
+}
+
+/* Interns enough names to make the table grow, and checks equal names
+   share one copy that outlives all but its last reference. */
+ATF_TC_BODY(intern_strings, tc)
+{
+    char *names[300], *a, *b, *c;
+    char buf[32];
+    int i;
+
+    a = intern_string("host-a.example", 6, MDL);
+    b = intern_string("host-a", 6, MDL);
+    c = intern_string("host-b", 6, MDL);
+    if (a == NULL || b == NULL || c == NULL) {
+        atf_tc_fail("can't intern strings");
+    }
+    if (a != b || strcmp(a, "host-a") != 0) {
+        atf_tc_fail("equal strings not shared");
+    }
+    if (a == c) {
+        atf_tc_fail("different strings shared");
+    }
+    intern_string_release(&b, MDL);
+
+    for (i = 0; i < 300; i++) {
+        snprintf(buf, sizeof(buf), "client-%d", i);
+        names[i] = intern_string(buf, strlen(buf), MDL);
+    }
+    for (i = 0; i < 300; i++) {
+        snprintf(buf, sizeof(buf), "client-%d", i);
+        b = intern_string(buf, strlen(buf), MDL);
+        if (b != names[i] || strcmp(b, buf) != 0) {
+            atf_tc_fail("lost %s after the table grew", buf);
+        }
+        intern_string_release(&b, MDL);
+        intern_string_release(&names[i], MDL);
+        if (b != NULL || names[i] != NULL) {
+            atf_tc_fail("release didn't clear the pointer");
+        }
+    }
+
+    b = intern_string_reference(a);
+    intern_string_release(&a, MDL);
+    intern_string_release(&a, MDL);
+    if (strcmp(b, "host-a") != 0) {
+        atf_tc_fail("string freed while still referenced");
+    }
+    intern_string_release(&b, MDL);
+    intern_string_release(&c, MDL);
+}
+
+ATF_TC(lease_reuse);
+
+ATF_TC_HEAD(lease_reuse, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the dhcp-cache-threshold lease "
+                      "reuse decision and its counters.");
+}
+
+/* Sets dhcp-cache-threshold in the reply options. */
+static void
+set_cache_threshold(struct lease_state *state, u_int8_t thresh)
+{
+    struct option *option = NULL;
+    struct option_cache *oc = NULL;
+    unsigned code = SV_CACHE_THRESHOLD;
+
+    if (!option_code_hash_lookup(&option, server_universe.code_hash,
+                                 &code, 0, MDL) ||
+        !make_const_option_cache(&oc, NULL, &thresh, 1, option, MDL)) {
+        atf_tc_fail("can't make dhcp-cache-threshold");
+    }
+    save_option(&server_universe, state->options, oc);
+    option_cache_dereference(&oc, MDL);
+    option_dereference(&option, MDL);
+}
+
+/* Runs reuse_lease() and checks it came to the verdict expected. */
+static void
+check_reuse(struct lease *new_lease, struct lease *lease,
+            struct lease_state *state, int offer,
+            enum reuse_verdict want, int line)
+{
+    struct packet packet;
+    unsigned long before = reuse_verdict_counts[want];
+
+    memset(&packet, 0, sizeof(packet));
+    if ((reuse_lease(&packet, new_lease, lease, state, offer) !=
+         (want == REUSE_OK)) ||
+        (reuse_verdict_counts[want] != before + 1)) {
+        atf_tc_fail("verdict %d not reached at line %d", want, line);
+    }
+}
+
+/* Walks the decision table of reuse_lease() one test at a time, each
+   time breaking only that test, and checks the per-pool hits and
+   misses it counts. */
+ATF_TC_BODY(lease_reuse, tc)
+{
+    struct lease lease, new_lease;
+    struct lease_state state;
+    struct pool pool;
+    struct host_decl host;
+#if defined (FAILOVER_PROTOCOL)
+    dhcp_failover_state_t peer;
+#endif
+    char *hostname;
+
+    initialize_common_option_spaces();
+    initialize_server_option_spaces();
+    cur_time = 1000000;
+
+    memset(&pool, 0, sizeof(pool));
+    memset(&state, 0, sizeof(state));
+    if (!option_state_allocate(&state.options, MDL)) {
+        atf_tc_fail("can't allocate option state");
+    }
+    set_cache_threshold(&state, 25);
+
+    /* an active lease of 1000 seconds, renewed 100 seconds in */
+    memset(&lease, 0, sizeof(lease));
+    lease.binding_state = FTS_ACTIVE;
+    lease.starts = cur_time - 100;
+    lease.ends = cur_time + 900;
+    lease.pool = &pool;
+    lease.uid = lease.uid_buf;
+    lease.uid_len = 3;
+    memcpy(lease.uid_buf, "cid", 3);
+    lease.hardware_addr.hlen = 7;
+    memcpy(lease.hardware_addr.hbuf, "\x01\x02\x00\x5e\x00\x00\x01", 7);
+    new_lease = lease;
+    new_lease.uid = new_lease.uid_buf;
+    new_lease.starts = cur_time;
+    new_lease.ends = cur_time + 1000;
+
+    check_reuse(&new_lease, &lease, &state, DHCPACK, REUSE_OK, __LINE__);
+    if (state.offered_expiry != lease.ends) {
+        atf_tc_fail("expiry not restored");
+    }
+
+    /* a new hostname is carried over to the reused lease */
+    hostname = intern_string("client", 6, MDL);
+    LEASE_COLD(&new_lease)->client_hostname = intern_string_reference(hostname);
+    check_reuse(&new_lease, &lease, &state, DHCPACK, REUSE_OK, __LINE__);
+    if ((LEASE_COLD_RO(&lease)->client_hostname != hostname) ||
+        (LEASE_COLD_RO(&new_lease)->client_hostname != NULL)) {
+        atf_tc_fail("hostname not carried over");
+    }
+
+    /* (a) a lease disqualified on the OFFER, e.g. by a new hostname,
+       is not reused on the REQUEST, which clears the flag */
+    lease.cannot_reuse = 1;
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_DISQUALIFIED, __LINE__);
+    if (lease.cannot_reuse != 0) {
+        atf_tc_fail("cannot_reuse not cleared");
+    }
+
+    /* (b) */
+    lease.binding_state = FTS_FREE;
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_NOT_ACTIVE, __LINE__);
+    lease.binding_state = FTS_ACTIVE;
+
+    /* (c) comes before (d) */
+    LEASE_COLD(&new_lease)->ddns_cb = (struct dhcp_ddns_cb *)&host;
+    LEASE_COLD(&new_lease)->host = &host;
+    check_reuse(&new_lease, &lease, &state, DHCPACK, REUSE_DDNS, __LINE__);
+    new_lease.cold->ddns_cb = NULL;
+
+    /* (d) */
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_HOST_CHANGED, __LINE__);
+    new_lease.cold->host = NULL;
+
+    /* (e) */
+    new_lease.uid_buf[2] = 'x';
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_UID_CHANGED, __LINE__);
+    new_lease.uid_buf[2] = 'd';
+
+    /* (f) */
+    new_lease.hardware_addr.hbuf[6] = 2;
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_HW_CHANGED, __LINE__);
+    new_lease.hardware_addr.hbuf[6] = 1;
+
+    /* (g) */
+    set_cache_threshold(&state, 0);
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_DISABLED, __LINE__);
+    set_cache_threshold(&state, 25);
+
+    /* (h) 300 seconds is past 25% of the lease; a miss on an OFFER
+       disqualifies the ensuing REQUEST */
+    new_lease.starts = cur_time + 200;
+    check_reuse(&new_lease, &lease, &state, DHCPOFFER,
+                REUSE_TOO_OLD, __LINE__);
+    if (lease.cannot_reuse == 0) {
+        atf_tc_fail("cannot_reuse not set on an OFFER");
+    }
+    new_lease.starts = cur_time;
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_DISQUALIFIED, __LINE__);
+
+#if defined (FAILOVER_PROTOCOL)
+    /* (i) the expiry is 900 seconds out, past the MCLT of 300, and
+       reusable only once the peer has acknowledged it */
+    memset(&peer, 0, sizeof(peer));
+    peer.mclt = 300;
+    pool.failover_peer = &peer;
+    check_reuse(&new_lease, &lease, &state, DHCPACK,
+                REUSE_FAILOVER_MCLT, __LINE__);
+    lease.tsfp = lease.ends;
+    check_reuse(&new_lease, &lease, &state, DHCPACK, REUSE_OK, __LINE__);
+    pool.failover_peer = NULL;
+#endif
+
+    /* every decision was counted against the pool */
+#if defined (FAILOVER_PROTOCOL)
+    if ((pool.reuse_hits != 3) || (pool.reuse_misses != 10)) {
+#else
+    if ((pool.reuse_hits != 2) || (pool.reuse_misses != 9)) {
+#endif
+        atf_tc_fail("pool counted %lu hits, %lu misses",
+                    pool.reuse_hits, pool.reuse_misses);
+    }
+
+    intern_string_release(&hostname, MDL);
+    option_state_dereference(&state.options, MDL);
+}
+
 /* This macro defines main() method that will call specified
    test cases. tp and simple_test_case names can be whatever you want
    as long as it is a valid variable identifier. */
+/* Sets up the server's objects and reads a configuration into the
+   root group. */
+static void
+parse_test_conf(const char *conf)
+{
+    struct parse *cfile = NULL;
+
+    omapi_init();
+    dhcp_common_objects_setup();
+    dhcp_db_objects_setup();
+    initialize_common_option_spaces();
+    initialize_server_option_spaces();
+    if (!group_allocate(&root_group, MDL)) {
+        atf_tc_fail("can't allocate root group");
+    }
+    if ((new_parse(&cfile, -1, (char *)conf, strlen(conf),
+                   "test", 0) != ISC_R_SUCCESS) ||
+        (conf_file_subparse(cfile, root_group, ROOT_GROUP) !=
+         ISC_R_SUCCESS)) {
+        atf_tc_fail("can't parse configuration");
+    }
+    end_parse(&cfile);
+}
+
+ATF_TC(class_match);
+
+ATF_TC_HEAD(class_match, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the compiled class matcher "
+                      "against checking the classes one by one.");
+}
+
+/* Classes that compile into lookups (substring, option and hardware
+   comparisons and "or"s of them) are mixed with ones that do not, so
+   that the two kinds have to be merged in declaration order. */
+static const char class_match_conf[] =
+    "class \"vendor-a\" {\n"
+    "  match if substring (option vendor-class-identifier, 0, 4) = \"MSFT\";\n"
+    "}\n"
+    "class \"sequential-1\" {\n"
+    "  match if not (option host-name = \"x\");\n"
+    "}\n"
+    "class \"hardware\" {\n"
+    "  match if hardware = 01:00:11:22:33:44:55;\n"
+    "}\n"
+    "class \"relay\" {\n"
+    "  match if option agent.remote-id = \"r1\" or\n"
+    "           option agent.remote-id = \"r2\" or\n"
+    "           option host-name = \"h\";\n"
+    "}\n"
+    "class \"vendor\" {\n"
+    "  match option vendor-class-identifier;\n"
+    "}\n"
+    "subclass \"vendor\" \"MSFT 5.0\";\n"
+    "class \"vendor-b\" {\n"
+    "  match if \"MSFT\" = substring (option vendor-class-identifier, 0, 4);\n"
+    "}\n"
+    "class \"user\" {\n"
+    "  match if option user-class = \"u\";\n"
+    "}\n"
+    "class \"sequential-2\" {\n"
+    "  match if exists host-name or exists user-class;\n"
+    "}\n"
+    "class \"host\" {\n"
+    "  match if option host-name = \"h\";\n"
+    "}\n";
+
+/* Classifies a packet with the given options and hardware address both
+   ways, checks the two agree, and that the classes matched are the
+   expected ones, in order. */
+static void
+check_class_match(const unsigned char *options, unsigned len,
+                  unsigned char hw, const char *expected)
+{
+    struct packet *packet = NULL;
+    struct dhcp_packet raw;
+    struct class *classes[PACKET_MAX_CLASSES];
+    const char *name;
+    char names[256];
+    int matched, count, i;
+
+    memset(&raw, 0, sizeof(raw));
+    raw.htype = HTYPE_ETHER;
+    raw.hlen = 6;
+    memcpy(raw.chaddr, "\x00\x11\x22\x33\x44", 5);
+    raw.chaddr[5] = hw;
+    if (!packet_allocate(&packet, MDL) ||
+        !option_state_allocate(&packet->options, MDL)) {
+        atf_tc_fail("can't allocate packet");
+    }
+    packet->raw = &raw;
+    if (!parse_option_buffer(packet->options, options, len,
+                             &dhcp_universe)) {
+        atf_tc_fail("can't parse options for \"%s\"", expected);
+    }
+
+    matched = check_collection(packet, NULL, &default_collection);
+    if (default_collection.matcher == NULL) {
+        atf_tc_fail("classes not compiled");
+    }
+    names[0] = '\0';
+    count = packet->class_count;
+    for (i = 0; i < count; i++) {
+        name = packet->classes[i]->name;
+        if (name == NULL)
+            name = packet->classes[i]->superclass->name;
+        if (i != 0)
+            strcat(names, " ");
+        strcat(names, name);
+        classes[i] = NULL;
+        class_reference(&classes[i], packet->classes[i], MDL);
+        class_dereference(&packet->classes[i], MDL);
+    }
+    packet->class_count = 0;
+    if (strcmp(names, expected) != 0) {
+        atf_tc_fail("matched \"%s\", expected \"%s\"", names, expected);
+    }
+    if (matched != (count != 0)) {
+        atf_tc_fail("\"%s\" returned %d", expected, matched);
+    }
+
+    if ((check_classes(packet, NULL, default_collection.classes) !=
+         matched) || (packet->class_count != count)) {
+        atf_tc_fail("\"%s\" checked one by one matched %d classes",
+                    expected, packet->class_count);
+    }
+    for (i = 0; i < count; i++) {
+        if (packet->classes[i] != classes[i]) {
+            atf_tc_fail("\"%s\" class %d differs", expected, i);
+        }
+        class_dereference(&classes[i], MDL);
+    }
+    packet->raw = NULL;
+    packet_dereference(&packet, MDL);
+}
+
+ATF_TC_BODY(class_match, tc)
+{
+    unsigned char vendor[] = {
+        DHO_VENDOR_CLASS_IDENTIFIER, 8,
+        'M', 'S', 'F', 'T', ' ', '5', '.', '0',
+        DHO_END
+    };
+    unsigned char host[] = {
+        DHO_HOST_NAME, 1, 'h',
+        DHO_END
+    };
+    unsigned char relay[] = {
+        DHO_DHCP_AGENT_OPTIONS, 4,
+        RAI_REMOTE_ID, 2, 'r', '2',
+        DHO_END
+    };
+    unsigned char none[] = {
+        DHO_END
+    };
+    unsigned char user[] = {
+        DHO_VENDOR_CLASS_IDENTIFIER, 4, 'M', 'S', 'F', 'X',
+        DHO_USER_CLASS, 1, 'u',
+        DHO_HOST_NAME, 1, 'x',
+        DHO_END
+    };
+
+    parse_test_conf(class_match_conf);
+
+    /* substring and hardware equality, both operand orders and a
+       subclass, between the sequential classes */
+    check_class_match(vendor, sizeof(vendor), 0x55,
+                      "vendor-a sequential-1 hardware vendor vendor-b");
+
+    /* one option, looked up once, matching the end of an "or" chain
+       and a class of its own */
+    check_class_match(host, sizeof(host), 0x56,
+                      "sequential-1 relay sequential-2 host");
+
+    /* an encapsulated option further down an "or" chain */
+    check_class_match(relay, sizeof(relay), 0x56,
+                      "sequential-1 relay");
+
+    /* missing options match no comparison */
+    check_class_match(none, sizeof(none), 0x56, "sequential-1");
+
+    /* near misses on the hashed constants */
+    check_class_match(user, sizeof(user), 0x56, "user sequential-2");
+
+    /* and the matcher is rebuilt once it has been dropped */
+    class_match_invalidate();
+    if (default_collection.matcher != NULL) {
+        atf_tc_fail("matcher not dropped");
+    }
+    check_class_match(relay, sizeof(relay), 0x55,
+                      "sequential-1 hardware relay");
+}
+
+ATF_TC(link_network);
+
+ATF_TC_HEAD(link_network, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the cache of relay link "
+                      "networks.");
+}
+
+static const char link_network_conf[] =
+    "shared-network \"net-a\" {\n"
+    "  subnet 10.0.0.0 netmask 255.255.255.0 { }\n"
+    "  subnet 10.0.1.0 netmask 255.255.255.0 { }\n"
+    "}\n"
+    "subnet 10.1.0.0 netmask 255.255.0.0 { }\n";
+
+static struct iaddr
+link_addr(const char *text)
+{
+    struct iaddr ia;
+
+    ia.len = 4;
+    if (inet_pton(AF_INET, text, ia.iabuf) != 1) {
+        atf_tc_fail("bad address %s", text);
+    }
+    return ia;
+}
+
+/* Looks a link address up, returning the shared network it is on or
+   NULL; the cache and the subnets keep their own references. */
+static struct shared_network *
+link_network(const char *text)
+{
+    struct shared_network *share = NULL, *found;
+
+    if (!find_link_network(&share, link_addr(text), MDL)) {
+        if (share != NULL) {
+            atf_tc_fail("%s: shared network set on a miss", text);
+        }
+        return NULL;
+    }
+    found = share;
+    shared_network_dereference(&share, MDL);
+    return found;
+}
+
+/* Puts a subnet in front of the others, optionally without telling
+   the cache. */
+static void
+add_subnet(const char *net, const char *mask, struct shared_network *share,
+           int enter)
+{
+    struct subnet *subnet = NULL;
+
+    if (subnet_allocate(&subnet, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("can't allocate subnet");
+    }
+    subnet->net = link_addr(net);
+    subnet->netmask = link_addr(mask);
+    shared_network_reference(&subnet->shared_network, share, MDL);
+    if (enter) {
+        enter_subnet(subnet);
+    } else {
+        subnet_reference(&subnet->next_subnet, subnets, MDL);
+        subnet_dereference(&subnets, MDL);
+        subnet_reference(&subnets, subnet, MDL);
+    }
+    subnet_dereference(&subnet, MDL);
+}
+
+/* Enters a new, empty shared network. */
+static void
+add_shared_network(void)
+{
+    struct shared_network *share = NULL;
+
+    if (shared_network_allocate(&share, MDL) != ISC_R_SUCCESS) {
+        atf_tc_fail("can't allocate shared network");
+    }
+    enter_shared_network(share);
+    shared_network_dereference(&share, MDL);
+}
+
+/* Answers given while the subnets are hidden can only come from the
+   cache. */
+ATF_TC_BODY(link_network, tc)
+{
+    struct shared_network *net_a, *net_b;
+    struct subnet *hidden;
+    struct group *group = NULL;
+    char text[32];
+    int i, evicted;
+
+    parse_test_conf(link_network_conf);
+
+    net_a = link_network("10.0.0.1");
+    net_b = link_network("10.1.2.3");
+    if ((net_a == NULL) || (net_b == NULL) || (net_a == net_b) ||
+        (strcmp(net_a->name, "net-a") != 0)) {
+        atf_tc_fail("wrong shared networks");
+    }
+    if (link_network("10.0.1.7") != net_a) {
+        atf_tc_fail("second subnet of net-a not found");
+    }
+
+    /* a hit is remembered */
+    hidden = subnets;
+    subnets = NULL;
+    if (link_network("10.0.0.1") != net_a) {
+        atf_tc_fail("hit not cached");
+    }
+    subnets = hidden;
+
+    /* and so is a miss */
+    if (link_network("192.168.0.1") != NULL) {
+        atf_tc_fail("192.168.0.1 found");
+    }
+    add_subnet("192.168.0.0", "255.255.255.0", net_b, 0);
+    if (link_network("192.168.0.1") != NULL) {
+        atf_tc_fail("miss not cached");
+    }
+
+    /* other configuration changes leave the cache alone */
+    if (!group_allocate(&group, MDL)) {
+        atf_tc_fail("can't allocate group");
+    }
+    group_dereference(&group, MDL);
+    if (link_network("192.168.0.1") != NULL) {
+        atf_tc_fail("cache emptied by a group");
+    }
+
+    /* entering a shared network empties it */
+    hidden = subnets;
+    subnets = NULL;
+    add_shared_network();
+    if (link_network("10.0.0.1") != NULL) {
+        atf_tc_fail("cache kept over a new shared network");
+    }
+    subnets = hidden;
+
+    /* and so does entering a subnet */
+    add_subnet("172.16.0.0", "255.255.0.0", net_b, 1);
+    if ((link_network("192.168.0.1") != net_b) ||
+        (link_network("10.0.0.1") != net_a)) {
+        atf_tc_fail("cache kept over a new subnet");
+    }
+
+    /* find an address that takes the slot of 10.0.0.1 */
+    evicted = 0;
+    for (i = 0; (i < 65536) && !evicted; i++) {
+        sprintf(text, "10.1.%d.%d", i >> 8, i & 255);
+        if (link_network("10.0.0.1") != net_a) {
+            atf_tc_fail("10.0.0.1 lost");
+        }
+        hidden = subnets;
+        subnets = NULL;
+        (void) link_network(text);
+        evicted = (link_network("10.0.0.1") == NULL);
+        subnets = hidden;
+    }
+    if (!evicted) {
+        atf_tc_fail("no address shares a slot with 10.0.0.1");
+    }
+
+    /* the two take turns in the slot and are both answered right */
+    add_shared_network();
+    for (i = 0; i < 3; i++) {
+        if ((link_network("10.0.0.1") != net_a) ||
+            (link_network(text) != net_b)) {
+            atf_tc_fail("10.0.0.1 and %s mixed up", text);
+        }
+    }
+}
+
 ATF_TP_ADD_TCS(tp)
 {
     ATF_TP_ADD_TC(tp, simple_test_case);
+    ATF_TP_ADD_TC(tp, relay_ids);
+    ATF_TP_ADD_TC(tp, intern_strings);
+    ATF_TP_ADD_TC(tp, lease_reuse);
+    ATF_TP_ADD_TC(tp, class_match);
+    ATF_TP_ADD_TC(tp, link_network);
 #ifdef DHCPv6
     ATF_TP_ADD_TC(tp, parse_byte_order);
 #endif